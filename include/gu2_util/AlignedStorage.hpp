@@ -0,0 +1,97 @@
+//
+// Project: GraphicsUtils2
+// File: AlignedStorage.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+
+namespace gu2 {
+
+
+// Owned, uninitialized block of memory with the start aligned to (at least) a cache line
+class AlignedStorage {
+public:
+    static constexpr size_t alignment = 64;
+
+    AlignedStorage() noexcept = default;
+    inline explicit AlignedStorage(size_t size);
+    AlignedStorage(const AlignedStorage&) = delete;
+    inline AlignedStorage(AlignedStorage&& other) noexcept;
+    AlignedStorage& operator=(const AlignedStorage&) = delete;
+    inline AlignedStorage& operator=(AlignedStorage&& other) noexcept;
+    inline ~AlignedStorage();
+
+    inline void allocate(size_t size);
+    inline void release() noexcept;
+
+    inline char* data() noexcept { return _data; }
+    inline const char* data() const noexcept { return _data; }
+    inline size_t size() const noexcept { return _size; }
+
+private:
+    char*   _data   {nullptr};
+    size_t  _size   {0};
+};
+
+
+AlignedStorage::AlignedStorage(size_t size)
+{
+    allocate(size);
+}
+
+AlignedStorage::AlignedStorage(AlignedStorage&& other) noexcept :
+    _data   (std::exchange(other._data, nullptr)),
+    _size   (std::exchange(other._size, 0))
+{
+}
+
+AlignedStorage& AlignedStorage::operator=(AlignedStorage&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    release();
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+    return *this;
+}
+
+AlignedStorage::~AlignedStorage()
+{
+    release();
+}
+
+void AlignedStorage::allocate(size_t size)
+{
+    release();
+    if (size == 0)
+        return;
+
+    // aligned_alloc requires the size to be a multiple of the alignment
+    _data = static_cast<char*>(std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment));
+    if (_data == nullptr)
+        throw std::bad_alloc();
+    _size = size;
+}
+
+void AlignedStorage::release() noexcept
+{
+    std::free(_data);
+    _data = nullptr;
+    _size = 0;
+}
+
+
+} // namespace gu2
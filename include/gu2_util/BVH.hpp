@@ -0,0 +1,99 @@
+//
+// Project: GraphicsUtils2
+// File: BVH.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Bounds.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Flat bounding volume hierarchy over externally stored item bounds (for example scene nodes). Nodes are stored
+// depth-first in a single array with the left child directly following its parent, so a node's children always
+// have larger indices than the node itself. Item bounds are passed as a pointer and a stride in bytes so that
+// they can be read directly from an array of larger structs.
+class BVH {
+public:
+    struct Node {
+        AABB        bounds;
+        uint32_t    rightOrFirst;   // right child index for interior nodes, index to items for leaves
+        uint32_t    nItems;         // 0 for interior nodes
+    };
+
+    // Top-down build splitting at the median of the longest centroid axis
+    void build(const AABB* itemBounds, size_t nItems, size_t stride = sizeof(AABB), uint32_t maxLeafSize = 4);
+
+    // Recompute all node bounds after the item bounds have changed, the topology stays as it is
+    void refit(const AABB* itemBounds, size_t stride = sizeof(AABB));
+    // Incremental refit: only the leaves containing changed items and their ancestors are updated, propagation
+    // stops at the first ancestor whose bounds don't change
+    void refit(const AABB* itemBounds, const std::vector<uint32_t>& changedItems, size_t stride = sizeof(AABB));
+
+    // Depth-first traversal, visitNode(const AABB&) decides whether to descend into a node and
+    // visitItem(uint32_t itemId) is called for the items in visited leaves
+    template <typename T_NodeVisitor, typename T_ItemVisitor>
+    void traverse(const T_NodeVisitor& visitNode, const T_ItemVisitor& visitItem) const;
+
+    // Append ids of the items whose bounds overlap with aabb
+    void query(const AABB& aabb, const AABB* itemBounds, std::vector<uint32_t>* items,
+        size_t stride = sizeof(AABB)) const;
+
+    inline const std::vector<Node>& getNodes() const noexcept { return _nodes; }
+    inline const std::vector<uint32_t>& getItems() const noexcept { return _items; }
+    inline bool empty() const noexcept { return _nodes.empty(); }
+
+private:
+    static constexpr uint32_t   invalidNode {0xffffffff};
+
+    std::vector<Node>       _nodes;
+    std::vector<uint32_t>   _items;     // item ids in leaf order
+    std::vector<uint32_t>   _parents;   // parent node index for each node
+    std::vector<uint32_t>   _itemLeafs; // leaf node index for each item id
+
+    uint32_t buildNode(const AABB* itemBounds, size_t stride, const std::vector<Vec3f>& centroids,
+        uint32_t first, uint32_t nItems, uint32_t parent, uint32_t maxLeafSize);
+    AABB computeNodeBounds(const Node& node, uint32_t nodeId, const AABB* itemBounds, size_t stride) const;
+};
+
+
+template <typename T_NodeVisitor, typename T_ItemVisitor>
+void BVH::traverse(const T_NodeVisitor& visitNode, const T_ItemVisitor& visitItem) const
+{
+    if (_nodes.empty())
+        return;
+
+    // Median splits keep the depth logarithmic, 64 levels is plenty
+    uint32_t stack[64];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const auto& node = _nodes[stack[--stackSize]];
+        if (!visitNode(node.bounds))
+            continue;
+
+        if (node.nItems > 0) {
+            for (uint32_t i=0; i<node.nItems; ++i)
+                visitItem(_items[node.rightOrFirst + i]);
+            continue;
+        }
+
+        uint32_t nodeId = static_cast<uint32_t>(&node - _nodes.data());
+        stack[stackSize++] = node.rightOrFirst;
+        stack[stackSize++] = nodeId + 1;
+    }
+}
+
+
+} // namespace gu2
@@ -0,0 +1,187 @@
+//
+// Project: GraphicsUtils2
+// File: BakedScene.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Bounds.hpp"
+#include "MappedFile.hpp"
+#include "MathTypes.hpp"
+#include "Typedef.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+class GLTFLoader;
+class StageTimings;
+
+
+// Fully processed representation of a glTF scene that can be written into a single cache file and memory mapped
+// back on the next run. The (small) tables are copied on load, bulk data (vertices, indices, image mip chains) is
+// accessed directly from the mapping so it can be streamed straight into staging buffers.
+class BakedScene {
+public:
+    // Scene node, the glTF node hierarchy with EXT_mesh_gpu_instancing instances expanded to child nodes of their
+    // node. Parents precede their children in the node table.
+    struct Node {
+        int64_t                 parent;         // -1 for root nodes
+        std::array<float, 3>    translation;    // local transformation
+        std::array<float, 4>    rotation;       // quaternion, xyzw
+        std::array<float, 3>    scale;
+        uint32_t                firstPrimitive; // primitives of the mesh drawn with the node
+        uint32_t                nPrimitives;
+    };
+
+    // Tightly packed vertex attribute stream
+    struct Attribute {
+        std::array<char, 24>    name;           // glTF attribute semantic, e.g. "POSITION" or "TEXCOORD_0"
+        uint32_t                componentType;  // GLTFLoader::Accessor::ComponentType
+        uint32_t                nComponents;
+        uint64_t                byteOffset;     // offset in vertex data
+        uint64_t                count;
+    };
+
+    // Level of detail of a primitive, the indices reference the vertices of the full resolution primitive
+    struct Lod {
+        uint32_t    firstIndex; // relative to the first index of the primitive
+        uint32_t    nIndices;
+        float       error;      // simplification error in model space units, 0 for the full resolution
+        uint32_t    padding;
+    };
+
+    struct Primitive {
+        uint32_t    firstAttribute;
+        uint32_t    nAttributes;
+        uint64_t    indexByteOffset;    // offset in index data
+        uint64_t    nIndices;           // full resolution index count, 0 for unindexed primitives
+        uint32_t    indexComponentType; // UNSIGNED_SHORT or UNSIGNED_INT
+        int32_t     material;
+        std::array<float, 3>    boundsMin;  // model space bounds of the POSITION attribute
+        std::array<float, 3>    boundsMax;
+        uint32_t    firstLod;           // LOD 0 is the full resolution, indices of the LODs follow it
+        uint32_t    nLods;
+
+        inline AABB getBounds() const noexcept;
+    };
+
+    struct TextureReference {
+        int32_t image       {-1}; // index to images, texture indirection is resolved during baking
+        int32_t texCoord    {0};
+    };
+
+    struct Material {
+        TextureReference        baseColorTexture;
+        TextureReference        metallicRoughnessTexture;
+        TextureReference        normalTexture;
+        std::array<float, 4>    baseColorFactor     {1.0f, 1.0f, 1.0f, 1.0f};
+        float                   metallicFactor      {1.0f};
+        float                   roughnessFactor     {1.0f};
+        float                   normalScale         {1.0f};
+    };
+
+    // RGBA8 image with a full mip chain, levels stored consecutively starting from the base level
+    struct Image {
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    mipLevels;
+        uint32_t    padding;
+        uint64_t    byteOffset; // offset in image data
+        uint64_t    byteSize;
+    };
+
+    BakedScene();
+    BakedScene(const BakedScene&) = delete;
+    BakedScene(BakedScene&&) = default;
+    BakedScene& operator=(const BakedScene&) = delete;
+    BakedScene& operator=(BakedScene&&) = default;
+
+    // Process a loaded glTF file: store the node hierarchy, pack and optimize accessor data, generate LODs and
+    // decode images and their mip chains. Images and primitives are processed as parallel tasks, per-stage timings
+    // are accumulated into timings if provided.
+    void bake(const GLTFLoader& gltfLoader, StageTimings* timings = nullptr);
+
+    // Returns false in case the file does not exist or it was baked from different sources / with different
+    // format version, in which case the scene needs to be rebaked.
+    bool readFromFile(const Path& filename, uint64_t sourceHash);
+    void writeToFile(const Path& filename, uint64_t sourceHash) const;
+
+    inline const std::vector<Node>& getNodes() const noexcept { return _nodes; }
+    inline const std::vector<Attribute>& getAttributes() const noexcept { return _attributes; }
+    inline const std::vector<Primitive>& getPrimitives() const noexcept { return _primitives; }
+    inline const std::vector<Lod>& getLods() const noexcept { return _lods; }
+    inline const std::vector<Material>& getMaterials() const noexcept { return _materials; }
+    inline const std::vector<Image>& getImages() const noexcept { return _images; }
+
+    const Attribute* findAttribute(const Primitive& primitive, const std::string& name) const noexcept;
+    inline const char* getAttributeData(const Attribute& attribute) const noexcept;
+    inline const char* getIndexData(const Primitive& primitive) const noexcept;
+    inline const uint8_t* getImageData(const Image& image) const noexcept;
+
+    // Hash of the glTF file and all the external files referenced by it
+    static uint64_t computeSourceHash(const Path& gltfFilename);
+    static size_t getMipChainSize(uint32_t width, uint32_t height, uint32_t mipLevels) noexcept;
+
+private:
+    // Bulk data, either owned (after baking) or pointing to the file mapping (after reading)
+    struct Blob {
+        std::vector<char>   storage;
+        const char*         data    {nullptr};
+        size_t              size    {0};
+
+        void own(std::vector<char>&& newStorage);
+    };
+
+    std::vector<Node>       _nodes;
+    std::vector<Attribute>  _attributes;
+    std::vector<Primitive>  _primitives;
+    std::vector<Lod>        _lods;
+    std::vector<Material>   _materials;
+    std::vector<Image>      _images;
+
+    Blob                    _vertexData;
+    Blob                    _indexData;
+    Blob                    _imageData;
+    MappedFile              _mappedFile;
+
+    void resolveMaterials(const GLTFLoader& gltfLoader);
+    void clear();
+};
+
+
+AABB BakedScene::Primitive::getBounds() const noexcept
+{
+    AABB aabb;
+    aabb.min = Eigen::Map<const Vec3f>(boundsMin.data());
+    aabb.max = Eigen::Map<const Vec3f>(boundsMax.data());
+    return aabb;
+}
+
+const char* BakedScene::getAttributeData(const Attribute& attribute) const noexcept
+{
+    return _vertexData.data + attribute.byteOffset;
+}
+
+const char* BakedScene::getIndexData(const Primitive& primitive) const noexcept
+{
+    return _indexData.data + primitive.indexByteOffset;
+}
+
+const uint8_t* BakedScene::getImageData(const Image& image) const noexcept
+{
+    return reinterpret_cast<const uint8_t*>(_imageData.data + image.byteOffset);
+}
+
+
+} // namespace gu2
@@ -0,0 +1,32 @@
+//
+// Project: GraphicsUtils2
+// File: Base64.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace gu2 {
+
+
+// Size of the data encoded in a base64 string (standard alphabet, padding optional)
+size_t getBase64DecodedSize(const char* src, size_t srcSize);
+
+// Decode a base64 string, dest must hold at least getBase64DecodedSize() bytes. Uses AVX2 or SSSE3 in case
+// they're enabled for the build. Throws in case the input contains invalid characters.
+void decodeBase64(const char* src, size_t srcSize, void* dest);
+
+// Scalar reference implementation of decodeBase64
+void decodeBase64Scalar(const char* src, size_t srcSize, void* dest);
+
+
+} // namespace gu2
@@ -0,0 +1,108 @@
+//
+// Project: GraphicsUtils2
+// File: Bounds.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MathTypes.hpp"
+
+#include <cstddef>
+#include <limits>
+
+
+namespace gu2 {
+
+
+// Axis-aligned bounding box, default constructed box is empty (min > max)
+struct AABB {
+    Vec3f   min {Vec3f::Constant(std::numeric_limits<float>::max())};
+    Vec3f   max {Vec3f::Constant(-std::numeric_limits<float>::max())};
+
+    inline bool isEmpty() const noexcept;
+    inline Vec3f center() const noexcept;
+    inline Vec3f extent() const noexcept; // half of the size
+    inline float surfaceArea() const noexcept;
+
+    inline void extend(const Vec3f& point) noexcept;
+    inline void extend(const AABB& other) noexcept;
+    inline bool intersects(const AABB& other) const noexcept;
+    inline bool operator==(const AABB& other) const noexcept;
+
+    // Bounds of the box transformed with an affine transformation (Arvo's method)
+    AABB transformed(const Mat4f& transformation) const noexcept;
+};
+
+struct BoundingSphere {
+    Vec3f   center  {Vec3f::Zero()};
+    float   radius  {-1.0f}; // negative for empty spheres
+};
+
+
+// Bounds of positions with three float components. Positions are expected to be tightly packed in case stride is
+// 0, in which case the reduction is vectorized with AVX or SSE (if enabled for the build).
+AABB computeAABB(const float* positions, size_t nPositions, size_t stride = 0) noexcept;
+// Scalar reference implementation of computeAABB
+AABB computeAABBScalar(const float* positions, size_t nPositions, size_t stride = 0) noexcept;
+
+// Sphere circumscribing the box
+BoundingSphere computeBoundingSphere(const AABB& aabb) noexcept;
+
+// Slab test, invDirection is the componentwise inverse of the ray direction. Returns the entry distance or a
+// negative value in case the ray misses the box within [0, tMax].
+float intersectRay(const AABB& aabb, const Vec3f& origin, const Vec3f& invDirection, float tMax) noexcept;
+
+
+bool AABB::isEmpty() const noexcept
+{
+    return min.x() > max.x() || min.y() > max.y() || min.z() > max.z();
+}
+
+Vec3f AABB::center() const noexcept
+{
+    return 0.5f*(min + max);
+}
+
+Vec3f AABB::extent() const noexcept
+{
+    return 0.5f*(max - min);
+}
+
+float AABB::surfaceArea() const noexcept
+{
+    if (isEmpty())
+        return 0.0f;
+    Vec3f d = max - min;
+    return 2.0f*(d.x()*d.y() + d.y()*d.z() + d.z()*d.x());
+}
+
+void AABB::extend(const Vec3f& point) noexcept
+{
+    min = min.cwiseMin(point);
+    max = max.cwiseMax(point);
+}
+
+void AABB::extend(const AABB& other) noexcept
+{
+    min = min.cwiseMin(other.min);
+    max = max.cwiseMax(other.max);
+}
+
+bool AABB::intersects(const AABB& other) const noexcept
+{
+    return (min.array() <= other.max.array()).all() && (other.min.array() <= max.array()).all();
+}
+
+bool AABB::operator==(const AABB& other) const noexcept
+{
+    return min == other.min && max == other.max;
+}
+
+
+} // namespace gu2
@@ -0,0 +1,60 @@
+//
+// Project: GraphicsUtils2
+// File: BuddyAllocator.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Buddy allocator for ranges of an abstract linear resource. Allocations are rounded up to power of two blocks,
+// which are split in halves on allocation and merged with their buddies on free. Allocation and free take
+// logarithmic time regardless of the fragmentation, the rounding is paid in unused space. Blocks are aligned to
+// their size, so power of two alignments up to the block size need no padding.
+class BuddyAllocator {
+public:
+    static constexpr uint64_t   invalidOffset   {0xffffffffffffffff};
+
+    // Capacity must be minBlockSize times a power of two, minBlockSize a power of two
+    BuddyAllocator(uint64_t capacity = 0, uint64_t minBlockSize = 1);
+
+    // Returns invalidOffset in case no free block large enough is found, alignment must be a power of two
+    uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+    // Offset must be one returned by allocate()
+    void free(uint64_t offset);
+    void clear();
+
+    inline uint64_t getCapacity() const noexcept { return _capacity; }
+    // Sum of the block sizes of the allocations, including the rounding
+    inline uint64_t getUsedSize() const noexcept { return _usedSize; }
+    inline size_t getAllocationCount() const noexcept { return _allocations.size(); }
+    // Block size of an allocation, 0 in case the offset does not correspond to an allocation
+    uint64_t getSize(uint64_t offset) const;
+    uint64_t getLargestFreeBlock() const;
+
+private:
+    uint64_t                            _capacity;
+    uint64_t                            _minBlockSize;
+    uint64_t                            _usedSize;
+    std::vector<std::set<uint64_t>>     _freeBlocks;    // offsets of the free blocks, index is the order
+    std::map<uint64_t, uint32_t>        _allocations;   // offset -> order
+
+    inline uint64_t getBlockSize(uint32_t order) const noexcept { return _minBlockSize << order; }
+};
+
+
+} // namespace gu2
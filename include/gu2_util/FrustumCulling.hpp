@@ -0,0 +1,93 @@
+//
+// Project: GraphicsUtils2
+// File: FrustumCulling.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Bounds.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// View frustum as six planes with the normals (xyz) pointing inwards, a point p is inside in case
+// n.dot(p) + w >= 0 for all planes
+struct Frustum {
+    std::array<Vec4f, 6>    planes;
+
+    // Planes of a view-projection matrix mapping to Vulkan clip space (0 <= z <= w). Reversed and infinite depth
+    // projections are supported, a plane at infinity never rejects anything.
+    static Frustum fromViewProjection(const Mat4f& viewProjection) noexcept;
+
+    inline bool intersects(const BoundingSphere& sphere) const noexcept;
+};
+
+// Bounding spheres in structure of arrays layout for vectorized culling
+struct BoundingSpheres {
+    std::vector<float>  x;
+    std::vector<float>  y;
+    std::vector<float>  z;
+    std::vector<float>  radius; // negative for empty spheres, which are always culled
+
+    inline size_t size() const noexcept { return radius.size(); }
+    inline void resize(size_t n);
+    inline void set(size_t i, const BoundingSphere& sphere) noexcept;
+};
+
+struct CullingStats {
+    uint64_t    nTested     {0};
+    uint64_t    nVisible    {0};
+    uint64_t    nOccluders  {0};    // occluders rasterized for occlusion culling
+    uint64_t    nOccluded   {0};    // passed the frustum test but were hidden behind the occluders
+};
+
+
+// Write ids of the spheres intersecting the frustum to visible (in increasing order). Spheres are tested 8 at
+// a time with AVX (4 with SSE) in parallel over ranges of spheres. Counts are accumulated to stats if provided.
+void cullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<uint32_t>* visible,
+    CullingStats* stats = nullptr);
+// Scalar reference implementation of cullSpheres
+void cullSpheresScalar(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<uint32_t>* visible,
+    CullingStats* stats = nullptr);
+
+
+bool Frustum::intersects(const BoundingSphere& sphere) const noexcept
+{
+    if (sphere.radius < 0.0f)
+        return false;
+    for (const auto& plane : planes) {
+        if (plane.head<3>().dot(sphere.center) + plane.w() < -sphere.radius)
+            return false;
+    }
+    return true;
+}
+
+void BoundingSpheres::resize(size_t n)
+{
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    radius.resize(n, -1.0f);
+}
+
+void BoundingSpheres::set(size_t i, const BoundingSphere& sphere) noexcept
+{
+    x[i] = sphere.center.x();
+    y[i] = sphere.center.y();
+    z[i] = sphere.center.z();
+    radius[i] = sphere.radius;
+}
+
+
+} // namespace gu2
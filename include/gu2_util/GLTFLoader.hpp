@@ -10,6 +10,9 @@
 
 #pragma once
 
+#include "AlignedStorage.hpp"
+#include "Bounds.hpp"
+#include "MappedFile.hpp"
 #include "MathTypes.hpp"
 #include "Typedef.hpp"
 
@@ -17,6 +20,9 @@
 namespace gu2 {
 
 
+class StageTimings;
+
+
 class GLTFLoader {
 public:
     struct Scene {
@@ -27,6 +33,15 @@ public:
         Mat4d                   matrix      {Mat4d::Identity()};
         int64_t                 mesh        {-1};
         std::vector<int64_t>    children;
+
+        // EXT_mesh_gpu_instancing attribute accessors, -1 in case not present
+        struct {
+            int64_t             translation {-1};
+            int64_t             rotation    {-1};
+            int64_t             scale       {-1};
+        }                       instancing;
+
+        inline bool isInstanced() const noexcept;
     };
 
     struct Mesh {
@@ -57,14 +72,15 @@ public:
     };
 
     struct Buffer {
-        std::string uri;
-        Path        filename;
-        size_t      byteLength  {0};
+        std::string     uri;
+        Path            filename; // empty in case of a data URI
+        size_t          byteLength  {0};
 
-        char*       buffer      {nullptr}; // pointer to a memory mapped file
-        size_t      bufferSize  {0}; // size of the memory mapped file (typically the same as byteLength)
+        const char*     buffer      {nullptr}; // pointer to the buffer data
+        size_t          bufferSize  {0}; // size of the buffer data (typically the same as byteLength)
 
-        ~Buffer();
+        MappedFile      mappedFile; // external buffer file
+        AlignedStorage  storage; // decoded data URI
     };
 
     struct BufferView {
@@ -87,8 +103,17 @@ public:
         int64_t         bufferView      {-1};
         uint64_t        byteOffset      {0};
         ComponentType   componentType   {ComponentType::BYTE};
+        bool            normalized      {false}; // integer components map to [0, 1] or [-1, 1]
         uint64_t        count           {0};
         std::string     type;
+        std::vector<double> min;    // per-component bounds, required for POSITION accessors, empty if not given
+        std::vector<double> max;
+
+        // Value of a component as seen by the shaders, normalized integers are mapped to [0, 1] or [-1, 1]
+        double dequantize(double value) const;
+        uint32_t getComponentSize() const;
+        uint32_t getNComponents() const; // number of components per element, deduced from type
+        size_t getElementSize() const;
     };
 
     struct Material {
@@ -120,11 +145,17 @@ public:
     };
 
     struct Image {
-        std::string uri;
-        Path        filename;
+        std::string     uri;
+        Path            filename; // empty in case of a data URI or a buffer view
+        std::string     mimeType;
+        int64_t         bufferView  {-1};
+
+        AlignedStorage  storage; // decoded data URI
     };
 
-    void readFromFile(const Path& filename);
+    // Sections are parsed and buffers mapped concurrently, per-stage timings are accumulated into timings
+    // if provided
+    void readFromFile(const Path& filename, StageTimings* timings = nullptr);
 
     const std::vector<Scene>& getScenes() const noexcept;
     const std::vector<Node>& getNodes() const noexcept;
@@ -136,6 +167,21 @@ public:
     const std::vector<Texture>& getTextures() const noexcept;
     const std::vector<Image>& getImages() const noexcept;
 
+    // Pointer to the first element of an accessor and the distance between consecutive elements in bytes
+    const char* getAccessorData(const Accessor& accessor) const;
+    size_t getAccessorStride(const Accessor& accessor) const;
+    // Bounds of a VEC3 accessor (POSITION), read from min / max in case present and computed otherwise. Integer
+    // components (KHR_mesh_quantization) are dequantized.
+    AABB getAccessorBounds(const Accessor& accessor) const;
+    // Instance transformations of an EXT_mesh_gpu_instancing node, relative to the node transformation. Empty for
+    // nodes without instancing.
+    std::vector<Mat4d> getInstanceMatrices(const Node& node) const;
+    // Encoded image data for images embedded as data URIs or buffer views, nullptr for images in external files
+    const char* getImageData(const Image& image, size_t* size) const;
+
+    // Whether the URI is a data URI ("data:[<mime type>][;base64],<data>") instead of a relative file path
+    static bool isDataUri(const std::string& uri) noexcept;
+
 private:
     Json                    _gltfJson;
     std::vector<Scene>      _scenes;
@@ -147,7 +193,23 @@ private:
     std::vector<Material>   _materials;
     std::vector<Texture>    _textures;
     std::vector<Image>      _images;
+
+    void parseScenes();
+    void parseNodes();
+    void parseMeshes();
+    void parseBuffers(const Path& directory);
+    void parseBufferViews();
+    void parseAccessors();
+    void parseMaterials();
+    void parseTextures();
+    void parseImages(const Path& directory);
 };
 
 
+bool GLTFLoader::Node::isInstanced() const noexcept
+{
+    return instancing.translation >= 0 || instancing.rotation >= 0 || instancing.scale >= 0;
+}
+
+
 } // namespace gu2
@@ -0,0 +1,135 @@
+//
+// Project: GraphicsUtils2
+// File: Hash.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Macros.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+
+namespace gu2 {
+
+
+namespace detail {
+
+constexpr uint64_t  hashPrime1  {0x9e3779b185ebca87ull};
+constexpr uint64_t  hashPrime2  {0xc2b2ae3d27d4eb4full};
+constexpr uint64_t  hashPrime3  {0x165667b19e3779f9ull};
+constexpr uint64_t  hashPrime4  {0x85ebca77c2b2ae63ull};
+constexpr uint64_t  hashPrime5  {0x27d4eb2f165667c5ull};
+
+INLINE uint64_t hashRotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+INLINE uint64_t hashRead64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+INLINE uint64_t hashRound(uint64_t acc, uint64_t input)
+{
+    acc += input * hashPrime2;
+    acc = hashRotl(acc, 31);
+    return acc * hashPrime1;
+}
+
+INLINE uint64_t hashMergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= hashRound(0, val);
+    return acc * hashPrime1 + hashPrime4;
+}
+
+} // namespace detail
+
+
+// Fast 64-bit non-cryptographic hash (xxHash64-style 4-lane construction), used for content addressing of
+// cached data. Processes 32 bytes per iteration so that hashing large asset files stays I/O bound.
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+    using namespace detail;
+
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + hashPrime1 + hashPrime2;
+        uint64_t v2 = seed + hashPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - hashPrime1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = hashRound(v1, hashRead64(p));
+            v2 = hashRound(v2, hashRead64(p + 8));
+            v3 = hashRound(v3, hashRead64(p + 16));
+            v4 = hashRound(v4, hashRead64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = hashRotl(v1, 1) + hashRotl(v2, 7) + hashRotl(v3, 12) + hashRotl(v4, 18);
+        h = hashMergeRound(h, v1);
+        h = hashMergeRound(h, v2);
+        h = hashMergeRound(h, v3);
+        h = hashMergeRound(h, v4);
+    }
+    else {
+        h = seed + hashPrime5;
+    }
+
+    h += static_cast<uint64_t>(size);
+
+    // Tail
+    for (; p + 8 <= end; p += 8) {
+        h ^= hashRound(0, hashRead64(p));
+        h = hashRotl(h, 27) * hashPrime1 + hashPrime4;
+    }
+    if (p + 4 <= end) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        h ^= static_cast<uint64_t>(v) * hashPrime1;
+        h = hashRotl(h, 23) * hashPrime2 + hashPrime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (*p) * hashPrime5;
+        h = hashRotl(h, 11) * hashPrime1;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= hashPrime2;
+    h ^= h >> 29;
+    h *= hashPrime3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+inline uint64_t hashString(std::string_view str, uint64_t seed = 0)
+{
+    return hashBytes(str.data(), str.size(), seed);
+}
+
+// Combine two hash values, order dependent
+INLINE uint64_t hashCombine(uint64_t seed, uint64_t value)
+{
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 12) + (seed >> 4));
+}
+
+
+} // namespace gu2
@@ -19,6 +19,7 @@
 #include "Typedef.hpp"
 
 #include <cstdint>
+#include <limits>
 
 
 namespace gu2 {
@@ -79,6 +80,10 @@ inline void writeImageToFile(const Image<T_Data>& image, const Path& filename);
 template <typename T_Data>
 inline Image<T_Data> readImageFromFile(const Path& filename);
 
+// Decode an encoded image (PNG, JPEG etc.) residing in memory, for example one embedded in a glTF file
+template <typename T_Data>
+inline Image<T_Data> readImageFromMemory(const void* data, size_t size);
+
 
 #include "Image.inl"
 
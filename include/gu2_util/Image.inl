@@ -167,25 +167,19 @@ void writeImageToFile(const Image<T_Data>& image, const Path& filename)
     stbi_write_png(GU2_PATH_TO_STRING(filename), img.width(), img.height(), nChannels, img.data(), img.width()*nChannels);
 }
 
+namespace detail {
+
 template<typename T_Data>
-Image<T_Data> readImageFromFile(const Path& filename)
+Image<T_Data> imageFromStbData(unsigned char* data, int w, int h, int c)
 {
-    // TODO extend, only 8/8/8 RGB PNG supported for now
-
-    int w, h, c;
-    c = 0;
-    unsigned char* data = stbi_load(GU2_PATH_TO_STRING(filename), &w, &h, &c, 0);
-    if (data == nullptr)
-        throw std::runtime_error("Unable to load image from " + filename.string() + ": " + stbi_failure_reason());
-
     ImageFormat imageFormat = ImageFormat::UNKNOWN;
     switch (c) {
         case 1: imageFormat = ImageFormat::GRAY; break;
         case 3: imageFormat = ImageFormat::RGB; break;
         case 4: imageFormat = ImageFormat::RGBA; break;
         default: {
-            throw std::runtime_error("Unable to deduce format from number of channels\n");
             stbi_image_free(data);
+            throw std::runtime_error("Unable to deduce format from number of channels\n");
         }
     }
     Image<T_Data> img(w, h, imageFormat);
@@ -194,3 +188,35 @@ Image<T_Data> readImageFromFile(const Path& filename)
 
     return img;
 }
+
+} // namespace detail
+
+template<typename T_Data>
+Image<T_Data> readImageFromFile(const Path& filename)
+{
+    // TODO extend, only 8/8/8 RGB PNG supported for now
+
+    int w, h, c;
+    c = 0;
+    unsigned char* data = stbi_load(GU2_PATH_TO_STRING(filename), &w, &h, &c, 0);
+    if (data == nullptr)
+        throw std::runtime_error("Unable to load image from " + filename.string() + ": " + stbi_failure_reason());
+
+    return detail::imageFromStbData<T_Data>(data, w, h, c);
+}
+
+template<typename T_Data>
+Image<T_Data> readImageFromMemory(const void* encodedData, size_t size)
+{
+    if (size > static_cast<size_t>(std::numeric_limits<int>::max()))
+        throw std::runtime_error("Encoded image too large");
+
+    int w, h, c;
+    c = 0;
+    unsigned char* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encodedData),
+        static_cast<int>(size), &w, &h, &c, 0);
+    if (data == nullptr)
+        throw std::runtime_error(std::string("Unable to load image from memory: ") + stbi_failure_reason());
+
+    return detail::imageFromStbData<T_Data>(data, w, h, c);
+}
@@ -18,12 +18,12 @@
 
 
 #define GU2_IMAGE_FORMAT_CONVERSION_TO_RGBA_MATRIX(IMAGE_FORMAT, ...)       \
-    ToRGBAMatrix<ImageFormat::IMAGE_FORMAT>                                 \
+    inline ToRGBAMatrix<ImageFormat::IMAGE_FORMAT>                          \
     ImageFormatConversionParams<ImageFormat::IMAGE_FORMAT>::toRGBAMatrix =  \
     initializeMatrix<ToRGBAMatrix<ImageFormat::IMAGE_FORMAT>>(__VA_ARGS__);
 
 #define GU2_IMAGE_FORMAT_CONVERSION_FROM_RGBA_MATRIX(IMAGE_FORMAT, ...)         \
-    FromRGBAMatrix<ImageFormat::IMAGE_FORMAT>                                   \
+    inline FromRGBAMatrix<ImageFormat::IMAGE_FORMAT>                            \
     ImageFormatConversionParams<ImageFormat::IMAGE_FORMAT>::fromRGBAMatrix =    \
     initializeMatrix<FromRGBAMatrix<ImageFormat::IMAGE_FORMAT>>(__VA_ARGS__);
 
@@ -0,0 +1,51 @@
+//
+// Project: GraphicsUtils2
+// File: LinearAllocator.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+
+namespace gu2 {
+
+
+// Linear allocator for ranges of an abstract linear resource. Allocations bump the head offset, the space is
+// reclaimed as the allocations at the head are freed (stack order) or as the last allocation is freed. Meant for
+// transient data that is released as a group, per frame or per upload batch for instance.
+class LinearAllocator {
+public:
+    static constexpr uint64_t   invalidOffset   {0xffffffffffffffff};
+
+    LinearAllocator(uint64_t capacity = 0);
+
+    // Returns invalidOffset in case the allocation does not fit after the head, alignment must be nonzero
+    uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+    // Offset must be one returned by allocate()
+    void free(uint64_t offset);
+    void clear();
+
+    inline uint64_t getCapacity() const noexcept { return _capacity; }
+    inline uint64_t getUsedSize() const noexcept { return _usedSize; }
+    inline size_t getAllocationCount() const noexcept { return _allocations.size(); }
+    // End of the last live allocation, the next allocation is placed after it
+    inline uint64_t getHead() const noexcept { return _head; }
+
+private:
+    uint64_t                        _capacity;
+    uint64_t                        _usedSize;
+    uint64_t                        _head;
+    std::map<uint64_t, uint64_t>    _allocations;   // offset -> size
+};
+
+
+} // namespace gu2
@@ -0,0 +1,46 @@
+//
+// Project: GraphicsUtils2
+// File: MappedFile.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Typedef.hpp"
+
+#include <cstddef>
+
+
+namespace gu2 {
+
+
+// Read-only memory mapped file
+class MappedFile {
+public:
+    MappedFile() noexcept;
+    explicit MappedFile(const Path& filename);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    void open(const Path& filename);
+    void close() noexcept;
+
+    inline bool isOpen() const noexcept { return _data != nullptr; }
+    inline const char* data() const noexcept { return _data; }
+    inline size_t size() const noexcept { return _size; }
+
+private:
+    char*   _data;
+    size_t  _size;
+};
+
+
+} // namespace gu2
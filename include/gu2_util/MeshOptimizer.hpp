@@ -0,0 +1,64 @@
+//
+// Project: GraphicsUtils2
+// File: MeshOptimizer.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MathTypes.hpp"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Index and vertex reordering for indexed triangle lists, to be applied in the order vertex cache -> overdraw
+// -> vertex fetch. T_Index is uint16_t or uint32_t.
+
+// Post-transform vertex cache optimization (Tipsify, Sander et al. 2007). The start of each cluster (in
+// triangles) is appended to clusters if provided, clusters end at dead-ends of the fan traversal and at points
+// where the running ACMR of the cluster drops below overdrawThreshold times the ACMR of the whole mesh.
+template <typename T_Index>
+void optimizeVertexCache(
+    T_Index* indices,
+    size_t nIndices,
+    size_t nVertices,
+    std::vector<uint32_t>* clusters = nullptr,
+    uint32_t cacheSize = 16,
+    float overdrawThreshold = 1.05f);
+
+// Overdraw reduction by sorting the clusters from optimizeVertexCache so that the ones facing away from the
+// mesh centroid are drawn first. Triangle order inside the clusters is retained.
+template <typename T_Index>
+void optimizeOverdraw(
+    T_Index* indices,
+    size_t nIndices,
+    const Vec3f* positions,
+    const std::vector<uint32_t>& clusters);
+
+// Vertex fetch optimization: vertices are renumbered in the order of their first use. remap[oldIndex] will hold
+// the new index (or ~0u for unused vertices), use remapVertices() to reorder the vertex streams accordingly.
+// Returns the number of vertices used.
+template <typename T_Index>
+size_t optimizeVertexFetch(T_Index* indices, size_t nIndices, size_t nVertices, std::vector<uint32_t>* remap);
+
+// Reorder a vertex stream according to the remap table, data is processed in place
+void remapVertices(void* data, size_t elementSize, size_t nVertices, const std::vector<uint32_t>& remap);
+
+// Narrow 32-bit indices to 16 bits, throws in case an index does not fit. src and dest may alias.
+void narrowIndices(const uint32_t* src, size_t nIndices, uint16_t* dest);
+
+// Average cache miss ratio (transformed vertices per triangle) of a FIFO cache of given size
+template <typename T_Index>
+float computeACMR(const T_Index* indices, size_t nIndices, size_t nVertices, uint32_t cacheSize = 16);
+
+
+} // namespace gu2
@@ -0,0 +1,41 @@
+//
+// Project: GraphicsUtils2
+// File: MeshSimplifier.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MathTypes.hpp"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Quadric error metric edge collapse simplification (Garland & Heckbert 1997) of an indexed triangle list.
+// Vertices are collapsed onto existing vertices, so the simplified index buffer references the original vertex
+// streams and no attribute interpolation is needed. Vertices on open borders (including attribute seams of meshes
+// with split vertices) are locked to keep the outline intact and the LODs crack-free. Collapses flipping triangles
+// are rejected. Simplification stops when the index count reaches targetIndexCount or the next collapse would
+// exceed targetError (distance in position units). T_Index is uint16_t or uint32_t.
+// Returns the simplified index list, the error of the result is written to resultError if provided.
+template <typename T_Index>
+std::vector<T_Index> simplifyMesh(
+    const T_Index* indices,
+    size_t nIndices,
+    const Vec3f* positions,
+    size_t nVertices,
+    size_t targetIndexCount,
+    float targetError,
+    float* resultError = nullptr);
+
+
+} // namespace gu2
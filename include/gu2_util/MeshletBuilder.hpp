@@ -0,0 +1,67 @@
+//
+// Project: GraphicsUtils2
+// File: MeshletBuilder.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MathTypes.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Clusters of an indexed triangle list in structure of arrays layout. Every array is tightly packed and uses
+// 4 or 16 byte elements, so each can be uploaded as is to a std430 storage buffer.
+struct Meshlets {
+    // Per meshlet
+    std::vector<uint32_t>   vertexOffsets;      // first element of the meshlet in vertices
+    std::vector<uint32_t>   triangleOffsets;    // first byte of the meshlet in triangles, 4 byte aligned
+    std::vector<uint32_t>   counts;             // vertex count in the low 16 bits, triangle count in the high 16 bits
+    std::vector<Vec4f>      spheres;            // bounding sphere, center in xyz and radius in w
+    std::vector<Vec4f>      cones;              // normal cone, axis in xyz and cutoff in w (1 for no cone)
+
+    // Meshlet local vertex -> mesh vertex index
+    std::vector<uint32_t>   vertices;
+    // Meshlet local vertex indices, 3 per triangle, each meshlet padded to a multiple of 4 bytes
+    std::vector<uint8_t>    triangles;
+
+    inline size_t size() const noexcept { return vertexOffsets.size(); }
+    inline uint32_t getVertexCount(size_t meshletId) const noexcept { return counts[meshletId] & 0xffff; }
+    inline uint32_t getTriangleCount(size_t meshletId) const noexcept { return counts[meshletId] >> 16; }
+};
+
+
+// Partition an indexed triangle list into meshlets of at most maxVertices vertices (no more than 255) and
+// maxTriangles triangles. Meshlets are grown over triangle adjacency, preferring triangles that add the fewest
+// new vertices and lie closest to the meshlet center, so feeding a vertex cache optimized index list is not
+// required but speeds up the process. T_Index is uint16_t or uint32_t.
+template <typename T_Index>
+Meshlets buildMeshlets(
+    const T_Index* indices,
+    size_t nIndices,
+    const Vec3f* positions,
+    size_t nVertices,
+    uint32_t maxVertices = 64,
+    uint32_t maxTriangles = 124);
+
+// Normal cone test: true in case all triangles of the meshlet face away from the camera. Sphere and cone need to
+// be in the same space as the camera position.
+inline bool isMeshletBackfacing(const Vec4f& sphere, const Vec4f& cone, const Vec3f& cameraPosition) noexcept
+{
+    Vec3f toCenter = sphere.head<3>() - cameraPosition;
+    return toCenter.dot(cone.head<3>()) >= cone.w()*toCenter.norm() + sphere.w();
+}
+
+
+} // namespace gu2
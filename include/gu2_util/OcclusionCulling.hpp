@@ -0,0 +1,83 @@
+//
+// Project: GraphicsUtils2
+// File: OcclusionCulling.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Bounds.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Low resolution depth buffer for CPU occlusion culling. Occluder triangles are binned to screen tiles, the tiles
+// are rasterized in parallel (8 pixels at a time with AVX, 4 with SSE) and a min-depth hierarchy is built on top
+// of the result. Depth uses the inverted convention of the renderer projections (1 at the near plane, 0 at
+// infinity), so the hierarchy stores the farthest occluder depth of each texel.
+class OcclusionBuffer {
+public:
+    static constexpr uint32_t   tileWidth   {32};
+    static constexpr uint32_t   tileHeight  {16};
+
+    // Dimensions are rounded up to multiples of the tile size
+    OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+
+    void resize(uint32_t width, uint32_t height);
+
+    // Start a new frame, discards the occluders added so far
+    void clear(const Mat4f& viewProjection);
+    // Add occluder triangles, transformed to clip space with viewProjection * modelMatrix. Triangles crossing the
+    // near plane are skipped, which is conservative. Triangles are rasterized from both sides.
+    template <typename T_Index>
+    void addOccluder(const Mat4f& modelMatrix, const Vec3f* positions, size_t nVertices, const T_Index* indices,
+        size_t nIndices);
+    // Rasterize the occluders added since clear() and build the depth hierarchy
+    void rasterize();
+
+    // False in case the world space box is certainly hidden behind the occluders
+    bool isVisible(const AABB& bounds) const noexcept;
+
+    inline uint32_t getWidth() const noexcept { return _width; }
+    inline uint32_t getHeight() const noexcept { return _height; }
+    inline uint32_t getLevelCount() const noexcept { return static_cast<uint32_t>(_levels.size()); }
+    inline size_t getTriangleCount() const noexcept { return _triangles.size(); }
+    // Level 0 is the full resolution depth, row-major
+    inline const float* getDepth(uint32_t level = 0) const noexcept { return _levels[level].depth.data(); }
+
+private:
+    struct Level {
+        uint32_t            width;
+        uint32_t            height;
+        std::vector<float>  depth;
+    };
+
+    // Screen space triangle, counter-clockwise in pixel coordinates
+    struct Triangle {
+        Vec3f   v[3];   // x, y in pixels, inverted depth in z
+    };
+
+    uint32_t                            _width;
+    uint32_t                            _height;
+    uint32_t                            _nTilesX;
+    uint32_t                            _nTilesY;
+    Mat4f                               _viewProjection;
+    std::vector<Level>                  _levels;
+    std::vector<Triangle>               _triangles;
+    std::vector<std::vector<uint32_t>>  _tileTriangles; // triangle ids per tile, row-major
+
+    void rasterizeTile(uint32_t tileId);
+    void buildHierarchy();
+};
+
+
+} // namespace gu2
@@ -0,0 +1,71 @@
+//
+// Project: GraphicsUtils2
+// File: Parallel.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <exception>
+#include <mutex>
+
+
+namespace gu2 {
+
+
+// Exceptions must not escape OpenMP parallel regions or tasks. Run the task bodies through an ExceptionGuard
+// and call rethrow() after the region to propagate the first exception thrown.
+class ExceptionGuard {
+public:
+    template <typename T_Function>
+    void run(T_Function&& function) noexcept;
+
+    inline bool hasException() const noexcept;
+    inline void rethrow();
+
+private:
+    mutable std::mutex  _mutex;
+    std::exception_ptr  _exception;
+};
+
+
+template <typename T_Function>
+void ExceptionGuard::run(T_Function&& function) noexcept
+{
+    if (hasException()) // no point in continuing
+        return;
+
+    try {
+        function();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_exception)
+            _exception = std::current_exception();
+    }
+}
+
+bool ExceptionGuard::hasException() const noexcept
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return static_cast<bool>(_exception);
+}
+
+void ExceptionGuard::rethrow()
+{
+    std::exception_ptr exception;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::swap(exception, _exception);
+    }
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+
+} // namespace gu2
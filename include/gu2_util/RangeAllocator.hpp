@@ -0,0 +1,75 @@
+//
+// Project: GraphicsUtils2
+// File: RangeAllocator.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Free-list allocator for ranges of an abstract linear resource (for example elements of a GPU buffer). Only the
+// bookkeeping is done here, the owner of the resource maps the returned offsets to the actual storage. Free ranges
+// are coalesced on free, allocation uses first fit.
+class RangeAllocator {
+public:
+    static constexpr uint64_t   invalidOffset   {0xffffffffffffffff};
+
+    // Range moved by defragment(), copying needs to be done to a separate resource as the ranges may overlap
+    struct Move {
+        uint64_t    srcOffset;
+        uint64_t    dstOffset;
+        uint64_t    size;
+    };
+
+    RangeAllocator(uint64_t capacity = 0);
+
+    // Returns invalidOffset in case no free range large enough is found, alignment must be nonzero
+    uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+    // Offset must be one returned by allocate()
+    void free(uint64_t offset);
+    // Increase the capacity, existing allocations are retained
+    void grow(uint64_t capacity);
+    void clear();
+
+    // Pack the allocations to the beginning of the range in their current order. Returns the moves of the
+    // allocations with a changed offset, the caller is responsible of updating the offsets it stores.
+    std::vector<Move> defragment();
+
+    inline uint64_t getCapacity() const noexcept { return _capacity; }
+    inline uint64_t getUsedSize() const noexcept { return _usedSize; }
+    inline size_t getAllocationCount() const noexcept { return _allocations.size(); }
+    // Size of an allocation, 0 in case the offset does not correspond to an allocation
+    uint64_t getSize(uint64_t offset) const;
+    uint64_t getLargestFreeRange() const;
+    // End of the last allocation, all offsets from there on are free
+    uint64_t getUsedEnd() const;
+
+private:
+    struct Allocation {
+        uint64_t    size;
+        uint64_t    alignment;
+    };
+
+    uint64_t                        _capacity;
+    uint64_t                        _usedSize;
+    std::map<uint64_t, uint64_t>    _freeRanges;    // offset -> size, adjacent ranges are always merged
+    std::map<uint64_t, Allocation>  _allocations;   // offset -> allocation
+
+    void addFreeRange(uint64_t offset, uint64_t size);
+};
+
+
+} // namespace gu2
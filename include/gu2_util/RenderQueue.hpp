@@ -0,0 +1,57 @@
+//
+// Project: GraphicsUtils2
+// File: RenderQueue.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Draw items of a frame ordered by 64-bit sort keys, so that the items sharing state end up adjacent. The keys are
+// sorted with a stable LSD radix sort over 8-bit digits, the passes over digits shared by all the keys are skipped.
+class RenderQueue {
+public:
+    struct Entry {
+        uint64_t    key;
+        uint32_t    item;   // index to the draw data of the caller
+    };
+
+    // Pack the state of a draw to a key, the state changing the most expensive binds goes to the most significant
+    // bits. The ids are truncated to 12, 16, 12 and 24 bits respectively, truncation only affects the ordering.
+    static inline uint64_t makeKey(uint32_t pipeline, uint32_t material, uint32_t geometry, uint32_t mesh) noexcept;
+
+    inline void clear() noexcept { _entries.clear(); }
+    inline void reserve(size_t n) { _entries.reserve(n); }
+    inline void push(uint64_t key, uint32_t item) { _entries.push_back(Entry{key, item}); }
+    void sort();
+
+    inline size_t size() const noexcept { return _entries.size(); }
+    inline bool empty() const noexcept { return _entries.empty(); }
+    inline const std::vector<Entry>& getEntries() const noexcept { return _entries; }
+
+private:
+    std::vector<Entry>  _entries;
+    std::vector<Entry>  _sortBuffer;    // kept to avoid reallocation
+};
+
+
+uint64_t RenderQueue::makeKey(uint32_t pipeline, uint32_t material, uint32_t geometry, uint32_t mesh) noexcept
+{
+    return (uint64_t(pipeline & 0xfff) << 52) | (uint64_t(material & 0xffff) << 36) |
+        (uint64_t(geometry & 0xfff) << 24) | uint64_t(mesh & 0xffffff);
+}
+
+
+} // namespace gu2
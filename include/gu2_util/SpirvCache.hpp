@@ -0,0 +1,67 @@
+//
+// Project: GraphicsUtils2
+// File: SpirvCache.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Typedef.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Content addressed cache of compiled SPIR-V, kept in memory and optionally in a directory with a file per entry.
+// The keys are computed by the caller from everything affecting the compilation output. The files included by the
+// source are only known after compiling, so they are stored with the entry along with hashes of their contents, and
+// an entry is only found in case none of them has changed. The file contents are hashed once per cache instance.
+// Thread safe.
+class SpirvCache {
+public:
+    // Empty directory for a cache kept in memory only, the directory is created on the first store
+    explicit SpirvCache(Path directory = Path());
+
+    // Returns false in case no entry is stored with the key or its dependencies have changed
+    bool find(uint64_t key, std::vector<uint32_t>* spirv);
+    // Store SPIR-V compiled from sources including the dependencies, replaces a previous entry of the key
+    void store(uint64_t key, const std::vector<Path>& dependencies, std::vector<uint32_t> spirv);
+
+    inline const Path& getDirectory() const noexcept { return _directory; }
+
+private:
+    struct Dependency {
+        std::string filename;
+        uint64_t    contentHash;
+    };
+
+    struct Entry {
+        std::vector<Dependency> dependencies;
+        std::vector<uint32_t>   spirv;
+    };
+
+    Path                                        _directory;
+    std::mutex                                  _mutex;
+    std::unordered_map<uint64_t, Entry>         _entries;
+    std::unordered_map<std::string, uint64_t>   _fileHashes;
+
+    // Hash of the file contents, 0 in case the file can't be read. Requires _mutex to be locked.
+    uint64_t getFileHash(const std::string& filename);
+    Path getEntryFilename(uint64_t key) const;
+    bool readEntry(uint64_t key, Entry* entry) const;
+    void writeEntry(uint64_t key, const Entry& entry) const;
+};
+
+
+} // namespace gu2
@@ -0,0 +1,115 @@
+//
+// Project: GraphicsUtils2
+// File: StageTimings.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Thread safe collection of named stage durations. Stages with the same name are accumulated, so for a stage
+// executed as multiple parallel tasks the reported time is the total thread time, not the wall clock time.
+class StageTimings {
+public:
+    struct Stage {
+        std::string name;
+        double      seconds {0.0};
+        uint64_t    count   {0};
+    };
+
+    // Measures the time from construction to destruction, no-op in case timings is nullptr
+    class Scope {
+    public:
+        inline Scope(StageTimings* timings, const char* name);
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        inline ~Scope();
+
+    private:
+        StageTimings*                           _timings;
+        const char*                             _name;
+        std::chrono::steady_clock::time_point   _start;
+    };
+
+    inline void add(const std::string& name, double seconds);
+    inline void clear();
+
+    inline std::vector<Stage> getStages() const;
+    inline void print(FILE* stream = stdout) const;
+
+private:
+    mutable std::mutex  _mutex;
+    std::vector<Stage>  _stages; // in order of first occurrence
+};
+
+
+StageTimings::Scope::Scope(StageTimings* timings, const char* name) :
+    _timings    (timings),
+    _name       (name),
+    _start      (timings != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+{
+}
+
+StageTimings::Scope::~Scope()
+{
+    if (_timings == nullptr)
+        return;
+
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - _start;
+    _timings->add(_name, duration.count());
+}
+
+void StageTimings::add(const std::string& name, double seconds)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& stage : _stages) {
+        if (stage.name == name) {
+            stage.seconds += seconds;
+            ++stage.count;
+            return;
+        }
+    }
+    _stages.emplace_back(name, seconds, 1);
+}
+
+void StageTimings::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stages.clear();
+}
+
+std::vector<StageTimings::Stage> StageTimings::getStages() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stages;
+}
+
+void StageTimings::print(FILE* stream) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& stage : _stages) {
+        fprintf(stream, "%-32s %10.3f ms", stage.name.c_str(), stage.seconds*1000.0);
+        if (stage.count > 1)
+            fprintf(stream, " (%" PRIu64 " times)", stage.count);
+        fprintf(stream, "\n");
+    }
+}
+
+
+} // namespace gu2
@@ -0,0 +1,92 @@
+//
+// Project: GraphicsUtils2
+// File: TransformHierarchy.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MathTypes.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Transformation hierarchy in flat structure of arrays layout. Nodes are created parents first, so the node
+// order is a topological order of the hierarchy. Changing a local transformation marks the node dirty, update()
+// then recomputes the world matrices of the dirty nodes and their descendants only. The update proceeds one depth
+// level at a time, nodes of a level are independent of each other and processed in parallel.
+class TransformHierarchy {
+public:
+    static constexpr uint32_t   noParent    {0xffffffff};
+
+    // Returns the id of the new node, parent needs to exist already
+    uint32_t addNode(
+        uint32_t parent,
+        const Vec3f& translation = Vec3f::Zero(),
+        const Quatf& rotation = Quatf::Identity(),
+        const Vec3f& scale = Vec3f::Ones());
+    // Local transformation as a matrix, decomposed to translation, rotation and scale (shear is discarded)
+    uint32_t addNodeFromMatrix(uint32_t parent, const Mat4f& localMatrix);
+    void clear();
+
+    void setTranslation(uint32_t nodeId, const Vec3f& translation);
+    void setRotation(uint32_t nodeId, const Quatf& rotation);
+    void setScale(uint32_t nodeId, const Vec3f& scale);
+    void setLocalMatrix(uint32_t nodeId, const Mat4f& localMatrix);
+
+    // Recompute world matrices of the dirty subtrees. Ids of the updated nodes are available via
+    // getChangedNodes() until the next update.
+    void update();
+
+    inline size_t size() const noexcept { return _parents.size(); }
+    inline uint32_t getParent(uint32_t nodeId) const noexcept { return _parents[nodeId]; }
+    inline const Vec3f& getTranslation(uint32_t nodeId) const noexcept { return _translations[nodeId]; }
+    inline const Quatf& getRotation(uint32_t nodeId) const noexcept { return _rotations[nodeId]; }
+    inline const Vec3f& getScale(uint32_t nodeId) const noexcept { return _scales[nodeId]; }
+    inline const Mat4f& getWorldMatrix(uint32_t nodeId) const noexcept { return _worldMatrices[nodeId]; }
+    inline bool isChanged(uint32_t nodeId) const noexcept { return _changed[nodeId]; }
+    inline const std::vector<uint32_t>& getChangedNodes() const noexcept { return _changedNodes; }
+
+    static void decompose(const Mat4f& matrix, Vec3f* translation, Quatf* rotation, Vec3f* scale);
+
+private:
+    // Per node
+    std::vector<uint32_t>   _parents;
+    std::vector<uint32_t>   _depths;
+    std::vector<Vec3f>      _translations;
+    std::vector<Quatf>      _rotations;
+    std::vector<Vec3f>      _scales;
+    std::vector<Mat4f>      _worldMatrices;
+    std::vector<uint8_t>    _dirty;         // local transformation changed since the last update
+    std::vector<uint8_t>    _changed;       // world matrix changed in the last update
+
+    // Node ids sorted by depth, nodes of level i are in [_levelOffsets[i], _levelOffsets[i+1])
+    std::vector<uint32_t>   _levelOrder;
+    std::vector<uint32_t>   _levelOffsets;
+    bool                    _levelsValid    {true};
+    uint32_t                _minDirtyDepth  {0xffffffff};
+    std::vector<uint32_t>   _changedNodes;
+
+    inline void markDirty(uint32_t nodeId);
+    void buildLevels();
+};
+
+
+void TransformHierarchy::markDirty(uint32_t nodeId)
+{
+    _dirty[nodeId] = 1;
+    _minDirtyDepth = std::min(_minDirtyDepth, _depths[nodeId]);
+}
+
+
+} // namespace gu2
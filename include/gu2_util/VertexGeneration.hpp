@@ -0,0 +1,67 @@
+//
+// Project: GraphicsUtils2
+// File: VertexGeneration.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MathTypes.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace gu2 {
+
+
+// Generation of vertex attributes missing from glTF primitives. All functions operate on indexed triangle lists,
+// indices may be nullptr for unindexed triangles. T_Index is uint16_t or uint32_t.
+
+// Area weighted smooth vertex normals
+template <typename T_Index>
+void generateNormals(
+    const Vec3f* positions,
+    size_t nVertices,
+    const T_Index* indices,
+    size_t nIndices,
+    Vec3f* normals);
+
+// Tangents of the triangle corners, a port of the MikkTSpace reference implementation (genTangSpaceDefault, i.e.
+// with an angular threshold of 180 degrees) which most tools bake tangent space normal maps with. Corners with equal
+// position, normal and texture coordinate are welded, tangent spaces are shared by corners of the same vertex that
+// are connected over the mesh surface and have the same UV orientation. cornerTangents receives nIndices elements,
+// the w component holds the handedness, bitangent = cross(normal, tangent.xyz) * tangent.w.
+template <typename T_Index>
+void generateTangents(
+    const Vec3f* positions,
+    const Vec3f* normals,
+    const Vec2f* texCoords,
+    size_t nVertices,
+    const T_Index* indices,
+    size_t nIndices,
+    Vec4f* cornerTangents);
+
+// Per-vertex values from per-corner values (e.g. tangents from generateTangents). Vertices whose corners have
+// different values are split: the duplicates are appended after the nVertices original vertices, the indices of the
+// corners are rewritten to reference them and the source vertex of each duplicate is written to duplicateSources.
+// vertexValues receives the values of all the vertices. In case the vertex count would exceed maxVertices nothing is
+// split, the vertices get the value of their first corner and false is returned.
+template <typename T_Index>
+bool splitVertices(
+    const Vec4f* cornerValues,
+    T_Index* indices,
+    size_t nIndices,
+    size_t nVertices,
+    size_t maxVertices,
+    std::vector<Vec4f>* vertexValues,
+    std::vector<uint32_t>* duplicateSources);
+
+
+} // namespace gu2
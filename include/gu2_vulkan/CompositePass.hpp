@@ -23,6 +23,7 @@ namespace gu2 {
 
 class DescriptorManager;
 class PipelineManager;
+class UploadContext;
 
 
 class CompositePass : public RenderPass {
@@ -37,7 +38,7 @@ public:
     ~CompositePass();
 
     void createSampler();
-    void createQuad(VkCommandPool commandPool, VkQueue queue);
+    void createQuad(UploadContext* uploadContext);
     void createMaterial();
     void updateDescriptorSets();
 
@@ -0,0 +1,85 @@
+//
+// Project: GraphicsUtils2
+// File: FrameAllocator.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MemoryAllocator.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+
+namespace gu2 {
+
+
+struct FrameAllocatorSettings {
+    VkPhysicalDevice    physicalDevice  {nullptr};
+    VkDevice            device          {nullptr};
+    MemoryAllocator*    memoryAllocator {nullptr};  // nullptr for a VkDeviceMemory per buffer
+    uint32_t            framesInFlight  {2};
+    VkDeviceSize        frameSize       {4 << 20};  // capacity of a frame in bytes
+};
+
+
+// Linear allocator for the data written by the host once per frame (uniforms, instance data, indirect draw
+// commands). Each frame in flight has a persistently mapped buffer of its own, allocations bump an offset into it
+// and are all released at once as the frame slot is reused. The offsets are aligned for both uniform and storage
+// buffer descriptors, so they can be passed as dynamic offsets.
+class FrameAllocator {
+public:
+    struct Allocation {
+        VkBuffer        buffer;
+        VkDeviceSize    offset;
+        void*           data;
+    };
+
+    FrameAllocator(FrameAllocatorSettings settings);
+    FrameAllocator(const FrameAllocator&) = delete;
+    FrameAllocator(FrameAllocator&&) = delete;
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+    FrameAllocator& operator=(FrameAllocator&&) = delete;
+    ~FrameAllocator();
+
+    // Release the allocations of a frame slot, its previous submission needs to have finished executing
+    void beginFrame(uint64_t currentFrame);
+    // Allocate from the frame slot of the last beginFrame() call, throws in case the frame is out of space
+    Allocation allocate(VkDeviceSize size);
+    template <typename T>
+    T* allocate(size_t n, Allocation* allocation);
+
+    inline VkBuffer getBuffer(uint64_t frame) const { return _buffers.at(frame).buffer; }
+    inline VkDeviceSize getFrameSize() const noexcept { return _settings.frameSize; }
+    inline VkDeviceSize getUsedSize() const noexcept { return _head; }
+
+private:
+    struct Buffer {
+        VkBuffer            buffer  {VK_NULL_HANDLE};
+        MemoryAllocation    allocation;
+    };
+
+    FrameAllocatorSettings  _settings;
+    VkDeviceSize            _alignment;
+    std::vector<Buffer>     _buffers;   // one per frame in flight
+    uint64_t                _currentFrame;
+    VkDeviceSize            _head;      // next free byte of the current frame
+};
+
+
+template <typename T>
+T* FrameAllocator::allocate(size_t n, Allocation* allocation)
+{
+    *allocation = allocate(static_cast<VkDeviceSize>(sizeof(T) * n));
+    return static_cast<T*>(allocation->data);
+}
+
+
+} // namespace gu2
@@ -11,25 +11,197 @@
 #pragma once
 
 
+#include "Descriptor.hpp"
+#include "FrameAllocator.hpp"
 #include "RenderPass.hpp"
+#include "gu2_util/FrustumCulling.hpp"
+#include "gu2_util/MathTypes.hpp"
+#include "gu2_util/OcclusionCulling.hpp"
+#include "gu2_util/RenderQueue.hpp"
+
+#include <vector>
 
 
 namespace gu2 {
 
 
+class DescriptorManager;
+class GeometryPool;
+class GpuCulling;
+class Material;
+class Mesh;
+class Pipeline;
 class Scene;
 
 
+// Per view constants, render pass descriptor set binding 0
+struct ViewUniforms {
+    alignas(16) Mat4f   view;
+    alignas(16) Mat4f   projection;
+    alignas(16) Mat4f   viewProjection;
+};
+
+// Top three rows of a model matrix, mat3x4 in the shaders. Render pass descriptor set binding 1 holds an array of
+// them indexed with gl_InstanceIndex.
+using InstanceTransform = Eigen::Matrix<float, 3, 4, Eigen::RowMajor>;
+
+// Draw calls and state changes recorded by the geometry pass
+struct RenderStats {
+    uint64_t    nDraws              {0};    // a multi-draw indirect call counts as one
+    uint64_t    nPipelineBinds      {0};
+    uint64_t    nMaterialBinds      {0};    // material descriptor set binds
+    uint64_t    nVertexBufferBinds  {0};    // vertex and index buffer binds
+};
+
+
 class GeometryPass : public RenderPass {
 public:
-    GeometryPass(RenderPassSettings settings) noexcept;
+    // View uniforms and instance transforms are allocated from frameAllocator, which needs to have room for
+    // maxInstances transforms in addition to the uniforms
+    GeometryPass(
+        RenderPassSettings settings,
+        DescriptorManager* descriptorManager,
+        FrameAllocator* frameAllocator,
+        uint32_t maxInstances,
+        int framesInFlight) noexcept;
+    GeometryPass(const GeometryPass&) = delete;
+    GeometryPass(GeometryPass&&) = delete;
+    GeometryPass& operator=(const GeometryPass&) = delete;
+    GeometryPass& operator=(GeometryPass&&) = delete;
+    ~GeometryPass();
 
     void setScene(const Scene& scene) noexcept;
+    // Write the view uniforms of the frame and reset the worker command pools of the frame slot, to be called after
+    // setScene and the FrameAllocator::beginFrame of the frame
+    void beginFrame(uint64_t currentFrame);
+    // Draw the nodes selected by GPU culling instead of culling on the CPU, nullptr for the CPU path
+    void setGpuCulling(GpuCulling* gpuCulling) noexcept;
+    // Issue the CPU culled draws with vkCmdDrawIndexedIndirect, merging the consecutive draws sharing the material
+    // and the geometry buffers. The device needs the multiDrawIndirect and drawIndirectFirstInstance features.
+    void setMultiDrawIndirect(bool multiDrawIndirect) noexcept;
+    // Split the draws of the pass across nThreads worker threads recording secondary command buffers, 0 to record
+    // inline to the primary command buffer. The command pools are created for queueFamilyIndex, one per thread and
+    // frame in flight. Not to be called while a frame using the pass is in flight.
+    void setParallelRecording(uint32_t queueFamilyIndex, uint32_t nThreads);
+
+    // Record the GPU culling dispatch of the frame, must be recorded before the render pass. Writes the transforms of
+    // the nodes changed since the previous use of the frame slot, see Scene::updateTransforms.
+    void cullOnGpu(VkCommandBuffer commandBuffer, uint64_t currentFrame);
 
     void render() final;
 
+    // Culling results of the last rendered frame
+    inline const CullingStats& getCullingStats() const noexcept { return _cullingStats; }
+    // Bind counts of the last rendered frame, summed over the command buffers recorded
+    inline const RenderStats& getRenderStats() const noexcept { return _renderStats; }
+    inline uint32_t getMaxInstances() const noexcept { return _maxInstances; }
+
 private:
-    const Scene*    _scene;
+    // Instanced draw of a mesh LOD
+    struct Draw {
+        const Mesh* mesh;
+        uint32_t    firstIndex;
+        uint32_t    nIndices;
+        uint32_t    firstInstance;
+        uint32_t    nInstances;
+    };
+
+    // Consecutive indirect draws issued with a single call
+    struct DrawRun {
+        const Mesh* mesh;
+        uint32_t    firstCommand;
+        uint32_t    nCommands;
+    };
+
+    // Transforms written by cullOnGpu to the instance data of a frame slot. The FrameAllocator does not clear the
+    // memory, so as long as the allocation of the slot lands at the same offset only the nodes changed since the
+    // previous write of the slot are written.
+    struct SlotTransforms {
+        bool                    valid           {false};
+        uint64_t                revision        {0};    // Scene::revision of the write
+        VkBuffer                buffer          {VK_NULL_HANDLE};
+        VkDeviceSize            offset          {0};
+        std::vector<uint32_t>   changedNodes;   // changed since the write, may contain duplicates
+    };
+
+    // Command buffer being recorded and the state bound to it, redundant binds are skipped
+    struct RecordState {
+        VkCommandBuffer     commandBuffer       {VK_NULL_HANDLE};
+        bool                descriptorSetsBound {false};
+        const Pipeline*     boundPipeline       {nullptr};
+        const Material*     boundMaterial       {nullptr};
+        const Mesh*         boundMesh           {nullptr};
+        const GeometryPool* boundGeometryPool   {nullptr};  // meshes of the same pool share the bound buffers
+        RenderStats         stats;
+    };
+
+    DescriptorManager*                  _descriptorManager;
+    FrameAllocator*                     _frameAllocator;
+    uint32_t                            _maxInstances;
+    int                                 _framesInFlight;
+    // Render pass descriptor sets, per frame. Allocated with the layout of the first material drawn, the layout is
+    // shared by all the geometry pass pipelines.
+    std::vector<DescriptorSetHandle>    _descriptorSets;
+    FrameAllocator::Allocation          _viewAllocation;
+    FrameAllocator::Allocation          _instanceAllocation;
+    InstanceTransform*                  _instanceData;
+
+    const Scene*            _scene;
+    GpuCulling*             _gpuCulling;
+    bool                    _multiDrawIndirect;
+
+    // Per frame slot, the transform changes of the scene are gathered for all the slots
+    std::vector<SlotTransforms> _slotTransforms;
+    const Scene*            _transformScene;
+    uint64_t                _transformRevision;
+
+    OcclusionBuffer         _occlusionBuffer;
+
+    // Per frame, kept to avoid reallocation
+    std::vector<uint32_t>   _visibleNodes;
+    std::vector<uint32_t>   _groupOffsets;  // visible nodes of group i are in [_groupOffsets[i], _groupOffsets[i+1])
+    std::vector<uint32_t>   _groupNodes;
+    std::vector<uint32_t>   _lodNodes;
+    std::vector<uint32_t>   _lodOffsets;
+    CullingStats            _cullingStats;
+    RenderStats             _renderStats;
+
+    // Draws are sorted by the keys of their instance groups, the keys are rebuilt once the scene or its revision
+    // changes
+    const Scene*            _keyedScene;
+    uint64_t                _keyedRevision;
+    std::vector<uint64_t>   _groupSortKeys;
+    std::vector<Draw>       _draws;
+    RenderQueue             _renderQueue;
+
+    // Parallel recording, the command pool and the secondary command buffer of thread t for frame f are at index
+    // f*_recordingThreads + t
+    uint32_t                        _recordingThreads;
+    std::vector<VkCommandPool>      _workerCommandPools;
+    std::vector<VkCommandBuffer>    _workerCommandBuffers;
+    std::vector<RecordState>        _workerStates;
+
+    // Draws gathered for multi-draw indirect, kept to avoid reallocation
+    std::vector<VkDrawIndexedIndirectCommand>   _drawCommands;
+    std::vector<DrawRun>                        _drawRuns;
+
+    void createDescriptorSets(const Material& material);
+    void destroyWorkerCommands();
+    // Bind the view uniforms and the instance transforms of the frame, valid for all the materials drawn. Bound
+    // once per command buffer.
+    void bindDescriptorSets(RecordState* state, const Material& material) const;
+    // Bind the pipeline, the material and the buffers of a mesh unless already bound
+    void bindState(RecordState* state, const Mesh& mesh) const;
+    void bindMesh(RecordState* state, const Mesh& mesh) const;
+    void updateSortKeys();
+    // Gather a draw for flushDraws(), merging it to the previous run if possible
+    void gatherDraw(const Draw& draw);
+    void flushDraws();
+    // Record items [0, nItems) with recordItem(RecordState*, size_t), in order. With parallel recording the items
+    // are split to contiguous ranges recorded to the secondary command buffers of the workers, so it may only be
+    // called once per frame.
+    template <typename T_RecordItem>
+    void record(size_t nItems, const T_RecordItem& recordItem);
 };
 
 
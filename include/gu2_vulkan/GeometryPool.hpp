@@ -0,0 +1,158 @@
+//
+// Project: GraphicsUtils2
+// File: GeometryPool.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MemoryAllocator.hpp"
+#include "gu2_util/RangeAllocator.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+
+namespace gu2 {
+
+
+class UploadContext;
+
+
+struct GeometryPoolSettings {
+    VkPhysicalDevice    physicalDevice  {nullptr};
+    VkDevice            device          {nullptr};
+    MemoryAllocator*    memoryAllocator {nullptr};
+    uint32_t            vertexCapacity  {1u << 18};     // initial capacity in vertices, grown as needed
+    uint32_t            indexCapacity   {1u << 20};     // initial capacity in indices, grown as needed
+    uint32_t            framesInFlight  {2};            // frames that may still draw a removed range
+};
+
+
+// Shared vertex and index buffers for the geometry of many meshes. There is one vertex buffer per attribute
+// stream (bound to the binding matching the attribute location) and one 32-bit index buffer, meshes occupy
+// ranges of them. The draws address the ranges via vertexOffset and firstIndex, so the buffers are bound once
+// for any number of meshes.
+class GeometryPool {
+public:
+    static constexpr uint32_t   invalidRange    {0xffffffff};
+
+    struct Range {
+        int32_t     vertexOffset;
+        uint32_t    nVertices;
+        uint32_t    firstIndex;
+        uint32_t    nIndices;
+    };
+
+    // Attribute stream input, locations need to be contiguous starting from 0
+    struct AttributeData {
+        uint32_t    location;
+        const void* data;
+        uint32_t    elementSize;    // the size of an element of a stream is fixed by the first range using it
+    };
+
+    GeometryPool(GeometryPoolSettings settings);
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool(GeometryPool&&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+    GeometryPool& operator=(GeometryPool&&) = delete;
+    ~GeometryPool();
+
+    // Allocate a range and record the upload of the attributes and indices to it, returns the range id. 16-bit
+    // indices are widened. Grows the buffers in case the range does not fit (flushes the upload context and waits
+    // for the device to be idle, the other threads adding ranges wait for the growth to finish). The id of the
+    // upload batch is written to uploadBatch in case it is set. Can be called from multiple threads.
+    uint32_t addRange(
+        UploadContext* uploadContext,
+        const std::vector<AttributeData>& attributes,
+        uint32_t nVertices,
+        const void* indexData,
+        VkIndexType indexType,
+        uint32_t nIndices,
+        uint64_t* uploadBatch = nullptr);
+    // Remove a range, it is freed by the beginFrame() call after the frames in flight that may have drawn it and
+    // its upload batch have finished
+    void removeRange(uint32_t rangeId);
+    inline const Range& getRange(uint32_t rangeId) const noexcept { return _ranges[rangeId]; }
+
+    // Pack the ranges to the beginning of the buffers. Waits for the device to be idle, the offsets of the ranges
+    // change so the users of getRange() need to refresh their copies (GpuCulling::setScene for instance).
+    void defragment(UploadContext* uploadContext);
+
+    // Advance the frame counter and free the removed ranges no longer in use. To be called once per frame before
+    // Renderer::render.
+    void beginFrame(UploadContext* uploadContext);
+
+    // Bind all attribute streams and the index buffer
+    void bind(VkCommandBuffer commandBuffer) const;
+
+    inline uint64_t getVertexCapacity() const noexcept { return _vertexAllocator.getCapacity(); }
+    inline uint64_t getIndexCapacity() const noexcept { return _indexAllocator.getCapacity(); }
+    inline uint64_t getUsedVertices() const noexcept { return _vertexAllocator.getUsedSize(); }
+    inline uint64_t getUsedIndices() const noexcept { return _indexAllocator.getUsedSize(); }
+
+private:
+    struct Buffer {
+        VkBuffer            buffer      {VK_NULL_HANDLE};
+        MemoryAllocation    allocation;
+    };
+
+    struct Stream {
+        Buffer          buffer;
+        uint32_t        elementSize {0};
+    };
+
+    struct PendingFree {
+        uint32_t    rangeId;
+        uint64_t    frame;          // value of _frame at the removal
+    };
+
+    GeometryPoolSettings            _settings;
+    RangeAllocator                  _vertexAllocator;
+    RangeAllocator                  _indexAllocator;
+    std::vector<Stream>             _streams;       // index is the attribute location
+    Buffer                          _indexBuffer;
+    std::vector<Range>              _ranges;
+    std::vector<uint32_t>           _freeRangeIds;
+    std::vector<uint64_t>           _uploadBatches; // upload batch of each range
+    std::deque<PendingFree>         _pendingFrees;  // removed ranges in the order of removal
+    uint64_t                        _frame;         // number of beginFrame() calls
+    std::vector<VkBuffer>           _bindBuffers;   // stream buffers for vkCmdBindVertexBuffers
+    std::vector<VkDeviceSize>       _bindOffsets;
+
+    std::mutex                      _mutex;
+    std::condition_variable         _condition;     // notified at the end of resizes and uploads
+    bool                            _resizing;      // buffers are being replaced, see beginResize()
+    uint32_t                        _activeUploads; // uploads being recorded to the current buffers
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage) const;
+    void destroyBuffer(Buffer* buffer) const;
+    // Validate the attributes against the streams and create the streams of new locations, expects _mutex to be
+    // locked
+    void createStreams(const std::vector<AttributeData>& attributes);
+    // Wait for the other resizes and the uploads recorded to the current buffers to finish and mark the pool as
+    // resizing. Returns with the lock released, the allocators, the ranges and the buffers belong to the caller until
+    // endResize(), so the flushes and the device waits of the resize do not block removeRange() and beginFrame().
+    void beginResize(std::unique_lock<std::mutex>& lock);
+    void endResize(std::unique_lock<std::mutex>& lock);
+    // Replace the buffers with larger ones, the used part of the old contents is copied. Called between
+    // beginResize() and endResize().
+    void grow(uint64_t vertexCapacity, uint64_t indexCapacity, UploadContext* uploadContext);
+    // Free the removed ranges and pack the live ones, called between beginResize() and endResize()
+    void defragmentBuffers(UploadContext* uploadContext);
+    // Return the range to the allocators and its id to the free list
+    void freeRange(uint32_t rangeId);
+    void updateBindBuffers();
+};
+
+
+} // namespace gu2
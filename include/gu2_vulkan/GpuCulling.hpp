@@ -0,0 +1,202 @@
+//
+// Project: GraphicsUtils2
+// File: GpuCulling.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Descriptor.hpp"
+#include "MemoryAllocator.hpp"
+#include "Scene.hpp"
+#include "Shader.hpp"
+#include "gu2_util/MathTypes.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <vector>
+
+
+namespace gu2 {
+
+
+class DescriptorManager;
+class Texture;
+
+
+struct GpuCullingSettings {
+    VkPhysicalDevice    physicalDevice      {nullptr};
+    VkDevice            device              {nullptr};
+    DescriptorManager*  descriptorManager   {nullptr};
+    MemoryAllocator*    memoryAllocator     {nullptr};
+    int                 framesInFlight      {2};
+};
+
+
+// GPU driven culling: a compute shader tests the node bounds against the view frustum and the depth pyramid of
+// the previous frame, selects the LODs and writes compacted VkDrawIndexedIndirectCommand arrays, one range per
+// draw group. The draws are issued with vkCmdDrawIndexedIndirectCount, so the CPU cost of recording the draws
+// depends on the number of draw groups only. The device needs VK_KHR_draw_indirect_count and the
+// multiDrawIndirect and drawIndirectFirstInstance features enabled, see isSupported().
+class GpuCulling {
+public:
+    // Shader side structs, std430 layout
+    struct Node {
+        Vec4f       sphere;     // world space center and radius, negative radius for empty nodes
+        Vec4f       boundsMin;  // world space bounding box, w unused
+        Vec4f       boundsMax;
+        uint32_t    drawGroup;
+        uint32_t    firstLod;
+        uint32_t    nLods;
+        float       maxScale;   // largest scale factor of the world matrix
+    };
+
+    // Index range in the bound index buffer, offsets of the geometry pool included
+    struct Lod {
+        uint32_t    firstIndex;
+        uint32_t    nIndices;
+        float       error;
+        int32_t     vertexOffset    {0};
+    };
+
+    // Draw commands of the group are written to [firstCommand, firstCommand + maxCommands)
+    struct DrawGroup {
+        uint32_t    firstCommand;
+        uint32_t    maxCommands;
+    };
+
+    // True in case the physical device has the extension and the features required
+    static bool isSupported(VkPhysicalDevice physicalDevice);
+
+    GpuCulling(GpuCullingSettings settings);
+    GpuCulling(const GpuCulling&) = delete;
+    GpuCulling(GpuCulling&&) = delete;
+    GpuCulling& operator=(const GpuCulling&) = delete;
+    GpuCulling& operator=(GpuCulling&&) = delete;
+    ~GpuCulling();
+
+    // Upload the LODs and the draw groups, each group has room for one command per node. The buffers and the
+    // descriptor sets are replaced, the old ones are destroyed by updateNodes() once the frames in flight using them
+    // have finished.
+    void setGeometry(const std::vector<Lod>& lods, const std::vector<uint32_t>& groupSizes, uint32_t nNodes);
+    // Instance groups of the scene are used as the draw groups. Needs to be called again in case the geometry pool
+    // of the meshes is defragmented.
+    void setScene(const Scene& scene);
+    // Write the node records of the frame, calls setScene in case the scene structure has changed. To be called once
+    // per frame.
+    void updateNodes(const Scene& scene, uint32_t currentFrame);
+    inline Node* getNodeData(uint32_t currentFrame) noexcept;
+
+    // Create the depth pyramid for the depth texture, needs to be called again once the texture is recreated.
+    // The texture needs VK_IMAGE_USAGE_SAMPLED_BIT.
+    void setDepthTexture(const Texture& depthTexture);
+    inline void setOcclusionCulling(bool enabled) noexcept { _occlusionCulling = enabled; }
+
+    // Record the culling dispatch, must be recorded outside of a render pass before the draws
+    void cull(VkCommandBuffer commandBuffer, uint32_t currentFrame, const Scene::Camera& camera, float maxLodError);
+    // Record building the depth pyramid used in the occlusion culling of the next frame, the depth texture needs
+    // to be in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    void buildDepthPyramid(VkCommandBuffer commandBuffer);
+    // Draw the visible nodes of a draw group, the vertex and index buffers and descriptor sets need to be bound
+    void draw(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t drawGroup) const;
+
+    // Number of commands written by the last culling of the frame, read from a host visible copy of the counts
+    // made by cull(). Valid once the execution of the command buffer has finished, e.g. its fence has been waited for.
+    uint32_t getVisibleCount(uint32_t currentFrame) const;
+    inline VkBuffer getDrawCommandBuffer(uint32_t currentFrame) const noexcept;
+    inline VkBuffer getDrawCountBuffer(uint32_t currentFrame) const noexcept;
+    inline const std::vector<DrawGroup>& getDrawGroups() const noexcept { return _drawGroups; }
+
+private:
+    struct Buffer {
+        VkBuffer            buffer      {VK_NULL_HANDLE};
+        MemoryAllocation    allocation;
+        VkDeviceSize        size        {0};
+    };
+
+    // Resources replicated for each frame in flight
+    struct FrameData {
+        Buffer          uniforms;
+        Buffer          nodes;
+        Buffer          drawCommands;
+        Buffer          drawCounts;
+        Buffer          drawCountReadback;  // host visible copy of drawCounts
+    };
+
+    // Resources replaced by setGeometry()
+    struct Retired {
+        std::vector<Buffer>                 buffers;
+        std::vector<DescriptorSetHandle>    descriptorSets;
+        uint64_t                            frame;          // value of _frame at the replacement
+    };
+
+    struct ComputePipeline {
+        Shader                                  shader;
+        std::vector<DescriptorSetLayoutHandle>  descriptorSetLayout;    // set 0, empty until created
+        VkPipelineLayout                        pipelineLayout          {VK_NULL_HANDLE};
+        VkPipeline                              pipeline                {VK_NULL_HANDLE};
+    };
+
+    GpuCullingSettings                          _settings;
+    PFN_vkCmdDrawIndexedIndirectCountKHR        _vkCmdDrawIndexedIndirectCount;
+
+    ComputePipeline                             _cullingPipeline;
+    ComputePipeline                             _depthPyramidPipeline;
+    VkSampler                                   _sampler;
+
+    Buffer                                      _lods;
+    Buffer                                      _drawGroupBuffer;
+    std::vector<DrawGroup>                      _drawGroups;
+    uint32_t                                    _nNodes;
+    uint32_t                                    _nLods;
+    std::vector<FrameData>                      _frames;
+    std::vector<DescriptorSetHandle>            _cullingDescriptorSets;     // per frame
+    std::deque<Retired>                         _retired;                   // in the order of replacement
+    uint64_t                                    _frame;                     // number of updateNodes() calls
+
+    // Depth pyramid, power of two dimensions, R32F in VK_IMAGE_LAYOUT_GENERAL
+    VkImageView                                 _depthView;
+    VkImage                                     _depthPyramid;
+    MemoryAllocation                            _depthPyramidAllocation;
+    VkImageView                                 _depthPyramidView;          // all levels, sampled in culling
+    std::vector<VkImageView>                    _depthPyramidLevelViews;
+    std::vector<DescriptorSetHandle>            _depthPyramidDescriptorSets; // per level
+    uint32_t                                    _depthPyramidWidth;
+    uint32_t                                    _depthPyramidHeight;
+    uint32_t                                    _depthPyramidLevels;
+    bool                                        _depthPyramidValid;         // built at least once
+    bool                                        _occlusionCulling;
+
+    void createComputePipeline(ComputePipeline* pipeline, const Path& filename);
+    void destroyComputePipeline(ComputePipeline* pipeline);
+    void createBuffer(Buffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+    void destroyBuffer(Buffer* buffer);
+    void destroyDepthPyramid();
+    void updateCullingDescriptorSets();
+    void transitionDepthPyramid(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage) const;
+};
+
+
+GpuCulling::Node* GpuCulling::getNodeData(uint32_t currentFrame) noexcept
+{
+    return static_cast<Node*>(_frames[currentFrame].nodes.allocation.mapped);
+}
+
+VkBuffer GpuCulling::getDrawCommandBuffer(uint32_t currentFrame) const noexcept
+{
+    return _frames[currentFrame].drawCommands.buffer;
+}
+
+VkBuffer GpuCulling::getDrawCountBuffer(uint32_t currentFrame) const noexcept
+{
+    return _frames[currentFrame].drawCounts.buffer;
+}
+
+
+} // namespace gu2
@@ -13,7 +13,10 @@
 
 #include "Descriptor.hpp"
 #include "Shader.hpp"
+#include "ShaderCompiler.hpp"
 
+#include <map>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -37,6 +40,14 @@ public:
 
     void setVertexShader(const Shader& shader); // TODO replace with generic addShader
     void setFragmentShader(const Shader& shader); // TODO replace with generic addShader
+    // Shaders still being compiled, waited for by createDescriptorSetLayouts and createPipeline
+    void setVertexShader(const ShaderFuture& shader);
+    void setFragmentShader(const ShaderFuture& shader);
+
+    // Specialize a constant declared with layout(constant_id = ...) in the vertex and/or fragment shader. The name is
+    // resolved to the constant id when the pipeline is created, the pipelines of materials with equal values are
+    // shared. Bools are passed as 0 or 1, floats as their bit pattern.
+    void setSpecializationConstant(const std::string& name, uint32_t value);
 
     void createDescriptorSetLayouts(DescriptorManager* descriptorManager);
     inline const std::vector<DescriptorSetLayoutInfo>& getDescriptorSetLayoutInfos() const noexcept;
@@ -47,6 +58,12 @@ public:
         const VkPipelineVertexInputStateCreateInfo& vertexInputInfo
     );
     void createPipeline(PipelineManager* pipelineManager, const PipelineSettings& pipelineSettings);
+    // Pipelines of several materials, created in parallel with PipelineManager::getPipelines
+    static void createPipelines(
+        PipelineManager* pipelineManager,
+        const std::vector<Material*>& materials,
+        const std::vector<VkPipelineVertexInputStateCreateInfo>& vertexInputInfos
+    );
 
     inline const Pipeline* getPipeline() const noexcept { return _pipeline; }
 
@@ -55,7 +72,10 @@ public:
     // Called after all uniforms have been added
     void createDescriptorSets(DescriptorManager* descriptorManager, int framesInFlight);
 
+    // Bind the pipeline and the material descriptor set
     void bind(VkCommandBuffer commandBuffer, uint32_t currentFrame) const;
+    // Bind the material descriptor set only, for when the pipeline is already bound
+    void bindDescriptorSets(VkCommandBuffer commandBuffer, uint32_t currentFrame) const;
 
 private:
     template <typename T_Uniform>
@@ -69,11 +89,18 @@ private:
     VkDevice                                _device;
     const Shader*                           _vertexShader;
     const Shader*                           _fragmentShader;
+    ShaderFuture                            _vertexShaderFuture;
+    ShaderFuture                            _fragmentShaderFuture;
     std::vector<DescriptorSetLayoutInfo>    _descriptorSetLayoutInfos;
     std::vector<DescriptorSetLayoutHandle>  _descriptorSetLayouts;
+    std::map<std::string, uint32_t>         _specializationConstants; // name, value
     const Pipeline*                         _pipeline;
     std::vector<UniformHandle<Texture>>     _textures;
     std::vector<DescriptorSetHandle>        _descriptorSets;
+
+    void waitForShaders();
+    // Throws in case a specialization constant is declared in neither of the shaders
+    void checkSpecializationConstants() const;
 };
 
 
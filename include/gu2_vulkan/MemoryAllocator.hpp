@@ -0,0 +1,198 @@
+//
+// Project: GraphicsUtils2
+// File: MemoryAllocator.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "gu2_util/BuddyAllocator.hpp"
+#include "gu2_util/LinearAllocator.hpp"
+#include "gu2_util/RangeAllocator.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <variant>
+#include <vector>
+
+
+namespace gu2 {
+
+
+struct MemoryAllocatorSettings {
+    VkPhysicalDevice    physicalDevice      {nullptr};
+    VkDevice            device              {nullptr};
+    VkDeviceSize        blockSize           {64 << 20};
+    // Resources at least this large get a VkDeviceMemory of their own
+    VkDeviceSize        dedicatedThreshold  {16 << 20};
+    // Query VkMemoryDedicatedRequirements and give the resources preferring it a VkDeviceMemory of their own,
+    // requires Vulkan 1.1 on both the instance and the device
+    bool                dedicatedRequirements   {false};
+};
+
+
+// Suballocation strategy of the memory blocks
+enum class MemoryStrategy : uint32_t {
+    FirstFit    = 0,    // general purpose, free ranges are coalesced
+    Buddy       = 1,    // power of two blocks, bounded allocation time for resources created and destroyed often
+    Linear      = 2,    // bump allocation for transient resources released as a group (per frame or batch)
+};
+
+
+// Suballocated device memory, memory and offset are passed to vkBind*Memory
+struct MemoryAllocation {
+    static constexpr uint32_t   dedicatedBlock  {0xffffffff};
+
+    VkDeviceMemory  memory      {VK_NULL_HANDLE};
+    VkDeviceSize    offset      {0};
+    VkDeviceSize    size        {0};
+    void*           mapped      {nullptr};  // persistently mapped for host visible memory, offset applied
+    uint32_t        pool        {0};
+    uint32_t        block       {dedicatedBlock};
+};
+
+
+// Device memory allocator. Allocations are placed in large blocks of VkDeviceMemory, one list of blocks per memory
+// type and resource kind, so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount. Buffers
+// and linear images are kept in separate blocks from optimal tiling images, which satisfies bufferImageGranularity
+// without padding. Each strategy has blocks of its own, the blocks of the buddy strategy are rounded down to a power
+// of two. Host visible blocks are mapped for their whole lifetime. Thread safe.
+class MemoryAllocator {
+public:
+    struct Statistics {
+        uint32_t        nDeviceMemories;        // vkAllocateMemory calls alive, blocks and dedicated allocations
+        uint32_t        nBlocks;
+        uint32_t        nAllocations;           // suballocations and dedicated allocations
+        uint32_t        nDedicatedAllocations;
+        VkDeviceSize    blockBytes;             // total size of the blocks
+        VkDeviceSize    usedBlockBytes;         // suballocated bytes in the blocks
+        VkDeviceSize    dedicatedBytes;
+        uint32_t        maxMemoryAllocationCount;
+        // Blocks and their suballocations per strategy, index is the MemoryStrategy
+        std::array<uint32_t, 3> nStrategyBlocks;
+        std::array<uint32_t, 3> nStrategyAllocations;
+    };
+
+    MemoryAllocator(MemoryAllocatorSettings settings);
+    MemoryAllocator(const MemoryAllocator&) = delete;
+    MemoryAllocator(MemoryAllocator&&) = delete;
+    MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+    MemoryAllocator& operator=(MemoryAllocator&&) = delete;
+    ~MemoryAllocator();
+
+    MemoryAllocation allocate(
+        const VkMemoryRequirements& requirements,
+        VkMemoryPropertyFlags properties,
+        bool optimalImage,
+        bool dedicated = false,
+        MemoryStrategy strategy = MemoryStrategy::FirstFit);
+    void free(MemoryAllocation* allocation);
+
+    // Create a resource and bind memory for it
+    void createBuffer(
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties,
+        VkBuffer* buffer,
+        MemoryAllocation* allocation,
+        MemoryStrategy strategy = MemoryStrategy::FirstFit);
+    void createImage(
+        uint32_t width,
+        uint32_t height,
+        uint32_t mipLevels,
+        VkFormat format,
+        VkImageTiling tiling,
+        VkImageUsageFlags usage,
+        VkMemoryPropertyFlags properties,
+        VkImage* image,
+        MemoryAllocation* allocation,
+        MemoryStrategy strategy = MemoryStrategy::FirstFit);
+    void destroyBuffer(VkBuffer* buffer, MemoryAllocation* allocation);
+    void destroyImage(VkImage* image, MemoryAllocation* allocation);
+
+    Statistics getStatistics() const;
+    void printStatistics() const;
+
+private:
+    struct Block {
+        VkDeviceMemory                                                  memory;
+        void*                                                           mapped;
+        std::variant<RangeAllocator, BuddyAllocator, LinearAllocator>   allocator;  // index is the strategy
+    };
+
+    // Blocks of a memory type, a resource kind and a strategy
+    struct Pool {
+        uint32_t                            memoryType;
+        bool                                hostVisible;
+        std::vector<std::unique_ptr<Block>> blocks;         // nullptr for freed blocks, indices are kept stable
+    };
+
+    MemoryAllocatorSettings             _settings;
+    VkPhysicalDeviceMemoryProperties    _memoryProperties;
+    VkDeviceSize                        _nonCoherentAtomSize;
+    uint32_t                            _maxMemoryAllocationCount;
+
+    mutable std::mutex                  _mutex;
+    std::vector<Pool>                   _pools;             // index is 3*(2*memoryType + optimalImage) + strategy
+    uint32_t                            _nDedicatedAllocations;
+    VkDeviceSize                        _dedicatedBytes;
+
+    // Allocation for a resource, dedicatedInfo is chained to the VkDeviceMemory in case it is dedicated
+    MemoryAllocation allocateMemory(
+        const VkMemoryRequirements& requirements,
+        VkMemoryPropertyFlags properties,
+        bool optimalImage,
+        bool dedicated,
+        MemoryStrategy strategy,
+        const VkMemoryDedicatedAllocateInfo* dedicatedInfo);
+    // Returns whether the driver prefers or requires a dedicated allocation for the resource
+    bool getMemoryRequirements(VkBuffer buffer, VkMemoryRequirements* requirements) const;
+    bool getMemoryRequirements(VkImage image, VkMemoryRequirements* requirements) const;
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    VkDeviceMemory allocateDeviceMemory(
+        VkDeviceSize size,
+        uint32_t memoryType,
+        void** mapped,
+        const VkMemoryDedicatedAllocateInfo* dedicatedInfo = nullptr);
+};
+
+
+// Resource creation through the allocator, or with a VkDeviceMemory per resource in case allocator is nullptr.
+// Host visible memory is mapped in both cases.
+void createBuffer(
+    MemoryAllocator* allocator,
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkBuffer* buffer,
+    MemoryAllocation* allocation,
+    MemoryStrategy strategy = MemoryStrategy::FirstFit);
+void createImage(
+    MemoryAllocator* allocator,
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mipLevels,
+    VkFormat format,
+    VkImageTiling tiling,
+    VkImageUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkImage* image,
+    MemoryAllocation* allocation,
+    MemoryStrategy strategy = MemoryStrategy::FirstFit);
+void destroyBuffer(MemoryAllocator* allocator, VkDevice device, VkBuffer* buffer, MemoryAllocation* allocation);
+void destroyImage(MemoryAllocator* allocator, VkDevice device, VkImage* image, MemoryAllocation* allocation);
+
+
+} // namespace gu2
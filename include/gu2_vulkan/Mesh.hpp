@@ -12,6 +12,7 @@
 
 
 #include "Descriptor.hpp"
+#include "MemoryAllocator.hpp"
 #include "VertexAttributesDescription.hpp"
 #include "VulkanSettings.hpp"
 #include "gu2_util/MathTypes.hpp"
@@ -23,30 +24,23 @@
 namespace gu2 {
 
 
-// TODO relocate
-struct UniformBufferObject {
-    alignas(16) Mat4f   model;
-    alignas(16) Mat4f   view;
-    alignas(16) Mat4f   projection;
-};
-
-
-class DescriptorManager;
+class GeometryPool;
 class GLTFLoader;
 class Material;
 class Pipeline;
 class Texture;
-class Renderer;
-class Scene;
+class UploadContext;
 
 
 class Mesh {
 public:
-    Mesh(VkPhysicalDevice physicalDevice, VkDevice device);
+    // The buffers of meshes uploaded without a geometry pool are allocated from memoryAllocator, nullptr for a
+    // VkDeviceMemory per buffer
+    Mesh(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator* memoryAllocator = nullptr);
     Mesh(const Mesh&) = delete; // TODO
-    Mesh(Mesh&&) = default;
+    Mesh(Mesh&& other) noexcept;
     Mesh& operator=(const Mesh&) = delete; // TODO
-    Mesh& operator=(Mesh&&) = default;
+    Mesh& operator=(Mesh&& other) noexcept;
     ~Mesh();
 
     // Add vertex attribute from single attribute array
@@ -59,14 +53,17 @@ public:
     // Set mesh indices, note that all provided attribute and index arrays must contain at least nIndices elements.
     template <typename T_Index> // T_Index must be either uint16_t or uint32_t
     void setIndices(const T_Index* data, uint32_t nIndices, uint32_t stride=0);
-
-    // Upload the mesh to GPU, all provided vertex attribute and index arrays must remain valid until the execution
-    // of upload is finished.
-    void upload(VkCommandPool commandPool, VkQueue queue);
-
-    void createDescriptorSets(DescriptorManager* descriptorManager, int framesInFlight);
-
-    const DescriptorSetLayoutHandle& getDescriptorSetLayout() const;
+    uint32_t getIndexCount() const;
+
+    // Upload the mesh to GPU, all provided vertex attribute and index arrays must remain valid until upload returns
+    // (the data is copied to the staging memory of the upload context). The mesh can be drawn by the submissions made
+    // after the batch of the upload context has been submitted (with a transfer queue, once the batch is complete,
+    // see getUploadBatch()). Can be called from multiple threads for different meshes. With a geometry pool the mesh
+    // occupies a range of the shared buffers (requires non-interleaved attributes), otherwise the mesh creates
+    // buffers of its own.
+    void upload(UploadContext* uploadContext, GeometryPool* geometryPool = nullptr);
+    // Id of the upload context batch of the latest upload, 0 in case there has been none
+    inline uint64_t getUploadBatch() const noexcept { return _uploadBatch; }
 
     void setMaterial(const Material* material);
     const Material& getMaterial() const;
@@ -76,18 +73,22 @@ public:
 
     const VertexAttributesDescription& getVertexAttributesDescription() const;
 
+    // nullptr in case the mesh has buffers of its own
+    inline const GeometryPool* getGeometryPool() const noexcept { return _geometryPool; }
+    // Offsets of the mesh in the geometry pool buffers, 0 for meshes with buffers of their own
+    int32_t getVertexOffset() const;
+    uint32_t getFirstIndex() const;
+
+    // Meshes in the same geometry pool share the bound buffers
     void bind(VkCommandBuffer commandBuffer) const;
-    void draw(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t uniformId) const;
+    // The draws bind the material, the view uniforms and the instance transforms are bound by the render pass
     void draw(VkCommandBuffer commandBuffer, uint32_t currentFrame) const;
-
-    // TODO subject to relocation
-    static void createUniformBuffers(
-        VkPhysicalDevice physicalDevice,
-        VkDevice device,
-        int framesInFlight,
-        uint32_t nUniforms);
-    static void updateUniformBuffer(const Scene& scene, const Renderer& renderer);
-    static void destroyUniformBuffers(VkDevice device);
+    // Draw a subrange of the indices, used for LODs
+    void draw(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t firstIndex, uint32_t nIndices) const;
+    // Instanced draw, the model matrices of the instances are read from the instance buffer starting at
+    // firstInstance
+    void draw(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t firstIndex, uint32_t nIndices,
+        uint32_t firstInstance, uint32_t nInstances) const;
 
 private:
     // Struct containing vertex data input buffer metadata
@@ -103,8 +104,8 @@ private:
     };
 
     VkPhysicalDevice                    _physicalDevice;
-    VkPhysicalDeviceProperties          _physicalDeviceProperties;
     VkDevice                            _device;
+    MemoryAllocator*                    _memoryAllocator;
 
     VertexAttributesDescription         _attributesDescription;
     std::vector<VertexBufferInfo>       _vertexBufferInfos;
@@ -114,15 +115,16 @@ private:
     const Pipeline*                     _pipeline;
 
     std::vector<VkBuffer>               _vertexAttributeBuffers;
-    std::vector<VkDeviceMemory>         _vertexBufferMemories;
+    std::vector<VkDeviceSize>           _vertexBufferOffsets;   // all zero, for binding _vertexAttributeBuffers
+    std::vector<MemoryAllocation>       _vertexBufferAllocations;
     VkBuffer                            _indexBuffer;
-    VkDeviceMemory                      _indexBufferMemory;
-    std::vector<DescriptorSetHandle>    _descriptorSets;
+    MemoryAllocation                    _indexBufferAllocation;
+    GeometryPool*                       _geometryPool;
+    uint32_t                            _geometryRange;
+    uint64_t                            _uploadBatch;
 
-    // TODO store actual uniform buffers elsewhere (use dynamic uniforms)
-    static std::vector<VkBuffer>        _uniformBuffers;
-    static std::vector<VkDeviceMemory>  _uniformBuffersMemory;
-    static std::vector<void*>           _uniformBuffersMapped;
+    // Destroy the buffers of a mesh uploaded without a geometry pool
+    void destroyBuffers();
 };
 
 
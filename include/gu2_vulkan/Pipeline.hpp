@@ -28,8 +28,21 @@ class Scene;
 class VulkanSettings;
 
 
+// Value of a specialization constant, the 32-bit bool, int, uint and float constants are supported (floats and ints
+// are passed as their bit patterns, bools as 0 or 1)
+struct SpecializationConstant {
+    uint32_t    constantId;
+    uint32_t    value;
+
+    friend bool operator==(const SpecializationConstant&, const SpecializationConstant&) = default;
+};
+
+using SpecializationConstants = std::vector<SpecializationConstant>;
+
+
 struct PipelineSettings {
     VkDevice                                device                      {nullptr};
+    VkPipelineCache                         pipelineCache               {nullptr};
 
     // Renderer info
     VkRenderPass                            renderPass                  {nullptr};
@@ -39,6 +52,8 @@ struct PipelineSettings {
     // Shader modules
     VkShaderModule                          vertShaderModule            {nullptr};
     VkShaderModule                          fragShaderModule            {nullptr};
+    SpecializationConstants                 vertSpecializationConstants;
+    SpecializationConstants                 fragSpecializationConstants;
 
     // Mesh / Material configuration
     VkPipelineVertexInputStateCreateInfo    vertexInputInfo;
@@ -49,6 +64,8 @@ struct PipelineSettings {
 class Pipeline {
 public:
     Pipeline(PipelineSettings settings = PipelineSettings());
+    // Created with creationCache instead of settings.pipelineCache, e.g. a thread cache merged into it afterwards
+    Pipeline(PipelineSettings settings, VkPipelineCache creationCache);
     Pipeline(const Pipeline& pipeline) = delete;
     Pipeline(Pipeline&& pipeline) = default;
     Pipeline& operator=(const Pipeline& pipeline) = delete;
@@ -65,7 +82,7 @@ private:
     VkPipelineLayout    _pipelineLayout;
     VkPipeline          _graphicsPipeline;
 
-    void createGraphicsPipeline();
+    void createGraphicsPipeline(VkPipelineCache pipelineCache);
 };
 
 
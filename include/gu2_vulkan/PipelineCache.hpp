@@ -0,0 +1,84 @@
+//
+// Project: GraphicsUtils2
+// File: PipelineCache.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "gu2_util/Typedef.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+
+namespace gu2 {
+
+
+struct PipelineCacheSettings {
+    VkPhysicalDevice    physicalDevice  {nullptr};
+    VkDevice            device          {nullptr};
+    Path                filename;       // empty for a cache not persisted to disk
+};
+
+
+// VkPipelineCache loaded from and saved to a file. The file is only used in case it was written with the same
+// vendor, device, driver version and pipeline cache UUID, otherwise the cache starts out empty. The cache can be
+// shared by several PipelineManagers and used by multiple threads at once. Threads creating lots of pipelines can
+// avoid the contention by using caches of their own, created with createThreadCache() and merged back afterwards.
+// Merging needs the cache externally synchronized, pipeline creation with the cache has to hold lockShared().
+class PipelineCache {
+public:
+    PipelineCache(PipelineCacheSettings settings);
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache(PipelineCache&&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+    PipelineCache& operator=(PipelineCache&&) = delete;
+    ~PipelineCache();
+
+    inline VkPipelineCache getPipelineCache() const noexcept { return _pipelineCache; }
+    // Whether the cache was initialized with the data of the file
+    inline bool isLoaded() const noexcept { return _loaded; }
+
+    // Shared lock for creating pipelines with the cache, excludes merging into it
+    inline std::shared_lock<std::shared_mutex> lockShared() { return std::shared_lock<std::shared_mutex>(_mutex); }
+
+    VkPipelineCache createThreadCache() const;
+    // Merge the thread caches into this cache and destroy them, waits for the pipeline creations holding the lock
+    void mergeThreadCaches(const std::vector<VkPipelineCache>& threadCaches);
+
+    // Write the cache to the file of the settings, pipelines may be created with the cache meanwhile
+    void save();
+
+private:
+    struct FileHeader {
+        uint32_t    magic;
+        uint32_t    version;
+        uint32_t    vendorID;
+        uint32_t    deviceID;
+        uint32_t    driverVersion;
+        uint8_t     pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t    dataSize;
+    };
+
+    PipelineCacheSettings       _settings;
+    VkPhysicalDeviceProperties  _properties;
+    VkPipelineCache             _pipelineCache;
+    bool                        _loaded;
+    std::shared_mutex           _mutex;     // exclusive for merging, shared for the other uses of the cache
+    std::mutex                  _saveMutex; // concurrent saves would write the same temporary file
+
+    std::vector<char> readFile() const;
+    FileHeader makeFileHeader(uint64_t dataSize) const;
+};
+
+
+} // namespace gu2
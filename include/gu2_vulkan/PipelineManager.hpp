@@ -14,50 +14,82 @@
 #include "Pipeline.hpp"
 #include "Descriptor.hpp"
 
+#include <memory>
 #include <unordered_map>
 
 
-struct pair_hash { // TODO remove
-    template <class T1, class T2>
-    std::size_t operator () (const std::pair<T1,T2> &p) const {
-        auto h1 = std::hash<T1>{}(p.first);
-        auto h2 = std::hash<T2>{}(p.second);
-
-        // Mainly for demonstration purposes, i.e. works but is overly simple
-        // In the real world, use sth. like boost.hash_combine
-        return h1 ^ h2;
-    }
-};
-
-
 namespace gu2 {
 
 
+class PipelineCache;
 class Shader;
 
 
 class PipelineManager {
 public:
+    // Pipelines are created with pipelineCache in case one is given, it may be shared by several managers
+    explicit PipelineManager(PipelineCache* pipelineCache = nullptr);
+
     void setDefaultPipelineSettings(const PipelineSettings& defaultPipelineSettings);
 
+    // Pipelines are identified by the shaders and the specialization constants, so variants of a shader specialized
+    // with different constant values share the shader module but get pipelines of their own
     Pipeline* getPipeline(
         const Shader* vertexShader,
         const Shader* fragmentShader,
         const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts,
-        const VkPipelineVertexInputStateCreateInfo& vertexInputInfo
+        const VkPipelineVertexInputStateCreateInfo& vertexInputInfo,
+        const SpecializationConstants& vertSpecializationConstants = {},
+        const SpecializationConstants& fragSpecializationConstants = {}
     );
 
     Pipeline* getPipeline(
         PipelineSettings pipelineSettings,
         const Shader* vertexShader,
         const Shader* fragmentShader,
-        const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts
+        const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts,
+        const SpecializationConstants& vertSpecializationConstants = {},
+        const SpecializationConstants& fragSpecializationConstants = {}
     );
 
+    struct PipelineRequest {
+        const Shader*                           vertexShader;
+        const Shader*                           fragmentShader;
+        std::vector<DescriptorSetLayoutHandle>  descriptorSetLayouts;
+        VkPipelineVertexInputStateCreateInfo    vertexInputInfo;
+        SpecializationConstants                 vertSpecializationConstants;
+        SpecializationConstants                 fragSpecializationConstants;
+    };
+
+    // Pipelines of several requests (with the default settings), the missing ones are created in parallel. Each
+    // thread creates its pipelines with a cache of its own, the thread caches are merged into the pipeline cache
+    // afterwards. Returns the pipelines in the order of the requests.
+    std::vector<Pipeline*> getPipelines(const std::vector<PipelineRequest>& requests);
+
 private:
-    using PipelineStorage = std::unordered_map<std::pair<const Shader*, const Shader*>, Pipeline, pair_hash>;
+    struct PipelineKey {
+        const Shader*           vertexShader;
+        const Shader*           fragmentShader;
+        SpecializationConstants vertSpecializationConstants;
+        SpecializationConstants fragSpecializationConstants;
+
+        friend bool operator==(const PipelineKey&, const PipelineKey&) = default;
+    };
+
+    struct PipelineKeyHash {
+        size_t operator()(const PipelineKey& key) const noexcept;
+    };
+
+    using PipelineStorage = std::unordered_map<PipelineKey, std::unique_ptr<Pipeline>, PipelineKeyHash>;
+    PipelineCache*      _pipelineCache;
     PipelineStorage     _pipelines;
     PipelineSettings    _defaultPipelineSettings;
+
+    Pipeline* createPipeline(PipelineKey&& key, PipelineSettings&& pipelineSettings);
+    PipelineSettings makePipelineSettings(
+        PipelineSettings pipelineSettings,
+        const PipelineKey& key,
+        const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts) const;
 };
 
 
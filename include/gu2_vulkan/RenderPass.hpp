@@ -78,9 +78,16 @@ protected:
 
     static AttachmentType getAttachmentType(const AttachmentHandle& attachment);
 
+    // Begin a secondary command buffer continuing the active render pass instance, sets the viewport and the
+    // scissor. For derived passes recording with _subpassContents set to secondary command buffers.
+    void beginSecondaryCommandBuffer(VkCommandBuffer commandBuffer) const;
+    void setViewportAndScissor(VkCommandBuffer commandBuffer) const;
+
     RenderPassSettings          _settings;
     bool                        _addLayoutTransitionDependency;
+    VkSubpassContents           _subpassContents;
     VkCommandBuffer             _commandBuffer; // active command buffer
+    VkFramebuffer               _framebuffer;   // framebuffer of the active render pass instance
     uint64_t                    _currentFrame;
     VkRenderPass                _renderPass;
     InputAttachmentStorage      _inputAttachments;
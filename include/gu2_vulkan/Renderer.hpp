@@ -12,12 +12,16 @@
 
 #include "backend.hpp"
 #include "CompositePass.hpp"
+#include "FrameAllocator.hpp"
 #include "GeometryPass.hpp"
+#include "GpuCulling.hpp"
 #include "Texture.hpp"
+#include "UploadContext.hpp"
 #include "gu2_util/MathTypes.hpp"
 
 #include <vulkan/vulkan.h>
 
+#include <memory>
 #include <vector>
 
 
@@ -40,6 +44,16 @@ struct RendererSettings {
     WindowObject*           window              {nullptr};
     DescriptorManager*      descriptorManager   {nullptr};
     PipelineManager*        pipelineManager     {nullptr};
+    MemoryAllocator*        memoryAllocator     {nullptr};  // nullptr for a VkDeviceMemory per resource
+    bool                    gpuCulling          {false};    // device needs the features of GpuCulling::isSupported
+    VkQueue                 transferQueue       {nullptr};  // queue of findQueueFamilies().transferFamily, optional
+    bool                    timelineSemaphore   {false};    // device has the timelineSemaphore feature enabled,
+                                                            // required by transferQueue
+    bool                    multiDrawIndirect   {false};    // device has the multiDrawIndirect and
+                                                            // drawIndirectFirstInstance features enabled
+    uint32_t                maxInstances        {1u << 16}; // capacity of the per-frame instance transforms
+    uint32_t                recordingThreads    {0};        // threads recording the geometry pass draws, 0 to
+                                                            // record on the calling thread
 };
 
 
@@ -66,14 +80,18 @@ public:
     bool render(const Scene& scene, VkQueue presentQueue);
 
     inline VkCommandPool getCommandPool() const noexcept { return _commandPool; }
+    // Uploads recorded to the upload context are submitted before the next frame
+    inline UploadContext* getUploadContext() const noexcept { return _uploadContext.get(); }
+    // Per-frame host written data, reset once the frame slot has been waited for in render()
+    inline FrameAllocator* getFrameAllocator() noexcept { return &_frameAllocator; }
     inline uint64_t getCurrentFrame() const noexcept { return _currentFrame; }
     inline const RenderPass& getGeometryRenderPass() const noexcept { return _geometryPass; }
+    inline const CullingStats& getCullingStats() const noexcept { return _geometryPass.getCullingStats(); }
+    inline const RenderStats& getRenderStats() const noexcept { return _geometryPass.getRenderStats(); }
     inline VkExtent2D getSwapChainExtent() const noexcept { return _swapChainExtent; }
 
     void framebufferResized();
 
-    friend class Mesh; // TODO remove
-
 private:
     // Helper struct for wrapping all the stuff that needs to be replicated for each swapchain image
     struct SwapChainData {
@@ -83,6 +101,8 @@ private:
     // Layout transition for G-buffer images
     static void transitionGBufferImageToAttachment(const Texture& image, VkCommandBuffer commandBuffer);
     static void transitionGBufferImageToRead(const Texture& image, VkCommandBuffer commandBuffer);
+    // Layout transition for sampling the depth in the depth pyramid construction
+    static void transitionDepthImageToRead(const Texture& image, VkCommandBuffer commandBuffer);
 
     RendererSettings                _settings;
     VkPhysicalDeviceProperties      _physicalDeviceProperties;
@@ -98,6 +118,7 @@ private:
     VkExtent2D                      _swapChainExtent;
     std::vector<SwapChainData>      _swapChainObjects;
     VkCommandPool                   _commandPool;
+    std::unique_ptr<UploadContext>  _uploadContext;
     std::vector<VkCommandBuffer>    _commandBuffers;
     std::vector<VkSemaphore>        _imageAvailableSemaphores;
     std::vector<VkSemaphore>        _renderFinishedSemaphores;
@@ -105,8 +126,10 @@ private:
     bool                            _framebufferResized;
     uint64_t                        _currentFrame;
 
+    FrameAllocator                  _frameAllocator;
     GeometryPass                    _geometryPass;
     CompositePass                   _compositePass;
+    std::unique_ptr<GpuCulling>     _gpuCulling;    // nullptr in case the nodes are culled on the CPU
 };
 
 
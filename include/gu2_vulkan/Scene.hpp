@@ -10,8 +10,12 @@
 
 #pragma once
 
+#include "gu2_util/BVH.hpp"
+#include "gu2_util/FrustumCulling.hpp"
 #include "gu2_util/MathTypes.hpp"
 #include "gu2_util/GLTFLoader.hpp"
+#include "gu2_util/OcclusionCulling.hpp"
+#include "gu2_util/TransformHierarchy.hpp"
 
 #include <vector>
 
@@ -19,26 +23,111 @@
 namespace gu2 {
 
 
+class BakedScene;
 class Mesh;
 
 
 struct Scene {
+    static constexpr uint32_t   noOccluder  {0xffffffff};
+
     struct Node {
-        Mat4f   transformation;
-        Mesh*   mesh;
+        Mat4f           transformation; // world matrix of the transform node, refreshed by updateTransforms()
+        uint32_t        transform;      // node in transforms
+        Mesh*           mesh;
+        uint32_t        firstLod;       // index of the full resolution LOD in lods
+        uint32_t        nLods;
+        AABB            localBounds;    // model space bounds of the mesh
+        AABB            worldBounds;
+        BoundingSphere  worldSphere;
+        uint32_t        instanceGroup;  // index to instanceGroups
+        uint32_t        occluder        {noOccluder};   // index to occluders
+    };
+
+    // Range of the mesh indices to draw, ordered from the finest to the coarsest
+    struct Lod {
+        uint32_t        firstIndex;
+        uint32_t        nIndices;
+        float           error;          // model space simplification error
+    };
+
+    // Nodes sharing a mesh (and thus the material), drawn with a single instanced draw per LOD
+    struct InstanceGroup {
+        Mesh*           mesh;
+        uint32_t        firstNode;      // index to instanceGroupNodes
+        uint32_t        nNodes;
+    };
+
+    // Low polygon stand-in of a mesh rasterized in CPU occlusion culling
+    struct Occluder {
+        std::vector<Vec3f>      positions;
+        std::vector<uint32_t>   indices;
+    };
+
+    struct Camera {
+        Mat4f           view            {Mat4f::Identity()};
+        Mat4f           projection      {Mat4f::Identity()};
+        float           viewportHeight  {1.0f};     // in pixels
+
+        Vec3f getPosition() const;
     };
 
     std::vector<Node>   nodes;
+    std::vector<Lod>    lods;
+    TransformHierarchy  transforms;     // glTF node hierarchy, several nodes may share a transform node
+    std::vector<InstanceGroup>  instanceGroups;
+    std::vector<uint32_t>       instanceGroupNodes; // node ids grouped by mesh
+    BVH                 bvh;            // over the world bounds of nodes, item ids are node indices
+    BoundingSpheres     nodeSpheres;    // world spheres of nodes in SoA layout for culling
+    Camera              camera;
+    float               maxLodError     {1.0f};     // screen space error allowed in LOD selection, in pixels
+    std::vector<Occluder>       occluders;
+    uint32_t            maxOccluders    {32};       // nodes rasterized per frame, 0 disables occlusion culling
+    float               minOccluderSize {0.1f};     // bounding sphere radius per distance to the camera
+    // Incremented by createInstanceGroups(). Increment it after changing the meshes, materials or pipelines of the
+    // nodes, the render passes rebuild the state derived from them (draw sort keys) once it changes.
+    uint64_t            revision        {0};
+    // Incremented by updateTransforms() once world matrices have changed, changedNodes holds the ids of the nodes
+    // changed by the last increment
+    uint64_t            transformRevision   {0};
+    std::vector<uint32_t>       changedNodes;
 
     void createFromGLFT(const GLTFLoader& gltfLoader, std::vector<Mesh>& meshes);
+    // Rebuilds the baked node hierarchy, meshes are indexed with the baked primitive ids
+    void createFromBakedScene(const BakedScene& bakedScene, std::vector<Mesh>& meshes);
+
+    // Propagate local transformation changes made via transforms to the world matrices and bounds of the
+    // affected nodes, only the changed subtrees are visited
+    void updateTransforms();
+
+    // Group the nodes by mesh, called by the create functions
+    void createInstanceGroups();
+
+    // Recompute world bounds of all nodes and rebuild the BVH, called by the create functions
+    void updateBounds();
+    // Recompute world bounds of nodes whose transformation has changed and refit the BVH incrementally
+    void updateBounds(const std::vector<uint32_t>& changedNodes);
+
+    // Write ids of the nodes intersecting the camera view frustum to visibleNodes, in increasing order
+    void cull(std::vector<uint32_t>* visibleNodes, CullingStats* stats = nullptr) const;
+
+    // Rasterize the largest visible occluders and remove the nodes hidden behind them from visibleNodes
+    void cullOccluded(OcclusionBuffer& buffer, std::vector<uint32_t>* visibleNodes, CullingStats* stats = nullptr)
+        const;
+
+    // Coarsest LOD of the node with projected error not exceeding maxLodError, returns an index to lods
+    uint32_t selectLod(const Node& node, const Vec3f& cameraPosition) const;
 
 private:
     void createNodes(
-        Mat4d transformation,
+        uint32_t parentTransform,
         const GLTFLoader::Node& gltfNode,
         const std::vector<GLTFLoader::Node>& gltfNodes,
         const std::vector<GLTFLoader::Mesh>& gltfMeshes,
+        const GLTFLoader& gltfLoader,
         std::vector<Mesh>& meshes);
+    // nodePrimitives: baked primitive of each node
+    void createOccluders(const BakedScene& bakedScene, const std::vector<uint32_t>& nodePrimitives);
+    void updateNodeBounds(uint32_t nodeId);
 };
 
 
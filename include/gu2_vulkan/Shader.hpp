@@ -22,13 +22,17 @@
 namespace gu2 {
 
 
+class SpirvCache;
+
+
 using ShaderType = shaderc_shader_kind;
 using SpirvByteCode = std::vector<uint32_t>;
 
 
 class Shader {
 public:
-    Shader(VkDevice device = nullptr);
+    // The SPIR-V compiled by loadFromFile is looked up from and stored to spirvCache, in case one is given
+    Shader(VkDevice device = nullptr, SpirvCache* spirvCache = nullptr);
     Shader(const Shader&) = delete;
     Shader(Shader&&);
     Shader& operator=(const Shader&) = delete;
@@ -37,6 +41,9 @@ public:
 
     void addMacroDefinition(const std::string& name, const std::string& value);
 
+    // Compile GLSL source, #includes are resolved relative to the including file. With a SPIR-V cache the compiler
+    // is only invoked in case the cache has no SPIR-V for the source, the macro definitions, the type, the
+    // optimization and the compiler version, or in case one of the files included has changed.
     void loadFromFile(
         const Path& filename,
         ShaderType type = shaderc_glsl_infer_from_source,
@@ -46,8 +53,11 @@ public:
     inline const std::vector<SpvReflectInterfaceVariable*>& getInputVariables() const noexcept;
     inline const std::vector<SpvReflectDescriptorBinding*>& getDescriptorBindings() const noexcept;
     inline const std::vector<DescriptorSetLayoutInfo>& getDescriptorSetLayouts() const noexcept;
+    inline const std::vector<SpvReflectSpecializationConstant*>& getSpecializationConstants() const noexcept;
 
     int64_t getInputVariableLayoutLocation(const std::string& inputVariableName) const noexcept;
+    // Returns the constant_id of a specialization constant declared in the shader, -1 in case there's no such constant
+    int64_t getSpecializationConstantId(const std::string& specializationConstantName) const noexcept;
 
     VkShaderModule getShaderModule() const noexcept;
 
@@ -57,18 +67,22 @@ private:
     using MacroDefinitionList = std::vector<std::pair<std::string, std::string>>; // TODO tidy up (use struct instead of pair)
 
     VkDevice            _device;
+    SpirvCache*         _spirvCache;
     MacroDefinitionList _macroDefinitions;
     Path                _filename;
     SpirvByteCode       _spirv; // SPIR-V bytecode
     VkShaderModule      _shaderModule;
 
     // SPIR-V reflection data
-    SpvReflectShaderModule                      _reflectionModule;
-    std::vector<SpvReflectInterfaceVariable*>   _inputVariables;
-    std::vector<SpvReflectDescriptorBinding*>   _descriptorBindings;
-    std::vector<SpvReflectDescriptorSet*>       _descriptorSets;
-    std::vector<DescriptorSetLayoutInfo>        _descriptorSetLayouts;
-
+    SpvReflectShaderModule                           _reflectionModule;
+    std::vector<SpvReflectInterfaceVariable*>        _inputVariables;
+    std::vector<SpvReflectDescriptorBinding*>        _descriptorBindings;
+    std::vector<SpvReflectDescriptorSet*>            _descriptorSets;
+    std::vector<DescriptorSetLayoutInfo>             _descriptorSetLayouts;
+    std::vector<SpvReflectSpecializationConstant*>   _specializationConstants;
+
+    uint64_t computeCacheKey(const Path& filename, const std::vector<char>& source, ShaderType type,
+        bool optimize) const;
     void parseSpirvReflection();
 };
 
@@ -93,5 +107,10 @@ const std::vector<DescriptorSetLayoutInfo>& Shader::getDescriptorSetLayouts() co
     return _descriptorSetLayouts;
 }
 
+const std::vector<SpvReflectSpecializationConstant*>& Shader::getSpecializationConstants() const noexcept
+{
+    return _specializationConstants;
+}
+
 
 } // namespace gu2
@@ -0,0 +1,85 @@
+//
+// Project: GraphicsUtils2
+// File: ShaderCompiler.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "Shader.hpp"
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace gu2 {
+
+
+class SpirvCache;
+
+
+struct ShaderCompilerSettings {
+    VkDevice    device      {nullptr};
+    SpirvCache* spirvCache  {nullptr};  // optional, passed to the shaders compiled
+};
+
+struct ShaderCompileRequest {
+    Path                                                filename;
+    std::vector<std::pair<std::string, std::string>>    macroDefinitions;   // name, value
+    ShaderType                                          type        {shaderc_glsl_infer_from_source};
+    bool                                                optimize    {false};
+};
+
+// Compiled shader, owned by the ShaderCompiler. Compilation errors are rethrown by get().
+using ShaderFuture = std::shared_future<const Shader*>;
+
+
+// Compiles batches of shader variants in the background. Each batch is compiled on a thread of its own, which
+// distributes the variants of the batch over an OpenMP team. Identical requests, also the ones in different
+// batches, are compiled once and share the shader. The shaders live as long as the compiler.
+class ShaderCompiler {
+public:
+    ShaderCompiler(ShaderCompilerSettings settings);
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler(ShaderCompiler&&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(ShaderCompiler&&) = delete;
+    // Waits for the batches in flight
+    ~ShaderCompiler();
+
+    // Start compiling a batch, returns the futures in the order of the requests
+    std::vector<ShaderFuture> compile(const std::vector<ShaderCompileRequest>& requests);
+    // Wait for all the batches started so far
+    void wait();
+
+private:
+    struct Variant {
+        ShaderCompileRequest            request;
+        std::unique_ptr<Shader>         shader;
+        std::promise<const Shader*>     promise;
+    };
+
+    ShaderCompilerSettings                          _settings;
+    std::mutex                                      _mutex;
+    std::deque<Variant>                             _variants;  // stable addresses for the batch threads
+    std::unordered_map<std::string, ShaderFuture>   _variantFutures;
+    std::vector<std::thread>                        _batchThreads;
+
+    static std::string makeVariantKey(const ShaderCompileRequest& request);
+    static void compileBatch(const std::vector<Variant*>& batch);
+};
+
+
+} // namespace gu2
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include "MemoryAllocator.hpp"
 #include "Util.hpp"
 #include "gu2_util/Typedef.hpp"
 
@@ -21,11 +22,13 @@ namespace gu2 {
 
 template <typename T_Data>
 class Image;
+class UploadContext;
 
 
 struct TextureSettings {
     VkPhysicalDevice    physicalDevice  {nullptr};
     VkDevice            device          {nullptr};
+    MemoryAllocator*    memoryAllocator {nullptr};  // nullptr for a VkDeviceMemory per image
 };
 
 
@@ -50,9 +53,15 @@ public:
     ~Texture();
 
     void create(TextureProperties properties);
-    void createFromFile(VkCommandPool commandPool, VkQueue queue, const Path& filename);
+    // The uploads are recorded to the current batch of the upload context, the texture can be sampled by the
+    // submissions made after the batch has been submitted. With a transfer queue the texture can be sampled once
+    // the batch is complete (see getUploadBatch()). Can be called from multiple threads for different textures.
+    void createFromFile(UploadContext* uploadContext, const Path& filename);
     template<class T_Data>
-    void createFromImage(VkCommandPool commandPool, VkQueue queue, const Image<T_Data>& image);
+    void createFromImage(UploadContext* uploadContext, const Image<T_Data>& image);
+    // Create from RGBA8 data with precomputed mip levels stored consecutively starting from the base level
+    void createFromMipChain(UploadContext* uploadContext, uint32_t width, uint32_t height, uint32_t mipLevels,
+        const uint8_t* data);
     void createTextureImageView();
     void createTextureSampler();
 
@@ -60,6 +69,8 @@ public:
     inline VkImage getImage() const noexcept { return _image; }
     inline VkImageView getImageView() const noexcept { return _imageView; }
     inline VkSampler getSampler() const noexcept { return _sampler; }
+    // Id of the upload context batch of the latest upload, 0 in case there has been none
+    inline uint64_t getUploadBatch() const noexcept { return _uploadBatch; }
 
 private:
     // TODO Subject to relocation
@@ -68,10 +79,11 @@ private:
     TextureProperties           _properties;
 
     VkImage                     _image;
-    VkDeviceMemory              _imageMemory;
+    MemoryAllocation            _imageAllocation;
     VkImageView                 _imageView;
     uint32_t                    _imageMipLevels;
     VkSampler                   _sampler;
+    uint64_t                    _uploadBatch;
 };
 
 
@@ -0,0 +1,172 @@
+//
+// Project: GraphicsUtils2
+// File: UploadContext.hpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#pragma once
+
+
+#include "MemoryAllocator.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+namespace gu2 {
+
+
+struct UploadContextSettings {
+    VkPhysicalDevice    physicalDevice              {nullptr};
+    VkDevice            device                      {nullptr};
+    MemoryAllocator*    memoryAllocator             {nullptr};  // nullptr for a VkDeviceMemory per resource
+    uint32_t            queueFamilyIndex            {0};        // graphics queue family
+    VkQueue             queue                       {nullptr};  // graphics queue
+    // Dedicated transfer queue, the uploads are run on it asynchronously in case it is set. Requires timeline
+    // semaphores.
+    uint32_t            transferQueueFamilyIndex    {0};
+    VkQueue             transferQueue               {nullptr};
+    bool                timelineSemaphore           {false};    // device has the timelineSemaphore feature enabled
+    VkDeviceSize        stagingSize                 {64 << 20}; // size of the staging ring buffer
+};
+
+
+// Batches transfers to device local resources. Data is copied to a persistently mapped staging ring buffer and the
+// commands reading it are recorded to a shared command buffer, which is submitted as a batch without waiting for the
+// queue to be idle. The staging memory of a batch is reused once its fence has been signaled. Uploads larger than
+// the ring get a staging buffer of their own. Thread safe.
+//
+// Without a transfer queue the batches are submitted to the graphics queue, and a memory barrier at the end of each
+// batch makes the transfer writes visible to any later submission to it. With a transfer queue the resources are
+// released to the graphics queue family at the end of the transfer batch. Once the transfer has completed, the
+// matching acquire barriers (and the commands deferred with recordOnGraphicsQueue) are submitted to the graphics
+// queue, ordering them before any later graphics submission.
+//
+// submit(), wait() and flush() may submit to the graphics queue, so they need to be externally synchronized with
+// the other submissions to it. Without a transfer queue the same holds for record() as the batch gets submitted in
+// case the staging ring is full.
+class UploadContext {
+public:
+    // Staging memory of a record() call, the commands recorded read it at buffer and offset
+    struct Staging {
+        VkBuffer        buffer;
+        VkDeviceSize    offset;
+        void*           data;
+    };
+
+    using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, const Staging& staging)>;
+    using GraphicsFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+    UploadContext(UploadContextSettings settings);
+    UploadContext(const UploadContext&) = delete;
+    UploadContext(UploadContext&&) = delete;
+    UploadContext& operator=(const UploadContext&) = delete;
+    UploadContext& operator=(UploadContext&&) = delete;
+    ~UploadContext();
+
+    // Check whether the timelineSemaphore feature is available (requires Vulkan 1.2)
+    static bool isTimelineSemaphoreSupported(VkPhysicalDevice physicalDevice);
+
+    // Reserve stagingSize bytes of staging memory and call recordFunction to fill it and to record the commands
+    // using it to the current batch. Both happen under the same lock, so other threads cannot submit the batch in
+    // between. Returns the id of the batch the commands were recorded to.
+    uint64_t record(VkDeviceSize stagingSize, const RecordFunction& recordFunction, VkDeviceSize alignment = 16);
+    // Record commands without staging memory
+    uint64_t record(const std::function<void(VkCommandBuffer commandBuffer)>& recordFunction);
+    // Upload data to a buffer and release it to the graphics queue family, the destination range needs to be unused
+    // by the pending batches
+    uint64_t copyToBuffer(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset = 0);
+
+    // The functions below are to be called from inside a record function with its command buffer. Release a
+    // resource written by the batch to the graphics queue family, no-op for buffers without a transfer queue.
+    void releaseBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+    // Color images only, the layout transition is done as a part of the ownership transfer
+    void releaseImage(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout,
+        uint32_t mipLevels);
+    // Record commands requiring the graphics queue (blits, or copies of resources owned by the graphics queue family)
+    // after the acquires of the batch. Called immediately without a transfer queue, otherwise called once the
+    // transfer has completed, references captured need to stay valid until then (until flush() for instance).
+    void recordOnGraphicsQueue(VkCommandBuffer commandBuffer, GraphicsFunction graphicsFunction);
+
+    // Submit the current batch in case it contains commands and submit the acquires of the completed transfers,
+    // returns the id of the last submitted batch (0 in case nothing has been submitted). Does not wait.
+    uint64_t submit();
+    // Wait for a batch to complete, the batch is submitted first in case it is still being recorded
+    void wait(uint64_t batchId);
+    // Submit the current batch and wait for all batches to complete
+    void flush();
+    // Whether the commands of a batch (including the acquires) have been executed
+    bool isComplete(uint64_t batchId);
+
+    inline bool hasTransferQueue() const noexcept { return _settings.transferQueue != nullptr; }
+    // Timeline semaphore reaching the id of a batch as its commands (including the acquires) have been executed.
+    // VK_NULL_HANDLE without the timeline semaphore support.
+    inline VkSemaphore getSemaphore() const noexcept { return _semaphore; }
+
+private:
+    struct Batch {
+        VkCommandBuffer                     commandBuffer   {VK_NULL_HANDLE};
+        VkFence                             fence           {VK_NULL_HANDLE};
+        uint64_t                            id              {0};
+        bool                                empty           {true}; // no commands recorded
+        VkDeviceSize                        stagingBytes    {0};    // ring bytes used, including the padding
+        std::vector<VkBuffer>               dedicatedBuffers;       // staging buffers of uploads larger than the ring
+        std::vector<MemoryAllocation>       dedicatedAllocations;
+        // Graphics queue side of a transfer batch
+        std::vector<VkBufferMemoryBarrier>  acquireBufferBarriers;
+        std::vector<VkImageMemoryBarrier>   acquireImageBarriers;
+        std::vector<GraphicsFunction>       graphicsFunctions;
+    };
+
+    // Acquire submission of a completed transfer batch, submitted to the graphics queue
+    struct Acquire {
+        VkCommandBuffer commandBuffer   {VK_NULL_HANDLE};   // allocated once there is something to acquire
+        VkFence         fence           {VK_NULL_HANDLE};
+        uint64_t        id              {0};
+    };
+
+    UploadContextSettings   _settings;
+    VkQueue                 _uploadQueue;           // transfer queue if available, graphics queue otherwise
+    VkCommandPool           _commandPool;           // for the upload queue
+    VkCommandPool           _graphicsCommandPool;   // for the acquires
+    VkSemaphore             _transferSemaphore;     // reaches the id of a batch as its transfer has been completed
+    VkSemaphore             _semaphore;
+    VkBuffer                _stagingBuffer;
+    MemoryAllocation        _stagingAllocation;
+    VkDeviceSize            _stagingHead;           // next free byte of the ring
+    VkDeviceSize            _stagingUsed;           // bytes held by the current batch and the batches in flight
+
+    std::mutex              _mutex;
+    Batch                   _currentBatch;
+    std::deque<Batch>       _pendingBatches;        // submitted, in submission order
+    std::vector<Batch>      _freeBatches;           // completed, command buffer and fence are reused
+    std::deque<Batch>       _transferredBatches;    // transfer completed, acquires yet to be submitted
+    std::deque<Acquire>     _pendingAcquires;       // submitted, in submission order
+    std::vector<Acquire>    _freeAcquires;
+    uint64_t                _nextBatchId;
+    uint64_t                _completedBatchId;      // all batches up to this one have completed
+
+    // The functions below expect _mutex to be locked
+    void beginBatch();
+    void submitBatch();
+    // Retire the completed batches from the front of the pending batches, waits for the first one in case wait is set
+    void retireBatches(bool wait);
+    void retireBatch(Batch* batch);
+    // Submit the acquires of the transferred batches to the graphics queue
+    void submitAcquires();
+    void retireAcquires(bool wait);
+    void waitBatch(uint64_t batchId);
+    // Returns the ring offset of the allocation, waits for the pending batches in case the ring is full
+    VkDeviceSize allocateStaging(VkDeviceSize size, VkDeviceSize alignment);
+};
+
+
+} // namespace gu2
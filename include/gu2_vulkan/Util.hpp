@@ -27,6 +27,7 @@ namespace gu2 {
 struct VulkanQueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily; // dedicated transfer family (no graphics), optional
 
     bool isComplete()
     {
@@ -56,6 +57,18 @@ inline VulkanQueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSur
         ++i;
     }
 
+    // Dedicated transfer family, the ones without compute are more likely to map to the copy engines
+    i = 0;
+    for (const auto& queueFamily : queueFamilies) {
+        if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            if (!indices.transferFamily.has_value() || !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
+                indices.transferFamily = i;
+            if (!(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
+                break;
+        }
+        ++i;
+    }
+
     return indices;
 }
 
@@ -117,19 +130,16 @@ inline void copyBuffer(
     endSingleTimeCommands(device, commandPool, queue, commandBuffer);
 }
 
-inline void copyBufferToImage(
-    VkDevice device,
-    VkCommandPool commandPool,
-    VkQueue queue,
+inline void recordCopyBufferToImage(
+    VkCommandBuffer commandBuffer,
     VkBuffer buffer,
+    VkDeviceSize bufferOffset,
     VkImage image,
     uint32_t width,
     uint32_t height)
 {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
-
     VkBufferImageCopy region{};
-    region.bufferOffset = 0;
+    region.bufferOffset = bufferOffset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
 
@@ -153,7 +163,81 @@ inline void copyBufferToImage(
         1,
         &region
     );
+}
+
+inline void copyBufferToImage(
+    VkDevice device,
+    VkCommandPool commandPool,
+    VkQueue queue,
+    VkBuffer buffer,
+    VkImage image,
+    uint32_t width,
+    uint32_t height)
+{
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
+    gu2::recordCopyBufferToImage(commandBuffer, buffer, 0, image, width, height);
+    gu2::endSingleTimeCommands(device, commandPool, queue, commandBuffer);
+}
+
+// Copy a tightly packed mip chain (levels stored consecutively starting from the base level) to an image
+inline void recordCopyBufferToImageMipChain(
+    VkCommandBuffer commandBuffer,
+    VkBuffer buffer,
+    VkDeviceSize bufferOffset,
+    VkImage image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mipLevels,
+    uint32_t bytesPerPixel)
+{
+    std::vector<VkBufferImageCopy> regions(mipLevels);
+    for (uint32_t i = 0; i < mipLevels; ++i) {
+        auto& region = regions[i];
+        region = VkBufferImageCopy{};
+        region.bufferOffset = bufferOffset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {
+            width,
+            height,
+            1
+        };
+
+        bufferOffset += static_cast<VkDeviceSize>(width) * height * bytesPerPixel;
+        if (width > 1) width /= 2;
+        if (height > 1) height /= 2;
+    }
+
+    vkCmdCopyBufferToImage(
+        commandBuffer,
+        buffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<uint32_t>(regions.size()),
+        regions.data()
+    );
+}
 
+inline void copyBufferToImageMipChain(
+    VkDevice device,
+    VkCommandPool commandPool,
+    VkQueue queue,
+    VkBuffer buffer,
+    VkImage image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mipLevels,
+    uint32_t bytesPerPixel)
+{
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
+    gu2::recordCopyBufferToImageMipChain(commandBuffer, buffer, 0, image, width, height, mipLevels, bytesPerPixel);
     gu2::endSingleTimeCommands(device, commandPool, queue, commandBuffer);
 }
 
@@ -286,18 +370,14 @@ inline bool hasStencilComponent(VkFormat format)
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-inline void transitionImageLayout(
-    VkDevice device,
-    VkCommandPool commandPool,
-    VkQueue queue,
+inline void recordTransitionImageLayout(
+    VkCommandBuffer commandBuffer,
     VkImage image,
     VkFormat format,
     VkImageLayout oldLayout,
     VkImageLayout newLayout,
     uint32_t mipLevels)
 {
-    VkCommandBuffer commandBuffer = gu2::beginSingleTimeCommands(device, commandPool);
-
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = oldLayout;
@@ -361,16 +441,29 @@ inline void transitionImageLayout(
         0, nullptr,
         1, &barrier
     );
-
-    gu2::endSingleTimeCommands(device, commandPool, queue, commandBuffer);
 }
 
-inline void generateMipmaps(
-    VkPhysicalDevice physicalDevice,
+inline void transitionImageLayout(
     VkDevice device,
     VkCommandPool commandPool,
     VkQueue queue,
     VkImage image,
+    VkFormat format,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    uint32_t mipLevels)
+{
+    VkCommandBuffer commandBuffer = gu2::beginSingleTimeCommands(device, commandPool);
+    gu2::recordTransitionImageLayout(commandBuffer, image, format, oldLayout, newLayout, mipLevels);
+    gu2::endSingleTimeCommands(device, commandPool, queue, commandBuffer);
+}
+
+// Blit the mip levels from the base level, the image needs to be in TRANSFER_DST_OPTIMAL layout and is left in
+// SHADER_READ_ONLY_OPTIMAL layout
+inline void recordGenerateMipmaps(
+    VkPhysicalDevice physicalDevice,
+    VkCommandBuffer commandBuffer,
+    VkImage image,
     VkFormat imageFormat,
     int32_t texWidth,
     int32_t texHeight,
@@ -383,8 +476,6 @@ inline void generateMipmaps(
         throw std::runtime_error("Texture image format does not support linear blitting!");
     }
 
-    VkCommandBuffer commandBuffer = gu2::beginSingleTimeCommands(device, commandPool);
-
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image = image;
@@ -457,19 +548,22 @@ inline void generateMipmaps(
         0, nullptr,
         0, nullptr,
         1, &barrier);
-
-    gu2::endSingleTimeCommands(device, commandPool, queue, commandBuffer);
 }
 
-inline size_t padUniformBufferSize(VkPhysicalDeviceProperties physicalDeviceProperties, size_t originalSize)
+inline void generateMipmaps(
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkCommandPool commandPool,
+    VkQueue queue,
+    VkImage image,
+    VkFormat imageFormat,
+    int32_t texWidth,
+    int32_t texHeight,
+    uint32_t mipLevels)
 {
-    // Calculate required alignment based on minimum device offset alignment
-    size_t minUboAlignment = physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
-    size_t alignedSize = originalSize;
-    if (minUboAlignment > 0) {
-        alignedSize = (alignedSize + minUboAlignment - 1) & ~(minUboAlignment - 1);
-    }
-    return alignedSize;
+    VkCommandBuffer commandBuffer = gu2::beginSingleTimeCommands(device, commandPool);
+    gu2::recordGenerateMipmaps(physicalDevice, commandBuffer, image, imageFormat, texWidth, texHeight, mipLevels);
+    gu2::endSingleTimeCommands(device, commandPool, queue, commandBuffer);
 }
 
 inline VkFormat findSupportedFormat(
@@ -0,0 +1,31 @@
+#version 450
+#pragma shader_stage(compute)
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+
+// Depth buffer for the first level, the previous pyramid level for the rest
+layout(set = 0, binding = 0) uniform sampler2D inputDepth;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D outputDepth;
+
+
+void main() {
+    ivec2 outputSize = imageSize(outputDepth);
+    ivec2 position = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(position, outputSize)))
+        return;
+
+    // Input texels overlapping the output texel, up to 3x3 in case the input size is not a power of two
+    ivec2 inputSize = textureSize(inputDepth, 0);
+    ivec2 begin = (position * inputSize) / outputSize;
+    ivec2 end = max(((position + 1) * inputSize + outputSize - 1) / outputSize, begin + 1);
+
+    // Inverted depth, the minimum is the farthest
+    float depth = 1.0;
+    for (int y=begin.y; y<end.y; ++y) {
+        for (int x=begin.x; x<end.x; ++x)
+            depth = min(depth, texelFetch(inputDepth, ivec2(x, y), 0).x);
+    }
+
+    imageStore(outputDepth, position, vec4(depth));
+}
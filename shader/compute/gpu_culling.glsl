@@ -0,0 +1,144 @@
+#version 450
+#pragma shader_stage(compute)
+
+layout(local_size_x = 64) in;
+
+
+struct Node {
+    vec4    sphere;         // world space center and radius, negative radius for empty nodes
+    vec4    boundsMin;      // world space bounding box, w unused
+    vec4    boundsMax;
+    uint    drawGroup;
+    uint    firstLod;
+    uint    nLods;
+    float   maxScale;       // largest scale factor of the world matrix
+};
+
+struct Lod {
+    uint    firstIndex;     // geometry pool offsets included
+    uint    nIndices;
+    float   error;
+    int     vertexOffset;
+};
+
+struct DrawGroup {
+    uint    firstCommand;
+    uint    maxCommands;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint    indexCount;
+    uint    instanceCount;
+    uint    firstIndex;
+    int     vertexOffset;
+    uint    firstInstance;
+};
+
+layout(set = 0, binding = 0) readonly buffer CullingUniforms {
+    mat4    viewProjection;
+    vec4    planes[6];
+    vec4    cameraPosition;     // w: LOD error allowed per distance, divided by the node scale
+    uint    nNodes;
+    uint    occlusion;          // nonzero in case the depth pyramid is valid
+    float   pyramidWidth;
+    float   pyramidHeight;
+} uniforms;
+
+layout(set = 0, binding = 1) readonly buffer NodeBuffer {
+    Node    nodes[];
+};
+
+layout(set = 0, binding = 2) readonly buffer LodBuffer {
+    Lod     lods[];
+};
+
+layout(set = 0, binding = 3) readonly buffer DrawGroupBuffer {
+    DrawGroup   drawGroups[];
+};
+
+layout(set = 0, binding = 4) writeonly buffer DrawCommandBuffer {
+    DrawCommand commands[];
+};
+
+layout(set = 0, binding = 5) buffer DrawCountBuffer {
+    uint    counts[];
+};
+
+// Farthest depth (inverted, so minimum) of the previous frame, nearest filtering
+layout(set = 0, binding = 6) uniform sampler2D depthPyramid;
+
+
+bool isOccluded(vec3 boundsMin, vec3 boundsMax)
+{
+    vec2 rectMin = vec2(1.0);
+    vec2 rectMax = vec2(0.0);
+    float maxDepth = 0.0;
+    for (int i=0; i<8; ++i) {
+        vec3 corner = vec3(
+            (i & 1) != 0 ? boundsMax.x : boundsMin.x,
+            (i & 2) != 0 ? boundsMax.y : boundsMin.y,
+            (i & 4) != 0 ? boundsMax.z : boundsMin.z);
+        vec4 clip = uniforms.viewProjection * vec4(corner, 1.0);
+        // Boxes crossing the near plane are never occluded
+        if (clip.w <= 0.0 || clip.z > clip.w)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy*0.5 + 0.5;
+        rectMin = min(rectMin, uv);
+        rectMax = max(rectMax, uv);
+        maxDepth = max(maxDepth, ndc.z);
+    }
+    rectMin = clamp(rectMin, 0.0, 1.0);
+    rectMax = clamp(rectMax, 0.0, 1.0);
+
+    // The rectangle spans at most two texels on the selected level, so the four corners cover it
+    vec2 size = (rectMax - rectMin) * vec2(uniforms.pyramidWidth, uniforms.pyramidHeight);
+    float level = ceil(log2(max(max(size.x, size.y), 1.0)));
+    float depth = min(
+        min(textureLod(depthPyramid, vec2(rectMin.x, rectMin.y), level).x,
+            textureLod(depthPyramid, vec2(rectMax.x, rectMin.y), level).x),
+        min(textureLod(depthPyramid, vec2(rectMin.x, rectMax.y), level).x,
+            textureLod(depthPyramid, vec2(rectMax.x, rectMax.y), level).x));
+
+    return maxDepth < depth;
+}
+
+// Same criterion as Scene::selectLod
+uint selectLod(Node node)
+{
+    uint lodId = node.firstLod;
+    float distance = length(node.sphere.xyz - uniforms.cameraPosition.xyz) - node.sphere.w;
+    if (node.nLods <= 1 || node.sphere.w < 0.0 || distance <= 0.0)
+        return lodId;
+
+    float maxError = uniforms.cameraPosition.w * distance / node.maxScale;
+    for (uint i=1; i<node.nLods && lods[node.firstLod + i].error <= maxError; ++i)
+        lodId = node.firstLod + i;
+    return lodId;
+}
+
+
+void main() {
+    uint nodeId = gl_GlobalInvocationID.x;
+    if (nodeId >= uniforms.nNodes)
+        return;
+
+    Node node = nodes[nodeId];
+    bool visible = node.sphere.w >= 0.0;
+    for (int p=0; p<6 && visible; ++p)
+        visible = dot(uniforms.planes[p].xyz, node.sphere.xyz) + uniforms.planes[p].w >= -node.sphere.w;
+    if (visible && uniforms.occlusion != 0)
+        visible = !isOccluded(node.boundsMin.xyz, node.boundsMax.xyz);
+    if (!visible)
+        return;
+
+    // One single instance draw per node, the instance index is the node id
+    Lod lod = lods[selectLod(node)];
+    DrawGroup drawGroup = drawGroups[node.drawGroup];
+    uint commandId = atomicAdd(counts[node.drawGroup], 1u);
+    if (commandId < drawGroup.maxCommands)
+        commands[drawGroup.firstCommand + commandId] = DrawCommand(lod.nIndices, 1u, lod.firstIndex, lod.vertexOffset,
+            nodeId);
+}
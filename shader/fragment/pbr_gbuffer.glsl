@@ -11,42 +11,36 @@ layout(location = 3) in vec2 fragTexCoord1;
 layout(location = 0) out vec4 outBaseColor;
 layout(location = 1) out vec4 outNormal;
 
-#ifndef DISABLE_BASE_COLOR
+// Material texture availability, specialized per pipeline. The textures are sampled only when available, but the
+// samplers are declared regardless and need to be bound (a placeholder texture will do).
+layout(constant_id = 0) const bool HAS_BASE_COLOR = true;
+layout(constant_id = 1) const bool HAS_METALLIC_ROUGHNESS = true;
+layout(constant_id = 2) const bool HAS_NORMAL = true;
+
 layout(set = 2, binding = 0) uniform sampler2D baseColorTexture;
-#endif
-#ifndef DISABLE_METALLIC_ROUGHNESS
 layout(set = 2, binding = 1) uniform sampler2D metallicRoughnessTexture;
-#endif
-#ifndef DISABLE_NORMAL
 layout(set = 2, binding = 2) uniform sampler2D normalTexture;
-#endif
 
 
 void main() {
-    #ifndef DISABLE_BASE_COLOR
-    vec3 baseColor = texture(baseColorTexture, fragTexCoord0).rgb;
-    #endif
-    #ifndef DISABLE_METALLIC_ROUGHNESS
-    float metallicity = texture(metallicRoughnessTexture, fragTexCoord0).b;
-    float roughness = texture(metallicRoughnessTexture, fragTexCoord0).g;
-    #endif
-    #ifndef DISABLE_NORMAL
-    vec3 normal = texture(normalTexture, fragTexCoord0).rgb;
-    #endif
-
-    #ifndef DISABLE_BASE_COLOR
+    vec3 baseColor = vec3(1.0, 1.0, 1.0);
+    if (HAS_BASE_COLOR)
+        baseColor = texture(baseColorTexture, fragTexCoord0).rgb;
+    float metallicity = 0.0;
+    float roughness = 1.0;
+    if (HAS_METALLIC_ROUGHNESS) {
+        metallicity = texture(metallicRoughnessTexture, fragTexCoord0).b;
+        roughness = texture(metallicRoughnessTexture, fragTexCoord0).g;
+    }
+
     outBaseColor = vec4(baseColor, 1.0);
-    #else
-    outBaseColor = vec4(1.0, 1.0, 1.0, 1.0);
-    #endif
 
     vec3 bitangent = cross(fragNormal, fragTangent.xyz) * -fragTangent.w; // TODO sponza bitangents oriented the wrong way
 
     mat3 tangentSpaceBase = mat3(fragTangent.xyz, bitangent, fragNormal);
 
-    #ifndef DISABLE_NORMAL
-    outNormal = vec4(tangentSpaceBase * normal, 1.0);
-    #else
-    outNormal = vec4(fragNormal, 1.0);
-    #endif
+    if (HAS_NORMAL)
+        outNormal = vec4(tangentSpaceBase * texture(normalTexture, fragTexCoord0).rgb, 1.0);
+    else
+        outNormal = vec4(fragNormal, 1.0);
 }
@@ -16,15 +16,22 @@ layout(location = 2) out vec2 fragTexCoord0;
 layout(location = 3) out vec2 fragTexCoord1;
 #endif
 
-layout(set = 3, binding = 0) uniform UniformBufferObject {
-    mat4 model;
+layout(set = 1, binding = 0) uniform ViewUniforms {
     mat4 view;
     mat4 projection;
-} ubo;
+    mat4 viewProjection;
+} view;
+
+// Top three rows of the model matrices
+layout(set = 1, binding = 1) readonly buffer InstanceBuffer {
+    mat3x4 models[];
+} instances;
 
 void main() {
-    gl_Position = ubo.projection * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragNormal = (ubo.model*vec4(inNormal, 0.0)).xyz;
+    mat3x4 model = instances.models[gl_InstanceIndex];
+    vec3 worldPosition = vec4(inPosition, 1.0) * model;
+    gl_Position = view.viewProjection * vec4(worldPosition, 1.0);
+    fragNormal = vec4(inNormal, 0.0) * model;
     fragTangent = inTangent;
     fragTexCoord0 = inTexCoord0;
     #ifndef DISABLE_IN_TEX_COORD_1
@@ -10,21 +10,31 @@
 
 #include <gu2_os/App.hpp>
 #include <gu2_os/Window.hpp>
+#include <gu2_util/BakedScene.hpp>
 #include <gu2_util/GLTFLoader.hpp>
 #include <gu2_util/MathTypes.hpp>
 #include <gu2_util/Image.hpp>
+#include <gu2_util/Parallel.hpp>
+#include <gu2_util/SpirvCache.hpp>
+#include <gu2_util/StageTimings.hpp>
 #include <gu2_util/Typedef.hpp>
 #include <gu2_vulkan/backend.hpp>
 #include <gu2_vulkan/DescriptorManager.hpp>
+#include <gu2_vulkan/GeometryPool.hpp>
+#include <gu2_vulkan/GpuCulling.hpp>
 #include <gu2_vulkan/Material.hpp>
+#include <gu2_vulkan/MemoryAllocator.hpp>
 #include <gu2_vulkan/Mesh.hpp>
 #include <gu2_vulkan/Pipeline.hpp>
+#include <gu2_vulkan/PipelineCache.hpp>
 #include <gu2_vulkan/PipelineManager.hpp>
 #include <gu2_vulkan/Renderer.hpp>
 #include <gu2_vulkan/Texture.hpp>
 #include <gu2_vulkan/QueryWrapper.hpp>
 #include <gu2_vulkan/Scene.hpp>
 #include <gu2_vulkan/Shader.hpp>
+#include <gu2_vulkan/ShaderCompiler.hpp>
+#include <gu2_vulkan/UploadContext.hpp>
 #include <gu2_vulkan/Util.hpp>
 #include <gu2_vulkan/VulkanSettings.hpp>
 
@@ -33,6 +43,7 @@
 #include <shaderc/shaderc.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <cstdint>
@@ -44,6 +55,7 @@
 #include <set>
 #include <iostream>
 #include <memory>
+#include <thread>
 
 
 bool checkValidationLayerSupport(const std::vector<const char*>& validationLayers)
@@ -113,48 +125,6 @@ void DestroyDebugUtilsMessengerEXT(
 }
 
 
-int64_t findShaderWithInputs(
-    std::vector<gu2::Shader>* shaders,
-    const std::vector<std::string>& requiredInputs,
-    const std::vector<std::string>& requiredDescriptorBindings
-) {
-    for (int64_t i=0; i<shaders->size(); ++i) {
-        const auto& shader = shaders->at(i);
-        const auto& shaderInputVariables = shader.getInputVariables();
-        if (requiredInputs.size() != shaderInputVariables.size())
-            continue;
-        const auto& shaderDescriptorBindings = shader.getDescriptorBindings();
-        if (requiredDescriptorBindings.size() != shaderDescriptorBindings.size())
-            continue;
-
-        int requiredInputsFound = 0;
-        for (const auto& requiredInput : requiredInputs) {
-            for (const auto& shaderInputVariable : shaderInputVariables) {
-                if (shaderInputVariable->name == requiredInput) {
-                    ++requiredInputsFound;
-                    break;
-                }
-            }
-        }
-
-        int requiredDescriptorBindingsFound = 0;
-        for (const auto& requiredDescriptorBinding : requiredDescriptorBindings) {
-            for (const auto& shaderDescriptorBinding : shaderDescriptorBindings) {
-                if (shaderDescriptorBinding->name == requiredDescriptorBinding) {
-                    ++requiredDescriptorBindingsFound;
-                    break;
-                }
-            }
-        }
-
-        if (requiredInputsFound == shaderInputVariables.size() &&
-            requiredDescriptorBindingsFound == shaderDescriptorBindings.size())
-            return i;
-    }
-
-    return -1;
-}
-
 struct MaterialBuildInfo {
     int64_t                                 vertexShaderId              {-1};
     int64_t                                 fragmentShaderId            {-1};
@@ -171,270 +141,181 @@ bool operator==(const MaterialBuildInfo& info1, const MaterialBuildInfo& info2)
         info1.normalTextureId == info2.normalTextureId;
 }
 
-void createFromGLTF(
-    const gu2::GLTFLoader& gltfLoader,
+template <typename T_Attribute>
+const T_Attribute* getBakedAttributeData(
+    const gu2::BakedScene& bakedScene,
+    const gu2::BakedScene::Attribute& attribute,
+    uint32_t nComponents
+) {
+    if (attribute.componentType != static_cast<uint32_t>(gu2::GLTFLoader::Accessor::ComponentType::FLOAT) ||
+        attribute.nComponents != nComponents)
+        throw std::runtime_error("Unsupported attribute format for \"" + std::string(attribute.name.data()) + "\"");
+
+    return reinterpret_cast<const T_Attribute*>(bakedScene.getAttributeData(attribute));
+}
+
+void createFromBakedScene(
+    gu2::BakedScene* bakedScene,
+    gu2::ShaderCompiler* shaderCompiler,
     std::vector<gu2::Mesh>* meshes,
+    gu2::GeometryPool* geometryPool,
     std::vector<gu2::Material>* materials,
-    std::vector<gu2::Shader>* shaders,
     std::vector<gu2::Texture>* textures,
     const gu2::VulkanSettings& vulkanSettings,
     VkPhysicalDevice physicalDevice,
     VkDevice device,
-    VkCommandPool commandPool,
-    VkQueue queue,
+    gu2::MemoryAllocator* memoryAllocator,
+    gu2::UploadContext* uploadContext,
     gu2::PipelineManager* pipelineManager,
-    gu2::DescriptorManager* descriptorManager
+    gu2::DescriptorManager* descriptorManager,
+    gu2::StageTimings* timings
 ) {
-    auto& gltfTextures = gltfLoader.getTextures();
-    auto nTextures = gltfTextures.size();
+    // One texture per baked image, mip chains have been generated during baking. The last texture is a placeholder
+    // bound in place of the textures missing from a material, the shader doesn't sample it.
+    auto& bakedImages = bakedScene->getImages();
+    auto nTextures = bakedImages.size();
+    auto placeholderTextureId = static_cast<int64_t>(nTextures);
     textures->clear();
-    for (const auto& t : gltfTextures)
+    for (size_t i=0; i<nTextures+1; ++i)
         textures->emplace_back(gu2::TextureSettings{
             .physicalDevice = physicalDevice,
-            .device=device
+            .device = device,
+            .memoryAllocator = memoryAllocator
         });
 
-    auto& gltfImages = gltfLoader.getImages();
-
-    #pragma omp parallel for
-    for (decltype(nTextures) i=0; i<nTextures; ++i) {
-        const auto& t = gltfTextures[i];
-        if (t.source < 0)
-            throw std::runtime_error("Texture source not defined");
-
-        const auto& imageFilename = gltfImages.at(t.source).filename;
-
-        auto& texture = textures->at(i);
-        texture.createFromFile(commandPool, queue, imageFilename);
-
-        printf("Added texture %u / %lu from %s\n", i, nTextures, GU2_PATH_TO_STRING(imageFilename));
-        fflush(stdout);
-    }
-
-    auto& gltfMeshes = gltfLoader.getMeshes();
-    auto& gltfMaterials = gltfLoader.getMaterials();
-
-    // Count the number of primitives (one gu2::Mesh corresponds to a single GLTF mesh primitive, not mesh)
-    size_t nPrimitives = 0;
-    for (const auto& m : gltfMeshes)
-        nPrimitives += m.primitives.size();
+    auto& bakedPrimitives = bakedScene->getPrimitives();
+    auto& bakedMaterials = bakedScene->getMaterials();
 
     std::vector<MaterialBuildInfo> materialBuildInfos;
 
-    // Build meshes, shaders and materials
+    // Build meshes, shaders and materials (one gu2::Mesh corresponds to a single GLTF mesh primitive, not mesh)
+    gu2::StageTimings::Scope totalScope(timings, "Create scene resources (total)");
     meshes->clear();
-    meshes->reserve(nPrimitives);
+    meshes->reserve(bakedPrimitives.size());
     std::vector<int64_t> meshMaterialIds;
-    meshMaterialIds.reserve(nPrimitives);
-    for (const auto& m : gltfMeshes) {
-        for (const auto& p : m.primitives) {
-            meshes->emplace_back(physicalDevice, device);
-            auto& mesh = meshes->back();
-
-            if (p.indices < 0) {
-                fprintf(stderr, "WARNING: Unindexed meshes not currently supported, skipping...\n");
-                continue;
-            }
-
-            printf("==============\n");
-            // List required vertex attributes
-            std::vector<std::string> requiredVertexAttributes, requiredFragmentInputs;
-            for (const auto& attribute : p.attributes) {
-                if (attribute.name == "POSITION") {
-                    requiredVertexAttributes.emplace_back("inPosition");
-                }
-                else if (attribute.name == "NORMAL") {
-                    requiredVertexAttributes.emplace_back("inNormal");
-                    requiredFragmentInputs.emplace_back("fragNormal");
-                }
-                else if (attribute.name == "TANGENT") {
-                    requiredVertexAttributes.emplace_back("inTangent");
-                    requiredFragmentInputs.emplace_back("fragTangent");
-                }
-                else if (attribute.name.substr(0, 9) == "TEXCOORD_") {
-                    requiredVertexAttributes.emplace_back("inTexCoord" + attribute.name.substr(9, 1));
-                    requiredFragmentInputs.emplace_back("fragTexCoord" + attribute.name.substr(9, 1));
-                }
-            }
+    meshMaterialIds.reserve(bakedPrimitives.size());
+
+    // Every baked primitive has the canonical vertex layout (missing normals, tangents and texture coordinates
+    // are generated during baking), so a single vertex shader serves all of them. The fragment shader is specialized
+    // per material by the textures it has. The shaders are compiled while the meshes and textures are created, the
+    // materials wait for them.
+    static const std::vector<std::string> canonicalAttributes {"POSITION", "NORMAL", "TANGENT", "TEXCOORD_0"};
+    std::vector<gu2::ShaderCompileRequest> shaderRequests {
+        {gu2::Path(GU2_SHADER_DIR) / "vertex/pbr_gbuffer.glsl", {{"DISABLE_IN_TEX_COORD_1", "true"}}},
+        {gu2::Path(GU2_SHADER_DIR) / "fragment/pbr_gbuffer.glsl", {{"DISABLE_IN_TEX_COORD_1", "true"}}}
+    };
+    int64_t vertexShaderId = 0;
+    int64_t fragmentShaderId = 1;
+    auto shaders = shaderCompiler->compile(shaderRequests);
+    const auto& vertexShader = *shaders[vertexShaderId].get();
+
+    for (const auto& p : bakedPrimitives) {
+        meshes->emplace_back(physicalDevice, device, memoryAllocator);
+        auto& mesh = meshes->back();
+
+        if (p.nIndices == 0) {
+            fprintf(stderr, "WARNING: Unindexed meshes not currently supported, skipping...\n");
+            continue;
+        }
 
-            // Try to find a vertex shader that matches the required input vertex attributes
-            MaterialBuildInfo materialBuildInfo;
-            materialBuildInfo.vertexShaderId = findShaderWithInputs(shaders, requiredVertexAttributes, {"ubo"});
-            if (materialBuildInfo.vertexShaderId < 0) { // no suitable shader found, make a new one
-                materialBuildInfo.vertexShaderId = shaders->size();
-                shaders->emplace_back(device);
-                auto& shader = shaders->back();
-                if (requiredVertexAttributes.size() < 5)
-                    shader.addMacroDefinition("DISABLE_IN_TEX_COORD_1", "true");
-                shader.loadFromFile(gu2::Path(GU2_SHADER_DIR) / "vertex/pbr_gbuffer.glsl");
-            }
+        MaterialBuildInfo materialBuildInfo;
+        materialBuildInfo.vertexShaderId = vertexShaderId;
 
-            printf("requiredVertexAttributes.size(): %lu vertexShaderId: %ld\n",
-                requiredVertexAttributes.size(), materialBuildInfo.vertexShaderId);
+        auto& bakedMaterial = bakedMaterials.at(p.material);
+        materialBuildInfo.fragmentShaderId = fragmentShaderId;
+        materialBuildInfo.baseColorTextureId = bakedMaterial.baseColorTexture.image;
+        materialBuildInfo.metallicRoughnessTextureId = bakedMaterial.metallicRoughnessTexture.image;
+        materialBuildInfo.normalTextureId = bakedMaterial.normalTexture.image;
 
-            // List required descriptor bindings
-            auto& gltfMaterial = gltfMaterials.at(p.material);
-            std::vector<std::string> requiredDescriptorBindings;
+        // Add vertex attribute data, the baked streams are tightly packed
+        for (const auto& attributeName : canonicalAttributes) {
+            const auto* attribute = bakedScene->findAttribute(p, attributeName);
+            if (attribute == nullptr)
+                throw std::runtime_error("Baked primitive is missing attribute \"" + attributeName + "\"");
 
-            if (gltfMaterial.pbrMetallicRoughness.baseColorTexture.index >= 0) {
-                requiredDescriptorBindings.emplace_back("baseColorTexture");
-                materialBuildInfo.baseColorTextureId = gltfMaterial.pbrMetallicRoughness.baseColorTexture.index;
+            if (attributeName == "POSITION") {
+                mesh.addVertexAttribute(vertexShader.getInputVariableLayoutLocation("inPosition"),
+                    getBakedAttributeData<gu2::Vec3f>(*bakedScene, *attribute, 3), attribute->count);
             }
-            if (gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index >= 0) {
-                requiredDescriptorBindings.emplace_back("metallicRoughnessTexture");
-                materialBuildInfo.metallicRoughnessTextureId = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index;
+            else if (attributeName == "NORMAL") {
+                mesh.addVertexAttribute(vertexShader.getInputVariableLayoutLocation("inNormal"),
+                    getBakedAttributeData<gu2::Vec3f>(*bakedScene, *attribute, 3), attribute->count);
             }
-            if (gltfMaterial.normalTexture.index >= 0) {
-                requiredDescriptorBindings.emplace_back("normalTexture");
-                materialBuildInfo.normalTextureId = gltfMaterial.normalTexture.index;
+            else if (attributeName == "TANGENT") {
+                mesh.addVertexAttribute(vertexShader.getInputVariableLayoutLocation("inTangent"),
+                    getBakedAttributeData<gu2::Vec4f>(*bakedScene, *attribute, 4), attribute->count);
             }
-
-            // Try to find a fragment shader that matches the required input vertex attributes
-            materialBuildInfo.fragmentShaderId = findShaderWithInputs(shaders, requiredFragmentInputs,
-                requiredDescriptorBindings);
-            if (materialBuildInfo.fragmentShaderId < 0) { // no suitable shader found, make a new one
-                materialBuildInfo.fragmentShaderId = shaders->size();
-                shaders->emplace_back(device);
-                auto& shader = shaders->back();
-
-                if (requiredVertexAttributes.size() < 5)
-                    shader.addMacroDefinition("DISABLE_IN_TEX_COORD_1", "true");
-                if (std::find(requiredDescriptorBindings.begin(), requiredDescriptorBindings.end(),
-                    "baseColorTexture") == requiredDescriptorBindings.end())
-                    shader.addMacroDefinition("DISABLE_BASE_COLOR", "true");
-                if (std::find(requiredDescriptorBindings.begin(), requiredDescriptorBindings.end(),
-                    "metallicRoughnessTexture") == requiredDescriptorBindings.end())
-                    shader.addMacroDefinition("DISABLE_METALLIC_ROUGHNESS", "true");
-                if (std::find(requiredDescriptorBindings.begin(), requiredDescriptorBindings.end(),
-                    "normalTexture") == requiredDescriptorBindings.end())
-                    shader.addMacroDefinition("DISABLE_NORMAL", "true");
-
-                shader.loadFromFile(gu2::Path(GU2_SHADER_DIR) / "fragment/pbr_gbuffer.glsl");
+            else {
+                mesh.addVertexAttribute(vertexShader.getInputVariableLayoutLocation("inTexCoord0"),
+                    getBakedAttributeData<gu2::Vec2f>(*bakedScene, *attribute, 2), attribute->count);
             }
+        }
 
-            printf("requiredDescriptorBindings.size(): %lu fragmentShaderId: %ld\n",
-                requiredDescriptorBindings.size(), materialBuildInfo.fragmentShaderId);
-
-            // Add vertex attribute data
-            for (const auto& attribute : p.attributes) {
-                if (attribute.accessorId < 0)
-                    throw std::runtime_error("No accessor ID for attribute \"" + attribute.name + "\" defined");
-                auto& accessor = gltfLoader.getAccessors().at(attribute.accessorId);
-                if (accessor.bufferView < 0)
-                    throw std::runtime_error("No buffer view for attribute \"" + attribute.name + "\" defined");
-                auto& bufferView = gltfLoader.getBufferViews().at(accessor.bufferView);
-                if (bufferView.buffer < 0)
-                    throw std::runtime_error("No buffer for attribute \"" + attribute.name + "\" defined");
-                auto& buffer = gltfLoader.getBuffers().at(bufferView.buffer);
-                if (buffer.buffer == nullptr)
-                    throw std::runtime_error("No buffer loaded");
-
-                if (attribute.name == "POSITION") {
-                    if (accessor.componentType == gu2::GLTFLoader::Accessor::ComponentType::FLOAT &&
-                        accessor.type == "VEC3") {
-                        printf("Adding POSITION, count: %lu stride: %lu\n", accessor.count, bufferView.byteStride);
-                        mesh.addVertexAttribute(shaders->at(materialBuildInfo.vertexShaderId)
-                            .getInputVariableLayoutLocation("inPosition"),
-                            reinterpret_cast<gu2::Vec3f*>(buffer.buffer + bufferView.byteOffset + accessor.byteOffset),
-                            accessor.count, bufferView.byteStride);
-                    }
-                    else
-                        throw std::runtime_error("Unsupported attribute format for \"POSITION\"");
-                }
-                else if (attribute.name == "NORMAL") {
-                    if (accessor.componentType == gu2::GLTFLoader::Accessor::ComponentType::FLOAT &&
-                        accessor.type == "VEC3") {
-                        printf("Adding NORMAL, count: %lu stride: %lu\n", accessor.count, bufferView.byteStride);
-                        mesh.addVertexAttribute(shaders->at(materialBuildInfo.vertexShaderId)
-                            .getInputVariableLayoutLocation("inNormal"),
-                            reinterpret_cast<gu2::Vec3f*>(buffer.buffer + bufferView.byteOffset + accessor.byteOffset),
-                            accessor.count, bufferView.byteStride);
-                    }
-                    else
-                        throw std::runtime_error("Unsupported attribute format for \"NORMAL\"");
-                }
-                else if (attribute.name == "TANGENT") {
-                    if (accessor.componentType == gu2::GLTFLoader::Accessor::ComponentType::FLOAT &&
-                        accessor.type == "VEC4") {
-                        printf("Adding TANGENT, count: %lu stride: %lu\n", accessor.count, bufferView.byteStride);
-                        mesh.addVertexAttribute(shaders->at(materialBuildInfo.vertexShaderId)
-                            .getInputVariableLayoutLocation("inTangent"),
-                            reinterpret_cast<gu2::Vec4f*>(buffer.buffer + bufferView.byteOffset + accessor.byteOffset),
-                            accessor.count, bufferView.byteStride);
-                    }
-                    else
-                        throw std::runtime_error("Unsupported attribute format for \"TANGENT\"");
-                }
-                else if (attribute.name.substr(0, 9) == "TEXCOORD_") {
-                    int texCoordId = std::stoi(attribute.name.substr(9, 1));
-                    if (accessor.componentType == gu2::GLTFLoader::Accessor::ComponentType::FLOAT &&
-                        accessor.type == "VEC2") {
-                        printf("Adding %s, count: %lu stride: %lu\n", attribute.name.c_str(), accessor.count,
-                            bufferView.byteStride);
-                        mesh.addVertexAttribute(shaders->at(materialBuildInfo.vertexShaderId)
-                            .getInputVariableLayoutLocation("inTexCoord" + attribute.name.substr(9, 1)),
-                            reinterpret_cast<gu2::Vec2f*>(buffer.buffer + bufferView.byteOffset + accessor.byteOffset),
-                            accessor.count, bufferView.byteStride);
-                    }
-                    else
-                        throw std::runtime_error("Unsupported attribute format for \"TEXCOORD\"");
-                }
-            }
+        // Add indices, the LOD indices follow the full resolution ones
+        const auto& lastLod = bakedScene->getLods().at(p.firstLod + p.nLods - 1);
+        uint32_t nIndices = lastLod.firstIndex + lastLod.nIndices;
+        switch (static_cast<gu2::GLTFLoader::Accessor::ComponentType>(p.indexComponentType)) {
+            case gu2::GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT:
+                mesh.setIndices(reinterpret_cast<const uint16_t*>(bakedScene->getIndexData(p)), nIndices);
+                break;
+            case gu2::GLTFLoader::Accessor::ComponentType::UNSIGNED_INT:
+                mesh.setIndices(reinterpret_cast<const uint32_t*>(bakedScene->getIndexData(p)), nIndices);
+                break;
+            default:
+                throw std::runtime_error("Invalid index component type, not \"UNSIGNED_SHORT\" or \"UNSIGNED_INT\"");
+        }
 
-            // Add indices
-            {
-                if (p.indices < 0)
-                    throw std::runtime_error("No accessor ID for indices defined");
-                auto& accessor = gltfLoader.getAccessors().at(p.indices);
-                if (accessor.bufferView < 0)
-                    throw std::runtime_error("No buffer view for indices defined");
-                auto& bufferView = gltfLoader.getBufferViews().at(accessor.bufferView);
-                if (bufferView.buffer < 0)
-                    throw std::runtime_error("No buffer for indices defined");
-                auto& buffer = gltfLoader.getBuffers().at(bufferView.buffer);
-                if (buffer.buffer == nullptr)
-                    throw std::runtime_error("No buffer loaded");
-
-                if (accessor.type != "SCALAR")
-                    throw std::runtime_error("Invalid accessor for indices, type not \"SCALAR\"");
-
-                printf("Adding indices, count: %lu stride: %lu\n", accessor.count, bufferView.byteStride);
-                switch (accessor.componentType) {
-                    case gu2::GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT:
-                        mesh.setIndices(
-                            reinterpret_cast<uint16_t*>(buffer.buffer + bufferView.byteOffset + accessor.byteOffset),
-                            accessor.count, bufferView.byteStride);
-                        break;
-                    case gu2::GLTFLoader::Accessor::ComponentType::UNSIGNED_INT:
-                        mesh.setIndices(
-                            reinterpret_cast<uint32_t*>(buffer.buffer + bufferView.byteOffset + accessor.byteOffset),
-                            accessor.count, bufferView.byteStride);
-                        break;
-                    default:
-                        throw std::runtime_error("Invalid accessor for indices, component type not \"UNSIGNED_SHORT\" or \"UNSIGNED_INT\"");
-                }
-            }
+        // Try to find pre-existing material with identical info, create new info if one is not found
+        int64_t meshMaterialId = -1;
+        for (int64_t i=0; i<materialBuildInfos.size(); ++i) {
+            if (materialBuildInfos[i] == materialBuildInfo)
+                meshMaterialId = i;
+        }
+        if (meshMaterialId < 0) {
+            meshMaterialId = (int64_t)materialBuildInfos.size();
+            materialBuildInfo.vertexInputInfo = mesh.getVertexAttributesDescription()
+                .getPipelineVertexInputStateCreateInfo(); // TODO doesn't feel very elegant of a solution
+            materialBuildInfos.push_back(std::move(materialBuildInfo));
+        }
+        meshMaterialIds.push_back(meshMaterialId);
+    }
 
-            mesh.upload(commandPool, queue);
+    assert(meshMaterialIds.size() == meshes->size());
 
-            // Try to find pre-existing material with identical info, create new info if one is not found
-            int64_t meshMaterialId = -1;
-            for (int64_t i=0; i<materialBuildInfos.size(); ++i) {
-                if (materialBuildInfos[i] == materialBuildInfo)
-                    meshMaterialId = i;
+    // Record the texture and mesh uploads concurrently, the upload context submits them in batches
+    {
+        gu2::StageTimings::Scope scope(timings, "GPU upload");
+        gu2::ExceptionGuard exceptionGuard;
+        int64_t nMeshes = static_cast<int64_t>(meshes->size());
+        #pragma omp parallel
+        {
+            #pragma omp for schedule(dynamic) nowait
+            for (decltype(nTextures) i=0; i<nTextures; ++i) {
+                exceptionGuard.run([&]() {
+                    const auto& image = bakedImages[i];
+                    textures->at(i).createFromMipChain(uploadContext, image.width, image.height, image.mipLevels,
+                        bakedScene->getImageData(image));
+                });
             }
-            if (meshMaterialId < 0) {
-                meshMaterialId = (int64_t)materialBuildInfos.size();
-                materialBuildInfo.vertexInputInfo = mesh.getVertexAttributesDescription()
-                    .getPipelineVertexInputStateCreateInfo(); // TODO doesn't feel very elegant of a solution
-                materialBuildInfos.push_back(std::move(materialBuildInfo));
+
+            #pragma omp single nowait
+            exceptionGuard.run([&]() {
+                const uint8_t white[4] {255, 255, 255, 255};
+                textures->at(placeholderTextureId).createFromMipChain(uploadContext, 1, 1, 1, white);
+            });
+
+            #pragma omp for schedule(dynamic)
+            for (int64_t i=0; i<nMeshes; ++i) {
+                if (bakedPrimitives[i].nIndices == 0)
+                    continue;
+                exceptionGuard.run([&]() { meshes->at(i).upload(uploadContext, geometryPool); });
             }
-            meshMaterialIds.push_back(meshMaterialId);
         }
+        exceptionGuard.rethrow();
+        // Wait for the uploads so that the timing covers them
+        uploadContext->flush();
     }
 
-    assert(meshMaterialIds.size() == meshes->size());
-
     materials->clear();
     materials->reserve(materialBuildInfos.size());
     for (const auto& materialBuildInfo : materialBuildInfos) {
@@ -442,22 +323,37 @@ void createFromGLTF(
         auto& material = materials->back();
 
         // Add shaders
-        material.setVertexShader(shaders->at(materialBuildInfo.vertexShaderId));
-        material.setFragmentShader(shaders->at(materialBuildInfo.fragmentShaderId));
+        material.setVertexShader(shaders[materialBuildInfo.vertexShaderId]);
+        material.setFragmentShader(shaders[materialBuildInfo.fragmentShaderId]);
+        material.setSpecializationConstant("HAS_BASE_COLOR", materialBuildInfo.baseColorTextureId >= 0);
+        material.setSpecializationConstant("HAS_METALLIC_ROUGHNESS", materialBuildInfo.metallicRoughnessTextureId >= 0);
+        material.setSpecializationConstant("HAS_NORMAL", materialBuildInfo.normalTextureId >= 0);
 
         // Build descriptor set layouts
         material.createDescriptorSetLayouts(descriptorManager);
+    }
 
-        // Build material pipeline
-        material.createPipeline(pipelineManager, materialBuildInfo.vertexInputInfo);
+    {   // Build material pipelines, in parallel
+        std::vector<gu2::Material*> pipelineMaterials;
+        std::vector<VkPipelineVertexInputStateCreateInfo> vertexInputInfos;
+        for (size_t i=0; i<materialBuildInfos.size(); ++i) {
+            pipelineMaterials.push_back(&materials->at(i));
+            vertexInputInfos.push_back(materialBuildInfos[i].vertexInputInfo);
+        }
+        gu2::Material::createPipelines(pipelineManager, pipelineMaterials, vertexInputInfos);
+    }
 
-        // Add textures
-        if (materialBuildInfo.baseColorTextureId >= 0)
-            material.addUniform(2, 0, textures->at(materialBuildInfo.baseColorTextureId));
-        if (materialBuildInfo.metallicRoughnessTextureId >= 0)
-            material.addUniform(2, 1, textures->at(materialBuildInfo.metallicRoughnessTextureId));
-        if (materialBuildInfo.normalTextureId >= 0)
-            material.addUniform(2, 2, textures->at(materialBuildInfo.normalTextureId));
+    for (size_t i=0; i<materialBuildInfos.size(); ++i) {
+        const auto& materialBuildInfo = materialBuildInfos[i];
+        auto& material = materials->at(i);
+
+        // Add textures, the missing ones are replaced by the placeholder
+        auto getTexture = [&](int64_t textureId) -> const gu2::Texture& {
+            return textures->at(textureId >= 0 ? textureId : placeholderTextureId);
+        };
+        material.addUniform(2, 0, getTexture(materialBuildInfo.baseColorTextureId));
+        material.addUniform(2, 1, getTexture(materialBuildInfo.metallicRoughnessTextureId));
+        material.addUniform(2, 2, getTexture(materialBuildInfo.normalTextureId));
 
         material.createDescriptorSets(descriptorManager, vulkanSettings.framesInFlight);
     }
@@ -465,7 +361,6 @@ void createFromGLTF(
     for (size_t i=0; i<meshes->size(); ++i) {
         auto& mesh = meshes->at(i);
         mesh.setMaterial(&materials->at(meshMaterialIds[i]));
-        mesh.createDescriptorSets(descriptorManager, vulkanSettings.framesInFlight);
     }
 }
 
@@ -485,13 +380,15 @@ public:
         // Wait for the Vulkan device to finish its tasks
         vkDeviceWaitIdle(_vulkanDevice);
         _meshes.clear();
-        gu2::Mesh::destroyUniformBuffers(_vulkanDevice);
+        _geometryPool.reset();
         _materials.clear();
-        _shaders.clear();
+        _shaderCompiler.reset();
         _textures.clear();
         _renderer.reset();
         _pipelineManager.reset();
+        _pipelineCache.reset();
         _descriptorManager.reset();
+        _memoryAllocator.reset();
         vkDestroyDevice(_vulkanDevice, nullptr);
         if (_vulkanSettings.enableValidationLayers)
             DestroyDebugUtilsMessengerEXT(_vulkanInstance, _vulkanDebugMessenger, nullptr);
@@ -510,7 +407,22 @@ public:
         selectPhysicalDevice();
         createLogicalDevice();
 
-        _pipelineManager = std::make_unique<gu2::PipelineManager>();
+        _memoryAllocator = std::make_unique<gu2::MemoryAllocator>(gu2::MemoryAllocatorSettings{
+            .physicalDevice = _vulkanPhysicalDevice,
+            .device = _vulkanDevice,
+            .dedicatedRequirements = true
+        });
+        _pipelineCache = std::make_unique<gu2::PipelineCache>(gu2::PipelineCacheSettings{
+            .physicalDevice = _vulkanPhysicalDevice,
+            .device = _vulkanDevice,
+            .filename = gu2::Path(ASSETS_DIR) / "pipelines.gu2cache"
+        });
+        _pipelineManager = std::make_unique<gu2::PipelineManager>(_pipelineCache.get());
+        _spirvCache = std::make_unique<gu2::SpirvCache>(gu2::Path(ASSETS_DIR) / "spirv_cache");
+        _shaderCompiler = std::make_unique<gu2::ShaderCompiler>(gu2::ShaderCompilerSettings{
+            .device = _vulkanDevice,
+            .spirvCache = _spirvCache.get()
+        });
         _descriptorManager = std::make_unique<gu2::DescriptorManager>(_vulkanDevice);
         gu2::RendererSettings rendererSettings {
             &_vulkanSettings,
@@ -520,8 +432,14 @@ public:
             _vulkanGraphicsQueue,
             &_window,
             _descriptorManager.get(),
-            _pipelineManager.get()
+            _pipelineManager.get(),
+            _memoryAllocator.get(),
+            _gpuCulling,
+            _vulkanTransferQueue,
+            _timelineSemaphore,
+            _multiDrawIndirect
         };
+        rendererSettings.recordingThreads = std::thread::hardware_concurrency();
         _renderer = std::make_unique<gu2::Renderer>(rendererSettings);
 
         gu2::PipelineSettings defaultPipelineSettings;
@@ -533,14 +451,56 @@ public:
         _pipelineManager->setDefaultPipelineSettings(defaultPipelineSettings);
 
         // Load sponza (TODO move elsewhere)
-        gu2::GLTFLoader sponzaLoader;
-        sponzaLoader.readFromFile(gu2::Path(ASSETS_DIR) / "sponza/Main.1_Sponza/NewSponza_Main_glTF_002.gltf");
-        gu2::Mesh::createUniformBuffers(_vulkanPhysicalDevice, _vulkanDevice, _vulkanSettings.framesInFlight, 512); // TODO number of uniforms
-        createFromGLTF(sponzaLoader, &_meshes, &_materials, &_shaders, &_textures, _vulkanSettings,
-            _vulkanPhysicalDevice, _vulkanDevice, _renderer->getCommandPool(), _vulkanGraphicsQueue,
-            _pipelineManager.get(), _descriptorManager.get());
-
-        _scene.createFromGLFT(sponzaLoader, _meshes);
+        gu2::StageTimings loadTimings;
+        gu2::Path sponzaFilename = gu2::Path(ASSETS_DIR) / "sponza/Main.1_Sponza/NewSponza_Main_glTF_002.gltf";
+        gu2::Path sponzaCacheFilename = sponzaFilename;
+        sponzaCacheFilename.replace_extension(".gu2cache");
+        uint64_t sponzaSourceHash = 0;
+        {
+            gu2::StageTimings::Scope scope(&loadTimings, "Compute source hash");
+            sponzaSourceHash = gu2::BakedScene::computeSourceHash(sponzaFilename);
+        }
+
+        gu2::BakedScene sponzaBakedScene;
+        bool bakedSceneDirty = false;
+        bool bakedSceneRead = false;
+        {
+            gu2::StageTimings::Scope scope(&loadTimings, "Read scene cache");
+            bakedSceneRead = sponzaBakedScene.readFromFile(sponzaCacheFilename, sponzaSourceHash);
+        }
+        if (!bakedSceneRead) {
+            printf("Baking %s\n", GU2_PATH_TO_STRING(sponzaFilename));
+            gu2::GLTFLoader sponzaLoader;
+            sponzaLoader.readFromFile(sponzaFilename, &loadTimings);
+            sponzaBakedScene.bake(sponzaLoader, &loadTimings);
+            bakedSceneDirty = true;
+        }
+
+        _geometryPool = std::make_unique<gu2::GeometryPool>(gu2::GeometryPoolSettings{
+            .physicalDevice = _vulkanPhysicalDevice,
+            .device = _vulkanDevice,
+            .memoryAllocator = _memoryAllocator.get(),
+            .framesInFlight = static_cast<uint32_t>(_vulkanSettings.framesInFlight)
+        });
+        createFromBakedScene(&sponzaBakedScene, _shaderCompiler.get(), &_meshes, _geometryPool.get(), &_materials,
+            &_textures, _vulkanSettings, _vulkanPhysicalDevice, _vulkanDevice, _memoryAllocator.get(),
+            _renderer->getUploadContext(), _pipelineManager.get(), _descriptorManager.get(), &loadTimings);
+
+        _scene.createFromBakedScene(sponzaBakedScene, _meshes);
+
+        // Store baked scene for the next run
+        if (bakedSceneDirty) {
+            gu2::StageTimings::Scope scope(&loadTimings, "Write scene cache");
+            sponzaBakedScene.writeToFile(sponzaCacheFilename, sponzaSourceHash);
+        }
+        {
+            gu2::StageTimings::Scope scope(&loadTimings, "Write pipeline cache");
+            _pipelineCache->save();
+        }
+
+        printf("Scene loading timings:\n");
+        loadTimings.print();
+        _memoryAllocator->printStatistics();
     }
 
     void createInstance()
@@ -551,7 +511,7 @@ public:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "GraphicsUtils2";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_2;
 
         VkInstanceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -685,6 +645,12 @@ public:
             familyIndices.graphicsFamily.value(), familyIndices.presentFamily.value()
         };
 
+        // Uploads are run on a dedicated transfer queue whenever the device has one and supports timeline semaphores
+        _timelineSemaphore = gu2::UploadContext::isTimelineSemaphoreSupported(_vulkanPhysicalDevice);
+        bool transferQueue = _timelineSemaphore && familyIndices.transferFamily.has_value();
+        if (transferQueue)
+            uniqueQueueFamilies.insert(familyIndices.transferFamily.value());
+
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
             VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -699,14 +665,33 @@ public:
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+        // Multi-draw indirect and GPU culling are used whenever the device supports them
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(_vulkanPhysicalDevice, &supportedFeatures);
+        _multiDrawIndirect = supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+        if (_multiDrawIndirect) {
+            deviceFeatures.multiDrawIndirect = VK_TRUE;
+            deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
+        auto deviceExtensions = _vulkanSettings.deviceExtensions;
+        _gpuCulling = gu2::GpuCulling::isSupported(_vulkanPhysicalDevice);
+        if (_gpuCulling)
+            deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+        VkPhysicalDeviceVulkan12Features deviceFeatures12{};
+        deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        deviceFeatures12.timelineSemaphore = _timelineSemaphore ? VK_TRUE : VK_FALSE;
+
         // Logical device creation info
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        if (_timelineSemaphore)
+            createInfo.pNext = &deviceFeatures12;
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(_vulkanSettings.deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = _vulkanSettings.deviceExtensions.data();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
         if (_vulkanSettings.enableValidationLayers) { // ignored in modern vulkan implementations
             createInfo.enabledLayerCount = static_cast<uint32_t>(_vulkanSettings.validationLayers.size());
             createInfo.ppEnabledLayerNames = _vulkanSettings.validationLayers.data();
@@ -719,6 +704,8 @@ public:
 
         vkGetDeviceQueue(_vulkanDevice, familyIndices.graphicsFamily.value(), 0, &_vulkanGraphicsQueue);
         vkGetDeviceQueue(_vulkanDevice, familyIndices.presentFamily.value(), 0, &_vulkanPresentQueue);
+        if (transferQueue)
+            vkGetDeviceQueue(_vulkanDevice, familyIndices.transferFamily.value(), 0, &_vulkanTransferQueue);
     }
 
     void handleEvent(const gu2::Event& event)
@@ -744,10 +731,46 @@ public:
         }
     }
 
+    void updateCamera()
+    {
+        static auto startTime = std::chrono::high_resolution_clock::now();
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        double time = std::chrono::duration<double, std::chrono::seconds::period>(currentTime - startTime).count();
+
+        // View matrix
+        double tScale = 0.1;
+        gu2::Vec3f target(-20.0f*sin((tScale/5.0)*time), 2.5f-2.5f*cos(0.87354*tScale*time), 8.0f*cos((tScale/3.0)*time));
+        gu2::Vec3f source(10.0f*cos((tScale/2.0)*time), 1.5f+1.0f*cos(0.34786*tScale*time), 5.8f*sin(tScale*time));
+        gu2::Vec3f up(0.0f, 1.0f, 0.0f);
+
+        gu2::Vec3f forward = (target-source).normalized();
+        gu2::Vec3f right = forward.cross(up).normalized();
+        gu2::Vec3f up2 = right.cross(forward).normalized();
+
+        gu2::Mat3f viewRotation;
+        viewRotation << right.transpose(), up2.transpose(), forward.transpose();
+        _scene.camera.view << viewRotation, -viewRotation*source,
+            0.0f, 0.0f, 0.0f, 1.0f;
+
+        // Infinite far-plane, inverted depth projection matrix
+        float near = 0.1f;
+        float fov = M_PI/3.0; // 60 degrees
+        auto extent = _renderer->getSwapChainExtent();
+        float aspectRatio = extent.width / (float) extent.height;
+        float r = tanf(fov / 2.0f);
+        _scene.camera.projection <<
+            1.0f/(aspectRatio * r), 0.0f,       0.0f,   0.0f,
+            0.0f,                   -1.0f/r,    0.0f,   0.0f,
+            0.0f,                   0.0f,       0.0f,   near,
+            0.0f,                   0.0f,       1.0f,   0.0f;
+        _scene.camera.viewportHeight = static_cast<float>(extent.height);
+    }
+
     void render()
     {
+        updateCamera();
+        _geometryPool->beginFrame(_renderer->getUploadContext());
         _renderer->render(_scene, _vulkanPresentQueue);
-        gu2::Mesh::updateUniformBuffer(_scene, *_renderer);
     }
 
 private:
@@ -761,13 +784,21 @@ private:
     VkDevice                                _vulkanDevice;
     VkQueue                                 _vulkanGraphicsQueue;
     VkQueue                                 _vulkanPresentQueue;
+    VkQueue                                 _vulkanTransferQueue    {nullptr};
+    bool                                    _gpuCulling             {false};
+    bool                                    _multiDrawIndirect      {false};
+    bool                                    _timelineSemaphore      {false};
 
+    std::unique_ptr<gu2::MemoryAllocator>   _memoryAllocator;   // outlives all the resources allocated from it
     std::unique_ptr<gu2::Renderer>          _renderer;
     std::vector<gu2::Texture>               _textures;
-    std::vector<gu2::Shader>                _shaders;
+    std::unique_ptr<gu2::ShaderCompiler>    _shaderCompiler;
     std::vector<gu2::Material>              _materials;
+    std::unique_ptr<gu2::GeometryPool>      _geometryPool;  // geometry of _meshes
     std::vector<gu2::Mesh>                  _meshes;
     std::unique_ptr<gu2::DescriptorManager> _descriptorManager;
+    std::unique_ptr<gu2::PipelineCache>     _pipelineCache;
+    std::unique_ptr<gu2::SpirvCache>        _spirvCache;
     std::unique_ptr<gu2::PipelineManager>   _pipelineManager;
     gu2::Scene                              _scene;
 };
@@ -0,0 +1,136 @@
+//
+// Project: GraphicsUtils2
+// File: BVH.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+
+using namespace gu2;
+
+
+namespace {
+
+inline const AABB& getItemBounds(const AABB* itemBounds, size_t stride, uint32_t itemId)
+{
+    return *reinterpret_cast<const AABB*>(reinterpret_cast<const char*>(itemBounds) + itemId*stride);
+}
+
+} // namespace
+
+
+void BVH::build(const AABB* itemBounds, size_t nItems, size_t stride, uint32_t maxLeafSize)
+{
+    _nodes.clear();
+    _parents.clear();
+    _items.resize(nItems);
+    _itemLeafs.assign(nItems, invalidNode);
+    if (nItems == 0)
+        return;
+
+    std::iota(_items.begin(), _items.end(), 0u);
+    std::vector<Vec3f> centroids(nItems);
+    for (uint32_t i=0; i<nItems; ++i)
+        centroids[i] = getItemBounds(itemBounds, stride, i).center();
+
+    // A binary tree with leaves of at least one item has less than 2n nodes
+    _nodes.reserve(2*nItems);
+    _parents.reserve(2*nItems);
+    buildNode(itemBounds, stride, centroids, 0, static_cast<uint32_t>(nItems), invalidNode, std::max(maxLeafSize, 1u));
+}
+
+void BVH::refit(const AABB* itemBounds, size_t stride)
+{
+    // Children are stored after their parents, so a reverse sweep sees the children first
+    for (size_t i=_nodes.size(); i>0; --i)
+        _nodes[i-1].bounds = computeNodeBounds(_nodes[i-1], static_cast<uint32_t>(i-1), itemBounds, stride);
+}
+
+void BVH::refit(const AABB* itemBounds, const std::vector<uint32_t>& changedItems, size_t stride)
+{
+    for (auto itemId : changedItems) {
+        uint32_t nodeId = _itemLeafs.at(itemId);
+        while (nodeId != invalidNode) {
+            AABB bounds = computeNodeBounds(_nodes[nodeId], nodeId, itemBounds, stride);
+            if (bounds == _nodes[nodeId].bounds)
+                break; // ancestors are up to date as well
+            _nodes[nodeId].bounds = bounds;
+            nodeId = _parents[nodeId];
+        }
+    }
+}
+
+void BVH::query(const AABB& aabb, const AABB* itemBounds, std::vector<uint32_t>* items, size_t stride) const
+{
+    traverse(
+        [&](const AABB& nodeBounds) { return nodeBounds.intersects(aabb); },
+        [&](uint32_t itemId) {
+            if (getItemBounds(itemBounds, stride, itemId).intersects(aabb))
+                items->push_back(itemId);
+        });
+}
+
+uint32_t BVH::buildNode(
+    const AABB* itemBounds,
+    size_t stride,
+    const std::vector<Vec3f>& centroids,
+    uint32_t first,
+    uint32_t nItems,
+    uint32_t parent,
+    uint32_t maxLeafSize
+) {
+    uint32_t nodeId = static_cast<uint32_t>(_nodes.size());
+    _nodes.emplace_back();
+    _parents.push_back(parent);
+
+    AABB bounds;
+    AABB centroidBounds;
+    for (uint32_t i=first; i<first+nItems; ++i) {
+        bounds.extend(getItemBounds(itemBounds, stride, _items[i]));
+        centroidBounds.extend(centroids[_items[i]]);
+    }
+    _nodes[nodeId].bounds = bounds;
+
+    Vec3f centroidExtent = centroidBounds.max - centroidBounds.min;
+    int axis = 0;
+    float maxExtent = centroidExtent.maxCoeff(&axis);
+    if (nItems <= maxLeafSize || maxExtent <= 0.0f) { // all centroids coincide, no point in splitting further
+        _nodes[nodeId].rightOrFirst = first;
+        _nodes[nodeId].nItems = nItems;
+        for (uint32_t i=first; i<first+nItems; ++i)
+            _itemLeafs[_items[i]] = nodeId;
+        return nodeId;
+    }
+
+    uint32_t nLeft = nItems / 2;
+    std::nth_element(_items.begin() + first, _items.begin() + first + nLeft, _items.begin() + first + nItems,
+        [&](uint32_t a, uint32_t b) { return centroids[a](axis) < centroids[b](axis); });
+
+    buildNode(itemBounds, stride, centroids, first, nLeft, nodeId, maxLeafSize);
+    uint32_t right = buildNode(itemBounds, stride, centroids, first + nLeft, nItems - nLeft, nodeId, maxLeafSize);
+    _nodes[nodeId].rightOrFirst = right;
+    _nodes[nodeId].nItems = 0;
+    return nodeId;
+}
+
+AABB BVH::computeNodeBounds(const Node& node, uint32_t nodeId, const AABB* itemBounds, size_t stride) const
+{
+    AABB bounds;
+    if (node.nItems > 0) {
+        for (uint32_t i=0; i<node.nItems; ++i)
+            bounds.extend(getItemBounds(itemBounds, stride, _items[node.rightOrFirst + i]));
+    }
+    else {
+        bounds.extend(_nodes[nodeId + 1].bounds);
+        bounds.extend(_nodes[node.rightOrFirst].bounds);
+    }
+    return bounds;
+}
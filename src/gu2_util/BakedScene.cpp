@@ -0,0 +1,1020 @@
+//
+// Project: GraphicsUtils2
+// File: BakedScene.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "BakedScene.hpp"
+#include "GLTFLoader.hpp"
+#include "Hash.hpp"
+#include "Image.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "Parallel.hpp"
+#include "StageTimings.hpp"
+#include "TransformHierarchy.hpp"
+#include "VertexGeneration.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint32_t  bakedSceneMagic         {0x53423247}; // "G2BS"
+constexpr uint32_t  bakedSceneVersion       {11};
+constexpr uint64_t  bakedSceneAlignment     {64};
+
+// LOD chain generation: each level targets lodReduction times the triangles of the previous one, the chain ends
+// when the simplifier can't reach at least lodMinReduction, or at maxLods or minLodTriangles
+constexpr uint32_t  maxLods                 {8};
+constexpr float     lodReduction            {0.5f};
+constexpr float     lodMinReduction         {0.9f};
+constexpr uint64_t  minLodTriangles         {32};
+
+// Attributes every baked primitive has, name and number of float components
+constexpr std::pair<const char*, uint32_t> canonicalAttributes[] {
+    {"NORMAL",      3},
+    {"TEXCOORD_0",  2},
+    {"TANGENT",     4}
+};
+
+enum Section : uint32_t {
+    SECTION_NODES = 0,
+    SECTION_ATTRIBUTES,
+    SECTION_PRIMITIVES,
+    SECTION_LODS,
+    SECTION_MATERIALS,
+    SECTION_IMAGES,
+    SECTION_VERTEX_DATA,
+    SECTION_INDEX_DATA,
+    SECTION_IMAGE_DATA,
+    N_SECTIONS
+};
+
+struct SectionEntry {
+    uint64_t    byteOffset;
+    uint64_t    byteSize;
+};
+
+struct Header {
+    uint32_t        magic;
+    uint32_t        version;
+    uint64_t        sourceHash;
+    SectionEntry    sections[N_SECTIONS];
+};
+
+
+inline uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+template <typename T>
+void readTable(std::vector<T>* table, const char* fileData, const SectionEntry& section)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    table->resize(section.byteSize / sizeof(T));
+    memcpy(table->data(), fileData + section.byteOffset, table->size()*sizeof(T));
+}
+
+void addNode(std::vector<BakedScene::Node>* nodes, int64_t parent, const Mat4f& localMatrix)
+{
+    Vec3f translation;
+    Quatf rotation;
+    Vec3f scale;
+    TransformHierarchy::decompose(localMatrix, &translation, &rotation, &scale);
+
+    nodes->emplace_back();
+    auto& node = nodes->back();
+    node.parent = parent;
+    Eigen::Map<Vec3f>(node.translation.data()) = translation;
+    Eigen::Map<Quatf>(node.rotation.data()) = rotation;
+    Eigen::Map<Vec3f>(node.scale.data()) = scale;
+    node.firstPrimitive = 0;
+    node.nPrimitives = 0;
+}
+
+void addNodes(
+    std::vector<BakedScene::Node>* nodes,
+    int64_t parent,
+    int64_t gltfNodeId,
+    const GLTFLoader& gltfLoader
+) {
+    const auto& gltfNode = gltfLoader.getNodes().at(gltfNodeId);
+    int64_t nodeId = static_cast<int64_t>(nodes->size());
+    addNode(nodes, parent, gltfNode.matrix.cast<float>());
+
+    if (gltfNode.mesh >= 0) {
+        // Primitive ids of a mesh are consecutive
+        const auto& primitives = gltfLoader.getMeshes().at(gltfNode.mesh).primitives;
+        uint32_t firstPrimitive = primitives.empty() ? 0 : static_cast<uint32_t>(primitives.front().id);
+        uint32_t nPrimitives = static_cast<uint32_t>(primitives.size());
+
+        // EXT_mesh_gpu_instancing instances are children of the node
+        std::vector<Mat4d> instanceMatrices = gltfLoader.getInstanceMatrices(gltfNode);
+        if (instanceMatrices.empty()) {
+            (*nodes)[nodeId].firstPrimitive = firstPrimitive;
+            (*nodes)[nodeId].nPrimitives = nPrimitives;
+        }
+        for (const auto& instanceMatrix : instanceMatrices) {
+            addNode(nodes, nodeId, instanceMatrix.cast<float>());
+            nodes->back().firstPrimitive = firstPrimitive;
+            nodes->back().nPrimitives = nPrimitives;
+        }
+    }
+
+    for (const auto& childNodeId : gltfNode.children)
+        addNodes(nodes, nodeId, childNodeId, gltfLoader);
+}
+
+// Copy accessor data into a tightly packed stream
+void packAttribute(const GLTFLoader& gltfLoader, const GLTFLoader::Accessor& accessor, char* dest)
+{
+    size_t elementSize = accessor.getElementSize();
+    size_t stride = gltfLoader.getAccessorStride(accessor);
+    const char* src = gltfLoader.getAccessorData(accessor);
+    if (stride == elementSize)
+        memcpy(dest, src, elementSize*accessor.count);
+    else {
+        for (uint64_t i=0; i<accessor.count; ++i)
+            memcpy(dest + i*elementSize, src + i*stride, elementSize);
+    }
+}
+
+// Copy indices into a tightly packed stream of destComponentType, 8-bit indices are widened to 16 bits and
+// 32-bit indices narrowed to 16 bits in case requested
+void packIndices(
+    const GLTFLoader& gltfLoader,
+    const GLTFLoader::Accessor& accessor,
+    uint32_t destComponentType,
+    char* dest
+) {
+    size_t stride = gltfLoader.getAccessorStride(accessor);
+    const char* src = gltfLoader.getAccessorData(accessor);
+    if (accessor.componentType == GLTFLoader::Accessor::ComponentType::UNSIGNED_BYTE) {
+        auto* dest16 = reinterpret_cast<uint16_t*>(dest);
+        for (uint64_t i=0; i<accessor.count; ++i)
+            dest16[i] = static_cast<uint8_t>(src[i*stride]);
+    }
+    else if (static_cast<uint32_t>(accessor.componentType) != destComponentType) {
+        auto* dest16 = reinterpret_cast<uint16_t*>(dest);
+        for (uint64_t i=0; i<accessor.count; ++i) {
+            uint32_t index;
+            memcpy(&index, src + i*stride, sizeof(uint32_t));
+            narrowIndices(&index, 1, dest16 + i);
+        }
+    }
+    else
+        packAttribute(gltfLoader, accessor, dest);
+}
+
+uint32_t getComponentSize(uint32_t componentType)
+{
+    switch (static_cast<GLTFLoader::Accessor::ComponentType>(componentType)) {
+        case GLTFLoader::Accessor::ComponentType::BYTE:
+        case GLTFLoader::Accessor::ComponentType::UNSIGNED_BYTE:
+            return 1;
+        case GLTFLoader::Accessor::ComponentType::SHORT:
+        case GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+// Fill in attributes missing from the canonical vertex layout (NORMAL, TANGENT, TEXCOORD_0), the sourced
+// attributes and indices need to be packed already. Only triangle lists get meaningful normals and tangents.
+// Vertices with corners of differing tangents are split: in that case all attributes of the primitive are copied
+// to privateVertexData with the duplicates appended and their byte offsets are rewritten to point to it.
+void generateAttributes(
+    const BakedScene::Primitive& primitive,
+    BakedScene::Attribute* attributes,
+    const uint32_t* generatedAttributes,
+    uint32_t nGeneratedAttributes,
+    bool triangles,
+    char* vertexData,
+    char* indexData,
+    std::vector<char>* privateVertexData
+) {
+    BakedScene::Attribute* primitiveAttributes = attributes + primitive.firstAttribute;
+    const BakedScene::Attribute* position = nullptr;
+    const BakedScene::Attribute* normal = nullptr;
+    const BakedScene::Attribute* tangent = nullptr;
+    const BakedScene::Attribute* texCoord = nullptr;
+    for (uint32_t i=0; i<primitive.nAttributes; ++i) {
+        const auto& attribute = primitiveAttributes[i];
+        std::string name = attribute.name.data();
+        if (name == "POSITION")
+            position = &attribute;
+        else if (name == "NORMAL")
+            normal = &attribute;
+        else if (name == "TANGENT")
+            tangent = &attribute;
+        else if (name == "TEXCOORD_0")
+            texCoord = &attribute;
+    }
+
+    auto isGenerated = [&](const BakedScene::Attribute* attribute) {
+        uint32_t attributeId = static_cast<uint32_t>(attribute - attributes);
+        return std::find(generatedAttributes, generatedAttributes + nGeneratedAttributes, attributeId) !=
+            generatedAttributes + nGeneratedAttributes;
+    };
+    auto isFloat = [](const BakedScene::Attribute* attribute) {
+        return attribute->componentType == static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::FLOAT);
+    };
+
+    size_t nVertices = position->count;
+    const auto* positions = reinterpret_cast<const Vec3f*>(vertexData + position->byteOffset);
+    auto* normals = reinterpret_cast<Vec3f*>(vertexData + normal->byteOffset);
+    auto* tangents = reinterpret_cast<Vec4f*>(vertexData + tangent->byteOffset);
+    auto* texCoords = reinterpret_cast<Vec2f*>(vertexData + texCoord->byteOffset);
+
+    // Unindexed triangle lists are handled by passing nullptr indices, other modes get the fallback values. Quantized
+    // (KHR_mesh_quantization) positions, normals and texture coordinates get the fallback values as well.
+    size_t nIndices = triangles ? (primitive.nIndices > 0 ? primitive.nIndices : nVertices) : 0;
+    if (!isFloat(position))
+        nIndices = 0;
+    if (isGenerated(texCoord))
+        std::fill(texCoords, texCoords + nVertices, Vec2f::Zero());
+    if (isGenerated(normal) && nIndices == 0)
+        std::fill(normals, normals + nVertices, Vec3f::UnitZ());
+    bool generateTangentSpace = isGenerated(tangent) && nIndices > 0 && isFloat(normal) && isFloat(texCoord);
+    if (isGenerated(tangent) && !generateTangentSpace)
+        std::fill(tangents, tangents + nVertices, Vec4f(1.0f, 0.0f, 0.0f, 1.0f));
+
+    auto generate = [&]<typename T_Index>(T_Index* indices, size_t maxVertices) {
+        if (isGenerated(normal))
+            generateNormals(positions, nVertices, indices, nIndices, normals);
+        if (!generateTangentSpace)
+            return;
+
+        std::vector<Vec4f> cornerTangents(nIndices);
+        generateTangents(positions, normals, texCoords, nVertices, indices, nIndices, cornerTangents.data());
+
+        // Malformed primitives with differing attribute counts are not split
+        for (uint32_t i=0; i<primitive.nAttributes; ++i) {
+            if (primitiveAttributes[i].count != nVertices)
+                maxVertices = nVertices;
+        }
+        std::vector<Vec4f> vertexTangents;
+        std::vector<uint32_t> duplicateSources;
+        splitVertices(cornerTangents.data(), indices, nIndices, nVertices, maxVertices, &vertexTangents,
+            &duplicateSources);
+        if (duplicateSources.empty()) {
+            std::copy(vertexTangents.begin(), vertexTangents.end(), tangents);
+            return;
+        }
+
+        // Copy the vertices with the duplicates appended, vertex data shared with other primitives is left as it is
+        size_t nSplitVertices = vertexTangents.size();
+        std::vector<uint64_t> byteOffsets(primitive.nAttributes);
+        uint64_t privateSize = 0;
+        for (uint32_t i=0; i<primitive.nAttributes; ++i) {
+            const auto& attribute = primitiveAttributes[i];
+            byteOffsets[i] = alignOffset(privateSize, 16);
+            privateSize = byteOffsets[i] +
+                getComponentSize(attribute.componentType)*attribute.nComponents*nSplitVertices;
+        }
+        privateVertexData->resize(privateSize);
+        for (uint32_t i=0; i<primitive.nAttributes; ++i) {
+            auto& attribute = primitiveAttributes[i];
+            size_t elementSize = getComponentSize(attribute.componentType)*attribute.nComponents;
+            const char* src = vertexData + attribute.byteOffset;
+            char* dest = privateVertexData->data() + byteOffsets[i];
+            memcpy(dest, src, elementSize*nVertices);
+            for (size_t j=0; j<duplicateSources.size(); ++j)
+                memcpy(dest + (nVertices + j)*elementSize, src + duplicateSources[j]*elementSize, elementSize);
+            attribute.byteOffset = byteOffsets[i];
+            attribute.count = nSplitVertices;
+        }
+        memcpy(privateVertexData->data() + tangent->byteOffset, vertexTangents.data(),
+            nSplitVertices*sizeof(Vec4f));
+    };
+
+    if (nIndices == 0)
+        return;
+    if (primitive.nIndices == 0)
+        generate(static_cast<uint32_t*>(nullptr), nVertices);
+    else if (primitive.indexComponentType == static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT))
+        generate(reinterpret_cast<uint16_t*>(indexData + primitive.indexByteOffset), 0x10000);
+    else
+        generate(reinterpret_cast<uint32_t*>(indexData + primitive.indexByteOffset), 0xffffffff);
+}
+
+// Vertex cache, overdraw and vertex fetch optimization of a packed indexed triangle list. Vertex streams are
+// reordered in place and unused vertices are dropped from the attribute counts, unless the vertices are shared with
+// other primitives, in which case only the indices are reordered.
+void optimizePrimitive(
+    const BakedScene::Primitive* primitive,
+    BakedScene::Attribute* attributes,
+    char* vertexData,
+    char* indexData,
+    bool sharedVertices
+) {
+    BakedScene::Attribute* primitiveAttributes = attributes + primitive->firstAttribute;
+    const BakedScene::Attribute* position = nullptr;
+    for (uint32_t i=0; i<primitive->nAttributes; ++i) {
+        if (std::string(primitiveAttributes[i].name.data()) == "POSITION")
+            position = &primitiveAttributes[i];
+    }
+    if (position == nullptr || position->componentType !=
+        static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::FLOAT))
+        return;
+
+    size_t nVertices = position->count;
+    for (uint32_t i=0; i<primitive->nAttributes; ++i) {
+        if (primitiveAttributes[i].count != nVertices)
+            return; // malformed primitive, leave it as it is
+    }
+    const auto* positions = reinterpret_cast<const Vec3f*>(vertexData + position->byteOffset);
+
+    auto optimize = [&]<typename T_Index>(T_Index* indices) {
+        std::vector<uint32_t> clusters;
+        optimizeVertexCache(indices, primitive->nIndices, nVertices, &clusters);
+        optimizeOverdraw(indices, primitive->nIndices, positions, clusters);
+        if (sharedVertices)
+            return;
+
+        std::vector<uint32_t> remap;
+        size_t nUsedVertices = optimizeVertexFetch(indices, primitive->nIndices, nVertices, &remap);
+        for (uint32_t i=0; i<primitive->nAttributes; ++i) {
+            auto& attribute = primitiveAttributes[i];
+            remapVertices(vertexData + attribute.byteOffset,
+                getComponentSize(attribute.componentType)*attribute.nComponents, nVertices, remap);
+            attribute.count = nUsedVertices;
+        }
+    };
+
+    char* indices = indexData + primitive->indexByteOffset;
+    if (primitive->indexComponentType == static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT))
+        optimize(reinterpret_cast<uint16_t*>(indices));
+    else
+        optimize(reinterpret_cast<uint32_t*>(indices));
+}
+
+// Simplified LODs of an optimized indexed triangle list. LOD 0 (the full resolution) is not included, the
+// LOD index offsets are relative to the end of the full resolution indices.
+template <typename T_Index>
+void generateLods(
+    const BakedScene::Primitive& primitive,
+    const BakedScene::Attribute* attributes,
+    const char* vertexData,
+    const char* indexData,
+    std::vector<BakedScene::Lod>* lods,
+    std::vector<char>* lodIndexData
+) {
+    const BakedScene::Attribute* position = nullptr;
+    for (uint32_t i=0; i<primitive.nAttributes; ++i) {
+        if (std::string(attributes[primitive.firstAttribute + i].name.data()) == "POSITION")
+            position = &attributes[primitive.firstAttribute + i];
+    }
+    if (position == nullptr || position->componentType !=
+        static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::FLOAT))
+        return;
+
+    const auto* positions = reinterpret_cast<const Vec3f*>(vertexData + position->byteOffset);
+    std::vector<T_Index> previous(reinterpret_cast<const T_Index*>(indexData + primitive.indexByteOffset),
+        reinterpret_cast<const T_Index*>(indexData + primitive.indexByteOffset) + primitive.nIndices);
+    float error = 0.0f;
+    uint32_t firstIndex = static_cast<uint32_t>(primitive.nIndices);
+    for (uint32_t level=1; level<maxLods && previous.size()/3 >= 2*minLodTriangles; ++level) {
+        size_t targetIndexCount = static_cast<size_t>(static_cast<float>(previous.size()/3) * lodReduction) * 3;
+        float lodError = 0.0f;
+        auto lodIndices = simplifyMesh(previous.data(), previous.size(), positions, position->count,
+            targetIndexCount, std::numeric_limits<float>::max(), &lodError);
+        if (static_cast<float>(lodIndices.size()) > lodMinReduction*static_cast<float>(previous.size()))
+            break;
+
+        // Errors of consecutive simplifications are accumulated, an upper bound w.r.t. the full resolution
+        error += lodError;
+        optimizeVertexCache(lodIndices.data(), lodIndices.size(), position->count);
+        lods->push_back({firstIndex, static_cast<uint32_t>(lodIndices.size()), error, 0});
+        firstIndex += static_cast<uint32_t>(lodIndices.size());
+        const char* lodIndexBytes = reinterpret_cast<const char*>(lodIndices.data());
+        lodIndexData->insert(lodIndexData->end(), lodIndexBytes, lodIndexBytes + lodIndices.size()*sizeof(T_Index));
+        previous = std::move(lodIndices);
+    }
+}
+
+// sRGB transfer functions, color channels of the images are sRGB encoded (they are sampled as VK_FORMAT_*_SRGB)
+inline float srgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f*std::pow(c, 1.0f/2.4f) - 0.055f;
+}
+
+// Box filtered mip chain, dest needs to hold BakedScene::getMipChainSize() bytes. Color channels are averaged in
+// linear space like the blit based mip generation does for sRGB formats, alpha is linear already.
+void generateMipChain(const Image<uint8_t>& image, uint8_t* dest, uint32_t mipLevels)
+{
+    static const auto srgbDecodeTable = []() {
+        std::array<float, 256> table;
+        for (int i=0; i<256; ++i)
+            table[i] = srgbToLinear(static_cast<float>(i) / 255.0f);
+        return table;
+    }();
+
+    uint32_t w = image.width();
+    uint32_t h = image.height();
+    memcpy(dest, image.data(), image.nElements());
+
+    const uint8_t* src = dest;
+    for (uint32_t level = 1; level < mipLevels; ++level) {
+        uint32_t mw = std::max(w/2, 1u);
+        uint32_t mh = std::max(h/2, 1u);
+        uint8_t* dst = const_cast<uint8_t*>(src) + w*h*4;
+
+        for (uint32_t j=0; j<mh; ++j) {
+            uint32_t j0 = std::min(2*j, h-1);
+            uint32_t j1 = std::min(2*j+1, h-1);
+            for (uint32_t i=0; i<mw; ++i) {
+                uint32_t i0 = std::min(2*i, w-1);
+                uint32_t i1 = std::min(2*i+1, w-1);
+                const uint8_t* p00 = src + (j0*w + i0)*4;
+                const uint8_t* p01 = src + (j0*w + i1)*4;
+                const uint8_t* p10 = src + (j1*w + i0)*4;
+                const uint8_t* p11 = src + (j1*w + i1)*4;
+                uint8_t* p = dst + (j*mw + i)*4;
+                for (uint32_t c=0; c<3; ++c) {
+                    float linear = 0.25f*(srgbDecodeTable[p00[c]] + srgbDecodeTable[p01[c]] +
+                        srgbDecodeTable[p10[c]] + srgbDecodeTable[p11[c]]);
+                    p[c] = static_cast<uint8_t>(linearToSrgb(linear)*255.0f + 0.5f);
+                }
+                uint32_t alphaSum = p00[3] + p01[3] + p10[3] + p11[3];
+                p[3] = static_cast<uint8_t>((alphaSum + 2) / 4);
+            }
+        }
+
+        src = dst;
+        w = mw;
+        h = mh;
+    }
+}
+
+uint64_t hashFileContents(const Path& filename, uint64_t seed)
+{
+    MappedFile file(filename);
+    return hashBytes(file.data(), file.size(), seed);
+}
+
+} // namespace
+
+
+void BakedScene::Blob::own(std::vector<char>&& newStorage)
+{
+    storage = std::move(newStorage);
+    data = storage.data();
+    size = storage.size();
+}
+
+
+BakedScene::BakedScene() = default;
+
+void BakedScene::bake(const GLTFLoader& gltfLoader, StageTimings* timings)
+{
+    StageTimings::Scope bakeScope(timings, "Bake scene");
+    clear();
+
+    {   // Node hierarchy
+        StageTimings::Scope scope(timings, "Add nodes");
+        for (const auto& gltfScene : gltfLoader.getScenes()) {
+            for (const auto& gltfNodeId : gltfScene.nodes)
+                addNodes(&_nodes, -1, gltfNodeId, gltfLoader);
+        }
+    }
+
+    // Lay out vertex and index data, primitives are stored in the order of their flattened ids. Only the accessor
+    // metadata is needed for this, the data itself is packed by the tasks below. Attribute accessors shared by
+    // multiple primitives are packed once and referenced by all of them.
+    const auto& gltfAccessors = gltfLoader.getAccessors();
+    std::unordered_map<int64_t, uint32_t> packedAccessors; // accessor id -> id of the attribute packing it
+    std::vector<const GLTFLoader::Accessor*> attributeAccessors; // nullptr for shared and generated attributes
+    std::vector<int64_t> attributeAccessorIds; // -1 for generated attributes
+    std::vector<const GLTFLoader::Accessor*> indexAccessors;
+    std::vector<const GLTFLoader::Accessor*> positionAccessors;
+    std::vector<uint32_t> generatedAttributes;
+    std::vector<std::pair<uint32_t, uint32_t>> generatedAttributeRanges; // first, count per primitive
+    std::vector<char> triangleLists;
+    uint64_t vertexDataSize = 0;
+    uint64_t indexDataSize = 0;
+    for (const auto& gltfMesh : gltfLoader.getMeshes()) {
+        for (const auto& gltfPrimitive : gltfMesh.primitives) {
+            _primitives.emplace_back();
+            auto& primitive = _primitives.back();
+            primitive.firstAttribute = static_cast<uint32_t>(_attributes.size());
+            primitive.nAttributes = static_cast<uint32_t>(gltfPrimitive.attributes.size());
+            primitive.material = static_cast<int32_t>(gltfPrimitive.material);
+            positionAccessors.push_back(nullptr);
+
+            for (const auto& gltfAttribute : gltfPrimitive.attributes) {
+                const auto& accessor = gltfAccessors.at(gltfAttribute.accessorId);
+                if (gltfAttribute.name.size() >= sizeof(Attribute::name))
+                    throw std::runtime_error("Attribute name \"" + gltfAttribute.name + "\" too long");
+
+                _attributes.emplace_back();
+                auto& attribute = _attributes.back();
+                attribute.name.fill('\0');
+                gltfAttribute.name.copy(attribute.name.data(), gltfAttribute.name.size());
+                attribute.componentType = static_cast<uint32_t>(accessor.componentType);
+                attribute.nComponents = accessor.getNComponents();
+                attribute.count = accessor.count;
+                attributeAccessorIds.push_back(gltfAttribute.accessorId);
+                auto [packedAccessor, first] = packedAccessors.try_emplace(gltfAttribute.accessorId,
+                    static_cast<uint32_t>(_attributes.size() - 1));
+                if (first) {
+                    attribute.byteOffset = alignOffset(vertexDataSize, 16);
+                    vertexDataSize = attribute.byteOffset + accessor.getElementSize()*accessor.count;
+                    attributeAccessors.push_back(&accessor);
+                }
+                else {
+                    attribute.byteOffset = _attributes[packedAccessor->second].byteOffset;
+                    attributeAccessors.push_back(nullptr);
+                }
+                if (gltfAttribute.name == "POSITION")
+                    positionAccessors.back() = &accessor;
+            }
+
+            // Canonical vertex layout: normals, tangents and texture coordinates are generated in case they're
+            // missing so that all primitives can share the same vertex input state and shaders
+            uint32_t firstGeneratedAttribute = static_cast<uint32_t>(generatedAttributes.size());
+            if (positionAccessors.back() != nullptr) {
+                const auto* positionAccessor = positionAccessors.back();
+                for (const auto& [name, nComponents] : canonicalAttributes) {
+                    bool found = false;
+                    for (const auto& gltfAttribute : gltfPrimitive.attributes)
+                        found |= gltfAttribute.name == name;
+                    if (found)
+                        continue;
+
+                    _attributes.emplace_back();
+                    auto& attribute = _attributes.back();
+                    attribute.name.fill('\0');
+                    std::string(name).copy(attribute.name.data(), attribute.name.size() - 1);
+                    attribute.componentType = static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::FLOAT);
+                    attribute.nComponents = nComponents;
+                    attribute.count = positionAccessor->count;
+                    attribute.byteOffset = alignOffset(vertexDataSize, 16);
+                    vertexDataSize = attribute.byteOffset + nComponents*sizeof(float)*positionAccessor->count;
+                    attributeAccessors.push_back(nullptr);
+                    attributeAccessorIds.push_back(-1);
+                    generatedAttributes.push_back(static_cast<uint32_t>(_attributes.size() - 1));
+                    ++primitive.nAttributes;
+                }
+            }
+            generatedAttributeRanges.emplace_back(firstGeneratedAttribute,
+                static_cast<uint32_t>(generatedAttributes.size()) - firstGeneratedAttribute);
+            triangleLists.push_back(gltfPrimitive.mode == GLTFLoader::Mesh::Primitive::Mode::TRIANGLES);
+
+            primitive.nIndices = 0;
+            primitive.indexByteOffset = 0;
+            primitive.indexComponentType = static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::UNSIGNED_INT);
+            indexAccessors.push_back(nullptr);
+            if (gltfPrimitive.indices < 0)
+                continue;
+
+            const auto& accessor = gltfAccessors.at(gltfPrimitive.indices);
+            if (accessor.type != "SCALAR")
+                throw std::runtime_error("Invalid accessor for indices, type not \"SCALAR\"");
+
+            switch (accessor.componentType) {
+                case GLTFLoader::Accessor::ComponentType::UNSIGNED_BYTE: // widened, not supported by Vulkan core
+                    primitive.indexComponentType = static_cast<uint32_t>(
+                        GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT);
+                    break;
+                case GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT:
+                    primitive.indexComponentType = static_cast<uint32_t>(accessor.componentType);
+                    break;
+                case GLTFLoader::Accessor::ComponentType::UNSIGNED_INT: // narrowed in case the vertices fit
+                    primitive.indexComponentType = static_cast<uint32_t>(
+                        positionAccessors.back() != nullptr && positionAccessors.back()->count <= 0x10000 ?
+                        GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT : accessor.componentType);
+                    break;
+                default:
+                    throw std::runtime_error("Invalid accessor for indices, component type not \"UNSIGNED_BYTE\", "
+                        "\"UNSIGNED_SHORT\" or \"UNSIGNED_INT\"");
+            }
+            primitive.nIndices = accessor.count;
+            primitive.indexByteOffset = alignOffset(indexDataSize, 16);
+            indexDataSize = primitive.indexByteOffset + accessor.count*(primitive.indexComponentType ==
+                static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT) ? 2 : 4);
+            indexAccessors.back() = &accessor;
+        }
+    }
+
+    std::vector<char> vertexData(vertexDataSize);
+    std::vector<char> indexData(indexDataSize);
+    int64_t nPrimitives = static_cast<int64_t>(_primitives.size());
+
+    // Primitives sharing vertex data with others must not reorder it
+    std::unordered_map<int64_t, uint32_t> accessorUseCounts;
+    for (auto accessorId : attributeAccessorIds) {
+        if (accessorId >= 0)
+            ++accessorUseCounts[accessorId];
+    }
+    std::vector<char> sharedVertices(nPrimitives, 0);
+    for (int64_t i=0; i<nPrimitives; ++i) {
+        const auto& primitive = _primitives[i];
+        for (uint32_t j=0; j<primitive.nAttributes; ++j) {
+            int64_t accessorId = attributeAccessorIds[primitive.firstAttribute + j];
+            if (accessorId >= 0 && accessorUseCounts[accessorId] > 1)
+                sharedVertices[i] = 1;
+        }
+    }
+    std::vector<std::vector<char>> primitiveVertexData(nPrimitives); // vertices of primitives with split vertices
+    std::vector<std::vector<Lod>> primitiveLods(nPrimitives);
+    std::vector<std::vector<char>> lodIndexData(nPrimitives);
+
+    // Task graph: image decoding -> mip generation per image, attribute packing -> index packing and processing per
+    // primitive. Images are spawned first since they're the longest running tasks.
+    const auto& gltfImages = gltfLoader.getImages();
+    int64_t nImages = static_cast<int64_t>(gltfImages.size());
+    std::vector<gu2::Image<uint8_t>> decodedImages(nImages);
+    std::vector<std::vector<uint8_t>> mipChains(nImages);
+    _images.resize(nImages);
+
+    ExceptionGuard exceptionGuard;
+    #pragma omp parallel
+    #pragma omp single
+    {
+        for (int64_t i=0; i<nImages; ++i) {
+            #pragma omp task firstprivate(i) depend(out: decodedImages.data()[i])
+            exceptionGuard.run([&]() {
+                StageTimings::Scope scope(timings, "Decode images");
+                size_t encodedSize = 0;
+                const char* encodedData = gltfLoader.getImageData(gltfImages[i], &encodedSize);
+                if (encodedData != nullptr) // embedded image, decode directly from memory
+                    convertImage(readImageFromMemory<uint8_t>(encodedData, encodedSize), decodedImages[i],
+                        ImageFormat::RGBA);
+                else
+                    convertImage(readImageFromFile<uint8_t>(gltfImages[i].filename), decodedImages[i],
+                        ImageFormat::RGBA);
+            });
+
+            #pragma omp task firstprivate(i) depend(in: decodedImages.data()[i])
+            exceptionGuard.run([&]() {
+                StageTimings::Scope scope(timings, "Generate mip chains");
+                auto& decodedImage = decodedImages[i];
+                auto& image = _images[i];
+                image.width = static_cast<uint32_t>(decodedImage.width());
+                image.height = static_cast<uint32_t>(decodedImage.height());
+                if (image.width == 0 || image.height == 0)
+                    throw std::runtime_error("Image " + std::to_string(i) + " is empty");
+                image.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(image.width, image.height))))
+                    + 1;
+                image.padding = 0;
+                image.byteSize = getMipChainSize(image.width, image.height, image.mipLevels);
+                mipChains[i].resize(image.byteSize);
+                generateMipChain(decodedImage, mipChains[i].data(), image.mipLevels);
+                decodedImage = gu2::Image<uint8_t>(); // release the decoded image early
+            });
+        }
+
+        // Shared attributes are read by multiple primitive tasks, all of them are packed before those are spawned
+        #pragma omp taskgroup
+        {
+            for (int64_t i=0; i<nPrimitives; ++i) {
+                #pragma omp task firstprivate(i)
+                exceptionGuard.run([&]() {
+                    StageTimings::Scope scope(timings, "Pack vertex data");
+                    const auto& primitive = _primitives[i];
+                    for (uint32_t j=0; j<primitive.nAttributes; ++j) {
+                        uint32_t attributeId = primitive.firstAttribute + j;
+                        if (attributeAccessors[attributeId] != nullptr)
+                            packAttribute(gltfLoader, *attributeAccessors[attributeId],
+                                vertexData.data() + _attributes[attributeId].byteOffset);
+                    }
+                });
+            }
+        }
+
+        for (int64_t i=0; i<nPrimitives; ++i) {
+            #pragma omp task firstprivate(i)
+            exceptionGuard.run([&]() {
+                StageTimings::Scope scope(timings, "Pack index data");
+                const auto& primitive = _primitives[i];
+                if (indexAccessors[i] != nullptr)
+                    packIndices(gltfLoader, *indexAccessors[i], primitive.indexComponentType,
+                        indexData.data() + primitive.indexByteOffset);
+
+                auto [firstGenerated, nGenerated] = generatedAttributeRanges[i];
+                if (nGenerated > 0) {
+                    StageTimings::Scope scope(timings, "Generate normals and tangents");
+                    generateAttributes(primitive, _attributes.data(), generatedAttributes.data() + firstGenerated,
+                        nGenerated, triangleLists[i], vertexData.data(), indexData.data(), &primitiveVertexData[i]);
+                }
+
+                if (triangleLists[i] && primitive.nIndices > 0) {
+                    bool splitVertices = !primitiveVertexData[i].empty();
+                    char* primitiveVertices = splitVertices ? primitiveVertexData[i].data() : vertexData.data();
+                    {
+                        StageTimings::Scope scope(timings, "Optimize meshes");
+                        optimizePrimitive(&primitive, _attributes.data(), primitiveVertices, indexData.data(),
+                            sharedVertices[i] && !splitVertices);
+                    }
+
+                    StageTimings::Scope scope(timings, "Generate LODs");
+                    if (primitive.indexComponentType ==
+                        static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT))
+                        generateLods<uint16_t>(primitive, _attributes.data(), primitiveVertices, indexData.data(),
+                            &primitiveLods[i], &lodIndexData[i]);
+                    else
+                        generateLods<uint32_t>(primitive, _attributes.data(), primitiveVertices, indexData.data(),
+                            &primitiveLods[i], &lodIndexData[i]);
+                }
+            });
+
+            #pragma omp task firstprivate(i)
+            exceptionGuard.run([&]() {
+                StageTimings::Scope scope(timings, "Compute primitive bounds");
+                auto& primitive = _primitives[i];
+                AABB bounds;
+                if (positionAccessors[i] != nullptr)
+                    bounds = gltfLoader.getAccessorBounds(*positionAccessors[i]);
+                Eigen::Map<Vec3f>(primitive.boundsMin.data()) = bounds.min;
+                Eigen::Map<Vec3f>(primitive.boundsMax.data()) = bounds.max;
+            });
+        }
+
+        // Materials are cheap, process them while the tasks are running
+        exceptionGuard.run([&]() {
+            StageTimings::Scope scope(timings, "Resolve materials");
+            resolveMaterials(gltfLoader);
+        });
+    }
+    exceptionGuard.rethrow();
+
+    {   // Lay out the final vertex data: vertices of the split primitives are moved in from their private copies and
+        // vertices dropped by the optimization are trimmed, attributes shared by multiple primitives stay shared
+        StageTimings::Scope scope(timings, "Lay out vertex data");
+        std::map<std::pair<int64_t, uint64_t>, uint64_t> packedOffsets; // (primitive or -1, byte offset) -> offset
+        std::vector<std::tuple<const char*, uint64_t, uint64_t>> copies; // source, packed offset, size
+        uint64_t packedVertexDataSize = 0;
+        for (int64_t i=0; i<nPrimitives; ++i) {
+            const auto& primitive = _primitives[i];
+            bool split = !primitiveVertexData[i].empty();
+            const char* source = split ? primitiveVertexData[i].data() : vertexData.data();
+            for (uint32_t j=0; j<primitive.nAttributes; ++j) {
+                auto& attribute = _attributes[primitive.firstAttribute + j];
+                auto [packedOffset, first] = packedOffsets.try_emplace({split ? i : -1, attribute.byteOffset}, 0);
+                if (first) {
+                    uint64_t size = getComponentSize(attribute.componentType)*attribute.nComponents*attribute.count;
+                    packedOffset->second = alignOffset(packedVertexDataSize, 16);
+                    packedVertexDataSize = packedOffset->second + size;
+                    copies.emplace_back(source + attribute.byteOffset, packedOffset->second, size);
+                }
+                attribute.byteOffset = packedOffset->second;
+            }
+        }
+
+        std::vector<char> packedVertexData(packedVertexDataSize);
+        int64_t nCopies = static_cast<int64_t>(copies.size());
+        #pragma omp parallel for
+        for (int64_t i=0; i<nCopies; ++i) {
+            auto [source, packedOffset, size] = copies[i];
+            memcpy(packedVertexData.data() + packedOffset, source, size);
+        }
+        vertexData = std::vector<char>();
+        primitiveVertexData = std::vector<std::vector<char>>();
+        _vertexData.own(std::move(packedVertexData));
+    }
+
+    {   // Lay out the LOD indices after the full resolution indices of each primitive
+        StageTimings::Scope scope(timings, "Pack LODs");
+        std::vector<uint64_t> indexByteOffsets(nPrimitives);
+        uint64_t lodIndexDataSize = 0;
+        for (int64_t i=0; i<nPrimitives; ++i) {
+            auto& primitive = _primitives[i];
+            indexByteOffsets[i] = alignOffset(lodIndexDataSize, 16);
+            lodIndexDataSize = indexByteOffsets[i] + primitive.nIndices*getComponentSize(primitive.indexComponentType) +
+                lodIndexData[i].size();
+
+            primitive.firstLod = static_cast<uint32_t>(_lods.size());
+            primitive.nLods = static_cast<uint32_t>(primitiveLods[i].size()) + 1;
+            _lods.push_back({0, static_cast<uint32_t>(primitive.nIndices), 0.0f, 0});
+            _lods.insert(_lods.end(), primitiveLods[i].begin(), primitiveLods[i].end());
+        }
+
+        std::vector<char> lodIndexDataPacked(lodIndexDataSize);
+        #pragma omp parallel for
+        for (int64_t i=0; i<nPrimitives; ++i) {
+            auto& primitive = _primitives[i];
+            size_t baseSize = primitive.nIndices*getComponentSize(primitive.indexComponentType);
+            char* dest = lodIndexDataPacked.data() + indexByteOffsets[i];
+            memcpy(dest, indexData.data() + primitive.indexByteOffset, baseSize);
+            memcpy(dest + baseSize, lodIndexData[i].data(), lodIndexData[i].size());
+            primitive.indexByteOffset = indexByteOffsets[i];
+        }
+        _indexData.own(std::move(lodIndexDataPacked));
+    }
+
+    // Concatenate the mip chains
+    StageTimings::Scope scope(timings, "Pack images");
+    uint64_t imageDataSize = 0;
+    for (auto& image : _images) {
+        image.byteOffset = alignOffset(imageDataSize, 16);
+        imageDataSize = image.byteOffset + image.byteSize;
+    }
+    std::vector<char> imageData(imageDataSize);
+    #pragma omp parallel for
+    for (int64_t i=0; i<nImages; ++i) {
+        memcpy(imageData.data() + _images[i].byteOffset, mipChains[i].data(), _images[i].byteSize);
+        mipChains[i] = std::vector<uint8_t>();
+    }
+    _imageData.own(std::move(imageData));
+}
+
+bool BakedScene::readFromFile(const Path& filename, uint64_t sourceHash)
+{
+    if (!std::filesystem::exists(filename))
+        return false;
+
+    MappedFile file(filename);
+    if (file.size() < sizeof(Header))
+        return false;
+
+    Header header;
+    memcpy(&header, file.data(), sizeof(Header));
+    if (header.magic != bakedSceneMagic || header.version != bakedSceneVersion || header.sourceHash != sourceHash)
+        return false;
+
+    for (const auto& section : header.sections) {
+        if (section.byteOffset > file.size() || section.byteSize > file.size() - section.byteOffset)
+            throw std::runtime_error("Corrupted baked scene file " + filename.string());
+    }
+
+    clear();
+    readTable(&_nodes, file.data(), header.sections[SECTION_NODES]);
+    readTable(&_attributes, file.data(), header.sections[SECTION_ATTRIBUTES]);
+    readTable(&_primitives, file.data(), header.sections[SECTION_PRIMITIVES]);
+    readTable(&_lods, file.data(), header.sections[SECTION_LODS]);
+    readTable(&_materials, file.data(), header.sections[SECTION_MATERIALS]);
+    readTable(&_images, file.data(), header.sections[SECTION_IMAGES]);
+
+    auto mapBlob = [&](Blob* blob, const SectionEntry& section) {
+        blob->storage.clear();
+        blob->data = file.data() + section.byteOffset;
+        blob->size = section.byteSize;
+    };
+    mapBlob(&_vertexData, header.sections[SECTION_VERTEX_DATA]);
+    mapBlob(&_indexData, header.sections[SECTION_INDEX_DATA]);
+    mapBlob(&_imageData, header.sections[SECTION_IMAGE_DATA]);
+    _mappedFile = std::move(file);
+
+    return true;
+}
+
+void BakedScene::writeToFile(const Path& filename, uint64_t sourceHash) const
+{
+    struct SectionSource {
+        const void* data;
+        size_t      size;
+    };
+    SectionSource sources[N_SECTIONS];
+    sources[SECTION_NODES] = {_nodes.data(), _nodes.size()*sizeof(Node)};
+    sources[SECTION_ATTRIBUTES] = {_attributes.data(), _attributes.size()*sizeof(Attribute)};
+    sources[SECTION_PRIMITIVES] = {_primitives.data(), _primitives.size()*sizeof(Primitive)};
+    sources[SECTION_LODS] = {_lods.data(), _lods.size()*sizeof(Lod)};
+    sources[SECTION_MATERIALS] = {_materials.data(), _materials.size()*sizeof(Material)};
+    sources[SECTION_IMAGES] = {_images.data(), _images.size()*sizeof(Image)};
+    sources[SECTION_VERTEX_DATA] = {_vertexData.data, _vertexData.size};
+    sources[SECTION_INDEX_DATA] = {_indexData.data, _indexData.size};
+    sources[SECTION_IMAGE_DATA] = {_imageData.data, _imageData.size};
+
+    Header header{};
+    header.magic = bakedSceneMagic;
+    header.version = bakedSceneVersion;
+    header.sourceHash = sourceHash;
+    uint64_t offset = alignOffset(sizeof(Header), bakedSceneAlignment);
+    for (uint32_t i=0; i<N_SECTIONS; ++i) {
+        header.sections[i].byteOffset = offset;
+        header.sections[i].byteSize = sources[i].size;
+        offset = alignOffset(offset + sources[i].size, bakedSceneAlignment);
+    }
+
+    // Write to a temporary file first, the current file might be the one mapped by this object
+    Path tmpFilename = filename;
+    tmpFilename += ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("Unable to open file " + tmpFilename.string() + " for writing");
+
+        static const char padding[bakedSceneAlignment] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        uint64_t position = sizeof(Header);
+        for (uint32_t i=0; i<N_SECTIONS; ++i) {
+            file.write(padding, static_cast<std::streamsize>(header.sections[i].byteOffset - position));
+            if (sources[i].size > 0)
+                file.write(reinterpret_cast<const char*>(sources[i].data), static_cast<std::streamsize>(sources[i].size));
+            position = header.sections[i].byteOffset + sources[i].size;
+        }
+
+        if (!file)
+            throw std::runtime_error("Writing to " + tmpFilename.string() + " failed");
+    }
+    std::filesystem::rename(tmpFilename, filename);
+}
+
+const BakedScene::Attribute* BakedScene::findAttribute(
+    const Primitive& primitive,
+    const std::string& name
+) const noexcept {
+    for (uint32_t i=0; i<primitive.nAttributes; ++i) {
+        const auto& attribute = _attributes[primitive.firstAttribute + i];
+        if (name == attribute.name.data())
+            return &attribute;
+    }
+    return nullptr;
+}
+
+uint64_t BakedScene::computeSourceHash(const Path& gltfFilename)
+{
+    MappedFile gltfFile(gltfFilename);
+    uint64_t hash = hashBytes(gltfFile.data(), gltfFile.size(), bakedSceneVersion);
+
+    Json gltfJson = Json::parse(gltfFile.data(), gltfFile.data() + gltfFile.size());
+    for (const auto* arrayName : {"buffers", "images"}) {
+        if (!gltfJson.contains(arrayName))
+            continue;
+        for (const auto& item : gltfJson[arrayName]) {
+            // Data URIs are part of the JSON and thus already hashed
+            if (item.contains("uri") && !GLTFLoader::isDataUri(item["uri"].get<std::string>()))
+                hash = hashFileContents(gltfFilename.parent_path() / item["uri"].get<std::string>(), hash);
+        }
+    }
+
+    return hash;
+}
+
+size_t BakedScene::getMipChainSize(uint32_t width, uint32_t height, uint32_t mipLevels) noexcept
+{
+    size_t size = 0;
+    for (uint32_t i=0; i<mipLevels; ++i) {
+        size += static_cast<size_t>(width)*height*4;
+        width = std::max(width/2, 1u);
+        height = std::max(height/2, 1u);
+    }
+    return size;
+}
+
+void BakedScene::resolveMaterials(const GLTFLoader& gltfLoader)
+{
+    // Texture references are resolved to image indices
+    const auto& gltfTextures = gltfLoader.getTextures();
+    auto resolveTexture = [&](int64_t textureId, int64_t texCoord) {
+        TextureReference reference;
+        if (textureId >= 0)
+            reference.image = static_cast<int32_t>(gltfTextures.at(textureId).source);
+        reference.texCoord = static_cast<int32_t>(texCoord);
+        return reference;
+    };
+
+    for (const auto& gltfMaterial : gltfLoader.getMaterials()) {
+        _materials.emplace_back();
+        auto& material = _materials.back();
+        const auto& pbr = gltfMaterial.pbrMetallicRoughness;
+        material.baseColorTexture = resolveTexture(pbr.baseColorTexture.index, pbr.baseColorTexture.texCoord);
+        material.metallicRoughnessTexture = resolveTexture(pbr.metallicRoughnessTexture.index,
+            pbr.metallicRoughnessTexture.texCoord);
+        material.normalTexture = resolveTexture(gltfMaterial.normalTexture.index,
+            gltfMaterial.normalTexture.texCoord);
+        for (int i=0; i<4; ++i)
+            material.baseColorFactor[i] = static_cast<float>(pbr.baseColorFactor(i));
+        material.metallicFactor = pbr.metallicFactor;
+        material.roughnessFactor = pbr.roughnessFactor;
+        material.normalScale = static_cast<float>(gltfMaterial.normalTexture.scale);
+    }
+}
+
+void BakedScene::clear()
+{
+    _nodes.clear();
+    _attributes.clear();
+    _primitives.clear();
+    _lods.clear();
+    _materials.clear();
+    _images.clear();
+    _vertexData = Blob();
+    _indexData = Blob();
+    _imageData = Blob();
+    _mappedFile.close();
+}
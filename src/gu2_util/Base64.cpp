@@ -0,0 +1,227 @@
+//
+// Project: GraphicsUtils2
+// File: Base64.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "Base64.hpp"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint8_t invalidSextet {0xff};
+
+constexpr std::array<uint8_t, 256> createDecodeTable()
+{
+    std::array<uint8_t, 256> table{};
+    for (auto& t : table)
+        t = invalidSextet;
+    for (int i=0; i<26; ++i) {
+        table['A' + i] = static_cast<uint8_t>(i);
+        table['a' + i] = static_cast<uint8_t>(26 + i);
+    }
+    for (int i=0; i<10; ++i)
+        table['0' + i] = static_cast<uint8_t>(52 + i);
+    table['+'] = 62;
+    table['/'] = 63;
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> decodeTable = createDecodeTable();
+
+// Length of the input without padding
+size_t getUnpaddedSize(const char* src, size_t srcSize)
+{
+    for (int i=0; i<2 && srcSize > 0 && src[srcSize-1] == '='; ++i)
+        --srcSize;
+    return srcSize;
+}
+
+[[noreturn]] void throwInvalidCharacter(const char* src, size_t position)
+{
+    throw std::runtime_error("Invalid base64 character '" + std::string(1, src[position]) + "' at position " +
+        std::to_string(position));
+}
+
+// Decode unpadded input
+void decodeScalar(const char* src, size_t srcSize, size_t srcOffset, uint8_t* dest)
+{
+    size_t i = 0;
+    for (; i+4 <= srcSize; i+=4) {
+        uint32_t sextets[4];
+        for (int j=0; j<4; ++j) {
+            sextets[j] = decodeTable[static_cast<uint8_t>(src[i+j])];
+            if (sextets[j] == invalidSextet)
+                throwInvalidCharacter(src - srcOffset, srcOffset + i + j);
+        }
+        uint32_t v = (sextets[0] << 18) | (sextets[1] << 12) | (sextets[2] << 6) | sextets[3];
+        *(dest++) = static_cast<uint8_t>(v >> 16);
+        *(dest++) = static_cast<uint8_t>(v >> 8);
+        *(dest++) = static_cast<uint8_t>(v);
+    }
+
+    // Tail, 2 or 3 characters
+    size_t nRemaining = srcSize - i;
+    if (nRemaining == 0)
+        return;
+    if (nRemaining == 1)
+        throw std::runtime_error("Invalid base64 input length");
+
+    uint32_t v = 0;
+    for (size_t j=0; j<nRemaining; ++j) {
+        uint32_t sextet = decodeTable[static_cast<uint8_t>(src[i+j])];
+        if (sextet == invalidSextet)
+            throwInvalidCharacter(src - srcOffset, srcOffset + i + j);
+        v |= sextet << (18 - 6*j);
+    }
+    *(dest++) = static_cast<uint8_t>(v >> 16);
+    if (nRemaining == 3)
+        *dest = static_cast<uint8_t>(v >> 8);
+}
+
+#if defined(__AVX2__)
+
+// Translates 32 characters into 24 bytes (written as 32 bytes, last 8 are garbage). Returns false in case
+// the input block contains invalid characters. Lookup tables by Wojciech Muła and Daniel Lemire.
+inline bool decodeBlockAVX2(const char* src, uint8_t* dest)
+{
+    const __m256i lutLo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lutHi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2f);
+
+    __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+
+    // Validate and translate ASCII to sextets
+    __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask2F);
+    __m256i loNibbles = _mm256_and_si256(in, mask2F);
+    __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+    __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+    if (!_mm256_testz_si256(lo, hi))
+        return false;
+    __m256i eq2F = _mm256_cmpeq_epi8(in, mask2F);
+    __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+    in = _mm256_add_epi8(in, roll);
+
+    // Pack 4 sextets into 3 bytes
+    __m256i merged = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), merged);
+
+    return true;
+}
+
+constexpr size_t simdBlockSrcSize   {32};
+constexpr size_t simdBlockDestSize  {24};
+constexpr size_t simdBlockStoreSize {32};
+#define GU2_BASE64_DECODE_BLOCK decodeBlockAVX2
+
+#elif defined(__SSSE3__)
+
+// Translates 16 characters into 12 bytes (written as 16 bytes, last 4 are garbage). Returns false in case
+// the input block contains invalid characters. Lookup tables by Wojciech Muła and Daniel Lemire.
+inline bool decodeBlockSSSE3(const char* src, uint8_t* dest)
+{
+    const __m128i lutLo = _mm_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lutHi = _mm_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2f);
+
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+
+    // Validate and translate ASCII to sextets
+    __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+    __m128i loNibbles = _mm_and_si128(in, mask2F);
+    __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+    __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff)
+        return false;
+    __m128i eq2F = _mm_cmpeq_epi8(in, mask2F);
+    __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+    in = _mm_add_epi8(in, roll);
+
+    // Pack 4 sextets into 3 bytes
+    __m128i merged = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), merged);
+
+    return true;
+}
+
+constexpr size_t simdBlockSrcSize   {16};
+constexpr size_t simdBlockDestSize  {12};
+constexpr size_t simdBlockStoreSize {16};
+#define GU2_BASE64_DECODE_BLOCK decodeBlockSSSE3
+
+#endif
+
+} // namespace
+
+
+size_t gu2::getBase64DecodedSize(const char* src, size_t srcSize)
+{
+    srcSize = getUnpaddedSize(src, srcSize);
+    size_t size = (srcSize / 4) * 3;
+    switch (srcSize % 4) {
+        case 2: return size + 1;
+        case 3: return size + 2;
+        default: return size;
+    }
+}
+
+void gu2::decodeBase64(const char* src, size_t srcSize, void* dest)
+{
+#ifdef GU2_BASE64_DECODE_BLOCK
+    srcSize = getUnpaddedSize(src, srcSize);
+    auto* dest8 = reinterpret_cast<uint8_t*>(dest);
+    size_t destSize = getBase64DecodedSize(src, srcSize);
+
+    // The blocks write past the decoded bytes, stop while the store still fits in dest
+    size_t i = 0;
+    size_t d = 0;
+    for (; i + simdBlockSrcSize <= srcSize && d + simdBlockStoreSize <= destSize;
+        i += simdBlockSrcSize, d += simdBlockDestSize) {
+        if (!GU2_BASE64_DECODE_BLOCK(src + i, dest8 + d))
+            break; // let the scalar path locate the invalid character
+    }
+
+    decodeScalar(src + i, srcSize - i, i, dest8 + d);
+#else
+    decodeBase64Scalar(src, srcSize, dest);
+#endif
+}
+
+void gu2::decodeBase64Scalar(const char* src, size_t srcSize, void* dest)
+{
+    decodeScalar(src, getUnpaddedSize(src, srcSize), 0, reinterpret_cast<uint8_t*>(dest));
+}
@@ -0,0 +1,166 @@
+//
+// Project: GraphicsUtils2
+// File: Bounds.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+
+using namespace gu2;
+
+
+namespace {
+
+// Fold interleaved xyz lanes into per-component bounds, lane k holds component k % 3
+void foldLanes(const float* mins, const float* maxs, size_t nLanes, AABB* aabb)
+{
+    for (size_t k=0; k<nLanes; ++k) {
+        aabb->min(k % 3) = std::min(aabb->min(k % 3), mins[k]);
+        aabb->max(k % 3) = std::max(aabb->max(k % 3), maxs[k]);
+    }
+}
+
+} // namespace
+
+
+AABB AABB::transformed(const Mat4f& transformation) const noexcept
+{
+    if (isEmpty())
+        return *this;
+
+    AABB aabb;
+    aabb.min = transformation.block<3,1>(0,3);
+    aabb.max = aabb.min;
+    for (int j=0; j<3; ++j) {
+        for (int i=0; i<3; ++i) {
+            float a = transformation(i,j)*min(j);
+            float b = transformation(i,j)*max(j);
+            aabb.min(i) += std::min(a, b);
+            aabb.max(i) += std::max(a, b);
+        }
+    }
+    return aabb;
+}
+
+
+AABB gu2::computeAABB(const float* positions, size_t nPositions, size_t stride) noexcept
+{
+    if (stride != 0 && stride != 3*sizeof(float))
+        return computeAABBScalar(positions, nPositions, stride);
+
+    AABB aabb;
+    size_t i = 0;
+#if defined(__AVX__)
+    // 8 positions per iteration, the 24 floats span 3 registers with the components interleaved
+    if (nPositions >= 8) {
+        __m256 min0 = _mm256_loadu_ps(positions);
+        __m256 min1 = _mm256_loadu_ps(positions + 8);
+        __m256 min2 = _mm256_loadu_ps(positions + 16);
+        __m256 max0 = min0;
+        __m256 max1 = min1;
+        __m256 max2 = min2;
+        for (i=8; i+8 <= nPositions; i+=8) {
+            const float* p = positions + i*3;
+            __m256 v0 = _mm256_loadu_ps(p);
+            __m256 v1 = _mm256_loadu_ps(p + 8);
+            __m256 v2 = _mm256_loadu_ps(p + 16);
+            min0 = _mm256_min_ps(min0, v0);
+            min1 = _mm256_min_ps(min1, v1);
+            min2 = _mm256_min_ps(min2, v2);
+            max0 = _mm256_max_ps(max0, v0);
+            max1 = _mm256_max_ps(max1, v1);
+            max2 = _mm256_max_ps(max2, v2);
+        }
+
+        alignas(32) float mins[24];
+        alignas(32) float maxs[24];
+        _mm256_store_ps(mins, min0);
+        _mm256_store_ps(mins + 8, min1);
+        _mm256_store_ps(mins + 16, min2);
+        _mm256_store_ps(maxs, max0);
+        _mm256_store_ps(maxs + 8, max1);
+        _mm256_store_ps(maxs + 16, max2);
+        foldLanes(mins, maxs, 24, &aabb);
+    }
+#elif defined(__SSE__)
+    // 4 positions per iteration, the 12 floats span 3 registers with the components interleaved
+    if (nPositions >= 4) {
+        __m128 min0 = _mm_loadu_ps(positions);
+        __m128 min1 = _mm_loadu_ps(positions + 4);
+        __m128 min2 = _mm_loadu_ps(positions + 8);
+        __m128 max0 = min0;
+        __m128 max1 = min1;
+        __m128 max2 = min2;
+        for (i=4; i+4 <= nPositions; i+=4) {
+            const float* p = positions + i*3;
+            __m128 v0 = _mm_loadu_ps(p);
+            __m128 v1 = _mm_loadu_ps(p + 4);
+            __m128 v2 = _mm_loadu_ps(p + 8);
+            min0 = _mm_min_ps(min0, v0);
+            min1 = _mm_min_ps(min1, v1);
+            min2 = _mm_min_ps(min2, v2);
+            max0 = _mm_max_ps(max0, v0);
+            max1 = _mm_max_ps(max1, v1);
+            max2 = _mm_max_ps(max2, v2);
+        }
+
+        alignas(16) float mins[12];
+        alignas(16) float maxs[12];
+        _mm_store_ps(mins, min0);
+        _mm_store_ps(mins + 4, min1);
+        _mm_store_ps(mins + 8, min2);
+        _mm_store_ps(maxs, max0);
+        _mm_store_ps(maxs + 4, max1);
+        _mm_store_ps(maxs + 8, max2);
+        foldLanes(mins, maxs, 12, &aabb);
+    }
+#endif
+
+    if (i < nPositions)
+        aabb.extend(computeAABBScalar(positions + i*3, nPositions - i));
+    return aabb;
+}
+
+AABB gu2::computeAABBScalar(const float* positions, size_t nPositions, size_t stride) noexcept
+{
+    if (stride == 0)
+        stride = 3*sizeof(float);
+
+    AABB aabb;
+    const char* p = reinterpret_cast<const char*>(positions);
+    for (size_t i=0; i<nPositions; ++i, p+=stride)
+        aabb.extend(Eigen::Map<const Vec3f>(reinterpret_cast<const float*>(p)));
+    return aabb;
+}
+
+BoundingSphere gu2::computeBoundingSphere(const AABB& aabb) noexcept
+{
+    BoundingSphere sphere;
+    if (aabb.isEmpty())
+        return sphere;
+
+    sphere.center = aabb.center();
+    sphere.radius = aabb.extent().norm();
+    return sphere;
+}
+
+float gu2::intersectRay(const AABB& aabb, const Vec3f& origin, const Vec3f& invDirection, float tMax) noexcept
+{
+    Vec3f t0 = (aabb.min - origin).cwiseProduct(invDirection);
+    Vec3f t1 = (aabb.max - origin).cwiseProduct(invDirection);
+    float tNear = std::max(t0.cwiseMin(t1).maxCoeff(), 0.0f);
+    float tFar = std::min(t0.cwiseMax(t1).minCoeff(), tMax);
+    return tNear <= tFar ? tNear : -1.0f;
+}
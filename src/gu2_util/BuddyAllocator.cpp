@@ -0,0 +1,113 @@
+//
+// Project: GraphicsUtils2
+// File: BuddyAllocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "BuddyAllocator.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+
+using namespace gu2;
+
+
+BuddyAllocator::BuddyAllocator(uint64_t capacity, uint64_t minBlockSize) :
+    _capacity       (capacity),
+    _minBlockSize   (minBlockSize),
+    _usedSize       (0)
+{
+    if (!std::has_single_bit(_minBlockSize))
+        throw std::runtime_error("BuddyAllocator: minimum block size must be a power of two");
+    if (_capacity % _minBlockSize != 0 || (_capacity > 0 && !std::has_single_bit(_capacity / _minBlockSize)))
+        throw std::runtime_error("BuddyAllocator: capacity must be the minimum block size times a power of two");
+
+    clear();
+}
+
+uint64_t BuddyAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    if (!std::has_single_bit(alignment))
+        throw std::runtime_error("BuddyAllocator: alignment must be a power of two");
+    if (_capacity == 0)
+        return invalidOffset;
+
+    uint64_t blockSize = std::bit_ceil(std::max({size, alignment, _minBlockSize}));
+    if (blockSize > _capacity)
+        return invalidOffset;
+    auto order = static_cast<uint32_t>(std::countr_zero(blockSize / _minBlockSize));
+
+    // Smallest free block large enough, split in halves down to the requested order
+    uint32_t freeOrder = order;
+    while (freeOrder < _freeBlocks.size() && _freeBlocks[freeOrder].empty())
+        ++freeOrder;
+    if (freeOrder == _freeBlocks.size())
+        return invalidOffset;
+
+    uint64_t offset = *_freeBlocks[freeOrder].begin();
+    _freeBlocks[freeOrder].erase(_freeBlocks[freeOrder].begin());
+    while (freeOrder > order) {
+        --freeOrder;
+        _freeBlocks[freeOrder].insert(offset + getBlockSize(freeOrder));
+    }
+
+    _allocations.emplace(offset, order);
+    _usedSize += blockSize;
+    return offset;
+}
+
+void BuddyAllocator::free(uint64_t offset)
+{
+    auto it = _allocations.find(offset);
+    if (it == _allocations.end())
+        throw std::runtime_error("BuddyAllocator: no allocation at offset " + std::to_string(offset));
+
+    uint32_t order = it->second;
+    _allocations.erase(it);
+    _usedSize -= getBlockSize(order);
+
+    // Merge with the buddy as long as it is free
+    while (order+1 < _freeBlocks.size()) {
+        uint64_t buddy = offset ^ getBlockSize(order);
+        auto buddyIt = _freeBlocks[order].find(buddy);
+        if (buddyIt == _freeBlocks[order].end())
+            break;
+        _freeBlocks[order].erase(buddyIt);
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+    _freeBlocks[order].insert(offset);
+}
+
+void BuddyAllocator::clear()
+{
+    _allocations.clear();
+    _usedSize = 0;
+    _freeBlocks.clear();
+    if (_capacity > 0) {
+        _freeBlocks.resize(std::countr_zero(_capacity / _minBlockSize) + 1);
+        _freeBlocks.back().insert(0);
+    }
+}
+
+uint64_t BuddyAllocator::getSize(uint64_t offset) const
+{
+    auto it = _allocations.find(offset);
+    return it == _allocations.end() ? 0 : getBlockSize(it->second);
+}
+
+uint64_t BuddyAllocator::getLargestFreeBlock() const
+{
+    for (size_t order=_freeBlocks.size(); order>0; --order) {
+        if (!_freeBlocks[order-1].empty())
+            return getBlockSize(static_cast<uint32_t>(order-1));
+    }
+    return 0;
+}
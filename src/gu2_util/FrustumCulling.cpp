@@ -0,0 +1,182 @@
+//
+// Project: GraphicsUtils2
+// File: FrustumCulling.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "FrustumCulling.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+
+using namespace gu2;
+
+
+namespace {
+
+// Spheres per parallel work item, multiple of the SIMD width
+constexpr size_t    cullingChunkSize    {2048};
+
+// Test spheres [begin, end) and write the ids of the visible ones to dest, returns the number of visible spheres
+uint32_t cullRangeScalar(const Frustum& frustum, const BoundingSpheres& spheres, size_t begin, size_t end,
+    uint32_t* dest)
+{
+    uint32_t nVisible = 0;
+    for (size_t i=begin; i<end; ++i) {
+        bool visible = spheres.radius[i] >= 0.0f;
+        for (int p=0; p<6 && visible; ++p) {
+            const Vec4f& plane = frustum.planes[p];
+            visible = plane.x()*spheres.x[i] + plane.y()*spheres.y[i] + plane.z()*spheres.z[i] + plane.w() >=
+                -spheres.radius[i];
+        }
+        dest[nVisible] = static_cast<uint32_t>(i);
+        nVisible += visible;
+    }
+    return nVisible;
+}
+
+uint32_t cullRange(const Frustum& frustum, const BoundingSpheres& spheres, size_t begin, size_t end,
+    uint32_t* dest)
+{
+    uint32_t nVisible = 0;
+    size_t i = begin;
+#if defined(__AVX__)
+    __m256 planes[6][4];
+    for (int p=0; p<6; ++p) {
+        for (int c=0; c<4; ++c)
+            planes[p][c] = _mm256_set1_ps(frustum.planes[p](c));
+    }
+    __m256 zero = _mm256_setzero_ps();
+    for (; i+8 <= end; i+=8) {
+        __m256 x = _mm256_loadu_ps(&spheres.x[i]);
+        __m256 y = _mm256_loadu_ps(&spheres.y[i]);
+        __m256 z = _mm256_loadu_ps(&spheres.z[i]);
+        __m256 radius = _mm256_loadu_ps(&spheres.radius[i]);
+        __m256 negRadius = _mm256_sub_ps(zero, radius);
+        __m256 visible = _mm256_cmp_ps(radius, zero, _CMP_GE_OQ);
+        for (int p=0; p<6; ++p) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[p][0], x),
+                _mm256_mul_ps(planes[p][1], y)), _mm256_add_ps(_mm256_mul_ps(planes[p][2], z), planes[p][3]));
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+        }
+
+        // Compact the lane ids of the visible spheres
+        int mask = _mm256_movemask_ps(visible);
+        while (mask != 0) {
+            int lane = __builtin_ctz(mask);
+            dest[nVisible++] = static_cast<uint32_t>(i + lane);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE__)
+    __m128 planes[6][4];
+    for (int p=0; p<6; ++p) {
+        for (int c=0; c<4; ++c)
+            planes[p][c] = _mm_set1_ps(frustum.planes[p](c));
+    }
+    __m128 zero = _mm_setzero_ps();
+    for (; i+4 <= end; i+=4) {
+        __m128 x = _mm_loadu_ps(&spheres.x[i]);
+        __m128 y = _mm_loadu_ps(&spheres.y[i]);
+        __m128 z = _mm_loadu_ps(&spheres.z[i]);
+        __m128 radius = _mm_loadu_ps(&spheres.radius[i]);
+        __m128 negRadius = _mm_sub_ps(zero, radius);
+        __m128 visible = _mm_cmpge_ps(radius, zero);
+        for (int p=0; p<6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+                _mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negRadius));
+        }
+
+        int mask = _mm_movemask_ps(visible);
+        while (mask != 0) {
+            int lane = __builtin_ctz(mask);
+            dest[nVisible++] = static_cast<uint32_t>(i + lane);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    if (i < end)
+        nVisible += cullRangeScalar(frustum, spheres, i, end, dest + nVisible);
+    return nVisible;
+}
+
+} // namespace
+
+
+Frustum Frustum::fromViewProjection(const Mat4f& viewProjection) noexcept
+{
+    // Gribb-Hartmann plane extraction, Vulkan clip space has 0 <= z <= w
+    Frustum frustum;
+    Vec4f row0 = viewProjection.row(0).transpose();
+    Vec4f row1 = viewProjection.row(1).transpose();
+    Vec4f row2 = viewProjection.row(2).transpose();
+    Vec4f row3 = viewProjection.row(3).transpose();
+    frustum.planes[0] = row3 + row0; // left
+    frustum.planes[1] = row3 - row0; // right
+    frustum.planes[2] = row3 + row1; // top / bottom depending on the y flip
+    frustum.planes[3] = row3 - row1;
+    frustum.planes[4] = row2;        // near, far in case of reversed depth
+    frustum.planes[5] = row3 - row2;
+
+    for (auto& plane : frustum.planes) {
+        float length = plane.head<3>().norm();
+        if (length > 0.0f)
+            plane /= length;
+        else
+            plane << 0.0f, 0.0f, 0.0f, 1.0f; // plane at infinity
+    }
+    return frustum;
+}
+
+void gu2::cullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<uint32_t>* visible,
+    CullingStats* stats)
+{
+    size_t nSpheres = spheres.size();
+    int64_t nChunks = static_cast<int64_t>((nSpheres + cullingChunkSize - 1) / cullingChunkSize);
+    visible->resize(nSpheres);
+    std::vector<uint32_t> chunkVisible(nChunks);
+
+    // Each chunk writes its visible ids to its own range of the output, compacted afterwards
+    #pragma omp parallel for if (nChunks > 1)
+    for (int64_t c=0; c<nChunks; ++c) {
+        size_t begin = c*cullingChunkSize;
+        size_t end = std::min(begin + cullingChunkSize, nSpheres);
+        chunkVisible[c] = cullRange(frustum, spheres, begin, end, visible->data() + begin);
+    }
+
+    size_t nVisible = 0;
+    for (int64_t c=0; c<nChunks; ++c) {
+        if (nVisible != c*cullingChunkSize)
+            memmove(visible->data() + nVisible, visible->data() + c*cullingChunkSize, chunkVisible[c]*sizeof(uint32_t));
+        nVisible += chunkVisible[c];
+    }
+    visible->resize(nVisible);
+
+    if (stats != nullptr) {
+        stats->nTested += nSpheres;
+        stats->nVisible += nVisible;
+    }
+}
+
+void gu2::cullSpheresScalar(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<uint32_t>* visible,
+    CullingStats* stats)
+{
+    visible->resize(spheres.size());
+    visible->resize(cullRangeScalar(frustum, spheres, 0, spheres.size(), visible->data()));
+
+    if (stats != nullptr) {
+        stats->nTested += spheres.size();
+        stats->nVisible += visible->size();
+    }
+}
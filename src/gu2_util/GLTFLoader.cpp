@@ -9,291 +9,188 @@
 //
 
 #include "GLTFLoader.hpp"
+#include "Base64.hpp"
 #include "MathUtils.hpp"
+#include "Parallel.hpp"
+#include "StageTimings.hpp"
 
-#include <fstream>
-#include <iostream> // TODO temp
-
-#ifdef __unix__
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <unistd.h>
-#else
-#error "Memory mapping only supported on unix systems"
-#endif // __unix__
+#include <algorithm>
 
 
 using namespace gu2;
 
 
-GLTFLoader::Buffer::~Buffer()
+namespace {
+
+// Decode base64 data URI of form "data:[<mime type>][;base64],<data>" into aligned storage
+AlignedStorage decodeDataUri(const std::string& uri, std::string* mimeType)
 {
-    if (buffer != nullptr) {
-        munmap(buffer, bufferSize);
-    }
+    size_t dataStart = uri.find(',');
+    if (dataStart == std::string::npos)
+        throw std::runtime_error("Invalid data URI: no ',' found");
+
+    std::string_view header(uri.data() + 5, dataStart - 5); // skip "data:"
+    if (!header.ends_with(";base64"))
+        throw std::runtime_error("Unsupported data URI encoding, only base64 is supported");
+    if (mimeType != nullptr)
+        *mimeType = header.substr(0, header.size() - 7);
+
+    const char* src = uri.data() + dataStart + 1;
+    size_t srcSize = uri.size() - dataStart - 1;
+    AlignedStorage storage(getBase64DecodedSize(src, srcSize));
+    decodeBase64(src, srcSize, storage.data());
+
+    return storage;
 }
 
-void GLTFLoader::readFromFile(const Path& filename)
+double readComponent(const char* src, GLTFLoader::Accessor::ComponentType componentType)
 {
-    std::ifstream gltfJsonFile(filename);
-    _gltfJson = Json::parse(gltfJsonFile);
-
-    // Parse scenes
-    if (_gltfJson.contains("scenes")) {
-        const auto& scenes = _gltfJson["scenes"];
-        _scenes.clear();
-        _scenes.reserve(scenes.size());
-        for (const auto& scene: scenes) {
-            _scenes.emplace_back();
-            auto& s = _scenes.back();
-            if (scene.contains("nodes")) {
-                for (const auto& nodeId: scene["nodes"])
-                    s.nodes.push_back(nodeId);
-            }
-        }
-        printf("Parsed %lu scenes.\n", _scenes.size());
+    switch (componentType) {
+        case GLTFLoader::Accessor::ComponentType::BYTE:
+            return *reinterpret_cast<const int8_t*>(src);
+        case GLTFLoader::Accessor::ComponentType::UNSIGNED_BYTE:
+            return *reinterpret_cast<const uint8_t*>(src);
+        case GLTFLoader::Accessor::ComponentType::SHORT:
+            return *reinterpret_cast<const int16_t*>(src);
+        case GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT:
+            return *reinterpret_cast<const uint16_t*>(src);
+        case GLTFLoader::Accessor::ComponentType::UNSIGNED_INT:
+            return *reinterpret_cast<const uint32_t*>(src);
+        case GLTFLoader::Accessor::ComponentType::FLOAT:
+            return *reinterpret_cast<const float*>(src);
     }
+    throw std::runtime_error("Invalid accessor component type " + std::to_string(static_cast<int64_t>(componentType)));
+}
 
-    // Parse nodes
-    if (_gltfJson.contains("nodes")) {
-        const auto& nodes = _gltfJson["nodes"];
-        _nodes.clear();
-        _nodes.reserve(nodes.size());
-        for (const auto& node: nodes) {
-            _nodes.emplace_back();
-            auto& n = _nodes.back();
-
-            if (node.contains("matrix")) { // explicit 4x4 transformation matrix takes precedence
-                n.matrix = node["matrix"].template get<Mat4d>();
-            }
-            else { // technically the node shouldn't contain both but we're supporting it anyway
-                if (node.contains("rotation")) {
-                    Quatd r = node["rotation"].template get<Quatd>();
-                    n.matrix.block<3, 3>(0, 0) = r.toRotationMatrix();
-                }
-                if (node.contains("scale")) {
-                    for (int i = 0; i < 3; ++i)
-                        n.matrix(i, i) *= node["scale"][i].get<double>();
-                }
-                if (node.contains("translation")) {
-                    n.matrix.block<3, 1>(0, 3) = node["translation"].template get<Vec3d>();
-                }
-            }
-
-            if (node.contains("mesh"))
-                n.mesh = node["mesh"];
-
-            if (node.contains("children")) {
-                for (const auto& nodeId: node["children"])
-                    n.children.push_back(nodeId);
-            }
-        }
-        printf("Parsed %lu nodes.\n", _nodes.size());
-    }
-
-    // Parse meshes
-    if (_gltfJson.contains("meshes")) {
-        const auto& meshes = _gltfJson["meshes"];
-        int64_t primitiveId = 0;
-        _meshes.clear();
-        _meshes.reserve(meshes.size());
-        for (const auto& mesh : meshes) {
-            if (!mesh.contains("primitives"))
-                throw std::runtime_error("Invalid GLTF file: mesh object does not contain the required \"primitives\" array.");
-
-            _meshes.emplace_back();
-            auto& m = _meshes.back();
-
-            for (const auto& primitive : mesh["primitives"]) {
-                if (!primitive.contains("attributes"))
-                    throw std::runtime_error("Invalid GLTF file: primitive object does not contain the required \"attributes\" array.");
-
-                m.primitives.emplace_back();
-                auto& p = m.primitives.back();
-                p.id = primitiveId++;
-
-                for (const auto& [name, accessorId] : primitive["attributes"].items()) {
-                    p.attributes.emplace_back(name, accessorId);
-                }
-
-                if (primitive.contains("indices"))
-                    p.indices = primitive["indices"];
+} // namespace
 
-                if (primitive.contains("mode"))
-                    p.mode = static_cast<Mesh::Primitive::Mode>(primitive["mode"].get<uint8_t>());
 
-                if (primitive.contains("material"))
-                    p.material = primitive["material"];
-            }
-        }
-        printf("Parsed %lu meshes.\n", _meshes.size());
+double GLTFLoader::Accessor::dequantize(double value) const
+{
+    if (!normalized)
+        return value;
+
+    switch (componentType) {
+        case ComponentType::BYTE:
+            return std::max(value / 127.0, -1.0);
+        case ComponentType::UNSIGNED_BYTE:
+            return value / 255.0;
+        case ComponentType::SHORT:
+            return std::max(value / 32767.0, -1.0);
+        case ComponentType::UNSIGNED_SHORT:
+            return value / 65535.0;
+        default:
+            return value;
     }
+}
 
-    // Parse buffers
-    if (_gltfJson.contains("buffers")) {
-        const auto& buffers = _gltfJson["buffers"];
-        _buffers.clear();
-        _buffers.reserve(buffers.size());
-        for (const auto& buffer : buffers) {
-            if (!buffer.contains("byteLength"))
-                throw std::runtime_error("Invalid GLTF file: buffer object does not contain the required \"byteLength\" property.");
-
-            _buffers.emplace_back();
-            auto& b = _buffers.back();
-
-            b.byteLength = buffer["byteLength"];
-
-            if (buffer.contains("uri")) {
-                b.uri = buffer["uri"];
-                b.filename = filename.parent_path() / b.uri;
-
-                // memory map the file (TODO wrap into an utility function that provides fallback on non-unix systems)
-                int file = open(GU2_PATH_TO_STRING(b.filename), O_RDONLY, 0);
-                if (file < 0)
-                    throw std::runtime_error("Unable to open file " + b.filename.string());
-
-                b.bufferSize = lseek(file, (size_t)0, SEEK_END);
-                if (b.bufferSize < 0)
-                    throw std::runtime_error("Unable to determine file size");
-
-                b.buffer = reinterpret_cast<char*>(mmap(nullptr, b.bufferSize, PROT_READ, MAP_SHARED, file, 0));
-            }
-        }
-        printf("Parsed %lu buffers.\n", _buffers.size());
+uint32_t GLTFLoader::Accessor::getComponentSize() const
+{
+    switch (componentType) {
+        case ComponentType::BYTE:
+        case ComponentType::UNSIGNED_BYTE:
+            return 1;
+        case ComponentType::SHORT:
+        case ComponentType::UNSIGNED_SHORT:
+            return 2;
+        case ComponentType::UNSIGNED_INT:
+        case ComponentType::FLOAT:
+            return 4;
     }
+    throw std::runtime_error("Invalid accessor component type " + std::to_string(static_cast<int64_t>(componentType)));
+}
 
-    // Parse buffer views
-    if (_gltfJson.contains("bufferViews")) {
-        const auto& bufferViews = _gltfJson["bufferViews"];
-        _bufferViews.clear();
-        _bufferViews.reserve(bufferViews.size());
-        for (const auto& bufferView : bufferViews) {
-            if (!bufferView.contains("buffer"))
-                throw std::runtime_error("Invalid GLTF file: bufferView object does not contain the required \"buffer\" property.");
-            if (!bufferView.contains("byteLength"))
-                throw std::runtime_error("Invalid GLTF file: bufferView object does not contain the required \"byteLength\" property.");
-
-            _bufferViews.emplace_back();
-            auto& b = _bufferViews.back();
-
-            b.buffer = bufferView["buffer"];
-            b.byteLength = bufferView["byteLength"];
-
-            if (bufferView.contains("byteOffset"))
-                b.byteOffset = bufferView["byteOffset"];
+uint32_t GLTFLoader::Accessor::getNComponents() const
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
+    throw std::runtime_error("Invalid accessor type \"" + type + "\"");
+}
 
-            if (bufferView.contains("byteStride"))
-                b.byteStride = bufferView["byteStride"];
-        }
-        printf("Parsed %lu bufferViews.\n", _bufferViews.size());
-    }
+size_t GLTFLoader::Accessor::getElementSize() const
+{
+    return static_cast<size_t>(getComponentSize()) * getNComponents();
+}
 
-    // Parse accessors
-    if (_gltfJson.contains("accessors")) {
-        const auto& accessors = _gltfJson["accessors"];
-        _accessors.clear();
-        _accessors.reserve(accessors.size());
-        for (const auto& accessor : accessors) {
-            if (!accessor.contains("componentType"))
-                throw std::runtime_error("Invalid GLTF file: accessor object does not contain the required \"componentType\" property.");
-            if (!accessor.contains("count"))
-                throw std::runtime_error("Invalid GLTF file: accessor object does not contain the required \"count\" property.");
-            if (!accessor.contains("type"))
-                throw std::runtime_error("Invalid GLTF file: accessor object does not contain the required \"type\" property.");
-
-            _accessors.emplace_back();
-            auto& a = _accessors.back();
-
-            a.componentType = static_cast<Accessor::ComponentType>(accessor["componentType"]);
-            a.count = accessor["count"];
-            a.type = accessor["type"];
-
-            if (accessor.contains("bufferView"))
-                a.bufferView = accessor["bufferView"];
-
-            if (accessor.contains("byteOffset"))
-                a.byteOffset = accessor["byteOffset"];
-        }
-        printf("Parsed %lu accessors.\n", _accessors.size());
+void GLTFLoader::readFromFile(const Path& filename, StageTimings* timings)
+{
+    {
+        StageTimings::Scope scope(timings, "Parse glTF JSON");
+        MappedFile gltfJsonFile(filename);
+        _gltfJson = Json::parse(gltfJsonFile.data(), gltfJsonFile.data() + gltfJsonFile.size());
     }
 
-    // Parse materials
-    if (_gltfJson.contains("materials")) {
-        const auto& materials = _gltfJson["materials"];
-        _materials.clear();
-        _materials.reserve(materials.size());
-        for (const auto& material : materials) {
-            _materials.emplace_back();
-            auto& m = _materials.back();
-
-            if (material.contains("pbrMetallicRoughness")) {
-                auto& pbrMetallicRoughness = material["pbrMetallicRoughness"];
-                if (pbrMetallicRoughness.contains("baseColorTexture")) {
-                    auto& baseColorTexture = pbrMetallicRoughness["baseColorTexture"];
-                    if (baseColorTexture.contains("index"))
-                        m.pbrMetallicRoughness.baseColorTexture.index = baseColorTexture["index"];
-                    if (baseColorTexture.contains("texCoord"))
-                        m.pbrMetallicRoughness.baseColorTexture.texCoord = baseColorTexture["texCoord"];
+    // Sections are written into separate containers so they can be parsed concurrently, buffers are mapped as soon
+    // as the buffers section has been parsed
+    StageTimings::Scope scope(timings, "Parse glTF sections");
+    ExceptionGuard exceptionGuard;
+    Path directory = filename.parent_path();
+    #pragma omp parallel
+    #pragma omp single
+    {
+        #pragma omp task
+        exceptionGuard.run([&]() { parseScenes(); });
+        #pragma omp task
+        exceptionGuard.run([&]() { parseNodes(); });
+        #pragma omp task
+        exceptionGuard.run([&]() { parseMeshes(); });
+        #pragma omp task
+        exceptionGuard.run([&]() { parseBufferViews(); });
+        #pragma omp task
+        exceptionGuard.run([&]() { parseAccessors(); });
+        #pragma omp task
+        exceptionGuard.run([&]() { parseMaterials(); });
+        #pragma omp task
+        exceptionGuard.run([&]() { parseTextures(); });
+
+        // Buffers and images are parsed on this thread so that their data can be loaded in separate tasks
+        exceptionGuard.run([&]() { parseBuffers(directory); });
+        int64_t nBuffers = static_cast<int64_t>(_buffers.size());
+        for (int64_t i=0; i<nBuffers; ++i) {
+            #pragma omp task firstprivate(i)
+            exceptionGuard.run([&]() {
+                auto& buffer = _buffers[i];
+                if (isDataUri(buffer.uri)) {
+                    StageTimings::Scope scope(timings, "Decode glTF data URIs");
+                    buffer.storage = decodeDataUri(buffer.uri, nullptr);
+                    buffer.buffer = buffer.storage.data();
+                    buffer.bufferSize = buffer.storage.size();
                 }
-                if (pbrMetallicRoughness.contains("metallicRoughnessTexture")) {
-                    auto& metallicRoughnessTexture = pbrMetallicRoughness["metallicRoughnessTexture"];
-                    if (metallicRoughnessTexture.contains("index"))
-                        m.pbrMetallicRoughness.metallicRoughnessTexture.index = metallicRoughnessTexture["index"];
-                    if (metallicRoughnessTexture.contains("texCoord"))
-                        m.pbrMetallicRoughness.metallicRoughnessTexture.texCoord = metallicRoughnessTexture["texCoord"];
+                else if (!buffer.filename.empty()) {
+                    StageTimings::Scope scope(timings, "Map glTF buffers");
+                    buffer.mappedFile.open(buffer.filename);
+                    buffer.buffer = buffer.mappedFile.data();
+                    buffer.bufferSize = buffer.mappedFile.size();
                 }
-                if (pbrMetallicRoughness.contains("baseColorFactor"))
-                    m.pbrMetallicRoughness.baseColorFactor = pbrMetallicRoughness["baseColorFactor"];
-                if (pbrMetallicRoughness.contains("metallicFactor"))
-                    m.pbrMetallicRoughness.metallicFactor = pbrMetallicRoughness["metallicFactor"];
-                if (pbrMetallicRoughness.contains("roughnessFactor"))
-                    m.pbrMetallicRoughness.roughnessFactor = pbrMetallicRoughness["roughnessFactor"];
-            }
+                else
+                    return; // GLB binary chunk, not supported
 
-            if (material.contains("normalTexture")) {
-                auto& normalTexture = material["normalTexture"];
-                if (normalTexture.contains("index"))
-                    m.normalTexture.index = normalTexture["index"];
-                if (normalTexture.contains("texCoord"))
-                    m.normalTexture.texCoord = normalTexture["texCoord"];
-                if (normalTexture.contains("scale"))
-                    m.normalTexture.scale = normalTexture["scale"];
-            }
+                if (buffer.bufferSize < buffer.byteLength)
+                    throw std::runtime_error("Buffer " + std::to_string(i) +
+                        " is smaller than the specified byteLength");
+            });
         }
-        printf("Parsed %lu materials.\n", _materials.size());
-    }
 
-    // Parse textures
-    if (_gltfJson.contains("textures")) {
-        const auto& textures = _gltfJson["textures"];
-        _textures.clear();
-        _textures.reserve(textures.size());
-        for (const auto& texture : textures) {
-            _textures.emplace_back();
-            auto& t = _textures.back();
-
-            if (texture.contains("source"))
-                t.source = texture["source"];
+        exceptionGuard.run([&]() { parseImages(directory); });
+        int64_t nImages = static_cast<int64_t>(_images.size());
+        for (int64_t i=0; i<nImages; ++i) {
+            if (!isDataUri(_images[i].uri))
+                continue;
+
+            #pragma omp task firstprivate(i)
+            exceptionGuard.run([&]() {
+                StageTimings::Scope scope(timings, "Decode glTF data URIs");
+                auto& image = _images[i];
+                image.storage = decodeDataUri(image.uri, &image.mimeType);
+            });
         }
-        printf("Parsed %lu textures.\n", _textures.size());
-    }
-
-    // Parse images
-    if (_gltfJson.contains("images")) {
-        const auto& images = _gltfJson["images"];
-        _images.clear();
-        _images.reserve(images.size());
-        for (const auto& image : images) {
-            _images.emplace_back();
-            auto& i = _images.back();
-
-            if (image.contains("uri")) {
-                i.uri = image["uri"];
-                i.filename = filename.parent_path() / i.uri;
-            }
-        }
-        printf("Parsed %lu images.\n", _images.size());
     }
+    exceptionGuard.rethrow();
 }
 
 const std::vector<GLTFLoader::Scene>& GLTFLoader::getScenes() const noexcept
@@ -340,3 +237,449 @@ const std::vector<GLTFLoader::Image>& GLTFLoader::getImages() const noexcept
 {
     return _images;
 }
+
+const char* GLTFLoader::getAccessorData(const Accessor& accessor) const
+{
+    if (accessor.bufferView < 0)
+        throw std::runtime_error("No buffer view for accessor defined");
+    const auto& bufferView = _bufferViews.at(accessor.bufferView);
+    if (bufferView.buffer < 0)
+        throw std::runtime_error("No buffer for accessor defined");
+    const auto& buffer = _buffers.at(bufferView.buffer);
+    if (buffer.buffer == nullptr)
+        throw std::runtime_error("No buffer loaded");
+
+    return buffer.buffer + bufferView.byteOffset + accessor.byteOffset;
+}
+
+size_t GLTFLoader::getAccessorStride(const Accessor& accessor) const
+{
+    if (accessor.bufferView >= 0) {
+        const auto& bufferView = _bufferViews.at(accessor.bufferView);
+        if (bufferView.byteStride > 0)
+            return bufferView.byteStride;
+    }
+    return accessor.getElementSize();
+}
+
+AABB GLTFLoader::getAccessorBounds(const Accessor& accessor) const
+{
+    if (accessor.type != "VEC3")
+        throw std::runtime_error("Bounds are only supported for VEC3 accessors");
+
+    // min / max are given in the component type, i.e. before normalization
+    AABB aabb;
+    if (accessor.min.size() == 3 && accessor.max.size() == 3) {
+        for (int i=0; i<3; ++i) {
+            aabb.min(i) = static_cast<float>(accessor.dequantize(accessor.min[i]));
+            aabb.max(i) = static_cast<float>(accessor.dequantize(accessor.max[i]));
+        }
+        return aabb;
+    }
+
+    size_t stride = getAccessorStride(accessor);
+    const char* data = getAccessorData(accessor);
+    if (accessor.componentType == Accessor::ComponentType::FLOAT) {
+        return computeAABB(reinterpret_cast<const float*>(data), accessor.count,
+            stride == accessor.getElementSize() ? 0 : stride);
+    }
+
+    uint32_t componentSize = accessor.getComponentSize();
+    for (uint64_t i=0; i<accessor.count; ++i) {
+        Vec3f position;
+        for (uint32_t c=0; c<3; ++c) {
+            position(c) = static_cast<float>(accessor.dequantize(
+                readComponent(data + i*stride + c*componentSize, accessor.componentType)));
+        }
+        aabb.extend(position);
+    }
+    return aabb;
+}
+
+std::vector<Mat4d> GLTFLoader::getInstanceMatrices(const Node& node) const
+{
+    std::vector<Mat4d> matrices;
+    if (!node.isInstanced())
+        return matrices;
+
+    // Element i of an instancing accessor, rotations may also be stored as normalized integers
+    auto readElement = [&](int64_t accessorId, uint64_t i, uint32_t nComponents, double* element) {
+        const auto& accessor = _accessors.at(accessorId);
+        if (accessor.getNComponents() != nComponents)
+            throw std::runtime_error("Invalid EXT_mesh_gpu_instancing accessor type " + accessor.type);
+        const char* src = getAccessorData(accessor) + i*getAccessorStride(accessor);
+        for (uint32_t c=0; c<nComponents; ++c) {
+            switch (accessor.componentType) {
+                case Accessor::ComponentType::FLOAT:
+                    element[c] = reinterpret_cast<const float*>(src)[c];
+                    break;
+                case Accessor::ComponentType::BYTE:
+                    element[c] = std::max(reinterpret_cast<const int8_t*>(src)[c] / 127.0, -1.0);
+                    break;
+                case Accessor::ComponentType::SHORT:
+                    element[c] = std::max(reinterpret_cast<const int16_t*>(src)[c] / 32767.0, -1.0);
+                    break;
+                default:
+                    throw std::runtime_error("Unsupported EXT_mesh_gpu_instancing accessor component type");
+            }
+        }
+    };
+
+    uint64_t nInstances = 0;
+    for (auto accessorId : {node.instancing.translation, node.instancing.rotation, node.instancing.scale}) {
+        if (accessorId < 0)
+            continue;
+        uint64_t count = _accessors.at(accessorId).count;
+        if (nInstances > 0 && count != nInstances)
+            throw std::runtime_error("EXT_mesh_gpu_instancing accessor counts differ");
+        nInstances = count;
+    }
+
+    matrices.resize(nInstances, Mat4d::Identity());
+    for (uint64_t i=0; i<nInstances; ++i) {
+        Vec3d translation = Vec3d::Zero();
+        Vec4d rotation(0.0, 0.0, 0.0, 1.0); // xyzw
+        Vec3d scale = Vec3d::Ones();
+        if (node.instancing.translation >= 0)
+            readElement(node.instancing.translation, i, 3, translation.data());
+        if (node.instancing.rotation >= 0)
+            readElement(node.instancing.rotation, i, 4, rotation.data());
+        if (node.instancing.scale >= 0)
+            readElement(node.instancing.scale, i, 3, scale.data());
+
+        auto& matrix = matrices[i];
+        matrix.block<3,3>(0,0) = Quatd(rotation.w(), rotation.x(), rotation.y(), rotation.z()).normalized()
+            .toRotationMatrix() * scale.asDiagonal();
+        matrix.block<3,1>(0,3) = translation;
+    }
+    return matrices;
+}
+
+const char* GLTFLoader::getImageData(const Image& image, size_t* size) const
+{
+    if (image.storage.data() != nullptr) {
+        *size = image.storage.size();
+        return image.storage.data();
+    }
+
+    if (image.bufferView >= 0) {
+        const auto& bufferView = _bufferViews.at(image.bufferView);
+        const auto& buffer = _buffers.at(bufferView.buffer);
+        if (buffer.buffer == nullptr)
+            throw std::runtime_error("No buffer loaded");
+        *size = bufferView.byteLength;
+        return buffer.buffer + bufferView.byteOffset;
+    }
+
+    *size = 0;
+    return nullptr;
+}
+
+bool GLTFLoader::isDataUri(const std::string& uri) noexcept
+{
+    return uri.starts_with("data:");
+}
+
+void GLTFLoader::parseScenes()
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("scenes"))
+        return;
+
+    const auto& scenes = json["scenes"];
+    _scenes.clear();
+    _scenes.reserve(scenes.size());
+    for (const auto& scene: scenes) {
+        _scenes.emplace_back();
+        auto& s = _scenes.back();
+        if (scene.contains("nodes")) {
+            for (const auto& nodeId: scene["nodes"])
+                s.nodes.push_back(nodeId);
+        }
+    }
+}
+
+void GLTFLoader::parseNodes()
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("nodes"))
+        return;
+
+    const auto& nodes = json["nodes"];
+    _nodes.clear();
+    _nodes.reserve(nodes.size());
+    for (const auto& node: nodes) {
+        _nodes.emplace_back();
+        auto& n = _nodes.back();
+
+        if (node.contains("matrix")) { // explicit 4x4 transformation matrix takes precedence
+            n.matrix = node["matrix"].template get<Mat4d>();
+        }
+        else { // technically the node shouldn't contain both but we're supporting it anyway
+            if (node.contains("rotation")) {
+                Quatd r = node["rotation"].template get<Quatd>();
+                n.matrix.block<3, 3>(0, 0) = r.toRotationMatrix();
+            }
+            if (node.contains("scale")) {
+                for (int i = 0; i < 3; ++i)
+                    n.matrix(i, i) *= node["scale"][i].get<double>();
+            }
+            if (node.contains("translation")) {
+                n.matrix.block<3, 1>(0, 3) = node["translation"].template get<Vec3d>();
+            }
+        }
+
+        if (node.contains("mesh"))
+            n.mesh = node["mesh"];
+
+        if (node.contains("children")) {
+            for (const auto& nodeId: node["children"])
+                n.children.push_back(nodeId);
+        }
+
+        if (node.contains("extensions") && node["extensions"].contains("EXT_mesh_gpu_instancing")) {
+            const auto& instancing = node["extensions"]["EXT_mesh_gpu_instancing"];
+            if (!instancing.contains("attributes"))
+                throw std::runtime_error("Invalid GLTF file: EXT_mesh_gpu_instancing object of node " +
+                    std::to_string(_nodes.size()-1) + " does not contain the required \"attributes\" object.");
+            const auto& attributes = instancing["attributes"];
+            if (attributes.contains("TRANSLATION"))
+                n.instancing.translation = attributes["TRANSLATION"];
+            if (attributes.contains("ROTATION"))
+                n.instancing.rotation = attributes["ROTATION"];
+            if (attributes.contains("SCALE"))
+                n.instancing.scale = attributes["SCALE"];
+        }
+    }
+}
+
+void GLTFLoader::parseMeshes()
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("meshes"))
+        return;
+
+    const auto& meshes = json["meshes"];
+    int64_t primitiveId = 0;
+    _meshes.clear();
+    _meshes.reserve(meshes.size());
+    for (const auto& mesh : meshes) {
+        if (!mesh.contains("primitives"))
+            throw std::runtime_error("Invalid GLTF file: mesh object does not contain the required \"primitives\" array.");
+
+        _meshes.emplace_back();
+        auto& m = _meshes.back();
+
+        for (const auto& primitive : mesh["primitives"]) {
+            if (!primitive.contains("attributes"))
+                throw std::runtime_error("Invalid GLTF file: primitive object does not contain the required \"attributes\" array.");
+
+            m.primitives.emplace_back();
+            auto& p = m.primitives.back();
+            p.id = primitiveId++;
+
+            for (const auto& [name, accessorId] : primitive["attributes"].items()) {
+                p.attributes.emplace_back(name, accessorId);
+            }
+
+            if (primitive.contains("indices"))
+                p.indices = primitive["indices"];
+
+            if (primitive.contains("mode"))
+                p.mode = static_cast<Mesh::Primitive::Mode>(primitive["mode"].get<uint8_t>());
+
+            if (primitive.contains("material"))
+                p.material = primitive["material"];
+        }
+    }
+}
+
+void GLTFLoader::parseBuffers(const Path& directory)
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("buffers"))
+        return;
+
+    const auto& buffers = json["buffers"];
+    _buffers.clear();
+    _buffers.reserve(buffers.size());
+    for (const auto& buffer : buffers) {
+        if (!buffer.contains("byteLength"))
+            throw std::runtime_error("Invalid GLTF file: buffer object does not contain the required \"byteLength\" property.");
+
+        _buffers.emplace_back();
+        auto& b = _buffers.back();
+
+        b.byteLength = buffer["byteLength"];
+
+        if (buffer.contains("uri")) {
+            b.uri = buffer["uri"];
+            if (!isDataUri(b.uri))
+                b.filename = directory / b.uri;
+        }
+    }
+}
+
+void GLTFLoader::parseBufferViews()
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("bufferViews"))
+        return;
+
+    const auto& bufferViews = json["bufferViews"];
+    _bufferViews.clear();
+    _bufferViews.reserve(bufferViews.size());
+    for (const auto& bufferView : bufferViews) {
+        if (!bufferView.contains("buffer"))
+            throw std::runtime_error("Invalid GLTF file: bufferView object does not contain the required \"buffer\" property.");
+        if (!bufferView.contains("byteLength"))
+            throw std::runtime_error("Invalid GLTF file: bufferView object does not contain the required \"byteLength\" property.");
+
+        _bufferViews.emplace_back();
+        auto& b = _bufferViews.back();
+
+        b.buffer = bufferView["buffer"];
+        b.byteLength = bufferView["byteLength"];
+
+        if (bufferView.contains("byteOffset"))
+            b.byteOffset = bufferView["byteOffset"];
+
+        if (bufferView.contains("byteStride"))
+            b.byteStride = bufferView["byteStride"];
+    }
+}
+
+void GLTFLoader::parseAccessors()
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("accessors"))
+        return;
+
+    const auto& accessors = json["accessors"];
+    _accessors.clear();
+    _accessors.reserve(accessors.size());
+    for (const auto& accessor : accessors) {
+        if (!accessor.contains("componentType"))
+            throw std::runtime_error("Invalid GLTF file: accessor object does not contain the required \"componentType\" property.");
+        if (!accessor.contains("count"))
+            throw std::runtime_error("Invalid GLTF file: accessor object does not contain the required \"count\" property.");
+        if (!accessor.contains("type"))
+            throw std::runtime_error("Invalid GLTF file: accessor object does not contain the required \"type\" property.");
+
+        _accessors.emplace_back();
+        auto& a = _accessors.back();
+
+        a.componentType = static_cast<Accessor::ComponentType>(accessor["componentType"]);
+        a.count = accessor["count"];
+        a.type = accessor["type"];
+
+        if (accessor.contains("normalized"))
+            a.normalized = accessor["normalized"];
+
+        if (accessor.contains("bufferView"))
+            a.bufferView = accessor["bufferView"];
+
+        if (accessor.contains("byteOffset"))
+            a.byteOffset = accessor["byteOffset"];
+
+        if (accessor.contains("min"))
+            a.min = accessor["min"].get<std::vector<double>>();
+
+        if (accessor.contains("max"))
+            a.max = accessor["max"].get<std::vector<double>>();
+    }
+}
+
+void GLTFLoader::parseMaterials()
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("materials"))
+        return;
+
+    const auto& materials = json["materials"];
+    _materials.clear();
+    _materials.reserve(materials.size());
+    for (const auto& material : materials) {
+        _materials.emplace_back();
+        auto& m = _materials.back();
+
+        if (material.contains("pbrMetallicRoughness")) {
+            auto& pbrMetallicRoughness = material["pbrMetallicRoughness"];
+            if (pbrMetallicRoughness.contains("baseColorTexture")) {
+                auto& baseColorTexture = pbrMetallicRoughness["baseColorTexture"];
+                if (baseColorTexture.contains("index"))
+                    m.pbrMetallicRoughness.baseColorTexture.index = baseColorTexture["index"];
+                if (baseColorTexture.contains("texCoord"))
+                    m.pbrMetallicRoughness.baseColorTexture.texCoord = baseColorTexture["texCoord"];
+            }
+            if (pbrMetallicRoughness.contains("metallicRoughnessTexture")) {
+                auto& metallicRoughnessTexture = pbrMetallicRoughness["metallicRoughnessTexture"];
+                if (metallicRoughnessTexture.contains("index"))
+                    m.pbrMetallicRoughness.metallicRoughnessTexture.index = metallicRoughnessTexture["index"];
+                if (metallicRoughnessTexture.contains("texCoord"))
+                    m.pbrMetallicRoughness.metallicRoughnessTexture.texCoord = metallicRoughnessTexture["texCoord"];
+            }
+            if (pbrMetallicRoughness.contains("baseColorFactor"))
+                m.pbrMetallicRoughness.baseColorFactor = pbrMetallicRoughness["baseColorFactor"];
+            if (pbrMetallicRoughness.contains("metallicFactor"))
+                m.pbrMetallicRoughness.metallicFactor = pbrMetallicRoughness["metallicFactor"];
+            if (pbrMetallicRoughness.contains("roughnessFactor"))
+                m.pbrMetallicRoughness.roughnessFactor = pbrMetallicRoughness["roughnessFactor"];
+        }
+
+        if (material.contains("normalTexture")) {
+            auto& normalTexture = material["normalTexture"];
+            if (normalTexture.contains("index"))
+                m.normalTexture.index = normalTexture["index"];
+            if (normalTexture.contains("texCoord"))
+                m.normalTexture.texCoord = normalTexture["texCoord"];
+            if (normalTexture.contains("scale"))
+                m.normalTexture.scale = normalTexture["scale"];
+        }
+    }
+}
+
+void GLTFLoader::parseTextures()
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("textures"))
+        return;
+
+    const auto& textures = json["textures"];
+    _textures.clear();
+    _textures.reserve(textures.size());
+    for (const auto& texture : textures) {
+        _textures.emplace_back();
+        auto& t = _textures.back();
+
+        if (texture.contains("source"))
+            t.source = texture["source"];
+    }
+}
+
+void GLTFLoader::parseImages(const Path& directory)
+{
+    const Json& json = _gltfJson;
+    if (!json.contains("images"))
+        return;
+
+    const auto& images = json["images"];
+    _images.clear();
+    _images.reserve(images.size());
+    for (const auto& image : images) {
+        _images.emplace_back();
+        auto& i = _images.back();
+
+        if (image.contains("uri")) {
+            i.uri = image["uri"];
+            if (!isDataUri(i.uri))
+                i.filename = directory / i.uri;
+        }
+
+        if (image.contains("bufferView"))
+            i.bufferView = image["bufferView"];
+
+        if (image.contains("mimeType"))
+            i.mimeType = image["mimeType"];
+    }
+}
@@ -0,0 +1,67 @@
+//
+// Project: GraphicsUtils2
+// File: LinearAllocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "LinearAllocator.hpp"
+
+#include <stdexcept>
+#include <string>
+
+
+using namespace gu2;
+
+
+LinearAllocator::LinearAllocator(uint64_t capacity) :
+    _capacity   (capacity),
+    _usedSize   (0),
+    _head       (0)
+{
+}
+
+uint64_t LinearAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    if (alignment == 0)
+        throw std::runtime_error("LinearAllocator: alignment must be nonzero");
+    if (size == 0)
+        size = 1; // keep the offsets of the allocations unique
+
+    uint64_t offset = ((_head + alignment - 1) / alignment) * alignment;
+    if (offset + size > _capacity)
+        return invalidOffset;
+
+    _allocations.emplace_hint(_allocations.end(), offset, size);
+    _usedSize += size;
+    _head = offset + size;
+    return offset;
+}
+
+void LinearAllocator::free(uint64_t offset)
+{
+    auto it = _allocations.find(offset);
+    if (it == _allocations.end())
+        throw std::runtime_error("LinearAllocator: no allocation at offset " + std::to_string(offset));
+
+    _usedSize -= it->second;
+    _allocations.erase(it);
+
+    // The head falls back to the end of the last live allocation
+    if (_allocations.empty())
+        _head = 0;
+    else {
+        const auto& [lastOffset, lastSize] = *_allocations.rbegin();
+        _head = lastOffset + lastSize;
+    }
+}
+
+void LinearAllocator::clear()
+{
+    _allocations.clear();
+    _usedSize = 0;
+    _head = 0;
+}
@@ -0,0 +1,100 @@
+//
+// Project: GraphicsUtils2
+// File: MappedFile.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#error "Memory mapping only supported on unix systems"
+#endif // __unix__
+
+
+using namespace gu2;
+
+
+MappedFile::MappedFile() noexcept :
+    _data   (nullptr),
+    _size   (0)
+{
+}
+
+MappedFile::MappedFile(const Path& filename) :
+    _data   (nullptr),
+    _size   (0)
+{
+    open(filename);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    _data   (other._data),
+    _size   (other._size)
+{
+    other._data = nullptr;
+    other._size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    close();
+    _data = other._data;
+    _size = other._size;
+    other._data = nullptr;
+    other._size = 0;
+
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::open(const Path& filename)
+{
+    close();
+
+    int file = ::open(GU2_PATH_TO_STRING(filename), O_RDONLY, 0);
+    if (file < 0)
+        throw std::runtime_error("Unable to open file " + filename.string());
+
+    off_t fileSize = lseek(file, 0, SEEK_END);
+    if (fileSize < 0) {
+        ::close(file);
+        throw std::runtime_error("Unable to determine size of file " + filename.string());
+    }
+    if (fileSize == 0) { // mmap does not accept zero-length mappings
+        ::close(file);
+        return;
+    }
+
+    void* data = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file); // the mapping keeps a reference to the file
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Unable to memory map file " + filename.string());
+
+    _data = reinterpret_cast<char*>(data);
+    _size = static_cast<size_t>(fileSize);
+}
+
+void MappedFile::close() noexcept
+{
+    if (_data != nullptr)
+        munmap(_data, _size);
+    _data = nullptr;
+    _size = 0;
+}
@@ -0,0 +1,314 @@
+//
+// Project: GraphicsUtils2
+// File: MeshOptimizer.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint32_t invalidIndex {0xffffffff};
+
+// Vertex -> triangle adjacency in compressed row format
+struct Adjacency {
+    std::vector<uint32_t>   offsets;
+    std::vector<uint32_t>   triangles;
+
+    template <typename T_Index>
+    Adjacency(const T_Index* indices, size_t nIndices, size_t nVertices) :
+        offsets     (nVertices+1, 0),
+        triangles   (nIndices)
+    {
+        for (size_t i=0; i<nIndices; ++i)
+            ++offsets[indices[i] + 1];
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i=0; i<nIndices; ++i)
+            triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    inline uint32_t valence(uint32_t vertex) const { return offsets[vertex+1] - offsets[vertex]; }
+};
+
+// FIFO cache simulation using insertion timestamps, a vertex is in the cache in case less than cacheSize
+// vertices have been inserted after it
+class FifoCache {
+public:
+    FifoCache(size_t nVertices, uint32_t cacheSize) :
+        _cacheSize  (cacheSize),
+        _time       (cacheSize + 1),
+        _timestamps (nVertices, 0)
+    {
+    }
+
+    // Returns true in case of a cache miss
+    inline bool access(uint32_t vertex)
+    {
+        if (_time - _timestamps[vertex] <= _cacheSize)
+            return false;
+        _timestamps[vertex] = _time++;
+        return true;
+    }
+
+    inline void flush() { _time += _cacheSize + 1; }
+
+private:
+    uint32_t                _cacheSize;
+    uint32_t                _time;
+    std::vector<uint32_t>   _timestamps;
+};
+
+template <typename T_Index>
+void validateIndices(const T_Index* indices, size_t nIndices, size_t nVertices)
+{
+    if (nIndices % 3 != 0)
+        throw std::runtime_error("Index count not divisible by 3");
+    for (size_t i=0; i<nIndices; ++i) {
+        if (indices[i] >= nVertices)
+            throw std::runtime_error("Index " + std::to_string(indices[i]) + " out of range");
+    }
+}
+
+} // namespace
+
+
+template <typename T_Index>
+void gu2::optimizeVertexCache(
+    T_Index* indices,
+    size_t nIndices,
+    size_t nVertices,
+    std::vector<uint32_t>* clusters,
+    uint32_t cacheSize,
+    float overdrawThreshold
+) {
+    validateIndices(indices, nIndices, nVertices);
+    size_t nTriangles = nIndices / 3;
+    if (nTriangles == 0)
+        return;
+
+    Adjacency adjacency(indices, nIndices, nVertices);
+    std::vector<uint32_t> liveTriangles(nVertices);
+    for (uint32_t v=0; v<nVertices; ++v)
+        liveTriangles[v] = adjacency.valence(v);
+
+    std::vector<uint32_t> cacheTimestamps(nVertices, 0);
+    std::vector<char> emitted(nTriangles, 0);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> hardBoundaries {0};
+    std::vector<T_Index> output;
+    output.reserve(nIndices);
+    uint32_t timestamp = cacheSize + 1;
+    uint32_t cursor = 0;
+
+    uint32_t fanVertex = indices[0];
+    while (fanVertex != invalidIndex) {
+        // Emit all remaining triangles around the fanning vertex
+        candidates.clear();
+        for (uint32_t i=adjacency.offsets[fanVertex]; i<adjacency.offsets[fanVertex+1]; ++i) {
+            uint32_t t = adjacency.triangles[i];
+            if (emitted[t])
+                continue;
+
+            for (uint32_t j=0; j<3; ++j) {
+                uint32_t v = indices[t*3 + j];
+                output.push_back(static_cast<T_Index>(v));
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+                if (timestamp - cacheTimestamps[v] > cacheSize)
+                    cacheTimestamps[v] = timestamp++;
+            }
+            emitted[t] = 1;
+        }
+
+        // Next fanning vertex: the candidate that stays longest in the cache after its fan has been emitted
+        fanVertex = invalidIndex;
+        int64_t bestPriority = -1;
+        for (auto v : candidates) {
+            if (liveTriangles[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (timestamp - cacheTimestamps[v] + 2*liveTriangles[v] <= cacheSize)
+                priority = timestamp - cacheTimestamps[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fanVertex = v;
+            }
+        }
+        if (fanVertex != invalidIndex)
+            continue;
+
+        // Dead-end, continue from a recently used vertex or the next vertex with triangles left
+        if (output.size() < nIndices)
+            hardBoundaries.push_back(static_cast<uint32_t>(output.size() / 3));
+        while (!deadEnds.empty() && fanVertex == invalidIndex) {
+            uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0)
+                fanVertex = v;
+        }
+        for (; cursor < nVertices && fanVertex == invalidIndex; ++cursor) {
+            if (liveTriangles[cursor] > 0)
+                fanVertex = cursor;
+        }
+    }
+    std::copy(output.begin(), output.end(), indices);
+
+    if (clusters == nullptr)
+        return;
+
+    // Split the clusters further at points where the cache efficiency of the cluster so far is close to the
+    // efficiency of the whole mesh (soft boundaries), restarting a cluster flushes the cache
+    float threshold = overdrawThreshold * computeACMR(indices, nIndices, nVertices, cacheSize);
+    hardBoundaries.push_back(static_cast<uint32_t>(nTriangles));
+    FifoCache cache(nVertices, cacheSize);
+    for (size_t c=0; c+1<hardBoundaries.size(); ++c) {
+        uint32_t clusterStart = hardBoundaries[c];
+        uint32_t clusterEnd = hardBoundaries[c+1];
+        clusters->push_back(clusterStart);
+        cache.flush();
+
+        uint32_t misses = 0;
+        for (uint32_t t=clusterStart; t<clusterEnd; ++t) {
+            for (uint32_t j=0; j<3; ++j)
+                misses += cache.access(indices[t*3 + j]);
+            if (t+1 < clusterEnd && static_cast<float>(misses) <= threshold*static_cast<float>(t+1 - clusterStart)) {
+                clusters->push_back(t+1);
+                clusterStart = t+1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+}
+
+template <typename T_Index>
+void gu2::optimizeOverdraw(
+    T_Index* indices,
+    size_t nIndices,
+    const Vec3f* positions,
+    const std::vector<uint32_t>& clusters
+) {
+    size_t nTriangles = nIndices / 3;
+    size_t nClusters = clusters.size();
+    if (nClusters <= 1)
+        return;
+
+    // Area weighted centroids and normals of the clusters and the whole mesh
+    std::vector<Vec3f> clusterCentroids(nClusters, Vec3f::Zero());
+    std::vector<Vec3f> clusterNormals(nClusters, Vec3f::Zero());
+    Vec3f meshCentroid = Vec3f::Zero();
+    float meshArea = 0.0f;
+    for (size_t c=0; c<nClusters; ++c) {
+        size_t clusterEnd = c+1 < nClusters ? clusters[c+1] : nTriangles;
+        float clusterArea = 0.0f;
+        for (size_t t=clusters[c]; t<clusterEnd; ++t) {
+            const Vec3f& p0 = positions[indices[t*3]];
+            const Vec3f& p1 = positions[indices[t*3 + 1]];
+            const Vec3f& p2 = positions[indices[t*3 + 2]];
+            Vec3f normal = (p1 - p0).cross(p2 - p0);
+            float area = normal.norm();
+            clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f)
+            clusterCentroids[c] /= clusterArea;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters on the outer side of the mesh that face outwards are the most likely occluders
+    std::vector<float> sortKeys(nClusters);
+    for (size_t c=0; c<nClusters; ++c)
+        sortKeys[c] = (clusterCentroids[c] - meshCentroid).dot(clusterNormals[c].normalized());
+
+    std::vector<uint32_t> order(nClusters);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<T_Index> output;
+    output.reserve(nIndices);
+    for (auto c : order) {
+        size_t clusterEnd = c+1 < nClusters ? clusters[c+1] : nTriangles;
+        output.insert(output.end(), indices + clusters[c]*3, indices + clusterEnd*3);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+template <typename T_Index>
+size_t gu2::optimizeVertexFetch(T_Index* indices, size_t nIndices, size_t nVertices, std::vector<uint32_t>* remap)
+{
+    remap->assign(nVertices, invalidIndex);
+    uint32_t nUsedVertices = 0;
+    for (size_t i=0; i<nIndices; ++i) {
+        uint32_t& newIndex = remap->at(indices[i]);
+        if (newIndex == invalidIndex)
+            newIndex = nUsedVertices++;
+        indices[i] = static_cast<T_Index>(newIndex);
+    }
+    return nUsedVertices;
+}
+
+void gu2::remapVertices(void* data, size_t elementSize, size_t nVertices, const std::vector<uint32_t>& remap)
+{
+    auto* data8 = static_cast<char*>(data);
+    std::vector<char> src(data8, data8 + elementSize*nVertices);
+    for (size_t i=0; i<nVertices; ++i) {
+        if (remap[i] != invalidIndex)
+            memcpy(data8 + remap[i]*elementSize, src.data() + i*elementSize, elementSize);
+    }
+}
+
+void gu2::narrowIndices(const uint32_t* src, size_t nIndices, uint16_t* dest)
+{
+    for (size_t i=0; i<nIndices; ++i) {
+        uint32_t index = src[i];
+        if (index > 0xffff)
+            throw std::runtime_error("Index " + std::to_string(index) + " does not fit in 16 bits");
+        dest[i] = static_cast<uint16_t>(index);
+    }
+}
+
+template <typename T_Index>
+float gu2::computeACMR(const T_Index* indices, size_t nIndices, size_t nVertices, uint32_t cacheSize)
+{
+    if (nIndices < 3)
+        return 0.0f;
+
+    FifoCache cache(nVertices, cacheSize);
+    size_t misses = 0;
+    for (size_t i=0; i<nIndices; ++i)
+        misses += cache.access(indices[i]);
+    return static_cast<float>(misses) / static_cast<float>(nIndices / 3);
+}
+
+
+template void gu2::optimizeVertexCache<uint16_t>(uint16_t*, size_t, size_t, std::vector<uint32_t>*, uint32_t, float);
+template void gu2::optimizeVertexCache<uint32_t>(uint32_t*, size_t, size_t, std::vector<uint32_t>*, uint32_t, float);
+template void gu2::optimizeOverdraw<uint16_t>(uint16_t*, size_t, const Vec3f*, const std::vector<uint32_t>&);
+template void gu2::optimizeOverdraw<uint32_t>(uint32_t*, size_t, const Vec3f*, const std::vector<uint32_t>&);
+template size_t gu2::optimizeVertexFetch<uint16_t>(uint16_t*, size_t, size_t, std::vector<uint32_t>*);
+template size_t gu2::optimizeVertexFetch<uint32_t>(uint32_t*, size_t, size_t, std::vector<uint32_t>*);
+template float gu2::computeACMR<uint16_t>(const uint16_t*, size_t, size_t, uint32_t);
+template float gu2::computeACMR<uint32_t>(const uint32_t*, size_t, size_t, uint32_t);
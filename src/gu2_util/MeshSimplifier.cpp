@@ -0,0 +1,269 @@
+//
+// Project: GraphicsUtils2
+// File: MeshSimplifier.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+
+using namespace gu2;
+
+
+namespace {
+
+// Symmetric 4x4 quadric, accumulated with area weights. Evaluates to the weighted mean squared distance from
+// the planes.
+struct Quadric {
+    double  a00 {0.0}, a01 {0.0}, a02 {0.0}, a03 {0.0};
+    double  a11 {0.0}, a12 {0.0}, a13 {0.0};
+    double  a22 {0.0}, a23 {0.0};
+    double  a33 {0.0};
+    double  weight {0.0};
+
+    static Quadric fromPlane(const Vec3d& n, double d, double w)
+    {
+        Quadric q;
+        q.a00 = w*n.x()*n.x(); q.a01 = w*n.x()*n.y(); q.a02 = w*n.x()*n.z(); q.a03 = w*n.x()*d;
+        q.a11 = w*n.y()*n.y(); q.a12 = w*n.y()*n.z(); q.a13 = w*n.y()*d;
+        q.a22 = w*n.z()*n.z(); q.a23 = w*n.z()*d;
+        q.a33 = w*d*d;
+        q.weight = w;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+        return *this;
+    }
+
+    double evaluate(const Vec3d& p) const
+    {
+        double x = p.x(), y = p.y(), z = p.z();
+        double e = a00*x*x + 2.0*a01*x*y + 2.0*a02*x*z + 2.0*a03*x +
+            a11*y*y + 2.0*a12*y*z + 2.0*a13*y +
+            a22*z*z + 2.0*a23*z + a33;
+        return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    uint32_t    from;
+    uint32_t    to;
+    double      cost;
+};
+
+// Vertex -> triangle adjacency in compressed row format
+struct TriangleAdjacency {
+    std::vector<uint32_t>   offsets;
+    std::vector<uint32_t>   triangles;
+
+    TriangleAdjacency(const std::vector<uint32_t>& indices, size_t nVertices) :
+        offsets     (nVertices+1, 0),
+        triangles   (indices.size())
+    {
+        for (auto index : indices)
+            ++offsets[index + 1];
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i=0; i<indices.size(); ++i)
+            triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+};
+
+inline uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+    return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+// Vertices on edges with other than two adjacent triangles
+std::vector<char> findLockedVertices(const std::vector<uint32_t>& indices, size_t nVertices)
+{
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t i=0; i<indices.size(); i+=3) {
+        for (int j=0; j<3; ++j)
+            edges.push_back(edgeKey(indices[i+j], indices[i + (j+1)%3]));
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<char> locked(nVertices, 0);
+    for (size_t i=0; i<edges.size();) {
+        size_t j = i+1;
+        while (j < edges.size() && edges[j] == edges[i])
+            ++j;
+        if (j-i != 2) {
+            locked[edges[i] >> 32] = 1;
+            locked[edges[i] & 0xffffffff] = 1;
+        }
+        i = j;
+    }
+    return locked;
+}
+
+// Whether moving vertex from onto to flips or collapses any of the remaining triangles around from
+bool collapseFlips(
+    uint32_t from,
+    uint32_t to,
+    const std::vector<uint32_t>& indices,
+    const TriangleAdjacency& adjacency,
+    const Vec3f* positions
+) {
+    for (uint32_t i=adjacency.offsets[from]; i<adjacency.offsets[from+1]; ++i) {
+        const uint32_t* triangle = &indices[adjacency.triangles[i]*3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue; // removed by the collapse
+
+        Vec3f p[3];
+        Vec3f q[3];
+        for (int j=0; j<3; ++j) {
+            p[j] = positions[triangle[j]];
+            q[j] = positions[triangle[j] == from ? to : triangle[j]];
+        }
+        Vec3f n0 = (p[1] - p[0]).cross(p[2] - p[0]);
+        Vec3f n1 = (q[1] - q[0]).cross(q[2] - q[0]);
+        if (n0.dot(n1) <= 0.25f*n0.norm()*n1.norm()) // also rejects sliver triangles
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+
+template <typename T_Index>
+std::vector<T_Index> gu2::simplifyMesh(
+    const T_Index* indices,
+    size_t nIndices,
+    const Vec3f* positions,
+    size_t nVertices,
+    size_t targetIndexCount,
+    float targetError,
+    float* resultError
+) {
+    if (nIndices % 3 != 0)
+        throw std::runtime_error("Index count not divisible by 3");
+
+    std::vector<uint32_t> current(indices, indices + nIndices);
+    for (auto index : current) {
+        if (index >= nVertices)
+            throw std::runtime_error("Index " + std::to_string(index) + " out of range");
+    }
+
+    // Plane quadrics of the original triangles
+    std::vector<Quadric> quadrics(nVertices);
+    for (size_t i=0; i<nIndices; i+=3) {
+        Vec3d p0 = positions[current[i]].cast<double>();
+        Vec3d p1 = positions[current[i+1]].cast<double>();
+        Vec3d p2 = positions[current[i+2]].cast<double>();
+        Vec3d n = (p1 - p0).cross(p2 - p0);
+        double area = 0.5*n.norm();
+        if (area <= 0.0)
+            continue;
+        n.normalize();
+        Quadric q = Quadric::fromPlane(n, -n.dot(p0), area);
+        for (int j=0; j<3; ++j)
+            quadrics[current[i+j]] += q;
+    }
+
+    std::vector<char> locked = findLockedVertices(current, nVertices);
+    double maxCost = static_cast<double>(targetError)*targetError;
+    double error = 0.0;
+
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(nVertices);
+    std::vector<char> touched(nVertices);
+    while (current.size() > targetIndexCount) {
+        // Candidate collapses for all edges, in the cheaper direction
+        collapses.clear();
+        for (size_t i=0; i<current.size(); i+=3) {
+            for (int j=0; j<3; ++j) {
+                uint32_t a = current[i+j];
+                uint32_t b = current[i + (j+1)%3];
+                if (a > b)
+                    continue; // manifold edges are visited from both triangles, border edges are locked anyway
+                Quadric q = quadrics[a];
+                q += quadrics[b];
+                double costAB = locked[a] ? HUGE_VAL : q.evaluate(positions[b].cast<double>());
+                double costBA = locked[b] ? HUGE_VAL : q.evaluate(positions[a].cast<double>());
+                if (costAB == HUGE_VAL && costBA == HUGE_VAL)
+                    continue;
+                if (costAB <= costBA)
+                    collapses.push_back({a, b, costAB});
+                else
+                    collapses.push_back({b, a, costBA});
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+            [](const Collapse& c1, const Collapse& c2) { return c1.cost < c2.cost; });
+
+        // Greedily apply the cheapest collapses, each vertex neighbourhood is modified at most once per pass
+        TriangleAdjacency adjacency(current, nVertices);
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t nTrianglesToRemove = (current.size() - targetIndexCount + 2) / 3;
+        size_t nTrianglesRemoved = 0;
+        size_t nCollapses = 0;
+        for (const auto& c : collapses) {
+            if (c.cost > maxCost || nTrianglesRemoved >= nTrianglesToRemove)
+                break;
+            if (touched[c.from] || touched[c.to] || collapseFlips(c.from, c.to, current, adjacency, positions))
+                continue;
+
+            remap[c.from] = c.to;
+            quadrics[c.to] += quadrics[c.from];
+            error = std::max(error, c.cost);
+            for (uint32_t i=adjacency.offsets[c.from]; i<adjacency.offsets[c.from+1]; ++i) {
+                const uint32_t* triangle = &current[adjacency.triangles[i]*3];
+                if (triangle[0] == c.to || triangle[1] == c.to || triangle[2] == c.to)
+                    ++nTrianglesRemoved;
+                for (int j=0; j<3; ++j)
+                    touched[triangle[j]] = 1;
+            }
+            ++nCollapses;
+        }
+        if (nCollapses == 0)
+            break;
+
+        // Apply the collapses and drop degenerate triangles
+        size_t nKept = 0;
+        for (size_t i=0; i<current.size(); i+=3) {
+            uint32_t a = remap[current[i]];
+            uint32_t b = remap[current[i+1]];
+            uint32_t c = remap[current[i+2]];
+            if (a == b || b == c || c == a)
+                continue;
+            current[nKept++] = a;
+            current[nKept++] = b;
+            current[nKept++] = c;
+        }
+        current.resize(nKept);
+    }
+
+    if (resultError != nullptr)
+        *resultError = static_cast<float>(std::sqrt(error));
+    return std::vector<T_Index>(current.begin(), current.end());
+}
+
+
+template std::vector<uint16_t> gu2::simplifyMesh<uint16_t>(const uint16_t*, size_t, const Vec3f*, size_t, size_t,
+    float, float*);
+template std::vector<uint32_t> gu2::simplifyMesh<uint32_t>(const uint32_t*, size_t, const Vec3f*, size_t, size_t,
+    float, float*);
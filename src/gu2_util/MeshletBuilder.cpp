@@ -0,0 +1,237 @@
+//
+// Project: GraphicsUtils2
+// File: MeshletBuilder.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "MeshletBuilder.hpp"
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint8_t unusedLocalIndex {0xff};
+
+// Vertex -> triangle adjacency in compressed row format
+struct Adjacency {
+    std::vector<uint32_t>   offsets;
+    std::vector<uint32_t>   triangles;
+
+    template <typename T_Index>
+    Adjacency(const T_Index* indices, size_t nIndices, size_t nVertices) :
+        offsets     (nVertices+1, 0),
+        triangles   (nIndices)
+    {
+        for (size_t i=0; i<nIndices; ++i)
+            ++offsets[indices[i] + 1];
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i=0; i<nIndices; ++i)
+            triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+};
+
+// Meshlet under construction
+struct MeshletState {
+    std::vector<uint32_t>   vertices;
+    std::vector<uint8_t>    triangles;
+    std::vector<uint32_t>   triangleIds;
+    Vec3f                   centroidSum {Vec3f::Zero()};
+};
+
+// Bounding sphere and normal cone of the meshlet triangles
+void computeMeshletBounds(
+    const MeshletState& meshlet,
+    const Vec3f* positions,
+    Vec4f* sphere,
+    Vec4f* cone
+) {
+    AABB aabb;
+    for (auto v : meshlet.vertices)
+        aabb.extend(positions[v]);
+    Vec3f center = aabb.center();
+    float radius = 0.0f;
+    for (auto v : meshlet.vertices)
+        radius = std::max(radius, (positions[v] - center).norm());
+    *sphere << center, radius;
+
+    // Cone axis is the average of the unit normals, the cutoff is the sine of the largest angle between the axis
+    // and a triangle normal
+    std::vector<Vec3f> normals;
+    normals.reserve(meshlet.triangles.size() / 3);
+    Vec3f axis = Vec3f::Zero();
+    for (size_t i=0; i<meshlet.triangles.size(); i+=3) {
+        const Vec3f& p0 = positions[meshlet.vertices[meshlet.triangles[i]]];
+        const Vec3f& p1 = positions[meshlet.vertices[meshlet.triangles[i+1]]];
+        const Vec3f& p2 = positions[meshlet.vertices[meshlet.triangles[i+2]]];
+        Vec3f normal = (p1 - p0).cross(p2 - p0);
+        float length = normal.norm();
+        if (length <= 0.0f)
+            continue;
+        normals.push_back(normal / length);
+        axis += normals.back();
+    }
+
+    float axisLength = axis.norm();
+    if (normals.empty() || axisLength <= 0.0f) {
+        *cone << Vec3f::UnitZ(), 1.0f;
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const auto& normal : normals)
+        minDot = std::min(minDot, normal.dot(axis));
+    // Cones wider than ~85 degrees are rarely culled, disable them to save the test
+    if (minDot <= 0.1f) {
+        *cone << axis, 1.0f;
+        return;
+    }
+    *cone << axis, std::sqrt(1.0f - minDot*minDot);
+}
+
+void finishMeshlet(MeshletState* meshlet, const Vec3f* positions, Meshlets* meshlets)
+{
+    if (meshlet->triangleIds.empty())
+        return;
+
+    uint32_t nTriangles = static_cast<uint32_t>(meshlet->triangleIds.size());
+    meshlets->vertexOffsets.push_back(static_cast<uint32_t>(meshlets->vertices.size()));
+    meshlets->triangleOffsets.push_back(static_cast<uint32_t>(meshlets->triangles.size()));
+    meshlets->counts.push_back(static_cast<uint32_t>(meshlet->vertices.size()) | (nTriangles << 16));
+    meshlets->spheres.emplace_back();
+    meshlets->cones.emplace_back();
+    computeMeshletBounds(*meshlet, positions, &meshlets->spheres.back(), &meshlets->cones.back());
+
+    meshlets->vertices.insert(meshlets->vertices.end(), meshlet->vertices.begin(), meshlet->vertices.end());
+    meshlets->triangles.insert(meshlets->triangles.end(), meshlet->triangles.begin(), meshlet->triangles.end());
+    meshlets->triangles.resize((meshlets->triangles.size() + 3) & ~size_t(3), 0);
+
+    meshlet->vertices.clear();
+    meshlet->triangles.clear();
+    meshlet->triangleIds.clear();
+    meshlet->centroidSum.setZero();
+}
+
+} // namespace
+
+
+template <typename T_Index>
+Meshlets gu2::buildMeshlets(
+    const T_Index* indices,
+    size_t nIndices,
+    const Vec3f* positions,
+    size_t nVertices,
+    uint32_t maxVertices,
+    uint32_t maxTriangles
+) {
+    if (nIndices % 3 != 0)
+        throw std::runtime_error("Index count not divisible by 3");
+    if (maxVertices < 3 || maxVertices > 255)
+        throw std::runtime_error("Invalid meshlet vertex limit " + std::to_string(maxVertices));
+    if (maxTriangles < 1 || maxTriangles > 0xffff)
+        throw std::runtime_error("Invalid meshlet triangle limit " + std::to_string(maxTriangles));
+    for (size_t i=0; i<nIndices; ++i) {
+        if (indices[i] >= nVertices)
+            throw std::runtime_error("Index " + std::to_string(indices[i]) + " out of range");
+    }
+
+    size_t nTriangles = nIndices / 3;
+    Meshlets meshlets;
+    if (nTriangles == 0)
+        return meshlets;
+
+    Adjacency adjacency(indices, nIndices, nVertices);
+    std::vector<char> emitted(nTriangles, 0);
+    std::vector<uint8_t> localIndices(nVertices, unusedLocalIndex); // vertex -> index in the current meshlet
+    MeshletState meshlet;
+    size_t cursor = 0; // first triangle possibly not emitted, for seeding new meshlets
+
+    auto nNewVertices = [&](uint32_t t) {
+        uint32_t n = 0;
+        for (uint32_t j=0; j<3; ++j)
+            n += localIndices[indices[t*3 + j]] == unusedLocalIndex;
+        return n;
+    };
+
+    while (true) {
+        // Best adjacent triangle: fewest new vertices, then closest to the meshlet centroid
+        uint32_t bestTriangle = std::numeric_limits<uint32_t>::max();
+        uint32_t bestNewVertices = 4;
+        float bestDistance = std::numeric_limits<float>::max();
+        if (!meshlet.triangleIds.empty()) {
+            Vec3f centroid = meshlet.centroidSum / static_cast<float>(meshlet.triangleIds.size());
+            for (auto v : meshlet.vertices) {
+                for (uint32_t i=adjacency.offsets[v]; i<adjacency.offsets[v+1]; ++i) {
+                    uint32_t t = adjacency.triangles[i];
+                    if (emitted[t])
+                        continue;
+                    uint32_t n = nNewVertices(t);
+                    if (n > bestNewVertices)
+                        continue;
+                    Vec3f triangleCentroid = (positions[indices[t*3]] + positions[indices[t*3 + 1]] +
+                        positions[indices[t*3 + 2]]) / 3.0f;
+                    float distance = (triangleCentroid - centroid).squaredNorm();
+                    if (n < bestNewVertices || distance < bestDistance) {
+                        bestTriangle = t;
+                        bestNewVertices = n;
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+
+        // No connected triangle left, seed from the next triangle in index order
+        if (bestTriangle == std::numeric_limits<uint32_t>::max()) {
+            while (cursor < nTriangles && emitted[cursor])
+                ++cursor;
+            if (cursor == nTriangles)
+                break;
+            bestTriangle = static_cast<uint32_t>(cursor);
+            bestNewVertices = nNewVertices(bestTriangle);
+        }
+
+        // Start a new meshlet from the triangle in case it doesn't fit
+        if (meshlet.vertices.size() + bestNewVertices > maxVertices || meshlet.triangleIds.size() >= maxTriangles) {
+            for (auto v : meshlet.vertices)
+                localIndices[v] = unusedLocalIndex;
+            finishMeshlet(&meshlet, positions, &meshlets);
+        }
+
+        Vec3f triangleCentroid = Vec3f::Zero();
+        for (uint32_t j=0; j<3; ++j) {
+            uint32_t v = indices[bestTriangle*3 + j];
+            if (localIndices[v] == unusedLocalIndex) {
+                localIndices[v] = static_cast<uint8_t>(meshlet.vertices.size());
+                meshlet.vertices.push_back(v);
+            }
+            meshlet.triangles.push_back(localIndices[v]);
+            triangleCentroid += positions[v];
+        }
+        meshlet.centroidSum += triangleCentroid / 3.0f;
+        meshlet.triangleIds.push_back(bestTriangle);
+        emitted[bestTriangle] = 1;
+    }
+    finishMeshlet(&meshlet, positions, &meshlets);
+
+    return meshlets;
+}
+
+
+template Meshlets gu2::buildMeshlets<uint16_t>(const uint16_t*, size_t, const Vec3f*, size_t, uint32_t, uint32_t);
+template Meshlets gu2::buildMeshlets<uint32_t>(const uint32_t*, size_t, const Vec3f*, size_t, uint32_t, uint32_t);
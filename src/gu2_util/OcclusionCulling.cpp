@@ -0,0 +1,311 @@
+//
+// Project: GraphicsUtils2
+// File: OcclusionCulling.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "OcclusionCulling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+
+using namespace gu2;
+
+
+namespace {
+
+// Triangle counts smaller than this are not worth distributing over threads
+constexpr int64_t   minParallelTriangles    {256};
+
+// Edge function e(x, y) = a*x + b*y + c, non-negative on the inner side of the edge from va to vb
+struct Edge {
+    float   a;
+    float   b;
+    float   c;
+
+    Edge(const Vec3f& va, const Vec3f& vb) :
+        a   (va.y() - vb.y()),
+        b   (vb.x() - va.x()),
+        c   (-(a*va.x() + b*va.y()))
+    {}
+};
+
+} // namespace
+
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+{
+    resize(width, height);
+    clear(Mat4f::Identity());
+}
+
+void OcclusionBuffer::resize(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+        throw std::runtime_error("Invalid occlusion buffer size " + std::to_string(width) + " x " +
+            std::to_string(height));
+
+    _nTilesX = (width + tileWidth - 1) / tileWidth;
+    _nTilesY = (height + tileHeight - 1) / tileHeight;
+    _width = _nTilesX * tileWidth;
+    _height = _nTilesY * tileHeight;
+    _tileTriangles.resize(_nTilesX * _nTilesY);
+
+    _levels.clear();
+    uint32_t levelWidth = _width;
+    uint32_t levelHeight = _height;
+    while (true) {
+        _levels.push_back({levelWidth, levelHeight, std::vector<float>(levelWidth*levelHeight, 0.0f)});
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+}
+
+void OcclusionBuffer::clear(const Mat4f& viewProjection)
+{
+    _viewProjection = viewProjection;
+    _triangles.clear();
+    for (auto& level : _levels)
+        std::fill(level.depth.begin(), level.depth.end(), 0.0f);
+}
+
+template <typename T_Index>
+void OcclusionBuffer::addOccluder(const Mat4f& modelMatrix, const Vec3f* positions, size_t nVertices,
+    const T_Index* indices, size_t nIndices)
+{
+    if (nIndices % 3 != 0)
+        throw std::runtime_error("Occluder index count " + std::to_string(nIndices) + " is not a multiple of 3");
+
+    Mat4f modelViewProjection = _viewProjection * modelMatrix;
+    Vec2f scale(0.5f*_width, 0.5f*_height);
+    for (size_t i=0; i<nIndices; i+=3) {
+        Triangle triangle;
+        bool inFront = true;
+        for (int j=0; j<3; ++j) {
+            if (indices[i+j] >= nVertices)
+                throw std::runtime_error("Occluder index " + std::to_string(indices[i+j]) + " out of range");
+
+            Vec4f clip = modelViewProjection * positions[indices[i+j]].homogeneous();
+            inFront &= clip.w() > 0.0f && clip.z() >= 0.0f && clip.z() <= clip.w();
+            triangle.v[j] << (clip.x()/clip.w() + 1.0f)*scale.x(), (clip.y()/clip.w() + 1.0f)*scale.y(),
+                clip.z()/clip.w();
+        }
+        if (!inFront)
+            continue;
+
+        // Counter-clockwise winding for positive edge functions inside the triangle
+        float area = (triangle.v[1].x() - triangle.v[0].x())*(triangle.v[2].y() - triangle.v[0].y()) -
+            (triangle.v[1].y() - triangle.v[0].y())*(triangle.v[2].x() - triangle.v[0].x());
+        if (area == 0.0f || !std::isfinite(area))
+            continue;
+        if (area < 0.0f)
+            std::swap(triangle.v[1], triangle.v[2]);
+
+        float minX = std::min({triangle.v[0].x(), triangle.v[1].x(), triangle.v[2].x()});
+        float maxX = std::max({triangle.v[0].x(), triangle.v[1].x(), triangle.v[2].x()});
+        float minY = std::min({triangle.v[0].y(), triangle.v[1].y(), triangle.v[2].y()});
+        float maxY = std::max({triangle.v[0].y(), triangle.v[1].y(), triangle.v[2].y()});
+        if (maxX < 0.0f || maxY < 0.0f || minX >= _width || minY >= _height)
+            continue;
+
+        _triangles.push_back(triangle);
+    }
+}
+
+void OcclusionBuffer::rasterize()
+{
+    // Bin the triangles to the tiles overlapped by their bounding rectangles
+    for (auto& tileTriangles : _tileTriangles)
+        tileTriangles.clear();
+    for (uint32_t triangleId=0; triangleId<_triangles.size(); ++triangleId) {
+        const auto& v = _triangles[triangleId].v;
+        float minX = std::min({v[0].x(), v[1].x(), v[2].x()});
+        float maxX = std::max({v[0].x(), v[1].x(), v[2].x()});
+        float minY = std::min({v[0].y(), v[1].y(), v[2].y()});
+        float maxY = std::max({v[0].y(), v[1].y(), v[2].y()});
+        uint32_t tileX0 = static_cast<uint32_t>(std::max(minX, 0.0f)) / tileWidth;
+        uint32_t tileX1 = static_cast<uint32_t>(std::min(maxX, _width - 1.0f)) / tileWidth;
+        uint32_t tileY0 = static_cast<uint32_t>(std::max(minY, 0.0f)) / tileHeight;
+        uint32_t tileY1 = static_cast<uint32_t>(std::min(maxY, _height - 1.0f)) / tileHeight;
+        for (uint32_t tileY=tileY0; tileY<=tileY1; ++tileY) {
+            for (uint32_t tileX=tileX0; tileX<=tileX1; ++tileX)
+                _tileTriangles[tileY*_nTilesX + tileX].push_back(triangleId);
+        }
+    }
+
+    // Tiles do not share pixels, they can be rasterized independently
+    int64_t nTiles = static_cast<int64_t>(_tileTriangles.size());
+    #pragma omp parallel for schedule(dynamic) if (static_cast<int64_t>(_triangles.size()) >= minParallelTriangles)
+    for (int64_t tileId=0; tileId<nTiles; ++tileId)
+        rasterizeTile(static_cast<uint32_t>(tileId));
+
+    buildHierarchy();
+}
+
+bool OcclusionBuffer::isVisible(const AABB& bounds) const noexcept
+{
+    if (bounds.isEmpty())
+        return false;
+
+    // Screen space rectangle and the nearest depth of the box
+    float minX = std::numeric_limits<float>::max();
+    float maxX = -std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    float maxDepth = 0.0f;
+    for (int i=0; i<8; ++i) {
+        Vec3f corner(i & 1 ? bounds.max.x() : bounds.min.x(), i & 2 ? bounds.max.y() : bounds.min.y(),
+            i & 4 ? bounds.max.z() : bounds.min.z());
+        Vec4f clip = _viewProjection * corner.homogeneous();
+        if (clip.w() <= 0.0f || clip.z() >= clip.w())
+            return true; // box crosses the near plane
+        float x = (clip.x()/clip.w() + 1.0f)*0.5f*_width;
+        float y = (clip.y()/clip.w() + 1.0f)*0.5f*_height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        maxDepth = std::max(maxDepth, clip.z()/clip.w());
+    }
+    if (maxX < 0.0f || maxY < 0.0f || minX >= _width || minY >= _height)
+        return true; // outside the buffer, left for the frustum culling to decide
+
+    uint32_t x0 = static_cast<uint32_t>(std::max(minX, 0.0f));
+    uint32_t x1 = static_cast<uint32_t>(std::min(maxX, _width - 1.0f));
+    uint32_t y0 = static_cast<uint32_t>(std::max(minY, 0.0f));
+    uint32_t y1 = static_cast<uint32_t>(std::min(maxY, _height - 1.0f));
+
+    // Coarsest level at which the rectangle still spans at most 4 x 4 texels
+    uint32_t levelId = 0;
+    while (levelId+1 < _levels.size() && ((x1 >> levelId) - (x0 >> levelId) >= 4 ||
+        (y1 >> levelId) - (y0 >> levelId) >= 4))
+        ++levelId;
+
+    const auto& level = _levels[levelId];
+    for (uint32_t y=(y0 >> levelId); y<=(y1 >> levelId); ++y) {
+        for (uint32_t x=(x0 >> levelId); x<=(x1 >> levelId); ++x) {
+            if (level.depth[y*level.width + x] <= maxDepth)
+                return true;
+        }
+    }
+    return false;
+}
+
+void OcclusionBuffer::rasterizeTile(uint32_t tileId)
+{
+    uint32_t tileX0 = (tileId % _nTilesX) * tileWidth;
+    uint32_t tileY0 = (tileId / _nTilesX) * tileHeight;
+    float* depth = _levels[0].depth.data();
+
+    for (auto triangleId : _tileTriangles[tileId]) {
+        const auto& v = _triangles[triangleId].v;
+        Edge e0(v[0], v[1]);
+        Edge e1(v[1], v[2]);
+        Edge e2(v[2], v[0]);
+
+        // Depth plane z(x, y) = zA*x + zB*y + zC from the barycentric weights of v[1] and v[2]
+        float invArea = 1.0f / (e0.c + e0.a*v[2].x() + e0.b*v[2].y());
+        float dz1 = v[1].z() - v[0].z();
+        float dz2 = v[2].z() - v[0].z();
+        float zA = (e2.a*dz1 + e0.a*dz2) * invArea;
+        float zB = (e2.b*dz1 + e0.b*dz2) * invArea;
+        float zC = v[0].z() + (e2.c*dz1 + e0.c*dz2) * invArea;
+
+        // Bounding rectangle clipped to the tile, x range aligned to the SIMD width
+        float minX = std::min({v[0].x(), v[1].x(), v[2].x()});
+        float maxX = std::max({v[0].x(), v[1].x(), v[2].x()});
+        float minY = std::min({v[0].y(), v[1].y(), v[2].y()});
+        float maxY = std::max({v[0].y(), v[1].y(), v[2].y()});
+        uint32_t x0 = std::max(static_cast<uint32_t>(std::max(minX, 0.0f)), tileX0);
+        uint32_t x1 = static_cast<uint32_t>(std::min(maxX + 1.0f, static_cast<float>(tileX0 + tileWidth)));
+        uint32_t y0 = std::max(static_cast<uint32_t>(std::max(minY, 0.0f)), tileY0);
+        uint32_t y1 = static_cast<uint32_t>(std::min(maxY + 1.0f, static_cast<float>(tileY0 + tileHeight)));
+
+        for (uint32_t y=y0; y<y1; ++y) {
+            float py = static_cast<float>(y) + 0.5f;
+            float row0 = e0.b*py + e0.c;
+            float row1 = e1.b*py + e1.c;
+            float row2 = e2.b*py + e2.c;
+            float rowZ = zB*py + zC;
+            float* depthRow = depth + y*_width;
+            uint32_t x = x0;
+#if defined(__AVX__)
+            x &= ~7u;
+            __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+            __m256 zero = _mm256_setzero_ps();
+            for (; x<x1; x+=8) {
+                __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+                __m256 w0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e0.a), px), _mm256_set1_ps(row0));
+                __m256 w1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e1.a), px), _mm256_set1_ps(row1));
+                __m256 w2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(e2.a), px), _mm256_set1_ps(row2));
+                __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(w0, zero, _CMP_GE_OQ),
+                    _mm256_cmp_ps(w1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(w2, zero, _CMP_GE_OQ));
+                __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(zA), px), _mm256_set1_ps(rowZ));
+                __m256 d = _mm256_loadu_ps(depthRow + x);
+                _mm256_storeu_ps(depthRow + x, _mm256_blendv_ps(d, _mm256_max_ps(d, z), inside));
+            }
+#elif defined(__SSE__)
+            x &= ~3u;
+            __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            __m128 zero = _mm_setzero_ps();
+            for (; x<x1; x+=4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                __m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0.a), px), _mm_set1_ps(row0));
+                __m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1.a), px), _mm_set1_ps(row1));
+                __m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2.a), px), _mm_set1_ps(row2));
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)),
+                    _mm_cmpge_ps(w2, zero));
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(rowZ));
+                __m128 d = _mm_loadu_ps(depthRow + x);
+                _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, _mm_max_ps(d, z)),
+                    _mm_andnot_ps(inside, d)));
+            }
+#endif
+            for (; x<x1; ++x) {
+                float px = static_cast<float>(x) + 0.5f;
+                if (e0.a*px + row0 >= 0.0f && e1.a*px + row1 >= 0.0f && e2.a*px + row2 >= 0.0f)
+                    depthRow[x] = std::max(depthRow[x], zA*px + rowZ);
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::buildHierarchy()
+{
+    // Each texel holds the farthest (minimum inverted) depth of the texels it covers on the finer level
+    for (size_t levelId=1; levelId<_levels.size(); ++levelId) {
+        const auto& fine = _levels[levelId-1];
+        auto& coarse = _levels[levelId];
+        for (uint32_t y=0; y<coarse.height; ++y) {
+            uint32_t fy0 = 2*y;
+            uint32_t fy1 = std::min(2*y + 1, fine.height - 1);
+            for (uint32_t x=0; x<coarse.width; ++x) {
+                uint32_t fx0 = 2*x;
+                uint32_t fx1 = std::min(2*x + 1, fine.width - 1);
+                coarse.depth[y*coarse.width + x] = std::min(
+                    std::min(fine.depth[fy0*fine.width + fx0], fine.depth[fy0*fine.width + fx1]),
+                    std::min(fine.depth[fy1*fine.width + fx0], fine.depth[fy1*fine.width + fx1]));
+            }
+        }
+    }
+}
+
+
+template void OcclusionBuffer::addOccluder<uint16_t>(const Mat4f& modelMatrix, const Vec3f* positions,
+    size_t nVertices, const uint16_t* indices, size_t nIndices);
+template void OcclusionBuffer::addOccluder<uint32_t>(const Mat4f& modelMatrix, const Vec3f* positions,
+    size_t nVertices, const uint32_t* indices, size_t nIndices);
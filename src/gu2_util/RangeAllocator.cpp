@@ -0,0 +1,169 @@
+//
+// Project: GraphicsUtils2
+// File: RangeAllocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "RangeAllocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+using namespace gu2;
+
+
+namespace {
+
+inline uint64_t alignUp(uint64_t offset, uint64_t alignment)
+{
+    return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+} // namespace
+
+
+RangeAllocator::RangeAllocator(uint64_t capacity) :
+    _capacity   (0),
+    _usedSize   (0)
+{
+    grow(capacity);
+}
+
+uint64_t RangeAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    if (alignment == 0)
+        throw std::runtime_error("RangeAllocator: alignment must be nonzero");
+    if (size == 0)
+        size = 1; // keep the offsets of the allocations unique
+
+    for (auto it = _freeRanges.begin(); it != _freeRanges.end(); ++it) {
+        uint64_t rangeBegin = it->first;
+        uint64_t rangeEnd = it->first + it->second;
+        uint64_t offset = alignUp(rangeBegin, alignment);
+        if (offset + size > rangeEnd)
+            continue;
+
+        // Split the free range, the alignment padding and the tail remain free
+        _freeRanges.erase(it);
+        if (offset > rangeBegin)
+            _freeRanges.emplace(rangeBegin, offset - rangeBegin);
+        if (offset + size < rangeEnd)
+            _freeRanges.emplace(offset + size, rangeEnd - offset - size);
+
+        _allocations.emplace(offset, Allocation{size, alignment});
+        _usedSize += size;
+        return offset;
+    }
+
+    return invalidOffset;
+}
+
+void RangeAllocator::free(uint64_t offset)
+{
+    auto it = _allocations.find(offset);
+    if (it == _allocations.end())
+        throw std::runtime_error("RangeAllocator: no allocation at offset " + std::to_string(offset));
+
+    uint64_t size = it->second.size;
+    _allocations.erase(it);
+    _usedSize -= size;
+    addFreeRange(offset, size);
+}
+
+void RangeAllocator::grow(uint64_t capacity)
+{
+    if (capacity <= _capacity)
+        return;
+
+    addFreeRange(_capacity, capacity - _capacity);
+    _capacity = capacity;
+}
+
+void RangeAllocator::clear()
+{
+    _allocations.clear();
+    _freeRanges.clear();
+    _usedSize = 0;
+    if (_capacity > 0)
+        _freeRanges.emplace(0, _capacity);
+}
+
+std::vector<RangeAllocator::Move> RangeAllocator::defragment()
+{
+    std::vector<Move> moves;
+    std::map<uint64_t, Allocation> allocations;
+    uint64_t end = 0;
+    for (const auto& [offset, allocation] : _allocations) {
+        uint64_t dstOffset = alignUp(end, allocation.alignment);
+        if (dstOffset != offset)
+            moves.push_back({offset, dstOffset, allocation.size});
+        allocations.emplace_hint(allocations.end(), dstOffset, allocation);
+        end = dstOffset + allocation.size;
+    }
+    _allocations = std::move(allocations);
+
+    // Alignment padding between the packed allocations remains free
+    _freeRanges.clear();
+    uint64_t previousEnd = 0;
+    for (const auto& [offset, allocation] : _allocations) {
+        if (offset > previousEnd)
+            _freeRanges.emplace(previousEnd, offset - previousEnd);
+        previousEnd = offset + allocation.size;
+    }
+    if (_capacity > previousEnd)
+        _freeRanges.emplace(previousEnd, _capacity - previousEnd);
+
+    return moves;
+}
+
+uint64_t RangeAllocator::getSize(uint64_t offset) const
+{
+    auto it = _allocations.find(offset);
+    return it == _allocations.end() ? 0 : it->second.size;
+}
+
+uint64_t RangeAllocator::getLargestFreeRange() const
+{
+    uint64_t largest = 0;
+    for (const auto& [offset, size] : _freeRanges)
+        largest = std::max(largest, size);
+    return largest;
+}
+
+uint64_t RangeAllocator::getUsedEnd() const
+{
+    if (_allocations.empty())
+        return 0;
+    const auto& [offset, allocation] = *_allocations.rbegin();
+    return offset + allocation.size;
+}
+
+void RangeAllocator::addFreeRange(uint64_t offset, uint64_t size)
+{
+    if (size == 0)
+        return;
+
+    // Merge with the following free range
+    auto next = _freeRanges.lower_bound(offset);
+    if (next != _freeRanges.end() && next->first == offset + size) {
+        size += next->second;
+        next = _freeRanges.erase(next);
+    }
+
+    // Merge with the preceding free range
+    if (next != _freeRanges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+
+    _freeRanges.emplace_hint(next, offset, size);
+}
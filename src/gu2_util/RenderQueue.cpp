@@ -0,0 +1,58 @@
+//
+// Project: GraphicsUtils2
+// File: RenderQueue.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "RenderQueue.hpp"
+
+#include <array>
+#include <utility>
+
+
+using namespace gu2;
+
+
+void RenderQueue::sort()
+{
+    constexpr uint32_t nDigits = 8;
+    constexpr uint32_t nBuckets = 256;
+
+    size_t n = _entries.size();
+    if (n < 2)
+        return;
+
+    // Histograms of all the digits in a single pass
+    std::array<std::array<uint32_t, nBuckets>, nDigits> counts {};
+    for (const auto& entry : _entries) {
+        for (uint32_t d=0; d<nDigits; ++d)
+            ++counts[d][(entry.key >> (8*d)) & 0xff];
+    }
+
+    _sortBuffer.resize(n);
+    auto* src = &_entries;
+    auto* dst = &_sortBuffer;
+    for (uint32_t d=0; d<nDigits; ++d) {
+        auto& digitCounts = counts[d];
+        // Nothing to do in case all the keys share the digit
+        if (digitCounts[(_entries[0].key >> (8*d)) & 0xff] == n)
+            continue;
+
+        std::array<uint32_t, nBuckets> offsets;
+        uint32_t offset = 0;
+        for (uint32_t b=0; b<nBuckets; ++b) {
+            offsets[b] = offset;
+            offset += digitCounts[b];
+        }
+        for (const auto& entry : *src)
+            (*dst)[offsets[(entry.key >> (8*d)) & 0xff]++] = entry;
+        std::swap(src, dst);
+    }
+
+    if (src != &_entries)
+        _entries.swap(_sortBuffer);
+}
@@ -0,0 +1,184 @@
+//
+// Project: GraphicsUtils2
+// File: SpirvCache.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "SpirvCache.hpp"
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint32_t spirvCacheMagic {0x53563247}; // "G2VS"
+constexpr uint32_t spirvCacheVersion {1};
+
+struct EntryHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    key;
+    uint32_t    nDependencies;
+    uint32_t    nWords;
+};
+
+template <typename T>
+inline bool readValue(std::istream& stream, T* value)
+{
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(value), sizeof(T)));
+}
+
+template <typename T>
+inline void writeValue(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+} // namespace
+
+
+SpirvCache::SpirvCache(Path directory) :
+    _directory  (std::move(directory))
+{
+}
+
+bool SpirvCache::find(uint64_t key, std::vector<uint32_t>* spirv)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto entryIter = _entries.find(key);
+    if (entryIter == _entries.end()) {
+        Entry entry;
+        if (!readEntry(key, &entry))
+            return false;
+        entryIter = _entries.emplace(key, std::move(entry)).first;
+    }
+
+    for (const auto& dependency : entryIter->second.dependencies) {
+        uint64_t contentHash = getFileHash(dependency.filename);
+        if (contentHash == 0 || contentHash != dependency.contentHash)
+            return false;
+    }
+
+    *spirv = entryIter->second.spirv;
+    return true;
+}
+
+void SpirvCache::store(uint64_t key, const std::vector<Path>& dependencies, std::vector<uint32_t> spirv)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Entry entry;
+    entry.dependencies.reserve(dependencies.size());
+    for (const auto& dependency : dependencies) {
+        std::string filename = dependency.string();
+        entry.dependencies.push_back(Dependency{filename, getFileHash(filename)});
+    }
+    entry.spirv = std::move(spirv);
+
+    if (!_directory.empty())
+        writeEntry(key, entry);
+    _entries.insert_or_assign(key, std::move(entry));
+}
+
+uint64_t SpirvCache::getFileHash(const std::string& filename)
+{
+    auto hashIter = _fileHashes.find(filename);
+    if (hashIter != _fileHashes.end())
+        return hashIter->second;
+
+    uint64_t hash = 0;
+    std::ifstream file(filename, std::ios::binary);
+    if (file) {
+        std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        // Reserve 0 for the unreadable files
+        hash = std::max(hashBytes(contents.data(), contents.size()), uint64_t(1));
+    }
+    _fileHashes.emplace(filename, hash);
+    return hash;
+}
+
+Path SpirvCache::getEntryFilename(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".spv", key);
+    return _directory / name;
+}
+
+bool SpirvCache::readEntry(uint64_t key, Entry* entry) const
+{
+    if (_directory.empty())
+        return false;
+
+    Path filename = getEntryFilename(key);
+    std::error_code error;
+    uint64_t fileSize = std::filesystem::file_size(filename, error);
+    std::ifstream file(filename, std::ios::binary);
+    if (error || !file)
+        return false;
+
+    // Stale or corrupted entries are treated as missing, they get replaced by the next store
+    EntryHeader header;
+    if (!readValue(file, &header) || header.magic != spirvCacheMagic || header.version != spirvCacheVersion ||
+        header.key != key || header.nDependencies > fileSize || uint64_t(header.nWords)*sizeof(uint32_t) > fileSize)
+        return false;
+
+    entry->dependencies.resize(header.nDependencies);
+    for (auto& dependency : entry->dependencies) {
+        uint32_t filenameLength = 0;
+        if (!readValue(file, &dependency.contentHash) || !readValue(file, &filenameLength) ||
+            filenameLength > 4096)
+            return false;
+        dependency.filename.resize(filenameLength);
+        if (!file.read(dependency.filename.data(), filenameLength))
+            return false;
+    }
+
+    entry->spirv.resize(header.nWords);
+    if (!file.read(reinterpret_cast<char*>(entry->spirv.data()), entry->spirv.size()*sizeof(uint32_t)))
+        return false;
+
+    return true;
+}
+
+void SpirvCache::writeEntry(uint64_t key, const Entry& entry) const
+{
+    std::filesystem::create_directories(_directory);
+
+    // Write to a temporary file first so that the readers never see a partially written entry
+    Path filename = getEntryFilename(key);
+    Path tmpFilename = filename;
+    tmpFilename += ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("Unable to open file " + tmpFilename.string() + " for writing");
+
+        writeValue(file, EntryHeader{spirvCacheMagic, spirvCacheVersion, key,
+            static_cast<uint32_t>(entry.dependencies.size()), static_cast<uint32_t>(entry.spirv.size())});
+        for (const auto& dependency : entry.dependencies) {
+            writeValue(file, dependency.contentHash);
+            writeValue(file, static_cast<uint32_t>(dependency.filename.size()));
+            file.write(dependency.filename.data(), static_cast<std::streamsize>(dependency.filename.size()));
+        }
+        file.write(reinterpret_cast<const char*>(entry.spirv.data()),
+            static_cast<std::streamsize>(entry.spirv.size()*sizeof(uint32_t)));
+
+        if (!file)
+            throw std::runtime_error("Writing to " + tmpFilename.string() + " failed");
+    }
+    std::filesystem::rename(tmpFilename, filename);
+}
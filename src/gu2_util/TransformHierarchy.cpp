@@ -0,0 +1,169 @@
+//
+// Project: GraphicsUtils2
+// File: TransformHierarchy.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+using namespace gu2;
+
+
+namespace {
+
+// Levels smaller than this are not worth distributing over threads
+constexpr int64_t   minParallelLevelSize    {1024};
+
+inline Mat4f composeMatrix(const Vec3f& translation, const Quatf& rotation, const Vec3f& scale)
+{
+    Mat4f matrix;
+    matrix.block<3,3>(0,0) = rotation.toRotationMatrix() * scale.asDiagonal();
+    matrix.block<3,1>(0,3) = translation;
+    matrix.row(3) << 0.0f, 0.0f, 0.0f, 1.0f;
+    return matrix;
+}
+
+} // namespace
+
+
+uint32_t TransformHierarchy::addNode(
+    uint32_t parent,
+    const Vec3f& translation,
+    const Quatf& rotation,
+    const Vec3f& scale
+) {
+    uint32_t nodeId = static_cast<uint32_t>(_parents.size());
+    if (parent != noParent && parent >= nodeId)
+        throw std::runtime_error("Invalid parent " + std::to_string(parent) + " for node " + std::to_string(nodeId));
+
+    _parents.push_back(parent);
+    _depths.push_back(parent == noParent ? 0 : _depths[parent] + 1);
+    _translations.push_back(translation);
+    _rotations.push_back(rotation);
+    _scales.push_back(scale);
+    _worldMatrices.push_back(Mat4f::Identity());
+    _dirty.push_back(0);
+    _changed.push_back(0);
+    _levelsValid = false;
+    markDirty(nodeId);
+
+    return nodeId;
+}
+
+uint32_t TransformHierarchy::addNodeFromMatrix(uint32_t parent, const Mat4f& localMatrix)
+{
+    Vec3f translation, scale;
+    Quatf rotation;
+    decompose(localMatrix, &translation, &rotation, &scale);
+    return addNode(parent, translation, rotation, scale);
+}
+
+void TransformHierarchy::clear()
+{
+    *this = TransformHierarchy();
+}
+
+void TransformHierarchy::setTranslation(uint32_t nodeId, const Vec3f& translation)
+{
+    _translations.at(nodeId) = translation;
+    markDirty(nodeId);
+}
+
+void TransformHierarchy::setRotation(uint32_t nodeId, const Quatf& rotation)
+{
+    _rotations.at(nodeId) = rotation;
+    markDirty(nodeId);
+}
+
+void TransformHierarchy::setScale(uint32_t nodeId, const Vec3f& scale)
+{
+    _scales.at(nodeId) = scale;
+    markDirty(nodeId);
+}
+
+void TransformHierarchy::setLocalMatrix(uint32_t nodeId, const Mat4f& localMatrix)
+{
+    decompose(localMatrix, &_translations.at(nodeId), &_rotations[nodeId], &_scales[nodeId]);
+    markDirty(nodeId);
+}
+
+void TransformHierarchy::update()
+{
+    for (auto nodeId : _changedNodes)
+        _changed[nodeId] = 0;
+    _changedNodes.clear();
+
+    if (!_levelsValid)
+        buildLevels();
+
+    // Levels above the topmost dirty node are not affected
+    int64_t nLevels = static_cast<int64_t>(_levelOffsets.size()) - 1;
+    for (int64_t level=_minDirtyDepth; level<nLevels; ++level) {
+        int64_t levelBegin = _levelOffsets[level];
+        int64_t levelEnd = _levelOffsets[level+1];
+
+        #pragma omp parallel for if (levelEnd - levelBegin >= minParallelLevelSize)
+        for (int64_t i=levelBegin; i<levelEnd; ++i) {
+            uint32_t nodeId = _levelOrder[i];
+            uint32_t parent = _parents[nodeId];
+            bool parentChanged = parent != noParent && _changed[parent];
+            if (!_dirty[nodeId] && !parentChanged)
+                continue;
+
+            Mat4f localMatrix = composeMatrix(_translations[nodeId], _rotations[nodeId], _scales[nodeId]);
+            if (parent == noParent)
+                _worldMatrices[nodeId] = localMatrix;
+            else
+                _worldMatrices[nodeId].noalias() = _worldMatrices[parent] * localMatrix;
+            _dirty[nodeId] = 0;
+            _changed[nodeId] = 1;
+        }
+
+        for (int64_t i=levelBegin; i<levelEnd; ++i) {
+            if (_changed[_levelOrder[i]])
+                _changedNodes.push_back(_levelOrder[i]);
+        }
+    }
+    _minDirtyDepth = 0xffffffff;
+}
+
+void TransformHierarchy::decompose(const Mat4f& matrix, Vec3f* translation, Quatf* rotation, Vec3f* scale)
+{
+    *translation = matrix.block<3,1>(0,3);
+    Mat3f basis = matrix.block<3,3>(0,0);
+    *scale = basis.colwise().norm();
+    if (basis.determinant() < 0.0f)
+        scale->x() = -scale->x(); // mirroring is expressed as a negative scale
+
+    for (int i=0; i<3; ++i) {
+        if ((*scale)(i) != 0.0f)
+            basis.col(i) /= (*scale)(i);
+    }
+    *rotation = Quatf(basis).normalized();
+}
+
+void TransformHierarchy::buildLevels()
+{
+    uint32_t nLevels = _depths.empty() ? 0 : *std::max_element(_depths.begin(), _depths.end()) + 1;
+    _levelOffsets.assign(nLevels + 1, 0);
+    for (auto depth : _depths)
+        ++_levelOffsets[depth + 1];
+    for (uint32_t level=0; level<nLevels; ++level)
+        _levelOffsets[level+1] += _levelOffsets[level];
+
+    _levelOrder.resize(_parents.size());
+    std::vector<uint32_t> fill(_levelOffsets.begin(), _levelOffsets.end() - 1);
+    for (uint32_t nodeId=0; nodeId<_depths.size(); ++nodeId)
+        _levelOrder[fill[_depths[nodeId]]++] = nodeId;
+
+    _levelsValid = true;
+}
@@ -0,0 +1,524 @@
+//
+// Project: GraphicsUtils2
+// File: VertexGeneration.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "VertexGeneration.hpp"
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+
+
+using namespace gu2;
+
+
+namespace {
+
+template <typename T_Index>
+inline uint32_t getIndex(const T_Index* indices, size_t i)
+{
+    return indices != nullptr ? static_cast<uint32_t>(indices[i]) : static_cast<uint32_t>(i);
+}
+
+
+// MikkTSpace port, names follow the reference implementation where practical
+
+// Triangle flags
+constexpr uint32_t  groupWithAny        {0x1}; // degenerate texture mapping, joins the group of any neighbor
+constexpr uint32_t  orientPreserving    {0x2}; // positive signed UV area
+
+// Cosine of the angular threshold for splitting the tangent spaces of a vertex group, genTangSpaceDefault uses
+// 180 degrees
+constexpr float     thresholdCos        {-1.0f};
+
+struct TriangleInfo {
+    int64_t     neighbors[3]    {-1, -1, -1};   // triangle sharing edge i (corner i -> corner i+1)
+    int64_t     groups[3]       {-1, -1, -1};   // group of corner i
+    Vec3f       os              {Vec3f::Zero()};// normalized first order derivatives of the position w.r.t. UV
+    Vec3f       ot              {Vec3f::Zero()};
+    float       magS            {0.0f};
+    float       magT            {0.0f};
+    uint32_t    flags           {groupWithAny};
+};
+
+// Corners of a vertex connected over the mesh surface with the same UV orientation
+struct Group {
+    uint32_t                vertex;
+    bool                    orientPreserving;
+    std::vector<uint32_t>   triangles;
+};
+
+struct TangentSpace {
+    Vec3f   os          {Vec3f::UnitX()};
+    Vec3f   ot          {Vec3f::UnitY()};
+    float   magS        {1.0f};
+    float   magT        {1.0f};
+    bool    orient      {false};
+};
+
+inline bool notZero(float x)
+{
+    return std::abs(x) > std::numeric_limits<float>::min();
+}
+
+inline bool notZero(const Vec3f& v)
+{
+    return notZero(v.x()) || notZero(v.y()) || notZero(v.z());
+}
+
+// Component of v perpendicular to n, normalized unless zero
+inline Vec3f projectToPlane(const Vec3f& v, const Vec3f& n)
+{
+    Vec3f p = v - n*n.dot(v);
+    return notZero(p) ? (p * (1.0f / p.norm())).eval() : p;
+}
+
+// Edge number of the welded triangle corners containing the edge {i0In, i1In}, i0 and i1 are in triangle order
+inline void getEdge(const uint32_t* corners, uint32_t i0In, uint32_t i1In, uint32_t* i0, uint32_t* i1, int* edge)
+{
+    if (corners[0] == i0In || corners[0] == i1In) {
+        if (corners[1] == i0In || corners[1] == i1In) {
+            *edge = 0;
+            *i0 = corners[0];
+            *i1 = corners[1];
+        }
+        else {
+            *edge = 2;
+            *i0 = corners[2];
+            *i1 = corners[0];
+        }
+    }
+    else {
+        *edge = 1;
+        *i0 = corners[1];
+        *i1 = corners[2];
+    }
+}
+
+inline int findCorner(const uint32_t* corners, uint32_t vertex)
+{
+    return corners[0] == vertex ? 0 : (corners[1] == vertex ? 1 : 2);
+}
+
+// Pair triangles sharing an edge in opposite directions (BuildNeighborsFast)
+void buildNeighbors(std::vector<TriangleInfo>& triangleInfos, const uint32_t* corners)
+{
+    struct Edge {
+        uint32_t    i0; // smaller index
+        uint32_t    i1;
+        uint32_t    triangle;
+    };
+
+    size_t nTriangles = triangleInfos.size();
+    std::vector<Edge> edges(nTriangles*3);
+    for (uint32_t t=0; t<nTriangles; ++t) {
+        for (int i=0; i<3; ++i) {
+            uint32_t i0 = corners[t*3 + i];
+            uint32_t i1 = corners[t*3 + (i<2 ? i+1 : 0)];
+            edges[t*3 + i] = {std::min(i0, i1), std::max(i0, i1), t};
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        return std::tie(a.i0, a.i1, a.triangle) < std::tie(b.i0, b.i1, b.triangle);
+    });
+
+    for (size_t i=0; i<edges.size(); ++i) {
+        const auto& edgeA = edges[i];
+        uint32_t i0A, i1A;
+        int edgeNumA;
+        getEdge(corners + edgeA.triangle*3, edgeA.i0, edgeA.i1, &i0A, &i1A, &edgeNumA);
+        if (triangleInfos[edgeA.triangle].neighbors[edgeNumA] != -1)
+            continue;
+
+        for (size_t j=i+1; j<edges.size() && edges[j].i0 == edgeA.i0 && edges[j].i1 == edgeA.i1; ++j) {
+            const auto& edgeB = edges[j];
+            uint32_t i0B, i1B;
+            int edgeNumB;
+            getEdge(corners + edgeB.triangle*3, edgeB.i0, edgeB.i1, &i1B, &i0B, &edgeNumB); // flipped
+            if (i0A == i0B && i1A == i1B && triangleInfos[edgeB.triangle].neighbors[edgeNumB] == -1) {
+                triangleInfos[edgeA.triangle].neighbors[edgeNumA] = edgeB.triangle;
+                triangleInfos[edgeB.triangle].neighbors[edgeNumB] = edgeA.triangle;
+                break;
+            }
+        }
+    }
+}
+
+// Grow a group over the neighbors of the triangle that share the group vertex (AssignRecur), depth first with an
+// explicit stack. The triangle adding the first corner starts the group and is handled by the caller.
+void assignToGroup(
+    std::vector<TriangleInfo>& triangleInfos,
+    const uint32_t* corners,
+    std::vector<Group>& groups,
+    int64_t groupId,
+    std::vector<int64_t>& stack
+) {
+    auto& group = groups[groupId];
+    while (!stack.empty()) {
+        int64_t t = stack.back();
+        stack.pop_back();
+
+        auto& info = triangleInfos[t];
+        int i = findCorner(corners + t*3, group.vertex);
+        if (info.groups[i] != -1)
+            continue;
+
+        // The first group reaching a triangle with degenerate texture mapping determines its orientation
+        if ((info.flags & groupWithAny) && info.groups[0] == -1 && info.groups[1] == -1 && info.groups[2] == -1)
+            info.flags = (info.flags & ~orientPreserving) | (group.orientPreserving ? orientPreserving : 0);
+        if (((info.flags & orientPreserving) != 0) != group.orientPreserving)
+            continue;
+
+        group.triangles.push_back(static_cast<uint32_t>(t));
+        info.groups[i] = groupId;
+        if (info.neighbors[i>0 ? i-1 : 2] >= 0)
+            stack.push_back(info.neighbors[i>0 ? i-1 : 2]);
+        if (info.neighbors[i] >= 0)
+            stack.push_back(info.neighbors[i]);
+    }
+}
+
+// Angle weighted average of the projected derivatives of the triangles sharing a vertex (EvalTspace)
+TangentSpace evaluateTangentSpace(
+    const std::vector<uint32_t>& triangles,
+    const std::vector<TriangleInfo>& triangleInfos,
+    const uint32_t* corners,
+    const Vec3f* positions,
+    const Vec3f* normals,
+    uint32_t vertex
+) {
+    TangentSpace result;
+    result.os.setZero();
+    result.ot.setZero();
+    result.magS = 0.0f;
+    result.magT = 0.0f;
+    float angleSum = 0.0f;
+
+    for (auto t : triangles) {
+        const auto& info = triangleInfos[t];
+        if (info.flags & groupWithAny)
+            continue;
+
+        int i = findCorner(corners + t*3, vertex);
+        const Vec3f& n = normals[vertex];
+        Vec3f os = projectToPlane(info.os, n);
+        Vec3f ot = projectToPlane(info.ot, n);
+
+        const Vec3f& p0 = positions[corners[t*3 + (i>0 ? i-1 : 2)]];
+        const Vec3f& p1 = positions[corners[t*3 + i]];
+        const Vec3f& p2 = positions[corners[t*3 + (i<2 ? i+1 : 0)]];
+        Vec3f v1 = projectToPlane(p0 - p1, n);
+        Vec3f v2 = projectToPlane(p2 - p1, n);
+        float angle = std::acos(std::clamp(v1.dot(v2), -1.0f, 1.0f));
+
+        result.os += angle*os;
+        result.ot += angle*ot;
+        result.magS += angle*info.magS;
+        result.magT += angle*info.magT;
+        angleSum += angle;
+    }
+
+    if (notZero(result.os))
+        result.os *= 1.0f / result.os.norm();
+    if (notZero(result.ot))
+        result.ot *= 1.0f / result.ot.norm();
+    if (angleSum > 0.0f) {
+        result.magS /= angleSum;
+        result.magT /= angleSum;
+    }
+    return result;
+}
+
+struct WeldKey {
+    std::array<float, 8>    data; // position, normal, texture coordinate
+
+    bool operator==(const WeldKey& other) const noexcept
+    {
+        return memcmp(data.data(), other.data.data(), sizeof(data)) == 0;
+    }
+};
+
+struct WeldKeyHash {
+    size_t operator()(const WeldKey& key) const noexcept
+    {
+        return static_cast<size_t>(hashBytes(key.data.data(), sizeof(key.data)));
+    }
+};
+
+} // namespace
+
+
+template <typename T_Index>
+void gu2::generateNormals(
+    const Vec3f* positions,
+    size_t nVertices,
+    const T_Index* indices,
+    size_t nIndices,
+    Vec3f* normals
+) {
+    std::fill(normals, normals + nVertices, Vec3f::Zero());
+
+    // Unnormalized cross product has the length of twice the triangle area
+    for (size_t i=0; i+3 <= nIndices; i+=3) {
+        uint32_t i0 = getIndex(indices, i);
+        uint32_t i1 = getIndex(indices, i+1);
+        uint32_t i2 = getIndex(indices, i+2);
+        Vec3f n = (positions[i1] - positions[i0]).cross(positions[i2] - positions[i0]);
+        normals[i0] += n;
+        normals[i1] += n;
+        normals[i2] += n;
+    }
+
+    for (size_t i=0; i<nVertices; ++i) {
+        float length = normals[i].norm();
+        normals[i] = length > 0.0f ? (normals[i] / length).eval() : Vec3f::UnitZ().eval();
+    }
+}
+
+template <typename T_Index>
+void gu2::generateTangents(
+    const Vec3f* positions,
+    const Vec3f* normals,
+    const Vec2f* texCoords,
+    size_t nVertices,
+    const T_Index* indices,
+    size_t nIndices,
+    Vec4f* cornerTangents
+) {
+    size_t nTriangles = nIndices / 3;
+
+    // Weld the vertices, MikkTSpace treats corners with identical data as the same vertex regardless of the indices
+    std::vector<uint32_t> weldedVertices(nVertices);
+    {
+        std::unordered_map<WeldKey, uint32_t, WeldKeyHash> vertexMap;
+        vertexMap.reserve(nVertices);
+        for (uint32_t v=0; v<nVertices; ++v) {
+            WeldKey key;
+            memcpy(key.data.data(), positions[v].data(), 3*sizeof(float));
+            memcpy(key.data.data() + 3, normals[v].data(), 3*sizeof(float));
+            memcpy(key.data.data() + 6, texCoords[v].data(), 2*sizeof(float));
+            weldedVertices[v] = vertexMap.try_emplace(key, v).first->second;
+        }
+    }
+
+    // Degenerate triangles (coinciding corner positions) are excluded from the tangent space generation, the good
+    // triangles are processed in their original order
+    std::vector<uint32_t> goodTriangles;
+    std::vector<uint32_t> degenerateTriangles;
+    for (uint32_t t=0; t<nTriangles; ++t) {
+        const Vec3f& p0 = positions[getIndex(indices, t*3)];
+        const Vec3f& p1 = positions[getIndex(indices, t*3+1)];
+        const Vec3f& p2 = positions[getIndex(indices, t*3+2)];
+        if (p0 == p1 || p0 == p2 || p1 == p2)
+            degenerateTriangles.push_back(t);
+        else
+            goodTriangles.push_back(t);
+    }
+
+    size_t nGoodTriangles = goodTriangles.size();
+    std::vector<uint32_t> corners(nGoodTriangles*3); // welded vertex of each corner of the good triangles
+    for (size_t t=0; t<nGoodTriangles; ++t) {
+        for (int i=0; i<3; ++i)
+            corners[t*3 + i] = weldedVertices[getIndex(indices, goodTriangles[t]*3 + i)];
+    }
+
+    // First order derivatives of the triangles (InitTriInfo)
+    std::vector<TriangleInfo> triangleInfos(nGoodTriangles);
+    for (size_t t=0; t<nGoodTriangles; ++t) {
+        auto& info = triangleInfos[t];
+        const uint32_t* c = corners.data() + t*3;
+        Vec3f d1 = positions[c[1]] - positions[c[0]];
+        Vec3f d2 = positions[c[2]] - positions[c[0]];
+        Vec2f t21 = texCoords[c[1]] - texCoords[c[0]];
+        Vec2f t31 = texCoords[c[2]] - texCoords[c[0]];
+        float signedAreaSTx2 = t21.x()*t31.y() - t21.y()*t31.x();
+        Vec3f os = t31.y()*d1 - t21.y()*d2;
+        Vec3f ot = -t31.x()*d1 + t21.x()*d2;
+        info.flags |= signedAreaSTx2 > 0.0f ? orientPreserving : 0;
+
+        if (notZero(signedAreaSTx2)) {
+            float absArea = std::abs(signedAreaSTx2);
+            float lenOs = os.norm();
+            float lenOt = ot.norm();
+            float s = (info.flags & orientPreserving) ? 1.0f : -1.0f;
+            if (notZero(lenOs))
+                info.os = (s / lenOs) * os;
+            if (notZero(lenOt))
+                info.ot = (s / lenOt) * ot;
+
+            info.magS = lenOs / absArea;
+            info.magT = lenOt / absArea;
+            if (notZero(info.magS) && notZero(info.magT))
+                info.flags &= ~groupWithAny;
+        }
+    }
+    buildNeighbors(triangleInfos, corners.data());
+
+    // Group the corners sharing a vertex by connectivity and orientation (Build4RuleGroups)
+    std::vector<Group> groups;
+    std::vector<int64_t> stack;
+    for (size_t t=0; t<nGoodTriangles; ++t) {
+        auto& info = triangleInfos[t];
+        for (int i=0; i<3; ++i) {
+            if ((info.flags & groupWithAny) || info.groups[i] != -1)
+                continue;
+
+            int64_t groupId = static_cast<int64_t>(groups.size());
+            groups.push_back({corners[t*3 + i], (info.flags & orientPreserving) != 0, {static_cast<uint32_t>(t)}});
+            info.groups[i] = groupId;
+            if (info.neighbors[i>0 ? i-1 : 2] >= 0)
+                stack.push_back(info.neighbors[i>0 ? i-1 : 2]);
+            if (info.neighbors[i] >= 0)
+                stack.push_back(info.neighbors[i]);
+            assignToGroup(triangleInfos, corners.data(), groups, groupId, stack);
+        }
+    }
+
+    // Tangent spaces of the corners (GenerateTSpaces), corners not in any group keep the default tangent space
+    std::vector<TangentSpace> tangentSpaces(nGoodTriangles*3);
+    std::vector<std::vector<uint32_t>> subGroups;
+    std::vector<TangentSpace> subGroupTangentSpaces;
+    std::vector<uint32_t> members;
+    for (int64_t g=0; g<static_cast<int64_t>(groups.size()); ++g) {
+        const auto& group = groups[g];
+        const Vec3f& n = normals[group.vertex];
+        subGroups.clear();
+        subGroupTangentSpaces.clear();
+
+        for (auto t : group.triangles) {
+            const auto& info = triangleInfos[t];
+            int i = findCorner(corners.data() + t*3, group.vertex);
+            Vec3f os = projectToPlane(info.os, n);
+            Vec3f ot = projectToPlane(info.ot, n);
+
+            // Triangles of the group with similar enough derivatives
+            members.clear();
+            for (auto t2 : group.triangles) {
+                const auto& info2 = triangleInfos[t2];
+                bool any = ((info.flags | info2.flags) & groupWithAny) != 0;
+                if (any || t == t2 || (os.dot(projectToPlane(info2.os, n)) > thresholdCos &&
+                    ot.dot(projectToPlane(info2.ot, n)) > thresholdCos))
+                    members.push_back(t2);
+            }
+            std::sort(members.begin(), members.end());
+
+            auto subGroup = std::find(subGroups.begin(), subGroups.end(), members);
+            if (subGroup == subGroups.end()) {
+                subGroups.push_back(members);
+                subGroupTangentSpaces.push_back(evaluateTangentSpace(members, triangleInfos, corners.data(),
+                    positions, normals, group.vertex));
+                subGroup = subGroups.end() - 1;
+            }
+
+            auto& tangentSpace = tangentSpaces[t*3 + i];
+            tangentSpace = subGroupTangentSpaces[subGroup - subGroups.begin()];
+            tangentSpace.orient = group.orientPreserving;
+        }
+    }
+
+    auto toTangent = [](const TangentSpace& tangentSpace) {
+        return Vec4f(tangentSpace.os.x(), tangentSpace.os.y(), tangentSpace.os.z(), tangentSpace.orient ? 1.0f : -1.0f);
+    };
+    for (size_t t=0; t<nGoodTriangles; ++t) {
+        for (int i=0; i<3; ++i)
+            cornerTangents[goodTriangles[t]*3 + i] = toTangent(tangentSpaces[t*3 + i]);
+    }
+
+    // Corners of degenerate triangles get the tangent space of the first good corner of the same vertex
+    // (DegenEpilogue)
+    std::unordered_map<uint32_t, size_t> firstGoodCorners;
+    if (!degenerateTriangles.empty()) {
+        for (size_t c=0; c<corners.size(); ++c)
+            firstGoodCorners.try_emplace(corners[c], c);
+    }
+    for (auto t : degenerateTriangles) {
+        for (int i=0; i<3; ++i) {
+            auto goodCorner = firstGoodCorners.find(weldedVertices[getIndex(indices, t*3 + i)]);
+            cornerTangents[t*3 + i] = toTangent(goodCorner != firstGoodCorners.end() ?
+                tangentSpaces[goodCorner->second] : TangentSpace());
+        }
+    }
+}
+
+template <typename T_Index>
+bool gu2::splitVertices(
+    const Vec4f* cornerValues,
+    T_Index* indices,
+    size_t nIndices,
+    size_t nVertices,
+    size_t maxVertices,
+    std::vector<Vec4f>* vertexValues,
+    std::vector<uint32_t>* duplicateSources
+) {
+    duplicateSources->clear();
+    vertexValues->assign(nVertices, Vec4f(1.0f, 0.0f, 0.0f, 1.0f));
+    if (indices == nullptr) { // every corner is a vertex of its own already
+        std::copy(cornerValues, cornerValues + std::min(nIndices, nVertices), vertexValues->begin());
+        return true;
+    }
+
+    // Each vertex takes the value of its first corner, corners with other values are assigned to duplicates of the
+    // vertex. The duplicates of a vertex are chained starting from firstDuplicates.
+    constexpr uint32_t noVertex = 0xffffffff;
+    std::vector<uint8_t> assigned(nVertices, 0);
+    std::vector<uint32_t> firstDuplicates(nVertices, noVertex);
+    std::vector<uint32_t> nextDuplicates;
+    std::vector<uint32_t> cornerVertices(nIndices);
+    for (size_t c=0; c<nIndices; ++c) {
+        uint32_t v = static_cast<uint32_t>(indices[c]);
+        if (!assigned[v]) {
+            (*vertexValues)[v] = cornerValues[c];
+            assigned[v] = 1;
+        }
+        if ((*vertexValues)[v] == cornerValues[c]) {
+            cornerVertices[c] = v;
+            continue;
+        }
+
+        uint32_t* link = &firstDuplicates[v];
+        uint32_t duplicate = *link;
+        while (duplicate != noVertex && (*vertexValues)[duplicate] != cornerValues[c]) {
+            link = &nextDuplicates[duplicate - nVertices];
+            duplicate = *link;
+        }
+        if (duplicate == noVertex) {
+            duplicate = static_cast<uint32_t>(vertexValues->size());
+            *link = duplicate;
+            nextDuplicates.push_back(noVertex);
+            vertexValues->push_back(cornerValues[c]);
+            duplicateSources->push_back(v);
+        }
+        cornerVertices[c] = duplicate;
+    }
+
+    if (vertexValues->size() > maxVertices) {
+        vertexValues->resize(nVertices);
+        duplicateSources->clear();
+        return false;
+    }
+    for (size_t c=0; c<nIndices; ++c)
+        indices[c] = static_cast<T_Index>(cornerVertices[c]);
+    return true;
+}
+
+template void gu2::generateNormals<uint16_t>(const Vec3f*, size_t, const uint16_t*, size_t, Vec3f*);
+template void gu2::generateNormals<uint32_t>(const Vec3f*, size_t, const uint32_t*, size_t, Vec3f*);
+template void gu2::generateTangents<uint16_t>(const Vec3f*, const Vec3f*, const Vec2f*, size_t, const uint16_t*,
+    size_t, Vec4f*);
+template void gu2::generateTangents<uint32_t>(const Vec3f*, const Vec3f*, const Vec2f*, size_t, const uint32_t*,
+    size_t, Vec4f*);
+template bool gu2::splitVertices<uint16_t>(const Vec4f*, uint16_t*, size_t, size_t, size_t, std::vector<Vec4f>*,
+    std::vector<uint32_t>*);
+template bool gu2::splitVertices<uint32_t>(const Vec4f*, uint32_t*, size_t, size_t, size_t, std::vector<Vec4f>*,
+    std::vector<uint32_t>*);
@@ -11,6 +11,7 @@
 #include "CompositePass.hpp"
 #include "DescriptorManager.hpp"
 #include "Pipeline.hpp"
+#include "UploadContext.hpp"
 
 
 using namespace gu2;
@@ -80,16 +81,16 @@ void CompositePass::createSampler()
     }
 }
 
-void CompositePass::createQuad(
-    VkCommandPool commandPool,
-    VkQueue queue
-) {
+void CompositePass::createQuad(UploadContext* uploadContext)
+{
     if (_quadSetupComplete)
         return;
 
     _quad.addVertexAttribute(0, _quadPositions.data(), _quadPositions.size());
     _quad.setIndices(_quadIndices.data(), _quadIndices.size());
-    _quad.upload(commandPool, queue);
+    _quad.upload(uploadContext);
+    // Drawn on the first frame already
+    uploadContext->wait(_quad.getUploadBatch());
 
     _quadSetupComplete = true;
 }
@@ -118,17 +118,26 @@ void DescriptorManager::updateDescriptorSetLayoutHandles()
 
 void DescriptorManager::createDescriptorPool(uint32_t maxSets)
 {
-    std::array<VkDescriptorPoolSize, 2> poolSize{};
+    std::array<VkDescriptorPoolSize, 5> poolSize{};
     poolSize[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSize[0].descriptorCount = static_cast<uint32_t>(maxSets);
 
     poolSize[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     poolSize[1].descriptorCount = static_cast<uint32_t>(maxSets);
 
+    poolSize[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize[2].descriptorCount = static_cast<uint32_t>(maxSets);
+
+    poolSize[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSize[3].descriptorCount = static_cast<uint32_t>(maxSets);
+
+    poolSize[4].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSize[4].descriptorCount = static_cast<uint32_t>(maxSets);
+
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    poolInfo.poolSizeCount = 2;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSize.size());
     poolInfo.pPoolSizes = poolSize.data();
     poolInfo.maxSets = static_cast<uint32_t>(maxSets);
 
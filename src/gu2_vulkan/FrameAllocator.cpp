@@ -0,0 +1,67 @@
+//
+// Project: GraphicsUtils2
+// File: FrameAllocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "FrameAllocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+using namespace gu2;
+
+
+FrameAllocator::FrameAllocator(FrameAllocatorSettings settings) :
+    _settings       (std::move(settings)),
+    _alignment      (16),
+    _currentFrame   (0),
+    _head           (0)
+{
+    // Both limits are powers of two, so the larger one satisfies both
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_settings.physicalDevice, &properties);
+    _alignment = std::max({_alignment, properties.limits.minUniformBufferOffsetAlignment,
+        properties.limits.minStorageBufferOffsetAlignment});
+
+    // The buffers of the frames are created and released together, so they are packed linearly in a block
+    _buffers.resize(_settings.framesInFlight);
+    for (auto& buffer : _buffers) {
+        gu2::createBuffer(_settings.memoryAllocator, _settings.physicalDevice, _settings.device, _settings.frameSize,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &buffer.buffer, &buffer.allocation, MemoryStrategy::Linear);
+    }
+}
+
+FrameAllocator::~FrameAllocator()
+{
+    for (auto& buffer : _buffers)
+        gu2::destroyBuffer(_settings.memoryAllocator, _settings.device, &buffer.buffer, &buffer.allocation);
+}
+
+void FrameAllocator::beginFrame(uint64_t currentFrame)
+{
+    if (currentFrame >= _buffers.size())
+        throw std::runtime_error("FrameAllocator: frame index out of range");
+
+    _currentFrame = currentFrame;
+    _head = 0;
+}
+
+FrameAllocator::Allocation FrameAllocator::allocate(VkDeviceSize size)
+{
+    VkDeviceSize offset = (_head + _alignment - 1) / _alignment * _alignment;
+    if (offset + size > _settings.frameSize)
+        throw std::runtime_error("FrameAllocator: frame size exceeded");
+    _head = offset + size;
+
+    const auto& buffer = _buffers[_currentFrame];
+    return Allocation{buffer.buffer, offset, static_cast<uint8_t*>(buffer.allocation.mapped) + offset};
+}
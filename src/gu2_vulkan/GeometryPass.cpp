@@ -9,33 +9,547 @@
 //
 
 #include "GeometryPass.hpp"
+#include "DescriptorManager.hpp"
+#include "GpuCulling.hpp"
+#include "Material.hpp"
+#include "Pipeline.hpp"
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "gu2_util/Parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
 
 
 using namespace gu2;
 
 
-GeometryPass::GeometryPass(RenderPassSettings settings) noexcept:
-    RenderPass  (std::move(settings)),
-    _scene      (nullptr)
+namespace {
+
+// Minimum maxDrawIndirectCount guaranteed with the multiDrawIndirect feature
+constexpr uint32_t maxDrawIndirectCount {65535};
+
+// Items recorded per worker at minimum, so that the binds repeated at the beginning of each secondary command buffer
+// and the cost of waking up the threads are amortized
+constexpr size_t minItemsPerThread {64};
+
+// Write the top three rows of a model matrix, the destination is 16 byte aligned
+inline void packTransform(const Mat4f& transformation, InstanceTransform* instanceTransform)
+{
+#if defined(__AVX__) || defined(__SSE__)
+    // Transpose the columns of the column major source to rows, the last row is dropped
+    const float* src = transformation.data();
+    float* dst = instanceTransform->data();
+    __m128 r0 = _mm_loadu_ps(src);
+    __m128 r1 = _mm_loadu_ps(src + 4);
+    __m128 r2 = _mm_loadu_ps(src + 8);
+    __m128 r3 = _mm_loadu_ps(src + 12);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_store_ps(dst, r0);
+    _mm_store_ps(dst + 4, r1);
+    _mm_store_ps(dst + 8, r2);
+#else
+    *instanceTransform = transformation.topRows<3>();
+#endif
+}
+
+inline void accumulate(RenderStats* total, const RenderStats& stats)
+{
+    total->nDraws += stats.nDraws;
+    total->nPipelineBinds += stats.nPipelineBinds;
+    total->nMaterialBinds += stats.nMaterialBinds;
+    total->nVertexBufferBinds += stats.nVertexBufferBinds;
+}
+
+} // namespace
+
+
+GeometryPass::GeometryPass(
+    RenderPassSettings settings,
+    DescriptorManager* descriptorManager,
+    FrameAllocator* frameAllocator,
+    uint32_t maxInstances,
+    int framesInFlight
+) noexcept :
+    RenderPass           (std::move(settings)),
+    _descriptorManager   (descriptorManager),
+    _frameAllocator      (frameAllocator),
+    _maxInstances        (std::max(maxInstances, 1u)),
+    _framesInFlight      (framesInFlight),
+    _viewAllocation      {VK_NULL_HANDLE, 0, nullptr},
+    _instanceAllocation  {VK_NULL_HANDLE, 0, nullptr},
+    _instanceData        (nullptr),
+    _scene               (nullptr),
+    _gpuCulling          (nullptr),
+    _multiDrawIndirect   (false),
+    _transformScene      (nullptr),
+    _transformRevision   (0),
+    _keyedScene          (nullptr),
+    _keyedRevision       (0),
+    _recordingThreads    (0)
 {
     _addLayoutTransitionDependency = false;
 }
 
+GeometryPass::~GeometryPass()
+{
+    destroyWorkerCommands();
+}
+
 void GeometryPass::setScene(const Scene& scene) noexcept
 {
     _scene = &scene;
 }
 
+void GeometryPass::beginFrame(uint64_t currentFrame)
+{
+    if (_scene == nullptr)
+        throw std::runtime_error("No scene to render set");
+    if (_scene->nodes.size() > _maxInstances)
+        throw std::runtime_error("Scene node count exceeds the instance buffer capacity");
+    if (currentFrame >= static_cast<uint64_t>(_framesInFlight))
+        throw std::runtime_error("Frame slot exceeds the frames in flight");
+
+    // Command buffers of the previous use of the frame slot have finished executing
+    for (uint32_t t=0; t<_recordingThreads; ++t)
+        vkResetCommandPool(_settings.device, _workerCommandPools[currentFrame*_recordingThreads + t], 0);
+
+    auto* viewUniforms = _frameAllocator->allocate<ViewUniforms>(1, &_viewAllocation);
+    viewUniforms->view = _scene->camera.view;
+    viewUniforms->projection = _scene->camera.projection;
+    viewUniforms->viewProjection = _scene->camera.projection * _scene->camera.view;
+
+    // The descriptor range covers maxInstances transforms, so the whole range is reserved
+    _instanceData = _frameAllocator->allocate<InstanceTransform>(_maxInstances, &_instanceAllocation);
+}
+
+void GeometryPass::setGpuCulling(GpuCulling* gpuCulling) noexcept
+{
+    _gpuCulling = gpuCulling;
+    // The CPU path writes the instance data in the draw order
+    for (auto& slot : _slotTransforms)
+        slot.valid = false;
+}
+
+void GeometryPass::setMultiDrawIndirect(bool multiDrawIndirect) noexcept
+{
+    _multiDrawIndirect = multiDrawIndirect;
+}
+
+void GeometryPass::setParallelRecording(uint32_t queueFamilyIndex, uint32_t nThreads)
+{
+    destroyWorkerCommands();
+    _recordingThreads = nThreads;
+    _subpassContents = nThreads > 0 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+    _workerStates.resize(nThreads);
+
+    // The pools are reset as a whole once their frame slot is reused
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+    size_t nWorkerCommands = static_cast<size_t>(_framesInFlight) * nThreads;
+    _workerCommandPools.resize(nWorkerCommands, VK_NULL_HANDLE);
+    _workerCommandBuffers.resize(nWorkerCommands, VK_NULL_HANDLE);
+    for (size_t i=0; i<nWorkerCommands; ++i) {
+        if (vkCreateCommandPool(_settings.device, &poolInfo, nullptr, &_workerCommandPools[i]) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create worker command pool!");
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = _workerCommandPools[i];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(_settings.device, &allocInfo, &_workerCommandBuffers[i]) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate worker command buffer!");
+    }
+}
+
+void GeometryPass::cullOnGpu(VkCommandBuffer commandBuffer, uint64_t currentFrame)
+{
+    if (_scene == nullptr)
+        throw std::runtime_error("No scene to render set");
+    if (_gpuCulling == nullptr)
+        throw std::runtime_error("No GPU culling set");
+
+    if (_instanceData == nullptr)
+        throw std::runtime_error("GeometryPass::beginFrame not called");
+
+    // Counts are read back from the previous use of the frame slot, which has finished executing
+    _cullingStats = CullingStats();
+    _cullingStats.nTested = _scene->nodes.size();
+    _cullingStats.nVisible = _gpuCulling->getVisibleCount(currentFrame);
+
+    // Transform changes of the scene since the last frame are gathered for all the frame slots, a new scene or
+    // several updates in between require rewriting all the transforms
+    if (_slotTransforms.empty())
+        _slotTransforms.resize(_framesInFlight);
+    if (_transformScene != _scene || _transformRevision != _scene->transformRevision) {
+        bool nextRevision = _transformScene == _scene && _scene->transformRevision == _transformRevision + 1;
+        for (auto& slot : _slotTransforms) {
+            if (nextRevision && slot.changedNodes.size() + _scene->changedNodes.size() <= _scene->nodes.size()) {
+                slot.changedNodes.insert(slot.changedNodes.end(), _scene->changedNodes.begin(),
+                    _scene->changedNodes.end());
+            }
+            else
+                slot.valid = false;
+        }
+        _transformScene = _scene;
+        _transformRevision = _scene->transformRevision;
+    }
+
+    // Model matrices are indexed with the node ids, the draw commands select the visible ones
+    auto& slot = _slotTransforms[currentFrame];
+    if (slot.valid && slot.revision == _scene->revision && slot.buffer == _instanceAllocation.buffer &&
+        slot.offset == _instanceAllocation.offset) {
+        for (auto nodeId : slot.changedNodes)
+            packTransform(_scene->nodes[nodeId].transformation, &_instanceData[nodeId]);
+    }
+    else {
+        for (size_t i=0; i<_scene->nodes.size(); ++i)
+            packTransform(_scene->nodes[i].transformation, &_instanceData[i]);
+        slot.valid = true;
+        slot.revision = _scene->revision;
+        slot.buffer = _instanceAllocation.buffer;
+        slot.offset = _instanceAllocation.offset;
+    }
+    slot.changedNodes.clear();
+
+    _gpuCulling->updateNodes(*_scene, currentFrame);
+    _gpuCulling->cull(commandBuffer, currentFrame, _scene->camera, _scene->maxLodError);
+}
+
 void GeometryPass::render()
 {
     if (_scene == nullptr)
         throw std::runtime_error("No scene to render set");
+    if (_instanceData == nullptr)
+        throw std::runtime_error("GeometryPass::beginFrame not called");
+
+    _renderStats = RenderStats();
+    updateSortKeys();
+    _renderQueue.clear();
+
+    // Created before recording, as the workers only read them. All the materials drawn share the layout.
+    if (_descriptorSets.empty() && !_scene->instanceGroups.empty())
+        createDescriptorSets(_scene->instanceGroups[0].mesh->getMaterial());
+
+    // One indirect draw per instance group, recorded by cullOnGpu, in the order of the sort keys
+    if (_gpuCulling != nullptr) {
+        for (uint32_t g=0; g<_scene->instanceGroups.size(); ++g) {
+            if (_scene->instanceGroups[g].nNodes > 0)
+                _renderQueue.push(_groupSortKeys[g], g);
+        }
+        _renderQueue.sort();
+        const auto& entries = _renderQueue.getEntries();
+        record(entries.size(), [&](RecordState* state, size_t i) {
+            bindState(state, *_scene->instanceGroups[entries[i].item].mesh);
+            _gpuCulling->draw(state->commandBuffer, _currentFrame, entries[i].item);
+            ++state->stats.nDraws;
+        });
+        _instanceData = nullptr;
+        return;
+    }
+
+    // Only the nodes intersecting the view frustum and not hidden behind the occluders are drawn
+    _cullingStats = CullingStats();
+    _scene->cull(&_visibleNodes, &_cullingStats);
+    _scene->cullOccluded(_occlusionBuffer, &_visibleNodes, &_cullingStats);
+
+    // Group the visible nodes by instance group, the relative order of the nodes is retained
+    uint32_t nGroups = static_cast<uint32_t>(_scene->instanceGroups.size());
+    _groupOffsets.assign(nGroups + 1, 0);
+    for (auto nodeId : _visibleNodes)
+        ++_groupOffsets[_scene->nodes[nodeId].instanceGroup + 1];
+    for (uint32_t g=0; g<nGroups; ++g)
+        _groupOffsets[g+1] += _groupOffsets[g];
+    _groupNodes.resize(_visibleNodes.size());
+    for (auto nodeId : _visibleNodes)
+        _groupNodes[_groupOffsets[_scene->nodes[nodeId].instanceGroup]++] = nodeId;
+    for (uint32_t g=nGroups; g>0; --g)
+        _groupOffsets[g] = _groupOffsets[g-1];
+    _groupOffsets[0] = 0;
+
+    // One instanced draw per mesh and LOD, the model matrices of the instances are laid out contiguously. The
+    // draws are sorted by state, with multi-draw indirect the consecutive ones sharing the material and the
+    // geometry buffers are issued with a single call.
+    _draws.clear();
+    Vec3f cameraPosition = _scene->camera.getPosition();
+    uint32_t nInstances = 0;
+    for (uint32_t g=0; g<nGroups; ++g) {
+        const auto& group = _scene->instanceGroups[g];
+        const uint32_t* groupNodes = &_groupNodes[_groupOffsets[g]];
+        uint32_t nGroupNodes = _groupOffsets[g+1] - _groupOffsets[g];
+        if (nGroupNodes == 0)
+            continue;
+        const auto& firstNode = _scene->nodes[groupNodes[0]];
+
+        // Bucket the nodes by the relative LOD index, nodes of a group share the LOD chain
+        _lodOffsets.assign(firstNode.nLods + 1, 0);
+        _lodNodes.resize(nGroupNodes);
+        for (uint32_t i=0; i<nGroupNodes; ++i) {
+            const auto& node = _scene->nodes[groupNodes[i]];
+            _lodNodes[i] = _scene->selectLod(node, cameraPosition) - node.firstLod;
+            ++_lodOffsets[_lodNodes[i] + 1];
+        }
+        for (uint32_t lod=0; lod<firstNode.nLods; ++lod)
+            _lodOffsets[lod+1] += _lodOffsets[lod];
+        for (uint32_t i=0; i<nGroupNodes; ++i) {
+            packTransform(_scene->nodes[groupNodes[i]].transformation,
+                &_instanceData[nInstances + _lodOffsets[_lodNodes[i]]++]);
+        }
 
-    for (size_t nodeId=0; nodeId<_scene->nodes.size(); ++nodeId) {
-        const auto& node = _scene->nodes[nodeId];
-        node.mesh->bind(_commandBuffer);
-        node.mesh->draw(_commandBuffer, _currentFrame, nodeId);
+        uint32_t firstInstance = nInstances;
+        for (uint32_t lod=0; lod<firstNode.nLods; ++lod) {
+            // _lodOffsets[lod] now holds the end of the bucket
+            uint32_t lodInstances = _lodOffsets[lod] - (firstInstance - nInstances);
+            if (lodInstances > 0) {
+                const auto& lodRange = _scene->lods[firstNode.firstLod + lod];
+                _renderQueue.push(_groupSortKeys[g], static_cast<uint32_t>(_draws.size()));
+                _draws.push_back(Draw{group.mesh, lodRange.firstIndex, lodRange.nIndices, firstInstance,
+                    lodInstances});
+            }
+            firstInstance += lodInstances;
+        }
+        nInstances += nGroupNodes;
     }
+
+    _renderQueue.sort();
+    const auto& entries = _renderQueue.getEntries();
+    if (_multiDrawIndirect) {
+        for (const auto& entry : entries)
+            gatherDraw(_draws[entry.item]);
+        flushDraws();
+    }
+    else {
+        record(entries.size(), [&](RecordState* state, size_t i) {
+            const auto& draw = _draws[entries[i].item];
+            const auto& mesh = *draw.mesh;
+            bindState(state, mesh);
+            vkCmdDrawIndexed(state->commandBuffer, draw.nIndices, draw.nInstances,
+                mesh.getFirstIndex() + draw.firstIndex, mesh.getVertexOffset(), draw.firstInstance);
+            ++state->stats.nDraws;
+        });
+    }
+    _instanceData = nullptr;
+}
+
+template <typename T_RecordItem>
+void GeometryPass::record(size_t nItems, const T_RecordItem& recordItem)
+{
+    if (_recordingThreads == 0) {
+        RecordState state;
+        state.commandBuffer = _commandBuffer;
+        for (size_t i=0; i<nItems; ++i)
+            recordItem(&state, i);
+        accumulate(&_renderStats, state.stats);
+        return;
+    }
+    if (nItems == 0)
+        return;
+
+    int nRanges = static_cast<int>(std::clamp<size_t>((nItems + minItemsPerThread - 1) / minItemsPerThread, 1,
+        _recordingThreads));
+    VkCommandBuffer* commandBuffers = &_workerCommandBuffers[_currentFrame*_recordingThreads];
+
+    ExceptionGuard exceptionGuard;
+    #pragma omp parallel for num_threads(nRanges)
+    for (int r=0; r<nRanges; ++r) {
+        exceptionGuard.run([&]() {
+            auto& state = _workerStates[r];
+            state = RecordState();
+            state.commandBuffer = commandBuffers[r];
+            beginSecondaryCommandBuffer(state.commandBuffer);
+
+            size_t end = nItems*(r+1) / nRanges;
+            for (size_t i=nItems*r / nRanges; i<end; ++i)
+                recordItem(&state, i);
+
+            if (vkEndCommandBuffer(state.commandBuffer) != VK_SUCCESS)
+                throw std::runtime_error("Failed to record worker command buffer!");
+        });
+    }
+    exceptionGuard.rethrow();
+
+    // Ranges are executed in order, so the draw order is the same as with a single thread
+    vkCmdExecuteCommands(_commandBuffer, nRanges, commandBuffers);
+    for (int r=0; r<nRanges; ++r)
+        accumulate(&_renderStats, _workerStates[r].stats);
+}
+
+void GeometryPass::createDescriptorSets(const Material& material)
+{
+    const auto& layouts = material.getDescriptorSetLayouts();
+    if (layouts.size() <= renderPassDescriptorSetId)
+        throw std::runtime_error("Geometry pass materials are expected to use the render pass descriptor set");
+
+    _descriptorSets.clear();
+    _descriptorManager->allocateDescriptorSets(&_descriptorSets, layouts[renderPassDescriptorSetId],
+        _framesInFlight);
+
+    // Both bindings use dynamic offsets, the buffers are the same for all the allocations of a frame
+    for (int i=0; i<_framesInFlight; ++i) {
+        std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+        bufferInfos[0].buffer = _frameAllocator->getBuffer(i);
+        bufferInfos[0].offset = 0;
+        bufferInfos[0].range = sizeof(ViewUniforms);
+        bufferInfos[1].buffer = _frameAllocator->getBuffer(i);
+        bufferInfos[1].offset = 0;
+        bufferInfos[1].range = sizeof(InstanceTransform) * _maxInstances;
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+        for (uint32_t binding=0; binding<2; ++binding) {
+            auto& descriptorWrite = descriptorWrites[binding];
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = _descriptorSets[i];
+            descriptorWrite.dstBinding = binding;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.pBufferInfo = &bufferInfos[binding];
+        }
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+        vkUpdateDescriptorSets(_settings.device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+void GeometryPass::destroyWorkerCommands()
+{
+    // Destroying the pools frees the command buffers
+    for (auto commandPool : _workerCommandPools) {
+        if (commandPool != VK_NULL_HANDLE)
+            vkDestroyCommandPool(_settings.device, commandPool, nullptr);
+    }
+    _workerCommandPools.clear();
+    _workerCommandBuffers.clear();
+}
+
+void GeometryPass::bindDescriptorSets(RecordState* state, const Material& material) const
+{
+    if (state->descriptorSetsBound)
+        return;
+
+    // Pipeline layouts of the geometry pass are compatible up to the render pass set, so the binding stays valid
+    // as the materials bind their pipelines
+    std::array<uint32_t, 2> offsets {
+        static_cast<uint32_t>(_viewAllocation.offset),
+        static_cast<uint32_t>(_instanceAllocation.offset)
+    };
+    vkCmdBindDescriptorSets(state->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        material.getPipeline()->getPipelineLayout(), renderPassDescriptorSetId, 1, &_descriptorSets[_currentFrame],
+        offsets.size(), offsets.data());
+    state->descriptorSetsBound = true;
+}
+
+void GeometryPass::gatherDraw(const Draw& draw)
+{
+    const auto& mesh = *draw.mesh;
+
+    // Index and vertex offsets of the commands are absolute, so meshes of the same geometry pool can be merged
+    bool merge = false;
+    if (!_drawRuns.empty()) {
+        const auto& run = _drawRuns.back();
+        merge = &run.mesh->getMaterial() == &mesh.getMaterial() && run.nCommands < maxDrawIndirectCount &&
+            (run.mesh == &mesh || (mesh.getGeometryPool() != nullptr &&
+            run.mesh->getGeometryPool() == mesh.getGeometryPool()));
+    }
+    if (!merge)
+        _drawRuns.push_back(DrawRun{&mesh, static_cast<uint32_t>(_drawCommands.size()), 0});
+
+    _drawCommands.push_back(VkDrawIndexedIndirectCommand{
+        .indexCount = draw.nIndices,
+        .instanceCount = draw.nInstances,
+        .firstIndex = mesh.getFirstIndex() + draw.firstIndex,
+        .vertexOffset = mesh.getVertexOffset(),
+        .firstInstance = draw.firstInstance
+    });
+    ++_drawRuns.back().nCommands;
+}
+
+void GeometryPass::flushDraws()
+{
+    if (_drawCommands.empty())
+        return;
+
+    FrameAllocator::Allocation allocation;
+    auto* drawCommands = _frameAllocator->allocate<VkDrawIndexedIndirectCommand>(_drawCommands.size(), &allocation);
+    memcpy(drawCommands, _drawCommands.data(), _drawCommands.size()*sizeof(VkDrawIndexedIndirectCommand));
+
+    record(_drawRuns.size(), [&](RecordState* state, size_t i) {
+        const auto& run = _drawRuns[i];
+        bindState(state, *run.mesh);
+        vkCmdDrawIndexedIndirect(state->commandBuffer, allocation.buffer,
+            allocation.offset + run.firstCommand*sizeof(VkDrawIndexedIndirectCommand), run.nCommands,
+            sizeof(VkDrawIndexedIndirectCommand));
+        ++state->stats.nDraws;
+    });
+
+    _drawCommands.clear();
+    _drawRuns.clear();
+}
+
+void GeometryPass::updateSortKeys()
+{
+    if (_keyedScene == _scene && _keyedRevision == _scene->revision &&
+        _groupSortKeys.size() == _scene->instanceGroups.size())
+        return;
+
+    // Dense ids in the order of appearance, sorting only needs the draws sharing state to be adjacent
+    std::unordered_map<const Pipeline*, uint32_t> pipelineIds;
+    std::unordered_map<const Material*, uint32_t> materialIds;
+    std::unordered_map<const void*, uint32_t> geometryIds; // geometry pool, or the mesh with buffers of its own
+    auto getId = [](auto& ids, const auto* object) {
+        return ids.try_emplace(object, static_cast<uint32_t>(ids.size())).first->second;
+    };
+
+    _groupSortKeys.resize(_scene->instanceGroups.size());
+    for (uint32_t g=0; g<_scene->instanceGroups.size(); ++g) {
+        const auto& mesh = *_scene->instanceGroups[g].mesh;
+        const auto& material = mesh.getMaterial();
+        const void* geometry = mesh.getGeometryPool() != nullptr ?
+            static_cast<const void*>(mesh.getGeometryPool()) : static_cast<const void*>(&mesh);
+        _groupSortKeys[g] = RenderQueue::makeKey(getId(pipelineIds, material.getPipeline()),
+            getId(materialIds, &material), getId(geometryIds, geometry), g);
+    }
+    _keyedScene = _scene;
+    _keyedRevision = _scene->revision;
+}
+
+void GeometryPass::bindState(RecordState* state, const Mesh& mesh) const
+{
+    const auto& material = mesh.getMaterial();
+    bindDescriptorSets(state, material);
+
+    if (&material != state->boundMaterial) {
+        if (material.getPipeline() != state->boundPipeline) {
+            material.getPipeline()->bind(state->commandBuffer);
+            state->boundPipeline = material.getPipeline();
+            ++state->stats.nPipelineBinds;
+        }
+        material.bindDescriptorSets(state->commandBuffer, _currentFrame);
+        state->boundMaterial = &material;
+        ++state->stats.nMaterialBinds;
+    }
+
+    bindMesh(state, mesh);
+}
+
+void GeometryPass::bindMesh(RecordState* state, const Mesh& mesh) const
+{
+    if (&mesh == state->boundMesh ||
+        (mesh.getGeometryPool() != nullptr && mesh.getGeometryPool() == state->boundGeometryPool))
+        return;
+
+    mesh.bind(state->commandBuffer);
+    state->boundMesh = &mesh;
+    state->boundGeometryPool = mesh.getGeometryPool();
+    ++state->stats.nVertexBufferBinds;
 }
@@ -0,0 +1,466 @@
+//
+// Project: GraphicsUtils2
+// File: GeometryPool.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "GeometryPool.hpp"
+#include "UploadContext.hpp"
+#include "Util.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr VkBufferUsageFlags    vertexBufferUsage   {VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+constexpr VkBufferUsageFlags    indexBufferUsage    {VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+
+// Copy regions in elements, converted to bytes per buffer
+struct Copy {
+    uint64_t    srcOffset;
+    uint64_t    dstOffset;
+    uint64_t    size;
+};
+
+void recordCopies(
+    VkCommandBuffer commandBuffer,
+    VkBuffer srcBuffer,
+    VkBuffer dstBuffer,
+    const std::vector<Copy>& copies,
+    VkDeviceSize elementSize
+) {
+    std::vector<VkBufferCopy> regions;
+    regions.reserve(copies.size());
+    for (const auto& copy : copies) {
+        if (copy.size > 0)
+            regions.push_back({copy.srcOffset*elementSize, copy.dstOffset*elementSize, copy.size*elementSize});
+    }
+    if (!regions.empty())
+        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+}
+
+} // namespace
+
+
+GeometryPool::GeometryPool(GeometryPoolSettings settings) :
+    _settings           (std::move(settings)),
+    _vertexAllocator    (std::max(_settings.vertexCapacity, 1u)),
+    _indexAllocator     (std::max(_settings.indexCapacity, 1u)),
+    _frame              (0),
+    _resizing           (false),
+    _activeUploads      (0)
+{
+    _indexBuffer = createBuffer(_indexAllocator.getCapacity() * sizeof(uint32_t), indexBufferUsage);
+}
+
+GeometryPool::~GeometryPool()
+{
+    for (auto& stream : _streams)
+        destroyBuffer(&stream.buffer);
+    destroyBuffer(&_indexBuffer);
+}
+
+uint32_t GeometryPool::addRange(
+    UploadContext* uploadContext,
+    const std::vector<AttributeData>& attributes,
+    uint32_t nVertices,
+    const void* indexData,
+    VkIndexType indexType,
+    uint32_t nIndices,
+    uint64_t* uploadBatch
+) {
+    if (indexType != VK_INDEX_TYPE_UINT16 && indexType != VK_INDEX_TYPE_UINT32)
+        throw std::runtime_error("GeometryPool: unsupported index type");
+
+    // Staging memory holds the attribute streams followed by the widened indices
+    VkDeviceSize stagingSize = nIndices * sizeof(uint32_t);
+    std::vector<VkDeviceSize> stagingOffsets;
+    for (const auto& attribute : attributes) {
+        stagingOffsets.push_back(stagingSize);
+        stagingSize += static_cast<VkDeviceSize>(attribute.elementSize) * nVertices;
+    }
+    stagingSize = std::max(stagingSize, VkDeviceSize(1));
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    Range range;
+    for (;;) {
+        _condition.wait(lock, [this]() { return !_resizing; });
+        createStreams(attributes);
+
+        uint64_t vertexOffset = _vertexAllocator.allocate(nVertices);
+        uint64_t firstIndex = _indexAllocator.allocate(nIndices);
+        if (vertexOffset != RangeAllocator::invalidOffset && firstIndex != RangeAllocator::invalidOffset) {
+            range = Range{static_cast<int32_t>(vertexOffset), nVertices, static_cast<uint32_t>(firstIndex), nIndices};
+            break;
+        }
+
+        // Double the capacity of the exhausted allocator (or more for large ranges), the old contents are kept at
+        // their offsets. The allocation is retried once the buffers have been grown.
+        uint64_t vertexCapacity = _vertexAllocator.getCapacity();
+        uint64_t indexCapacity = _indexAllocator.getCapacity();
+        if (vertexOffset == RangeAllocator::invalidOffset)
+            vertexCapacity = std::max(2*vertexCapacity, _vertexAllocator.getUsedEnd() + nVertices);
+        else
+            _vertexAllocator.free(vertexOffset);
+        if (firstIndex == RangeAllocator::invalidOffset)
+            indexCapacity = std::max(2*indexCapacity, _indexAllocator.getUsedEnd() + nIndices);
+        else
+            _indexAllocator.free(firstIndex);
+        if (vertexCapacity > 0x7fffffff || indexCapacity > 0xffffffff)
+            throw std::runtime_error("GeometryPool: capacity exceeds the range of the draw parameters");
+
+        beginResize(lock);
+        try {
+            grow(vertexCapacity, indexCapacity, uploadContext);
+        }
+        catch (...) {
+            endResize(lock);
+            throw;
+        }
+        endResize(lock);
+    }
+
+    // The upload is recorded without holding the lock, the resizes wait for it to finish. The streams are copied as
+    // other threads may add new ones.
+    std::vector<Stream> streams;
+    streams.reserve(attributes.size());
+    for (const auto& attribute : attributes)
+        streams.push_back(_streams[attribute.location]);
+    VkBuffer indexBuffer = _indexBuffer.buffer;
+    ++_activeUploads;
+    lock.unlock();
+
+    uint64_t batchId = 0;
+    try {
+        batchId = uploadContext->record(stagingSize, [&](VkCommandBuffer commandBuffer,
+            const UploadContext::Staging& staging) {
+            auto* stagingData = static_cast<uint8_t*>(staging.data);
+            auto* stagingIndices = reinterpret_cast<uint32_t*>(stagingData);
+            if (indexType == VK_INDEX_TYPE_UINT16) {
+                const auto* indices16 = static_cast<const uint16_t*>(indexData);
+                std::copy(indices16, indices16 + nIndices, stagingIndices);
+            }
+            else
+                memcpy(stagingIndices, indexData, nIndices * sizeof(uint32_t));
+            for (size_t i=0; i<attributes.size(); ++i) {
+                memcpy(stagingData + stagingOffsets[i], attributes[i].data,
+                    static_cast<size_t>(attributes[i].elementSize) * nVertices);
+            }
+
+            for (size_t i=0; i<streams.size(); ++i) {
+                VkBufferCopy region{staging.offset + stagingOffsets[i],
+                    range.vertexOffset * VkDeviceSize(streams[i].elementSize),
+                    VkDeviceSize(nVertices) * streams[i].elementSize};
+                if (region.size > 0) {
+                    vkCmdCopyBuffer(commandBuffer, staging.buffer, streams[i].buffer.buffer, 1, &region);
+                    uploadContext->releaseBuffer(commandBuffer, streams[i].buffer.buffer, region.dstOffset,
+                        region.size);
+                }
+            }
+            VkBufferCopy indexRegion{staging.offset, range.firstIndex * sizeof(uint32_t),
+                nIndices * sizeof(uint32_t)};
+            if (indexRegion.size > 0) {
+                vkCmdCopyBuffer(commandBuffer, staging.buffer, indexBuffer, 1, &indexRegion);
+                uploadContext->releaseBuffer(commandBuffer, indexBuffer, indexRegion.dstOffset, indexRegion.size);
+            }
+        }, sizeof(uint32_t));
+    }
+    catch (...) {
+        lock.lock();
+        _vertexAllocator.free(range.vertexOffset);
+        _indexAllocator.free(range.firstIndex);
+        --_activeUploads;
+        _condition.notify_all();
+        throw;
+    }
+    if (uploadBatch != nullptr)
+        *uploadBatch = batchId;
+
+    lock.lock();
+    --_activeUploads;
+    _condition.notify_all();
+    uint32_t rangeId;
+    if (_freeRangeIds.empty()) {
+        rangeId = static_cast<uint32_t>(_ranges.size());
+        _ranges.push_back(range);
+        _uploadBatches.push_back(batchId);
+    }
+    else {
+        rangeId = _freeRangeIds.back();
+        _freeRangeIds.pop_back();
+        _ranges[rangeId] = range;
+        _uploadBatches[rangeId] = batchId;
+    }
+
+    return rangeId;
+}
+
+void GeometryPool::removeRange(uint32_t rangeId)
+{
+    if (rangeId == invalidRange)
+        return;
+
+    // The frames in flight may still draw the range and its upload may still be pending
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pendingFrees.push_back({rangeId, _frame});
+}
+
+void GeometryPool::beginFrame(UploadContext* uploadContext)
+{
+    // The frame of the removal has finished once framesInFlight frames have been submitted after it. The upload
+    // batches are queried without holding the lock.
+    std::vector<uint64_t> batchIds;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_frame;
+        for (const auto& pendingFree : _pendingFrees) {
+            if (pendingFree.frame + _settings.framesInFlight >= _frame)
+                break;
+            batchIds.push_back(_uploadBatches[pendingFree.rangeId]);
+        }
+    }
+    size_t nFrees = 0;
+    while (nFrees < batchIds.size() && uploadContext->isComplete(batchIds[nFrees]))
+        ++nFrees;
+
+    // The allocators belong to the thread resizing the buffers, the ranges are freed on a later frame
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_resizing)
+        return;
+    for (size_t i=0; i<nFrees; ++i) {
+        freeRange(_pendingFrees.front().rangeId);
+        _pendingFrees.pop_front();
+    }
+}
+
+void GeometryPool::defragment(UploadContext* uploadContext)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    beginResize(lock);
+    try {
+        defragmentBuffers(uploadContext);
+    }
+    catch (...) {
+        endResize(lock);
+        throw;
+    }
+    endResize(lock);
+}
+
+void GeometryPool::defragmentBuffers(UploadContext* uploadContext)
+{
+    // The pending uploads need to land in the old buffers first, after which none of the removed ranges is in use
+    uploadContext->flush();
+    vkDeviceWaitIdle(_settings.device);
+    std::deque<PendingFree> pendingFrees;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::swap(pendingFrees, _pendingFrees);
+    }
+    for (const auto& pendingFree : pendingFrees)
+        freeRange(pendingFree.rangeId);
+
+    // Map the old offsets of the live ranges to the new ones
+    auto vertexMoves = _vertexAllocator.defragment();
+    auto indexMoves = _indexAllocator.defragment();
+    if (vertexMoves.empty() && indexMoves.empty())
+        return;
+
+    std::unordered_map<uint64_t, uint64_t> newVertexOffsets;
+    for (const auto& move : vertexMoves)
+        newVertexOffsets.emplace(move.srcOffset, move.dstOffset);
+    std::unordered_map<uint64_t, uint64_t> newFirstIndices;
+    for (const auto& move : indexMoves)
+        newFirstIndices.emplace(move.srcOffset, move.dstOffset);
+
+    std::vector<bool> rangeFree(_ranges.size(), false);
+    for (auto rangeId : _freeRangeIds)
+        rangeFree[rangeId] = true;
+
+    std::vector<Copy> vertexCopies;
+    std::vector<Copy> indexCopies;
+    for (size_t i=0; i<_ranges.size(); ++i) {
+        if (rangeFree[i])
+            continue;
+
+        auto& range = _ranges[i];
+        auto vertexIt = newVertexOffsets.find(range.vertexOffset);
+        uint64_t vertexOffset = vertexIt == newVertexOffsets.end() ? range.vertexOffset : vertexIt->second;
+        vertexCopies.push_back({static_cast<uint64_t>(range.vertexOffset), vertexOffset, range.nVertices});
+        range.vertexOffset = static_cast<int32_t>(vertexOffset);
+
+        auto indexIt = newFirstIndices.find(range.firstIndex);
+        uint64_t firstIndex = indexIt == newFirstIndices.end() ? range.firstIndex : indexIt->second;
+        indexCopies.push_back({range.firstIndex, firstIndex, range.nIndices});
+        range.firstIndex = static_cast<uint32_t>(firstIndex);
+    }
+
+    // Indices are relative to vertexOffset and need no rewriting. The copies go to new buffers as the source and
+    // the destination ranges may overlap.
+    std::vector<Buffer> retiredBuffers;
+    uploadContext->record([&](VkCommandBuffer commandBuffer) {
+        // The old buffers are owned by the graphics queue family
+        uploadContext->recordOnGraphicsQueue(commandBuffer, [&](VkCommandBuffer graphicsCommandBuffer) {
+            for (auto& stream : _streams) {
+                Buffer buffer = createBuffer(_vertexAllocator.getCapacity() * stream.elementSize, vertexBufferUsage);
+                recordCopies(graphicsCommandBuffer, stream.buffer.buffer, buffer.buffer, vertexCopies,
+                    stream.elementSize);
+                std::swap(stream.buffer, buffer);
+                retiredBuffers.push_back(buffer);
+            }
+            Buffer indexBuffer = createBuffer(_indexAllocator.getCapacity() * sizeof(uint32_t), indexBufferUsage);
+            recordCopies(graphicsCommandBuffer, _indexBuffer.buffer, indexBuffer.buffer, indexCopies,
+                sizeof(uint32_t));
+            std::swap(_indexBuffer, indexBuffer);
+            retiredBuffers.push_back(indexBuffer);
+        });
+    });
+    uploadContext->flush();
+
+    for (auto& buffer : retiredBuffers)
+        destroyBuffer(&buffer);
+    retiredBuffers.clear();
+}
+
+void GeometryPool::bind(VkCommandBuffer commandBuffer) const
+{
+    if (!_bindBuffers.empty()) {
+        vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(_bindBuffers.size()), _bindBuffers.data(),
+            _bindOffsets.data());
+    }
+    vkCmdBindIndexBuffer(commandBuffer, _indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+GeometryPool::Buffer GeometryPool::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage) const
+{
+    Buffer buffer;
+    gu2::createBuffer(_settings.memoryAllocator, _settings.physicalDevice, _settings.device, size, usage,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer.buffer, &buffer.allocation);
+    return buffer;
+}
+
+void GeometryPool::destroyBuffer(Buffer* buffer) const
+{
+    gu2::destroyBuffer(_settings.memoryAllocator, _settings.device, &buffer->buffer, &buffer->allocation);
+}
+
+void GeometryPool::createStreams(const std::vector<AttributeData>& attributes)
+{
+    // The attributes are validated before the streams are modified
+    size_t nStreams = _streams.size();
+    for (const auto& attribute : attributes)
+        nStreams = std::max(nStreams, static_cast<size_t>(attribute.location) + 1);
+    std::vector<uint32_t> elementSizes(nStreams, 0);
+    for (size_t i=0; i<_streams.size(); ++i)
+        elementSizes[i] = _streams[i].elementSize;
+    for (const auto& attribute : attributes) {
+        auto& elementSize = elementSizes[attribute.location];
+        if (elementSize != 0 && elementSize != attribute.elementSize)
+            throw std::runtime_error("GeometryPool: attribute element size does not match the stream");
+        elementSize = attribute.elementSize;
+    }
+    if (std::find(elementSizes.begin(), elementSizes.end(), 0u) != elementSizes.end())
+        throw std::runtime_error("GeometryPool: attribute locations need to be contiguous");
+    if (nStreams == _streams.size())
+        return;
+
+    std::vector<Stream> newStreams;
+    try {
+        for (size_t i=_streams.size(); i<nStreams; ++i) {
+            newStreams.push_back({createBuffer(_vertexAllocator.getCapacity() * elementSizes[i], vertexBufferUsage),
+                elementSizes[i]});
+        }
+    }
+    catch (...) {
+        for (auto& stream : newStreams)
+            destroyBuffer(&stream.buffer);
+        throw;
+    }
+    _streams.insert(_streams.end(), newStreams.begin(), newStreams.end());
+    updateBindBuffers();
+}
+
+void GeometryPool::beginResize(std::unique_lock<std::mutex>& lock)
+{
+    _condition.wait(lock, [this]() { return !_resizing; });
+    _resizing = true;
+    _condition.wait(lock, [this]() { return _activeUploads == 0; });
+    lock.unlock();
+}
+
+void GeometryPool::endResize(std::unique_lock<std::mutex>& lock)
+{
+    lock.lock();
+    updateBindBuffers();
+    _resizing = false;
+    _condition.notify_all();
+}
+
+void GeometryPool::grow(uint64_t vertexCapacity, uint64_t indexCapacity, UploadContext* uploadContext)
+{
+    // The pending uploads need to land in the old buffers before they are copied, and the buffers may be in use by
+    // the frames in flight
+    uploadContext->flush();
+    vkDeviceWaitIdle(_settings.device);
+    std::vector<Buffer> retiredBuffers;
+
+    uploadContext->record([&](VkCommandBuffer commandBuffer) {
+        // The old buffers are owned by the graphics queue family
+        uploadContext->recordOnGraphicsQueue(commandBuffer, [&](VkCommandBuffer graphicsCommandBuffer) {
+            if (vertexCapacity > _vertexAllocator.getCapacity()) {
+                std::vector<Copy> copies {{0, 0, _vertexAllocator.getUsedEnd()}};
+                for (auto& stream : _streams) {
+                    Buffer buffer = createBuffer(vertexCapacity * stream.elementSize, vertexBufferUsage);
+                    recordCopies(graphicsCommandBuffer, stream.buffer.buffer, buffer.buffer, copies,
+                        stream.elementSize);
+                    std::swap(stream.buffer, buffer);
+                    retiredBuffers.push_back(buffer);
+                }
+                _vertexAllocator.grow(vertexCapacity);
+            }
+            if (indexCapacity > _indexAllocator.getCapacity()) {
+                std::vector<Copy> copies {{0, 0, _indexAllocator.getUsedEnd()}};
+                Buffer buffer = createBuffer(indexCapacity * sizeof(uint32_t), indexBufferUsage);
+                recordCopies(graphicsCommandBuffer, _indexBuffer.buffer, buffer.buffer, copies, sizeof(uint32_t));
+                std::swap(_indexBuffer, buffer);
+                retiredBuffers.push_back(buffer);
+                _indexAllocator.grow(indexCapacity);
+            }
+        });
+    });
+    uploadContext->flush();
+
+    for (auto& buffer : retiredBuffers)
+        destroyBuffer(&buffer);
+    retiredBuffers.clear();
+}
+
+void GeometryPool::freeRange(uint32_t rangeId)
+{
+    auto& range = _ranges[rangeId];
+    _vertexAllocator.free(range.vertexOffset);
+    _indexAllocator.free(range.firstIndex);
+    range = Range{0, 0, 0, 0};
+    _freeRangeIds.push_back(rangeId);
+}
+
+void GeometryPool::updateBindBuffers()
+{
+    _bindBuffers.clear();
+    for (const auto& stream : _streams)
+        _bindBuffers.push_back(stream.buffer.buffer);
+    _bindOffsets.assign(_bindBuffers.size(), 0);
+}
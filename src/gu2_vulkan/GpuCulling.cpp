@@ -0,0 +1,609 @@
+//
+// Project: GraphicsUtils2
+// File: GpuCulling.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "GpuCulling.hpp"
+#include "DescriptorManager.hpp"
+#include "Mesh.hpp"
+#include "Texture.hpp"
+#include "Util.hpp"
+#include "gu2_util/FrustumCulling.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint32_t  cullingGroupSize            {64};   // local_size_x of gpu_culling.glsl
+constexpr uint32_t  depthPyramidGroupSize       {8};    // local_size_x and local_size_y of depth_pyramid.glsl
+constexpr int64_t   parallelNodeUpdateThreshold {4096};
+
+constexpr VkMemoryPropertyFlags hostVisibleMemory {
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+
+// CullingUniforms of gpu_culling.glsl
+struct CullingUniforms {
+    Mat4f       viewProjection;
+    Vec4f       planes[6];
+    Vec4f       cameraPosition;     // w: LOD error allowed per distance, divided by the node scale
+    uint32_t    nNodes;
+    uint32_t    occlusion;
+    float       pyramidWidth;
+    float       pyramidHeight;
+};
+
+static_assert(sizeof(CullingUniforms) == 192, "CullingUniforms does not match the std430 layout");
+static_assert(sizeof(GpuCulling::Node) == 64, "GpuCulling::Node does not match the std430 layout");
+static_assert(sizeof(GpuCulling::Lod) == 16, "GpuCulling::Lod does not match the std430 layout");
+static_assert(sizeof(GpuCulling::DrawGroup) == 8, "GpuCulling::DrawGroup does not match the std430 layout");
+
+} // namespace
+
+
+bool GpuCulling::isSupported(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+    if (!features.multiDrawIndirect || !features.drawIndirectFirstInstance)
+        return false;
+
+    for (const auto& extension : gu2::vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr)) {
+        if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+            return true;
+    }
+    return false;
+}
+
+GpuCulling::GpuCulling(GpuCullingSettings settings) :
+    _settings                       (std::move(settings)),
+    _vkCmdDrawIndexedIndirectCount  (nullptr),
+    _sampler                        (VK_NULL_HANDLE),
+    _nNodes                         (0),
+    _nLods                          (0),
+    _frame                          (0),
+    _depthView                      (VK_NULL_HANDLE),
+    _depthPyramid                   (VK_NULL_HANDLE),
+    _depthPyramidView               (VK_NULL_HANDLE),
+    _depthPyramidWidth              (0),
+    _depthPyramidHeight             (0),
+    _depthPyramidLevels             (0),
+    _depthPyramidValid              (false),
+    _occlusionCulling               (true)
+{
+    _vkCmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+        vkGetDeviceProcAddr(_settings.device, "vkCmdDrawIndexedIndirectCountKHR"));
+    if (_vkCmdDrawIndexedIndirectCount == nullptr)
+        throw std::runtime_error("VK_KHR_draw_indirect_count not enabled for the device");
+
+    createComputePipeline(&_cullingPipeline, Path(GU2_SHADER_DIR) / "compute/gpu_culling.glsl");
+    createComputePipeline(&_depthPyramidPipeline, Path(GU2_SHADER_DIR) / "compute/depth_pyramid.glsl");
+
+    // Nearest filtering, the pyramid levels hold conservative depths that must not be interpolated
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(_settings.device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create depth pyramid sampler!");
+
+    _frames.resize(_settings.framesInFlight);
+    for (auto& frame : _frames)
+        createBuffer(&frame.uniforms, sizeof(CullingUniforms), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisibleMemory);
+    _settings.descriptorManager->allocateDescriptorSets(&_cullingDescriptorSets,
+        _cullingPipeline.descriptorSetLayout.at(0), _settings.framesInFlight);
+}
+
+GpuCulling::~GpuCulling()
+{
+    destroyDepthPyramid();
+    for (auto& retired : _retired) {
+        for (auto& buffer : retired.buffers)
+            destroyBuffer(&buffer);
+    }
+    for (auto& frame : _frames) {
+        destroyBuffer(&frame.uniforms);
+        destroyBuffer(&frame.nodes);
+        destroyBuffer(&frame.drawCommands);
+        destroyBuffer(&frame.drawCounts);
+        destroyBuffer(&frame.drawCountReadback);
+    }
+    destroyBuffer(&_lods);
+    destroyBuffer(&_drawGroupBuffer);
+    if (_sampler != VK_NULL_HANDLE)
+        vkDestroySampler(_settings.device, _sampler, nullptr);
+    destroyComputePipeline(&_cullingPipeline);
+    destroyComputePipeline(&_depthPyramidPipeline);
+}
+
+void GpuCulling::setGeometry(const std::vector<Lod>& lods, const std::vector<uint32_t>& groupSizes, uint32_t nNodes)
+{
+    _drawGroups.resize(groupSizes.size());
+    uint32_t nCommands = 0;
+    for (size_t g=0; g<groupSizes.size(); ++g) {
+        _drawGroups[g] = {nCommands, groupSizes[g]};
+        nCommands += groupSizes[g];
+    }
+    if (nCommands != nNodes)
+        throw std::runtime_error("Draw group sizes do not add up to the node count");
+
+    // The buffers and the descriptor sets may be in use by the frames in flight, new ones are created and the old
+    // ones destroyed once the frames have finished. Descriptor sets are not written before the first geometry.
+    if (_drawGroupBuffer.buffer != VK_NULL_HANDLE) {
+        Retired retired;
+        retired.buffers = {_lods, _drawGroupBuffer};
+        _lods = Buffer();
+        _drawGroupBuffer = Buffer();
+        for (auto& frame : _frames) {
+            retired.buffers.insert(retired.buffers.end(),
+                {frame.nodes, frame.drawCommands, frame.drawCounts, frame.drawCountReadback});
+            frame.nodes = Buffer();
+            frame.drawCommands = Buffer();
+            frame.drawCounts = Buffer();
+            frame.drawCountReadback = Buffer();
+        }
+        retired.descriptorSets = std::move(_cullingDescriptorSets);
+        retired.frame = _frame;
+        _retired.push_back(std::move(retired));
+
+        _cullingDescriptorSets.clear();
+        _settings.descriptorManager->allocateDescriptorSets(&_cullingDescriptorSets,
+            _cullingPipeline.descriptorSetLayout.at(0), _settings.framesInFlight);
+    }
+
+    createBuffer(&_lods, lods.size()*sizeof(Lod), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisibleMemory);
+    createBuffer(&_drawGroupBuffer, _drawGroups.size()*sizeof(DrawGroup), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        hostVisibleMemory);
+    memcpy(_lods.allocation.mapped, lods.data(), lods.size()*sizeof(Lod));
+    memcpy(_drawGroupBuffer.allocation.mapped, _drawGroups.data(), _drawGroups.size()*sizeof(DrawGroup));
+
+    for (auto& frame : _frames) {
+        createBuffer(&frame.nodes, nNodes*sizeof(Node), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisibleMemory);
+        createBuffer(&frame.drawCommands, nCommands*sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        // Counts are written with atomics in device local memory, copied for reading back after each culling
+        createBuffer(&frame.drawCounts, _drawGroups.size()*sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        createBuffer(&frame.drawCountReadback, _drawGroups.size()*sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            hostVisibleMemory);
+        memset(frame.drawCountReadback.allocation.mapped, 0, frame.drawCountReadback.size);
+    }
+    _nNodes = nNodes;
+    _nLods = static_cast<uint32_t>(lods.size());
+
+    updateCullingDescriptorSets();
+}
+
+void GpuCulling::setScene(const Scene& scene)
+{
+    std::vector<Lod> lods;
+    lods.reserve(scene.lods.size());
+    for (const auto& lod : scene.lods)
+        lods.push_back({lod.firstIndex, lod.nIndices, lod.error});
+
+    // LOD ranges are relative to the mesh, add the offsets of the mesh in the geometry pool
+    std::vector<uint8_t> lodOffsetAdded(lods.size(), 0);
+    for (const auto& node : scene.nodes) {
+        if (node.mesh == nullptr)
+            continue;
+        for (uint32_t i=node.firstLod; i<node.firstLod + node.nLods; ++i) {
+            if (lodOffsetAdded[i])
+                continue;
+            lods[i].firstIndex += node.mesh->getFirstIndex();
+            lods[i].vertexOffset = node.mesh->getVertexOffset();
+            lodOffsetAdded[i] = 1;
+        }
+    }
+
+    std::vector<uint32_t> groupSizes;
+    groupSizes.reserve(scene.instanceGroups.size());
+    for (const auto& group : scene.instanceGroups)
+        groupSizes.push_back(group.nNodes);
+
+    setGeometry(lods, groupSizes, static_cast<uint32_t>(scene.nodes.size()));
+}
+
+void GpuCulling::updateNodes(const Scene& scene, uint32_t currentFrame)
+{
+    // The frame of the replacement has finished once framesInFlight frames have been submitted after it
+    ++_frame;
+    while (!_retired.empty() && _retired.front().frame + _settings.framesInFlight < _frame) {
+        for (auto& buffer : _retired.front().buffers)
+            destroyBuffer(&buffer);
+        _retired.pop_front();
+    }
+
+    bool sceneChanged = scene.nodes.size() != _nNodes || scene.lods.size() != _nLods ||
+        scene.instanceGroups.size() != _drawGroups.size();
+    for (size_t g=0; g<_drawGroups.size() && !sceneChanged; ++g)
+        sceneChanged = scene.instanceGroups[g].nNodes != _drawGroups[g].maxCommands;
+    if (sceneChanged)
+        setScene(scene);
+
+    Node* nodeData = getNodeData(currentFrame);
+    int64_t nNodes = static_cast<int64_t>(scene.nodes.size());
+    #pragma omp parallel for if (nNodes >= parallelNodeUpdateThreshold)
+    for (int64_t i=0; i<nNodes; ++i) {
+        const auto& node = scene.nodes[i];
+        auto& record = nodeData[i];
+        record.sphere << node.worldSphere.center, node.worldSphere.radius;
+        record.boundsMin << node.worldBounds.min, 0.0f;
+        record.boundsMax << node.worldBounds.max, 0.0f;
+        record.drawGroup = node.instanceGroup;
+        record.firstLod = node.firstLod;
+        record.nLods = node.nLods;
+        record.maxScale = node.transformation.block<3,3>(0,0).colwise().norm().maxCoeff();
+    }
+}
+
+void GpuCulling::setDepthTexture(const Texture& depthTexture)
+{
+    destroyDepthPyramid();
+
+    // Largest power of two not exceeding the depth texture, so that every level halves the previous one exactly
+    const auto& properties = depthTexture.getProperties();
+    _depthPyramidWidth = std::bit_floor(std::max(properties.width, 1u));
+    _depthPyramidHeight = std::bit_floor(std::max(properties.height, 1u));
+    _depthPyramidLevels = std::bit_width(std::max(_depthPyramidWidth, _depthPyramidHeight));
+    _depthView = depthTexture.getImageView();
+
+    // Recreated with the depth texture, power of two dimensions fit the buddy blocks well
+    gu2::createImage(_settings.memoryAllocator, _settings.physicalDevice, _settings.device, _depthPyramidWidth,
+        _depthPyramidHeight, _depthPyramidLevels, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &_depthPyramid, &_depthPyramidAllocation, MemoryStrategy::Buddy);
+    _depthPyramidView = gu2::createImageView(_settings.device, _depthPyramid, VK_FORMAT_R32_SFLOAT,
+        VK_IMAGE_ASPECT_COLOR_BIT, _depthPyramidLevels);
+
+    _depthPyramidLevelViews.resize(_depthPyramidLevels);
+    for (uint32_t level=0; level<_depthPyramidLevels; ++level) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = _depthPyramid;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(_settings.device, &viewInfo, nullptr, &_depthPyramidLevelViews[level]) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create an image view!");
+    }
+
+    // Each level is reduced from the previous one, the first one from the depth texture
+    _settings.descriptorManager->allocateDescriptorSets(&_depthPyramidDescriptorSets,
+        _depthPyramidPipeline.descriptorSetLayout.at(0), _depthPyramidLevels);
+    std::vector<VkDescriptorImageInfo> imageInfos(2*_depthPyramidLevels);
+    std::vector<VkWriteDescriptorSet> descriptorWrites(2*_depthPyramidLevels);
+    for (uint32_t level=0; level<_depthPyramidLevels; ++level) {
+        imageInfos[2*level] = VkDescriptorImageInfo{
+            .sampler = _sampler,
+            .imageView = level == 0 ? _depthView : _depthPyramidLevelViews[level-1],
+            .imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL
+        };
+        imageInfos[2*level + 1] = VkDescriptorImageInfo{
+            .sampler = VK_NULL_HANDLE,
+            .imageView = _depthPyramidLevelViews[level],
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+
+        for (uint32_t binding=0; binding<2; ++binding) {
+            auto& descriptorWrite = descriptorWrites[2*level + binding];
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = _depthPyramidDescriptorSets[level];
+            descriptorWrite.dstBinding = binding;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.descriptorType = binding == 0 ?
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrite.pImageInfo = &imageInfos[2*level + binding];
+        }
+    }
+    vkUpdateDescriptorSets(_settings.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(),
+        0, nullptr);
+
+    updateCullingDescriptorSets();
+}
+
+void GpuCulling::cull(
+    VkCommandBuffer commandBuffer,
+    uint32_t currentFrame,
+    const Scene::Camera& camera,
+    float maxLodError
+) {
+    if (_drawGroupBuffer.buffer == VK_NULL_HANDLE || _depthPyramid == VK_NULL_HANDLE)
+        throw std::runtime_error("GPU culling requires the geometry and the depth texture to be set");
+
+    auto& frame = _frames[currentFrame];
+
+    // Projected error of Scene::selectLod is maxLodError at the distance times this, divided by the node scale
+    Mat4f viewProjection = camera.projection * camera.view;
+    Frustum frustum = Frustum::fromViewProjection(viewProjection);
+    CullingUniforms uniforms;
+    uniforms.viewProjection = viewProjection;
+    for (int p=0; p<6; ++p)
+        uniforms.planes[p] = frustum.planes[p];
+    uniforms.cameraPosition << camera.getPosition(),
+        maxLodError / (0.5f * camera.viewportHeight * std::abs(camera.projection(1,1)));
+    uniforms.nNodes = _nNodes;
+    uniforms.occlusion = _occlusionCulling && _depthPyramidValid;
+    uniforms.pyramidWidth = static_cast<float>(_depthPyramidWidth);
+    uniforms.pyramidHeight = static_cast<float>(_depthPyramidHeight);
+    memcpy(frame.uniforms.allocation.mapped, &uniforms, sizeof(CullingUniforms));
+
+    // The pyramid is bound even when unused, so it needs to be in the layout declared in the descriptor set
+    if (!_depthPyramidValid)
+        transitionDepthPyramid(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+    vkCmdFillBuffer(commandBuffer, frame.drawCounts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    // Cleared counts and the depth pyramid of the previous frame are read by the culling shader
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullingPipeline.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullingPipeline.pipelineLayout, 0, 1,
+        &_cullingDescriptorSets[currentFrame], 0, nullptr);
+    vkCmdDispatch(commandBuffer, (_nNodes + cullingGroupSize - 1) / cullingGroupSize, 1, 1);
+
+    // Draw commands and counts are consumed by the indirect draws, the counts are also copied for the host
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    if (!_drawGroups.empty()) {
+        VkBufferCopy copyRegion{0, 0, _drawGroups.size()*sizeof(uint32_t)};
+        vkCmdCopyBuffer(commandBuffer, frame.drawCounts.buffer, frame.drawCountReadback.buffer, 1, &copyRegion);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCulling::buildDepthPyramid(VkCommandBuffer commandBuffer)
+{
+    if (_depthPyramid == VK_NULL_HANDLE)
+        throw std::runtime_error("No depth texture set");
+
+    // Previous contents are discarded once the culling of the frame has read them
+    transitionDepthPyramid(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthPyramidPipeline.pipeline);
+    for (uint32_t level=0; level<_depthPyramidLevels; ++level) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthPyramidPipeline.pipelineLayout,
+            0, 1, &_depthPyramidDescriptorSets[level], 0, nullptr);
+        uint32_t width = std::max(_depthPyramidWidth >> level, 1u);
+        uint32_t height = std::max(_depthPyramidHeight >> level, 1u);
+        vkCmdDispatch(commandBuffer, (width + depthPyramidGroupSize - 1) / depthPyramidGroupSize,
+            (height + depthPyramidGroupSize - 1) / depthPyramidGroupSize, 1);
+
+        // Next level is reduced from this one
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = _depthPyramid;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = level;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    _depthPyramidValid = true;
+}
+
+void GpuCulling::draw(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t drawGroup) const
+{
+    const auto& group = _drawGroups.at(drawGroup);
+    const auto& frame = _frames[currentFrame];
+    _vkCmdDrawIndexedIndirectCount(commandBuffer,
+        frame.drawCommands.buffer, group.firstCommand*sizeof(VkDrawIndexedIndirectCommand),
+        frame.drawCounts.buffer, drawGroup*sizeof(uint32_t),
+        group.maxCommands, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+uint32_t GpuCulling::getVisibleCount(uint32_t currentFrame) const
+{
+    const auto* counts = static_cast<const uint32_t*>(_frames[currentFrame].drawCountReadback.allocation.mapped);
+    uint32_t nVisible = 0;
+    for (size_t g=0; g<_drawGroups.size(); ++g)
+        nVisible += std::min(counts[g], _drawGroups[g].maxCommands);
+    return nVisible;
+}
+
+void GpuCulling::createComputePipeline(ComputePipeline* pipeline, const Path& filename)
+{
+    pipeline->shader = Shader(_settings.device);
+    pipeline->shader.loadFromFile(filename);
+
+    const auto& layoutInfos = pipeline->shader.getDescriptorSetLayouts();
+    if (layoutInfos.size() != 1 || layoutInfos[0].setId != 0)
+        throw std::runtime_error("Compute shaders are expected to use descriptor set 0 only");
+    pipeline->descriptorSetLayout.clear();
+    pipeline->descriptorSetLayout.push_back(_settings.descriptorManager->getDescriptorSetLayout(layoutInfos[0]));
+
+    VkDescriptorSetLayout descriptorSetLayout = pipeline->descriptorSetLayout[0];
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    if (vkCreatePipelineLayout(_settings.device, &pipelineLayoutInfo, nullptr, &pipeline->pipelineLayout) !=
+        VK_SUCCESS)
+        throw std::runtime_error("Failed to create pipeline layout!");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = pipeline->shader.getShaderModule();
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipeline->pipelineLayout;
+    if (vkCreateComputePipelines(_settings.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline->pipeline) !=
+        VK_SUCCESS)
+        throw std::runtime_error("Failed to create compute pipeline!");
+}
+
+void GpuCulling::destroyComputePipeline(ComputePipeline* pipeline)
+{
+    if (pipeline->pipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(_settings.device, pipeline->pipeline, nullptr);
+    if (pipeline->pipelineLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(_settings.device, pipeline->pipelineLayout, nullptr);
+    pipeline->pipeline = VK_NULL_HANDLE;
+    pipeline->pipelineLayout = VK_NULL_HANDLE;
+}
+
+void GpuCulling::createBuffer(
+    Buffer* buffer,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties
+) {
+    // Existing buffer is reused in case it is large enough, zero sized buffers are not allowed
+    size = std::max(size, VkDeviceSize(16));
+    if (buffer->buffer != VK_NULL_HANDLE && buffer->size >= size)
+        return;
+
+    // The buffers are recreated as the scene structure changes, buddy blocks keep the allocations fast
+    destroyBuffer(buffer);
+    gu2::createBuffer(_settings.memoryAllocator, _settings.physicalDevice, _settings.device, size, usage, properties,
+        &buffer->buffer, &buffer->allocation, MemoryStrategy::Buddy);
+    buffer->size = size;
+}
+
+void GpuCulling::destroyBuffer(Buffer* buffer)
+{
+    gu2::destroyBuffer(_settings.memoryAllocator, _settings.device, &buffer->buffer, &buffer->allocation);
+    *buffer = Buffer();
+}
+
+void GpuCulling::destroyDepthPyramid()
+{
+    _depthPyramidDescriptorSets.clear();
+    for (auto& levelView : _depthPyramidLevelViews)
+        vkDestroyImageView(_settings.device, levelView, nullptr);
+    _depthPyramidLevelViews.clear();
+    if (_depthPyramidView != VK_NULL_HANDLE)
+        vkDestroyImageView(_settings.device, _depthPyramidView, nullptr);
+    gu2::destroyImage(_settings.memoryAllocator, _settings.device, &_depthPyramid, &_depthPyramidAllocation);
+    _depthPyramidView = VK_NULL_HANDLE;
+    _depthPyramidValid = false;
+}
+
+void GpuCulling::updateCullingDescriptorSets()
+{
+    if (_drawGroupBuffer.buffer == VK_NULL_HANDLE || _depthPyramid == VK_NULL_HANDLE)
+        return;
+
+    constexpr uint32_t nBufferBindings = 6;
+    std::vector<VkDescriptorBufferInfo> bufferInfos(nBufferBindings*_frames.size());
+    std::vector<VkDescriptorImageInfo> imageInfos(_frames.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites;
+    for (size_t i=0; i<_frames.size(); ++i) {
+        const auto& frame = _frames[i];
+        // Bindings 0 - 5 of gpu_culling.glsl
+        VkBuffer buffers[nBufferBindings] {frame.uniforms.buffer, frame.nodes.buffer, _lods.buffer,
+            _drawGroupBuffer.buffer, frame.drawCommands.buffer, frame.drawCounts.buffer};
+        for (uint32_t binding=0; binding<nBufferBindings; ++binding) {
+            auto& bufferInfo = bufferInfos[i*nBufferBindings + binding];
+            bufferInfo.buffer = buffers[binding];
+            bufferInfo.offset = 0;
+            bufferInfo.range = VK_WHOLE_SIZE;
+
+            descriptorWrites.emplace_back();
+            auto& descriptorWrite = descriptorWrites.back();
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = _cullingDescriptorSets[i];
+            descriptorWrite.dstBinding = binding;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrite.pBufferInfo = &bufferInfo;
+        }
+
+        imageInfos[i] = VkDescriptorImageInfo{
+            .sampler = _sampler,
+            .imageView = _depthPyramidView,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+        descriptorWrites.emplace_back();
+        auto& descriptorWrite = descriptorWrites.back();
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = _cullingDescriptorSets[i];
+        descriptorWrite.dstBinding = nBufferBindings;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.pImageInfo = &imageInfos[i];
+    }
+
+    vkUpdateDescriptorSets(_settings.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(),
+        0, nullptr);
+}
+
+void GpuCulling::transitionDepthPyramid(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage) const
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = _depthPyramid;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = _depthPyramidLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        srcStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
@@ -16,12 +16,36 @@
 
 #include "gu2_util/GLTFLoader.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 
 
 using namespace gu2;
 
 
+namespace {
+
+// Resolve the constant ids of the specialization constants declared in the shader, sorted by constant id so that
+// equal values produce equal pipeline keys
+SpecializationConstants resolveSpecializationConstants(
+    const std::map<std::string, uint32_t>& specializationConstants,
+    const Shader& shader
+) {
+    SpecializationConstants resolved;
+    for (const auto& [name, value] : specializationConstants) {
+        int64_t constantId = shader.getSpecializationConstantId(name);
+        if (constantId >= 0)
+            resolved.push_back(SpecializationConstant{static_cast<uint32_t>(constantId), value});
+    }
+    std::sort(resolved.begin(), resolved.end(), [](const SpecializationConstant& a, const SpecializationConstant& b) {
+        return a.constantId < b.constantId;
+    });
+    return resolved;
+}
+
+} // namespace
+
+
 Material::Material(VkDevice device) :
     _device         (device),
     _vertexShader   (nullptr),
@@ -33,11 +57,30 @@ Material::Material(VkDevice device) :
 void Material::setVertexShader(const Shader& shader)
 {
     _vertexShader = &shader;
+    _vertexShaderFuture = ShaderFuture();
 }
 
 void Material::setFragmentShader(const Shader& shader)
 {
     _fragmentShader = &shader;
+    _fragmentShaderFuture = ShaderFuture();
+}
+
+void Material::setVertexShader(const ShaderFuture& shader)
+{
+    _vertexShader = nullptr;
+    _vertexShaderFuture = shader;
+}
+
+void Material::setFragmentShader(const ShaderFuture& shader)
+{
+    _fragmentShader = nullptr;
+    _fragmentShaderFuture = shader;
+}
+
+void Material::setSpecializationConstant(const std::string& name, uint32_t value)
+{
+    _specializationConstants[name] = value;
 }
 
 void mergeBindings(DescriptorSetLayoutInfo* dest, const DescriptorSetLayoutInfo& src)
@@ -67,6 +110,8 @@ void Material::createDescriptorSetLayouts(DescriptorManager* descriptorManager)
     if (descriptorManager->getDevice() != _device)
         throw std::runtime_error("DescriptorManager with different Vulkan device provided");
 
+    waitForShaders();
+
     // TODO make _shaders a member and add generic interface for adding arbitrary number of shaders
     std::vector<const Shader*> _shaders{_vertexShader, _fragmentShader};
 
@@ -112,11 +157,16 @@ void Material::createDescriptorSetLayouts(DescriptorManager* descriptorManager)
         _descriptorSetLayoutInfos[descriptorSetLayoutInfo.setId] = descriptorSetLayoutInfo;
     }
 
-    // TODO replace this hack that turns object descriptor UBO types to dynamic
-    if (_descriptorSetLayoutInfos.size() > objectDescriptorSetId) {
-        for (auto& binding: _descriptorSetLayoutInfos.at(objectDescriptorSetId).bindings) {
+    // TODO replace this hack that turns render pass and object descriptor buffer types to dynamic. The render pass
+    // set buffers are suballocated from the frame allocator.
+    for (auto setId : {renderPassDescriptorSetId, objectDescriptorSetId}) {
+        if (_descriptorSetLayoutInfos.size() <= setId)
+            continue;
+        for (auto& binding: _descriptorSetLayoutInfos.at(setId).bindings) {
             if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
                 binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            else if (binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
         }
     }
 
@@ -131,14 +181,44 @@ void Material::createPipeline(
     PipelineManager* pipelineManager,
     const VkPipelineVertexInputStateCreateInfo& vertexInputInfo
 ) {
-    _pipeline = pipelineManager->getPipeline(_vertexShader, _fragmentShader, _descriptorSetLayouts, vertexInputInfo);
+    waitForShaders();
+    checkSpecializationConstants();
+    _pipeline = pipelineManager->getPipeline(_vertexShader, _fragmentShader, _descriptorSetLayouts, vertexInputInfo,
+        resolveSpecializationConstants(_specializationConstants, *_vertexShader),
+        resolveSpecializationConstants(_specializationConstants, *_fragmentShader));
 }
 
 void Material::createPipeline(
     PipelineManager* pipelineManager,
     const PipelineSettings& pipelineSettings
 ) {
-    _pipeline = pipelineManager->getPipeline(pipelineSettings, _vertexShader, _fragmentShader, _descriptorSetLayouts);
+    waitForShaders();
+    checkSpecializationConstants();
+    _pipeline = pipelineManager->getPipeline(pipelineSettings, _vertexShader, _fragmentShader, _descriptorSetLayouts,
+        resolveSpecializationConstants(_specializationConstants, *_vertexShader),
+        resolveSpecializationConstants(_specializationConstants, *_fragmentShader));
+}
+
+void Material::createPipelines(
+    PipelineManager* pipelineManager,
+    const std::vector<Material*>& materials,
+    const std::vector<VkPipelineVertexInputStateCreateInfo>& vertexInputInfos
+) {
+    std::vector<PipelineManager::PipelineRequest> requests;
+    requests.reserve(materials.size());
+    for (size_t i=0; i<materials.size(); ++i) {
+        auto* material = materials[i];
+        material->waitForShaders();
+        material->checkSpecializationConstants();
+        requests.push_back({material->_vertexShader, material->_fragmentShader, material->_descriptorSetLayouts,
+            vertexInputInfos.at(i),
+            resolveSpecializationConstants(material->_specializationConstants, *material->_vertexShader),
+            resolveSpecializationConstants(material->_specializationConstants, *material->_fragmentShader)});
+    }
+
+    auto pipelines = pipelineManager->getPipelines(requests);
+    for (size_t i=0; i<materials.size(); ++i)
+        materials[i]->_pipeline = pipelines[i];
 }
 
 void Material::addUniform(uint32_t set, uint32_t binding, const Texture& texture)
@@ -209,10 +289,36 @@ void Material::createDescriptorSets(DescriptorManager* descriptorManager, int fr
 void Material::bind(VkCommandBuffer commandBuffer, uint32_t currentFrame) const
 {
     _pipeline->bind(commandBuffer);
+    bindDescriptorSets(commandBuffer, currentFrame);
+}
 
+void Material::bindDescriptorSets(VkCommandBuffer commandBuffer, uint32_t currentFrame) const
+{
     if (_descriptorSets.size() <= currentFrame)
         return;
 
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline->getPipelineLayout(),
         materialDescriptorSetId, 1, &_descriptorSets[currentFrame], 0, nullptr);
 }
+
+void Material::waitForShaders()
+{
+    // Rethrows the compilation errors
+    if (_vertexShaderFuture.valid()) {
+        _vertexShader = _vertexShaderFuture.get();
+        _vertexShaderFuture = ShaderFuture();
+    }
+    if (_fragmentShaderFuture.valid()) {
+        _fragmentShader = _fragmentShaderFuture.get();
+        _fragmentShaderFuture = ShaderFuture();
+    }
+}
+
+void Material::checkSpecializationConstants() const
+{
+    for (const auto& [name, value] : _specializationConstants) {
+        if (_vertexShader->getSpecializationConstantId(name) < 0 &&
+            _fragmentShader->getSpecializationConstantId(name) < 0)
+            throw std::runtime_error("No specialization constant " + name + " declared in the material shaders");
+    }
+}
@@ -0,0 +1,494 @@
+//
+// Project: GraphicsUtils2
+// File: MemoryAllocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "MemoryAllocator.hpp"
+#include "Util.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <stdexcept>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint32_t      nStrategies         {3};
+constexpr VkDeviceSize  buddyMinBlockSize   {256};
+
+template <typename T_Variant>
+inline size_t getAllocationCount(const T_Variant& allocator)
+{
+    return std::visit([](const auto& a) { return a.getAllocationCount(); }, allocator);
+}
+
+VkImageCreateInfo getImageCreateInfo(
+    uint32_t width,
+    uint32_t height,
+    uint32_t mipLevels,
+    VkFormat format,
+    VkImageTiling tiling,
+    VkImageUsageFlags usage
+) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = tiling;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.flags = 0;
+    return imageInfo;
+}
+
+} // namespace
+
+
+MemoryAllocator::MemoryAllocator(MemoryAllocatorSettings settings) :
+    _settings               (std::move(settings)),
+    _nDedicatedAllocations  (0),
+    _dedicatedBytes         (0)
+{
+    vkGetPhysicalDeviceMemoryProperties(_settings.physicalDevice, &_memoryProperties);
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(_settings.physicalDevice, &physicalDeviceProperties);
+    _nonCoherentAtomSize = physicalDeviceProperties.limits.nonCoherentAtomSize;
+    _maxMemoryAllocationCount = physicalDeviceProperties.limits.maxMemoryAllocationCount;
+
+    _pools.resize(2*nStrategies*_memoryProperties.memoryTypeCount);
+    for (uint32_t i=0; i<_pools.size(); ++i) {
+        _pools[i].memoryType = i/(2*nStrategies);
+        _pools[i].hostVisible = _memoryProperties.memoryTypes[_pools[i].memoryType].propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    }
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    // Remaining allocations are released with the blocks, dedicated allocations are owned by the users
+    for (auto& pool : _pools) {
+        for (auto& block : pool.blocks) {
+            if (block)
+                vkFreeMemory(_settings.device, block->memory, nullptr);
+        }
+    }
+}
+
+MemoryAllocation MemoryAllocator::allocate(
+    const VkMemoryRequirements& requirements,
+    VkMemoryPropertyFlags properties,
+    bool optimalImage,
+    bool dedicated,
+    MemoryStrategy strategy
+) {
+    return allocateMemory(requirements, properties, optimalImage, dedicated, strategy, nullptr);
+}
+
+MemoryAllocation MemoryAllocator::allocateMemory(
+    const VkMemoryRequirements& requirements,
+    VkMemoryPropertyFlags properties,
+    bool optimalImage,
+    bool dedicated,
+    MemoryStrategy strategy,
+    const VkMemoryDedicatedAllocateInfo* dedicatedInfo
+) {
+    MemoryAllocation allocation;
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+    allocation.pool = nStrategies*(2*memoryType + (optimalImage ? 1 : 0)) + static_cast<uint32_t>(strategy);
+    auto& pool = _pools[allocation.pool];
+
+    // Mapped ranges of non-coherent memory need to be flushed in whole atoms
+    VkDeviceSize alignment = std::max(requirements.alignment, VkDeviceSize(1));
+    VkDeviceSize size = requirements.size;
+    if (pool.hostVisible && !(_memoryProperties.memoryTypes[memoryType].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        alignment = std::max(alignment, _nonCoherentAtomSize);
+        size = ((size + _nonCoherentAtomSize - 1) / _nonCoherentAtomSize) * _nonCoherentAtomSize;
+    }
+
+    // Buddy blocks are powers of two, smaller than blockSize in case it is not one
+    VkDeviceSize blockCapacity = strategy == MemoryStrategy::Buddy ?
+        std::max(std::bit_floor(_settings.blockSize), buddyMinBlockSize) : _settings.blockSize;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (dedicated || size >= _settings.dedicatedThreshold || size > blockCapacity) {
+        // The dedicated allocation needs to match the size of the resource, a mapping from offset 0 is flushed
+        // with VK_WHOLE_SIZE
+        if (dedicatedInfo != nullptr)
+            size = requirements.size;
+        allocation.memory = allocateDeviceMemory(size, memoryType, &allocation.mapped, dedicatedInfo);
+        allocation.size = size;
+        allocation.block = MemoryAllocation::dedicatedBlock;
+        ++_nDedicatedAllocations;
+        _dedicatedBytes += size;
+        return allocation;
+    }
+
+    // First live block with room. A new block is created only in case none has room, it takes the place of a
+    // freed block if there is one.
+    auto allocateFromBlock = [&](uint32_t b) {
+        auto& block = *pool.blocks[b];
+        VkDeviceSize offset = std::visit([&](auto& allocator) { return allocator.allocate(size, alignment); },
+            block.allocator);
+        if (offset == RangeAllocator::invalidOffset)
+            return false;
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.mapped = block.mapped == nullptr ? nullptr : static_cast<uint8_t*>(block.mapped) + offset;
+        allocation.block = b;
+        return true;
+    };
+
+    uint32_t nBlocks = static_cast<uint32_t>(pool.blocks.size());
+    for (uint32_t b=0; b<nBlocks; ++b) {
+        if (pool.blocks[b] && allocateFromBlock(b))
+            return allocation;
+    }
+
+    auto block = std::make_unique<Block>();
+    switch (strategy) {
+        case MemoryStrategy::FirstFit:
+            block->allocator.emplace<RangeAllocator>(blockCapacity);
+            break;
+        case MemoryStrategy::Buddy:
+            block->allocator.emplace<BuddyAllocator>(blockCapacity, buddyMinBlockSize);
+            break;
+        case MemoryStrategy::Linear:
+            block->allocator.emplace<LinearAllocator>(blockCapacity);
+            break;
+    }
+    block->memory = allocateDeviceMemory(blockCapacity, memoryType, &block->mapped);
+    auto freeSlot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+    uint32_t b = static_cast<uint32_t>(freeSlot - pool.blocks.begin());
+    if (freeSlot == pool.blocks.end())
+        pool.blocks.push_back(std::move(block));
+    else
+        *freeSlot = std::move(block);
+
+    if (allocateFromBlock(b))
+        return allocation;
+
+    throw std::runtime_error("MemoryAllocator: allocation failed"); // not reached, a new block always fits
+}
+
+void MemoryAllocator::free(MemoryAllocation* allocation)
+{
+    if (allocation->memory == VK_NULL_HANDLE)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (allocation->block == MemoryAllocation::dedicatedBlock) {
+        vkFreeMemory(_settings.device, allocation->memory, nullptr);
+        --_nDedicatedAllocations;
+        _dedicatedBytes -= allocation->size;
+    }
+    else {
+        auto& pool = _pools[allocation->pool];
+        auto& block = pool.blocks[allocation->block];
+        std::visit([&](auto& allocator) { allocator.free(allocation->offset); }, block->allocator);
+
+        // Empty blocks are released, except for the first one of the pool to avoid reallocating it repeatedly
+        if (getAllocationCount(block->allocator) == 0 && allocation->block > 0) {
+            vkFreeMemory(_settings.device, block->memory, nullptr);
+            block.reset();
+        }
+    }
+
+    *allocation = MemoryAllocation();
+}
+
+void MemoryAllocator::createBuffer(
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkBuffer* buffer,
+    MemoryAllocation* allocation,
+    MemoryStrategy strategy
+) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(_settings.device, &bufferInfo, nullptr, buffer) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create buffer!");
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = *buffer;
+
+    VkMemoryRequirements memRequirements;
+    bool dedicated = getMemoryRequirements(*buffer, &memRequirements);
+    *allocation = allocateMemory(memRequirements, properties, false, dedicated, strategy,
+        _settings.dedicatedRequirements ? &dedicatedInfo : nullptr);
+    vkBindBufferMemory(_settings.device, *buffer, allocation->memory, allocation->offset);
+}
+
+void MemoryAllocator::createImage(
+    uint32_t width,
+    uint32_t height,
+    uint32_t mipLevels,
+    VkFormat format,
+    VkImageTiling tiling,
+    VkImageUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkImage* image,
+    MemoryAllocation* allocation,
+    MemoryStrategy strategy
+) {
+    VkImageCreateInfo imageInfo = getImageCreateInfo(width, height, mipLevels, format, tiling, usage);
+    if (vkCreateImage(_settings.device, &imageInfo, nullptr, image) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create image!");
+
+    // Attachments are recreated with the swap chain, keep them out of the blocks
+    constexpr VkImageUsageFlags attachmentUsage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.image = *image;
+
+    VkMemoryRequirements memRequirements;
+    bool dedicated = getMemoryRequirements(*image, &memRequirements) || (usage & attachmentUsage) != 0;
+    *allocation = allocateMemory(memRequirements, properties, tiling == VK_IMAGE_TILING_OPTIMAL, dedicated, strategy,
+        _settings.dedicatedRequirements ? &dedicatedInfo : nullptr);
+    vkBindImageMemory(_settings.device, *image, allocation->memory, allocation->offset);
+}
+
+void MemoryAllocator::destroyBuffer(VkBuffer* buffer, MemoryAllocation* allocation)
+{
+    if (*buffer != VK_NULL_HANDLE)
+        vkDestroyBuffer(_settings.device, *buffer, nullptr);
+    *buffer = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+void MemoryAllocator::destroyImage(VkImage* image, MemoryAllocation* allocation)
+{
+    if (*image != VK_NULL_HANDLE)
+        vkDestroyImage(_settings.device, *image, nullptr);
+    *image = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+MemoryAllocator::Statistics MemoryAllocator::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Statistics statistics{};
+    for (size_t poolId=0; poolId<_pools.size(); ++poolId) {
+        for (const auto& block : _pools[poolId].blocks) {
+            if (!block)
+                continue;
+            auto nAllocations = static_cast<uint32_t>(getAllocationCount(block->allocator));
+            ++statistics.nBlocks;
+            statistics.nAllocations += nAllocations;
+            ++statistics.nStrategyBlocks[poolId % nStrategies];
+            statistics.nStrategyAllocations[poolId % nStrategies] += nAllocations;
+            statistics.blockBytes += std::visit([](const auto& allocator) { return allocator.getCapacity(); },
+                block->allocator);
+            statistics.usedBlockBytes += std::visit([](const auto& allocator) { return allocator.getUsedSize(); },
+                block->allocator);
+        }
+    }
+    statistics.nDedicatedAllocations = _nDedicatedAllocations;
+    statistics.nAllocations += _nDedicatedAllocations;
+    statistics.nDeviceMemories = statistics.nBlocks + _nDedicatedAllocations;
+    statistics.dedicatedBytes = _dedicatedBytes;
+    statistics.maxMemoryAllocationCount = _maxMemoryAllocationCount;
+    return statistics;
+}
+
+void MemoryAllocator::printStatistics() const
+{
+    auto statistics = getStatistics();
+    printf("Device memory: %u allocations in %u device memories (limit %u)\n", statistics.nAllocations,
+        statistics.nDeviceMemories, statistics.maxMemoryAllocationCount);
+    printf("  %u blocks: %.1f / %.1f MiB used\n", statistics.nBlocks, statistics.usedBlockBytes / 1048576.0,
+        statistics.blockBytes / 1048576.0);
+    printf("  first fit / buddy / linear: %u / %u / %u blocks, %u / %u / %u allocations\n",
+        statistics.nStrategyBlocks[0], statistics.nStrategyBlocks[1], statistics.nStrategyBlocks[2],
+        statistics.nStrategyAllocations[0], statistics.nStrategyAllocations[1], statistics.nStrategyAllocations[2]);
+    printf("  %u dedicated: %.1f MiB\n", statistics.nDedicatedAllocations, statistics.dedicatedBytes / 1048576.0);
+}
+
+bool MemoryAllocator::getMemoryRequirements(VkBuffer buffer, VkMemoryRequirements* requirements) const
+{
+    if (!_settings.dedicatedRequirements) {
+        vkGetBufferMemoryRequirements(_settings.device, buffer, requirements);
+        return false;
+    }
+
+    VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.buffer = buffer;
+    VkMemoryDedicatedRequirements dedicatedRequirements{};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements2{};
+    requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements2.pNext = &dedicatedRequirements;
+    vkGetBufferMemoryRequirements2(_settings.device, &requirementsInfo, &requirements2);
+
+    *requirements = requirements2.memoryRequirements;
+    return dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+}
+
+bool MemoryAllocator::getMemoryRequirements(VkImage image, VkMemoryRequirements* requirements) const
+{
+    if (!_settings.dedicatedRequirements) {
+        vkGetImageMemoryRequirements(_settings.device, image, requirements);
+        return false;
+    }
+
+    VkImageMemoryRequirementsInfo2 requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.image = image;
+    VkMemoryDedicatedRequirements dedicatedRequirements{};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements2{};
+    requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements2.pNext = &dedicatedRequirements;
+    vkGetImageMemoryRequirements2(_settings.device, &requirementsInfo, &requirements2);
+
+    *requirements = requirements2.memoryRequirements;
+    return dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i=0; i<_memoryProperties.memoryTypeCount; ++i) {
+        if ((typeFilter & (1 << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            return i;
+    }
+
+    throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(
+    VkDeviceSize size,
+    uint32_t memoryType,
+    void** mapped,
+    const VkMemoryDedicatedAllocateInfo* dedicatedInfo
+) {
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = dedicatedInfo;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(_settings.device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate device memory!");
+
+    *mapped = nullptr;
+    if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(_settings.device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            vkFreeMemory(_settings.device, memory, nullptr);
+            throw std::runtime_error("Failed to map device memory!");
+        }
+    }
+
+    return memory;
+}
+
+
+void gu2::createBuffer(
+    MemoryAllocator* allocator,
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkBuffer* buffer,
+    MemoryAllocation* allocation,
+    MemoryStrategy strategy
+) {
+    if (allocator != nullptr) {
+        allocator->createBuffer(size, usage, properties, buffer, allocation, strategy);
+        return;
+    }
+
+    *allocation = MemoryAllocation();
+    createBuffer(physicalDevice, device, size, usage, properties, *buffer, allocation->memory);
+    allocation->size = size;
+    if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        vkMapMemory(device, allocation->memory, 0, VK_WHOLE_SIZE, 0, &allocation->mapped);
+}
+
+void gu2::createImage(
+    MemoryAllocator* allocator,
+    VkPhysicalDevice physicalDevice,
+    VkDevice device,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mipLevels,
+    VkFormat format,
+    VkImageTiling tiling,
+    VkImageUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkImage* image,
+    MemoryAllocation* allocation,
+    MemoryStrategy strategy
+) {
+    if (allocator != nullptr) {
+        allocator->createImage(width, height, mipLevels, format, tiling, usage, properties, image, allocation,
+            strategy);
+        return;
+    }
+
+    *allocation = MemoryAllocation();
+    createImage(physicalDevice, device, width, height, mipLevels, format, tiling, usage, properties, *image,
+        allocation->memory);
+    if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        vkMapMemory(device, allocation->memory, 0, VK_WHOLE_SIZE, 0, &allocation->mapped);
+}
+
+void gu2::destroyBuffer(MemoryAllocator* allocator, VkDevice device, VkBuffer* buffer, MemoryAllocation* allocation)
+{
+    if (allocator != nullptr) {
+        allocator->destroyBuffer(buffer, allocation);
+        return;
+    }
+
+    if (*buffer != VK_NULL_HANDLE)
+        vkDestroyBuffer(device, *buffer, nullptr);
+    if (allocation->memory != VK_NULL_HANDLE)
+        vkFreeMemory(device, allocation->memory, nullptr);
+    *buffer = VK_NULL_HANDLE;
+    *allocation = MemoryAllocation();
+}
+
+void gu2::destroyImage(MemoryAllocator* allocator, VkDevice device, VkImage* image, MemoryAllocation* allocation)
+{
+    if (allocator != nullptr) {
+        allocator->destroyImage(image, allocation);
+        return;
+    }
+
+    if (*image != VK_NULL_HANDLE)
+        vkDestroyImage(device, *image, nullptr);
+    if (allocation->memory != VK_NULL_HANDLE)
+        vkFreeMemory(device, allocation->memory, nullptr);
+    *image = VK_NULL_HANDLE;
+    *allocation = MemoryAllocation();
+}
@@ -16,12 +16,55 @@
 using namespace gu2;
 
 
+namespace {
+
+struct SpecializationInfo {
+    std::vector<VkSpecializationMapEntry>   mapEntries;
+    std::vector<uint32_t>                   data;
+    VkSpecializationInfo                    info;
+
+    // Returns nullptr in case there are no constants to specialize
+    const VkSpecializationInfo* create(const SpecializationConstants& specializationConstants)
+    {
+        if (specializationConstants.empty())
+            return nullptr;
+
+        mapEntries.clear();
+        data.clear();
+        for (const auto& specializationConstant : specializationConstants) {
+            mapEntries.push_back(VkSpecializationMapEntry{
+                .constantID = specializationConstant.constantId,
+                .offset = static_cast<uint32_t>(data.size() * sizeof(uint32_t)),
+                .size = sizeof(uint32_t)
+            });
+            data.push_back(specializationConstant.value);
+        }
+
+        info.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+        info.pMapEntries = mapEntries.data();
+        info.dataSize = data.size() * sizeof(uint32_t);
+        info.pData = data.data();
+        return &info;
+    }
+};
+
+} // namespace
+
+
 Pipeline::Pipeline(PipelineSettings settings) :
     _settings           (std::move(settings)),
     _pipelineLayout     (nullptr),
     _graphicsPipeline   (nullptr)
 {
-    createGraphicsPipeline();
+    createGraphicsPipeline(_settings.pipelineCache);
+}
+
+Pipeline::Pipeline(PipelineSettings settings, VkPipelineCache creationCache) :
+    _settings           (std::move(settings)),
+    _pipelineLayout     (nullptr),
+    _graphicsPipeline   (nullptr)
+{
+    createGraphicsPipeline(creationCache);
 }
 
 Pipeline::~Pipeline()
@@ -37,19 +80,23 @@ void Pipeline::bind(VkCommandBuffer commandBuffer) const
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
 }
 
-void Pipeline::createGraphicsPipeline()
+void Pipeline::createGraphicsPipeline(VkPipelineCache pipelineCache)
 {
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
     vertShaderStageInfo.module = _settings.vertShaderModule;
     vertShaderStageInfo.pName = "main";
+    SpecializationInfo vertSpecializationInfo;
+    vertShaderStageInfo.pSpecializationInfo = vertSpecializationInfo.create(_settings.vertSpecializationConstants);
 
     VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
     fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     fragShaderStageInfo.module = _settings.fragShaderModule;
     fragShaderStageInfo.pName = "main";
+    SpecializationInfo fragSpecializationInfo;
+    fragShaderStageInfo.pSpecializationInfo = fragSpecializationInfo.create(_settings.fragSpecializationConstants);
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
@@ -181,7 +228,7 @@ void Pipeline::createGraphicsPipeline()
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    if (vkCreateGraphicsPipelines(_settings.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(_settings.device, pipelineCache, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create graphics pipeline!");
     }
 }
@@ -0,0 +1,158 @@
+//
+// Project: GraphicsUtils2
+// File: PipelineCache.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "PipelineCache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr uint32_t pipelineCacheMagic {0x43503247}; // "G2PC"
+constexpr uint32_t pipelineCacheVersion {1};
+
+} // namespace
+
+
+PipelineCache::PipelineCache(PipelineCacheSettings settings) :
+    _settings       (std::move(settings)),
+    _pipelineCache  (VK_NULL_HANDLE),
+    _loaded         (false)
+{
+    vkGetPhysicalDeviceProperties(_settings.physicalDevice, &_properties);
+
+    // Data of a mismatching file is discarded, the driver would reject it anyway
+    std::vector<char> data = readFile();
+    _loaded = !data.empty();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.data();
+    if (vkCreatePipelineCache(_settings.device, &cacheInfo, nullptr, &_pipelineCache) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create pipeline cache!");
+}
+
+PipelineCache::~PipelineCache()
+{
+    if (_pipelineCache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(_settings.device, _pipelineCache, nullptr);
+}
+
+VkPipelineCache PipelineCache::createThreadCache() const
+{
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    VkPipelineCache threadCache;
+    if (vkCreatePipelineCache(_settings.device, &cacheInfo, nullptr, &threadCache) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create pipeline cache!");
+    return threadCache;
+}
+
+void PipelineCache::mergeThreadCaches(const std::vector<VkPipelineCache>& threadCaches)
+{
+    if (threadCaches.empty())
+        return;
+
+    VkResult result;
+    {
+        std::unique_lock<std::shared_mutex> lock(_mutex);
+        result = vkMergePipelineCaches(_settings.device, _pipelineCache, static_cast<uint32_t>(threadCaches.size()),
+            threadCaches.data());
+    }
+    for (auto threadCache : threadCaches)
+        vkDestroyPipelineCache(_settings.device, threadCache, nullptr);
+
+    if (result != VK_SUCCESS)
+        throw std::runtime_error("Failed to merge pipeline caches!");
+}
+
+void PipelineCache::save()
+{
+    if (_settings.filename.empty())
+        return;
+
+    std::lock_guard<std::mutex> saveLock(_saveMutex);
+
+    // Size of the data may change between the calls in case pipelines are being created
+    std::vector<char> data;
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        VkResult result;
+        do {
+            size_t dataSize = 0;
+            if (vkGetPipelineCacheData(_settings.device, _pipelineCache, &dataSize, nullptr) != VK_SUCCESS)
+                throw std::runtime_error("Failed to get pipeline cache data!");
+            data.resize(dataSize);
+            result = vkGetPipelineCacheData(_settings.device, _pipelineCache, &dataSize, data.data());
+            data.resize(dataSize);
+        } while (result == VK_INCOMPLETE);
+        if (result != VK_SUCCESS)
+            throw std::runtime_error("Failed to get pipeline cache data!");
+    }
+
+    // Write to a temporary file first so that an interrupted write does not leave a truncated cache behind
+    FileHeader header = makeFileHeader(data.size());
+    Path tmpFilename = _settings.filename;
+    tmpFilename += ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("Unable to open file " + tmpFilename.string() + " for writing");
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+        if (!file)
+            throw std::runtime_error("Writing to " + tmpFilename.string() + " failed");
+    }
+    std::filesystem::rename(tmpFilename, _settings.filename);
+}
+
+std::vector<char> PipelineCache::readFile() const
+{
+    if (_settings.filename.empty() || !std::filesystem::is_regular_file(_settings.filename))
+        return {};
+
+    std::ifstream file(_settings.filename, std::ios::binary);
+    FileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader)))
+        return {};
+
+    FileHeader expectedHeader = makeFileHeader(header.dataSize);
+    if (memcmp(&header, &expectedHeader, sizeof(FileHeader)) != 0 ||
+        header.dataSize != std::filesystem::file_size(_settings.filename) - sizeof(FileHeader))
+        return {};
+
+    std::vector<char> data(header.dataSize);
+    if (!file.read(data.data(), static_cast<std::streamsize>(data.size())))
+        return {};
+    return data;
+}
+
+PipelineCache::FileHeader PipelineCache::makeFileHeader(uint64_t dataSize) const
+{
+    FileHeader header;
+    memset(&header, 0, sizeof(FileHeader)); // padding is compared as well
+    header.magic = pipelineCacheMagic;
+    header.version = pipelineCacheVersion;
+    header.vendorID = _properties.vendorID;
+    header.deviceID = _properties.deviceID;
+    header.driverVersion = _properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = dataSize;
+    return header;
+}
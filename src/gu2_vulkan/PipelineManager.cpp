@@ -9,12 +9,22 @@
 //
 
 #include "PipelineManager.hpp"
+#include "PipelineCache.hpp"
 #include "Shader.hpp"
+#include "gu2_util/Hash.hpp"
+#include "gu2_util/Parallel.hpp"
+
+#include <mutex>
 
 
 using namespace gu2;
 
 
+PipelineManager::PipelineManager(PipelineCache* pipelineCache) :
+    _pipelineCache  (pipelineCache)
+{
+}
+
 void PipelineManager::setDefaultPipelineSettings(const PipelineSettings& defaultPipelineSettings)
 {
     _defaultPipelineSettings = defaultPipelineSettings;
@@ -24,44 +34,153 @@ Pipeline* PipelineManager::getPipeline(
     const Shader* vertexShader,
     const Shader* fragmentShader,
     const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts,
-    const VkPipelineVertexInputStateCreateInfo& vertexInputInfo
+    const VkPipelineVertexInputStateCreateInfo& vertexInputInfo,
+    const SpecializationConstants& vertSpecializationConstants,
+    const SpecializationConstants& fragSpecializationConstants
 ) {
-    auto key = std::make_pair(vertexShader, fragmentShader);
+    PipelineKey key{vertexShader, fragmentShader, vertSpecializationConstants, fragSpecializationConstants};
     auto pipelineIter = _pipelines.find(key);
     if (pipelineIter == _pipelines.end()) { // no such pipeline, make a new one
         PipelineSettings newSettings = _defaultPipelineSettings;
         newSettings.vertexInputInfo = vertexInputInfo;
-        newSettings.vertShaderModule = vertexShader->getShaderModule();
-        newSettings.fragShaderModule = fragmentShader->getShaderModule();
-        for (const auto& descriptorSetLayout : descriptorSetLayouts)
-            newSettings.descriptorSetLayouts.emplace_back(descriptorSetLayout);
-
-        auto [newPipelineIter, _] = _pipelines.emplace(key, newSettings);
-
-        return &newPipelineIter->second;
+        newSettings = makePipelineSettings(std::move(newSettings), key, descriptorSetLayouts);
+        return createPipeline(std::move(key), std::move(newSettings));
     }
 
-    return &pipelineIter->second;
+    return pipelineIter->second.get();
 }
 
 Pipeline* PipelineManager::getPipeline(
     gu2::PipelineSettings pipelineSettings,
     const Shader* vertexShader,
     const Shader* fragmentShader,
-    const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts
+    const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts,
+    const SpecializationConstants& vertSpecializationConstants,
+    const SpecializationConstants& fragSpecializationConstants
 ) {
-    auto key = std::make_pair(vertexShader, fragmentShader);
+    PipelineKey key{vertexShader, fragmentShader, vertSpecializationConstants, fragSpecializationConstants};
     auto pipelineIter = _pipelines.find(key);
     if (pipelineIter == _pipelines.end()) { // no such pipeline, make a new one
-        pipelineSettings.vertShaderModule = vertexShader->getShaderModule();
-        pipelineSettings.fragShaderModule = fragmentShader->getShaderModule();
-        for (const auto& descriptorSetLayout : descriptorSetLayouts)
-            pipelineSettings.descriptorSetLayouts.emplace_back(descriptorSetLayout);
+        pipelineSettings = makePipelineSettings(std::move(pipelineSettings), key, descriptorSetLayouts);
+        return createPipeline(std::move(key), std::move(pipelineSettings));
+    }
+
+    return pipelineIter->second.get();
+}
 
-        auto [newPipelineIter, _] = _pipelines.emplace(key, pipelineSettings);
+std::vector<Pipeline*> PipelineManager::getPipelines(const std::vector<PipelineRequest>& requests)
+{
+    // Missing pipelines, requests with equal keys share the pipeline
+    std::vector<Pipeline*> pipelines(requests.size(), nullptr);
+    std::unordered_map<PipelineKey, size_t, PipelineKeyHash> newPipelineIds;
+    std::vector<std::pair<PipelineKey, PipelineSettings>> newPipelines;
+    std::vector<size_t> requestNewPipelines(requests.size());
+    for (size_t i=0; i<requests.size(); ++i) {
+        const auto& request = requests[i];
+        PipelineKey key{request.vertexShader, request.fragmentShader, request.vertSpecializationConstants,
+            request.fragSpecializationConstants};
+        auto pipelineIter = _pipelines.find(key);
+        if (pipelineIter != _pipelines.end()) {
+            pipelines[i] = pipelineIter->second.get();
+            continue;
+        }
 
-        return &newPipelineIter->second;
+        auto [newPipelineIter, first] = newPipelineIds.try_emplace(key, newPipelines.size());
+        requestNewPipelines[i] = newPipelineIter->second;
+        if (first) {
+            PipelineSettings newSettings = _defaultPipelineSettings;
+            newSettings.vertexInputInfo = request.vertexInputInfo;
+            newSettings = makePipelineSettings(std::move(newSettings), key, request.descriptorSetLayouts);
+            newPipelines.emplace_back(std::move(key), std::move(newSettings));
+        }
     }
+    if (newPipelines.empty())
+        return pipelines;
 
-    return &pipelineIter->second;
+    // Threads create the pipelines with caches of their own, the shared cache is only locked for the merge
+    std::vector<std::unique_ptr<Pipeline>> createdPipelines(newPipelines.size());
+    std::vector<VkPipelineCache> threadCaches;
+    std::mutex threadCachesMutex;
+    int64_t nNewPipelines = static_cast<int64_t>(newPipelines.size());
+    ExceptionGuard exceptionGuard;
+    #pragma omp parallel
+    {
+        VkPipelineCache threadCache = VK_NULL_HANDLE;
+        if (_pipelineCache != nullptr) {
+            exceptionGuard.run([&]() {
+                threadCache = _pipelineCache->createThreadCache();
+                std::lock_guard<std::mutex> lock(threadCachesMutex);
+                threadCaches.push_back(threadCache);
+            });
+        }
+
+        #pragma omp for schedule(dynamic)
+        for (int64_t i=0; i<nNewPipelines; ++i) {
+            exceptionGuard.run([&]() {
+                createdPipelines[i] = std::make_unique<Pipeline>(newPipelines[i].second, threadCache);
+            });
+        }
+    }
+    if (_pipelineCache != nullptr) { // the merge destroys the thread caches, so it's done in case of errors as well
+        try {
+            _pipelineCache->mergeThreadCaches(threadCaches);
+        }
+        catch (...) {
+            exceptionGuard.rethrow(); // errors of the pipeline creation take precedence
+            throw;
+        }
+    }
+    exceptionGuard.rethrow();
+
+    for (size_t i=0; i<requests.size(); ++i) {
+        if (pipelines[i] == nullptr)
+            pipelines[i] = createdPipelines[requestNewPipelines[i]].get();
+    }
+    for (int64_t i=0; i<nNewPipelines; ++i)
+        _pipelines.emplace(std::move(newPipelines[i].first), std::move(createdPipelines[i]));
+    return pipelines;
+}
+
+Pipeline* PipelineManager::createPipeline(PipelineKey&& key, PipelineSettings&& pipelineSettings)
+{
+    std::unique_ptr<Pipeline> pipeline;
+    if (_pipelineCache != nullptr) {
+        auto lock = _pipelineCache->lockShared();
+        pipeline = std::make_unique<Pipeline>(std::move(pipelineSettings));
+    }
+    else
+        pipeline = std::make_unique<Pipeline>(std::move(pipelineSettings));
+
+    auto [pipelineIter, _] = _pipelines.emplace(std::move(key), std::move(pipeline));
+    return pipelineIter->second.get();
+}
+
+PipelineSettings PipelineManager::makePipelineSettings(
+    PipelineSettings pipelineSettings,
+    const PipelineKey& key,
+    const std::vector<DescriptorSetLayoutHandle>& descriptorSetLayouts
+) const {
+    if (_pipelineCache != nullptr)
+        pipelineSettings.pipelineCache = _pipelineCache->getPipelineCache();
+    pipelineSettings.vertShaderModule = key.vertexShader->getShaderModule();
+    pipelineSettings.fragShaderModule = key.fragmentShader->getShaderModule();
+    pipelineSettings.vertSpecializationConstants = key.vertSpecializationConstants;
+    pipelineSettings.fragSpecializationConstants = key.fragSpecializationConstants;
+    for (const auto& descriptorSetLayout : descriptorSetLayouts)
+        pipelineSettings.descriptorSetLayouts.emplace_back(descriptorSetLayout);
+    return pipelineSettings;
+}
+
+size_t PipelineManager::PipelineKeyHash::operator()(const PipelineKey& key) const noexcept
+{
+    uint64_t hash = hashCombine(std::hash<const Shader*>{}(key.vertexShader),
+        std::hash<const Shader*>{}(key.fragmentShader));
+    for (const auto* specializationConstants : {&key.vertSpecializationConstants, &key.fragSpecializationConstants}) {
+        hash = hashCombine(hash, specializationConstants->size());
+        for (const auto& specializationConstant : *specializationConstants) {
+            hash = hashCombine(hash, (uint64_t(specializationConstant.constantId) << 32) |
+                specializationConstant.value);
+        }
+    }
+    return static_cast<size_t>(hash);
 }
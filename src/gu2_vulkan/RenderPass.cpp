@@ -21,6 +21,8 @@ using namespace gu2;
 RenderPass::RenderPass(RenderPassSettings settings) noexcept :
     _settings                       (std::move(settings)),
     _addLayoutTransitionDependency  (true),
+    _subpassContents                (VK_SUBPASS_CONTENTS_INLINE),
+    _framebuffer                    (VK_NULL_HANDLE),
     _outputExtent                   {0,0},
     _nSwapChainImages               (0),
     _renderPass                     (VK_NULL_HANDLE),
@@ -277,18 +279,48 @@ void RenderPass::render(VkCommandBuffer commandBuffer, uint64_t currentFrame, ui
 {
     _commandBuffer = commandBuffer;
     _currentFrame = currentFrame;
+    _framebuffer = _framebuffers[swapChainImageId];
 
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = _renderPass;
-    renderPassInfo.framebuffer = _framebuffers[swapChainImageId];
+    renderPassInfo.framebuffer = _framebuffer;
     renderPassInfo.renderArea.offset = {0, 0};
     renderPassInfo.renderArea.extent = _outputExtent;
     renderPassInfo.clearValueCount = static_cast<uint32_t>(_clearValues.size());
     renderPassInfo.pClearValues = _clearValues.data();
 
-    vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, _subpassContents);
 
+    // Dynamic state is not inherited by secondary command buffers, see beginSecondaryCommandBuffer
+    if (_subpassContents == VK_SUBPASS_CONTENTS_INLINE)
+        setViewportAndScissor(_commandBuffer);
+
+    render();
+
+    vkCmdEndRenderPass(_commandBuffer);
+}
+
+void RenderPass::beginSecondaryCommandBuffer(VkCommandBuffer commandBuffer) const
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = _renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = _framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        throw std::runtime_error("Failed to begin recording secondary command buffer!");
+
+    setViewportAndScissor(commandBuffer);
+}
+
+void RenderPass::setViewportAndScissor(VkCommandBuffer commandBuffer) const
+{
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
@@ -296,14 +328,10 @@ void RenderPass::render(VkCommandBuffer commandBuffer, uint64_t currentFrame, ui
     viewport.height = static_cast<float>(_outputExtent.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(_commandBuffer, 0, 1, &viewport);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
     scissor.extent = _outputExtent;
-    vkCmdSetScissor(_commandBuffer, 0, 1, &scissor);
-
-    render();
-
-    vkCmdEndRenderPass(_commandBuffer);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
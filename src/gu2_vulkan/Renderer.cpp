@@ -23,20 +23,50 @@ using namespace gu2;
 
 Renderer::Renderer(RendererSettings settings) :
     _settings           (settings),
-    _depthTexture       ({_settings.physicalDevice, _settings.device}),
-    _baseColorTexture   ({_settings.physicalDevice, _settings.device}),
-    _normalTexture      ({_settings.physicalDevice, _settings.device}),
+    _depthTexture       ({_settings.physicalDevice, _settings.device, _settings.memoryAllocator}),
+    _baseColorTexture   ({_settings.physicalDevice, _settings.device, _settings.memoryAllocator}),
+    _normalTexture      ({_settings.physicalDevice, _settings.device, _settings.memoryAllocator}),
     _framebufferResized (false),
     _currentFrame       (0),
-    _geometryPass       ({_settings.device}),
+    _frameAllocator     ({
+        .physicalDevice = _settings.physicalDevice,
+        .device = _settings.device,
+        .memoryAllocator = _settings.memoryAllocator,
+        .framesInFlight = static_cast<uint32_t>(_settings.vulkanSettings->framesInFlight),
+        // Instance transforms and at most one indirect draw per instance, 1 MiB for the uniforms
+        .frameSize = (sizeof(InstanceTransform) + sizeof(VkDrawIndexedIndirectCommand))*_settings.maxInstances +
+            (1 << 20)
+    }),
+    _geometryPass       ({_settings.device}, _settings.descriptorManager, &_frameAllocator, _settings.maxInstances,
+                         _settings.vulkanSettings->framesInFlight),
     _compositePass      ({_settings.device}, _settings.physicalDevice, _settings.descriptorManager,
                          _settings.pipelineManager, _settings.vulkanSettings->framesInFlight)
 {
     // Store the device properties in local struct
     vkGetPhysicalDeviceProperties(_settings.physicalDevice, &_physicalDeviceProperties);
 
+    if (_settings.gpuCulling) {
+        _gpuCulling = std::make_unique<GpuCulling>(GpuCullingSettings{_settings.physicalDevice, _settings.device,
+            _settings.descriptorManager, _settings.memoryAllocator, _settings.vulkanSettings->framesInFlight});
+        _geometryPass.setGpuCulling(_gpuCulling.get());
+    }
+    _geometryPass.setMultiDrawIndirect(_settings.multiDrawIndirect);
+
     createCommandPool();
     createCommandBuffers();
+    auto queueFamilyIndices = findQueueFamilies(_settings.physicalDevice, _settings.surface);
+    if (_settings.recordingThreads > 0)
+        _geometryPass.setParallelRecording(queueFamilyIndices.graphicsFamily.value(), _settings.recordingThreads);
+    _uploadContext = std::make_unique<UploadContext>(UploadContextSettings{
+        .physicalDevice = _settings.physicalDevice,
+        .device = _settings.device,
+        .memoryAllocator = _settings.memoryAllocator,
+        .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(),
+        .queue = _settings.graphicsQueue,
+        .transferQueueFamilyIndex = queueFamilyIndices.transferFamily.value_or(0),
+        .transferQueue = queueFamilyIndices.transferFamily.has_value() ? _settings.transferQueue : nullptr,
+        .timelineSemaphore = _settings.timelineSemaphore
+    });
     createSwapChain();
     createSyncObjects();
 }
@@ -83,16 +113,20 @@ void Renderer::createCommandBuffers()
 
 void Renderer::createDepthResources()
 {
+    // GPU culling samples the depth for the depth pyramid
     auto depthFormat = findDepthFormat(_settings.physicalDevice);
     _depthTexture.create(TextureProperties{
         .width = _swapChainExtent.width,
         .height = _swapChainExtent.height,
         .format = depthFormat,
         .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+            (_gpuCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : VkImageUsageFlags(0)),
         .memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         .aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT
     });
+    if (_gpuCulling)
+        _gpuCulling->setDepthTexture(_depthTexture);
 }
 
 void Renderer::createGBufferResources()
@@ -229,7 +263,7 @@ void Renderer::createCompositePass()
     _compositePass.setInputAttachment(1, _normalTexture);
     for (size_t i=0; i<_swapChainObjects.size(); ++i)
         _compositePass.setOutputAttachment(0, _swapChainObjects[i].image, _swapChainImageFormat, i);
-    _compositePass.createQuad(_commandPool, _settings.graphicsQueue);
+    _compositePass.createQuad(_uploadContext.get());
     _compositePass.build();
 }
 
@@ -284,19 +318,32 @@ bool Renderer::render(const Scene& scene, VkQueue presentQueue)
         throw std::runtime_error("Failed to begin recording command buffer!");
     }
 
+    // Allocations of the previous use of the frame slot are no longer in use
+    _frameAllocator.beginFrame(_currentFrame);
+
     // Render passes
     _geometryPass.setScene(scene);
+    _geometryPass.beginFrame(_currentFrame);
+    if (_gpuCulling)
+        _geometryPass.cullOnGpu(commandBuffer, _currentFrame);
     transitionGBufferImageToAttachment(_baseColorTexture, commandBuffer);
     transitionGBufferImageToAttachment(_normalTexture, commandBuffer);
     dynamic_cast<RenderPass*>(&_geometryPass)->render(commandBuffer, _currentFrame, 0);
     transitionGBufferImageToRead(_baseColorTexture, commandBuffer);
     transitionGBufferImageToRead(_normalTexture, commandBuffer);
+    if (_gpuCulling) {
+        transitionDepthImageToRead(_depthTexture, commandBuffer);
+        _gpuCulling->buildDepthPyramid(commandBuffer);
+    }
     dynamic_cast<RenderPass*>(&_compositePass)->render(commandBuffer, _currentFrame, swapChainImageId);
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("Failed to record command buffer!");
     }
 
+    // Pending uploads go first in the queue, the barrier at the end of the upload batch makes them visible
+    _uploadContext->submit();
+
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -398,3 +445,32 @@ void Renderer::transitionGBufferImageToRead(const Texture& texture, VkCommandBuf
         1, &barrier
     );
 }
+
+void Renderer::transitionDepthImageToRead(const Texture& texture, VkCommandBuffer commandBuffer)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = texture.getImage();
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (hasStencilComponent(texture.getProperties().format))
+        barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier
+    );
+}
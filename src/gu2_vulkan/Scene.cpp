@@ -10,15 +10,53 @@
 
 #include "Scene.hpp"
 #include "Mesh.hpp"
+#include "gu2_util/BakedScene.hpp"
 #include "gu2_util/GLTFLoader.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
 
 using namespace gu2;
 
 
+namespace {
+
+// Meshes with more triangles in their coarsest LOD are not used as occluders
+constexpr uint32_t  maxOccluderTriangles    {1024};
+
+template <typename T_Index>
+void createOccluder(const T_Index* indices, uint32_t nIndices, const Vec3f* positions, Scene::Occluder* occluder)
+{
+    // Only the vertices referenced by the LOD are retained
+    std::unordered_map<uint32_t, uint32_t> vertexMap;
+    occluder->indices.resize(nIndices);
+    for (uint32_t i=0; i<nIndices; ++i) {
+        auto [vertex, inserted] = vertexMap.try_emplace(indices[i], static_cast<uint32_t>(vertexMap.size()));
+        if (inserted)
+            occluder->positions.push_back(positions[indices[i]]);
+        occluder->indices[i] = vertex->second;
+    }
+}
+
+} // namespace
+
+
+Vec3f Scene::Camera::getPosition() const
+{
+    return -view.block<3,3>(0,0).transpose() * view.block<3,1>(0,3);
+}
+
 void Scene::createFromGLFT(const GLTFLoader& gltfLoader, std::vector<Mesh>& meshes)
 {
     nodes.clear();
+    lods.clear();
+    transforms.clear();
+    occluders.clear();
 
     const auto& gltfScenes = gltfLoader.getScenes();
     const auto& gltfNodes = gltfLoader.getNodes();
@@ -27,27 +65,284 @@ void Scene::createFromGLFT(const GLTFLoader& gltfLoader, std::vector<Mesh>& mesh
     for (const auto& gltfScene : gltfScenes) {
         for (const auto& gltfNodeId : gltfScene.nodes) {
             const auto& gltfNode = gltfNodes.at(gltfNodeId);
-            createNodes(Mat4d::Identity(), gltfNode, gltfNodes, gltfMeshes, meshes);
+            createNodes(TransformHierarchy::noParent, gltfNode, gltfNodes, gltfMeshes, gltfLoader, meshes);
+        }
+    }
+
+    transforms.update();
+    for (auto& node : nodes)
+        node.transformation = transforms.getWorldMatrix(node.transform);
+    createInstanceGroups();
+    updateBounds();
+}
+
+void Scene::createFromBakedScene(const BakedScene& bakedScene, std::vector<Mesh>& meshes)
+{
+    nodes.clear();
+
+    // Baked LODs are stored per primitive, their index ranges map directly to the mesh index buffers
+    const auto& bakedLods = bakedScene.getLods();
+    lods.clear();
+    lods.reserve(bakedLods.size());
+    for (const auto& bakedLod : bakedLods)
+        lods.push_back({bakedLod.firstIndex, bakedLod.nIndices, bakedLod.error});
+
+    // Baked nodes map one to one to the transform hierarchy, both have parents before their children
+    transforms.clear();
+    const auto& bakedPrimitives = bakedScene.getPrimitives();
+    std::vector<uint32_t> nodePrimitives;
+    for (const auto& bakedNode : bakedScene.getNodes()) {
+        uint32_t transform = transforms.addNode(
+            bakedNode.parent >= 0 ? static_cast<uint32_t>(bakedNode.parent) : TransformHierarchy::noParent,
+            Eigen::Map<const Vec3f>(bakedNode.translation.data()),
+            Eigen::Map<const Quatf>(bakedNode.rotation.data()),
+            Eigen::Map<const Vec3f>(bakedNode.scale.data()));
+        for (uint32_t primitiveId=bakedNode.firstPrimitive;
+            primitiveId<bakedNode.firstPrimitive+bakedNode.nPrimitives; ++primitiveId) {
+            const auto& bakedPrimitive = bakedPrimitives.at(primitiveId);
+            nodes.emplace_back(Mat4f::Identity(), transform, &meshes.at(primitiveId), bakedPrimitive.firstLod,
+                bakedPrimitive.nLods, bakedPrimitive.getBounds());
+            nodePrimitives.push_back(primitiveId);
         }
     }
+    transforms.update();
+    for (auto& node : nodes)
+        node.transformation = transforms.getWorldMatrix(node.transform);
+    createInstanceGroups();
+    createOccluders(bakedScene, nodePrimitives);
+
+    updateBounds();
+}
+
+void Scene::updateTransforms()
+{
+    transforms.update();
+    if (transforms.getChangedNodes().empty())
+        return;
+
+    changedNodes.clear();
+    for (uint32_t nodeId=0; nodeId<nodes.size(); ++nodeId) {
+        auto& node = nodes[nodeId];
+        if (!transforms.isChanged(node.transform))
+            continue;
+        node.transformation = transforms.getWorldMatrix(node.transform);
+        changedNodes.push_back(nodeId);
+    }
+    ++transformRevision;
+    updateBounds(changedNodes);
+}
+
+void Scene::createInstanceGroups()
+{
+    instanceGroupNodes.resize(nodes.size());
+    std::iota(instanceGroupNodes.begin(), instanceGroupNodes.end(), 0u);
+    std::stable_sort(instanceGroupNodes.begin(), instanceGroupNodes.end(),
+        [&](uint32_t a, uint32_t b) { return std::less<const Mesh*>()(nodes[a].mesh, nodes[b].mesh); });
+
+    instanceGroups.clear();
+    for (uint32_t i=0; i<instanceGroupNodes.size(); ++i) {
+        Mesh* mesh = nodes[instanceGroupNodes[i]].mesh;
+        if (instanceGroups.empty() || instanceGroups.back().mesh != mesh)
+            instanceGroups.push_back({mesh, i, 0});
+        ++instanceGroups.back().nNodes;
+        nodes[instanceGroupNodes[i]].instanceGroup = static_cast<uint32_t>(instanceGroups.size() - 1);
+    }
+    ++revision;
+}
+
+void Scene::updateBounds()
+{
+    nodeSpheres.resize(nodes.size());
+    for (uint32_t nodeId=0; nodeId<nodes.size(); ++nodeId)
+        updateNodeBounds(nodeId);
+
+    bvh = BVH();
+    if (!nodes.empty())
+        bvh.build(&nodes[0].worldBounds, nodes.size(), sizeof(Node));
+}
+
+void Scene::updateBounds(const std::vector<uint32_t>& changedNodes)
+{
+    for (auto nodeId : changedNodes)
+        updateNodeBounds(nodeId);
+
+    if (!nodes.empty())
+        bvh.refit(&nodes[0].worldBounds, changedNodes, sizeof(Node));
+}
+
+void Scene::cull(std::vector<uint32_t>* visibleNodes, CullingStats* stats) const
+{
+    cullSpheres(Frustum::fromViewProjection(camera.projection * camera.view), nodeSpheres, visibleNodes, stats);
+}
+
+void Scene::cullOccluded(OcclusionBuffer& buffer, std::vector<uint32_t>* visibleNodes, CullingStats* stats) const
+{
+    if (occluders.empty() || maxOccluders == 0)
+        return;
+
+    // The largest visible occluders on the screen, camera inside the bounds makes the node an occluder for sure
+    Vec3f cameraPosition = camera.getPosition();
+    std::vector<std::pair<float, uint32_t>> candidates;
+    for (auto nodeId : *visibleNodes) {
+        const auto& node = nodes[nodeId];
+        if (node.occluder == noOccluder)
+            continue;
+        float distance = (node.worldSphere.center - cameraPosition).norm();
+        float size = distance > node.worldSphere.radius ? node.worldSphere.radius / distance :
+            std::numeric_limits<float>::max();
+        if (size >= minOccluderSize)
+            candidates.emplace_back(size, nodeId);
+    }
+    if (candidates.empty())
+        return;
+
+    uint32_t nOccluders = std::min(maxOccluders, static_cast<uint32_t>(candidates.size()));
+    std::partial_sort(candidates.begin(), candidates.begin() + nOccluders, candidates.end(),
+        [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    buffer.clear(camera.projection * camera.view);
+    for (uint32_t i=0; i<nOccluders; ++i) {
+        const auto& node = nodes[candidates[i].second];
+        const auto& occluder = occluders[node.occluder];
+        buffer.addOccluder(node.transformation, occluder.positions.data(), occluder.positions.size(),
+            occluder.indices.data(), occluder.indices.size());
+    }
+    buffer.rasterize();
+
+    // Test the world bounds against the depth hierarchy, order of the remaining nodes is retained
+    int64_t nVisible = static_cast<int64_t>(visibleNodes->size());
+    std::vector<uint8_t> occluded(nVisible);
+    #pragma omp parallel for if (nVisible >= 1024)
+    for (int64_t i=0; i<nVisible; ++i)
+        occluded[i] = !buffer.isVisible(nodes[(*visibleNodes)[i]].worldBounds);
+
+    size_t nRemaining = 0;
+    for (int64_t i=0; i<nVisible; ++i) {
+        if (!occluded[i])
+            (*visibleNodes)[nRemaining++] = (*visibleNodes)[i];
+    }
+    visibleNodes->resize(nRemaining);
+
+    if (stats != nullptr) {
+        stats->nOccluders += nOccluders;
+        stats->nOccluded += nVisible - nRemaining;
+        stats->nVisible -= nVisible - nRemaining;
+    }
+}
+
+uint32_t Scene::selectLod(const Node& node, const Vec3f& cameraPosition) const
+{
+    if (node.nLods <= 1 || node.worldSphere.radius < 0.0f)
+        return node.firstLod;
+
+    float distance = (node.worldSphere.center - cameraPosition).norm() - node.worldSphere.radius;
+    if (distance <= 0.0f)
+        return node.firstLod;
+
+    // Pixels per world unit at the distance of the nearest point of the bounding sphere
+    float projectionScale = 0.5f * camera.viewportHeight * std::abs(camera.projection(1,1)) / distance;
+    float maxScale = node.transformation.block<3,3>(0,0).colwise().norm().maxCoeff();
+    float maxError = maxLodError / (projectionScale * maxScale);
+
+    uint32_t lodId = node.firstLod;
+    for (uint32_t i=1; i<node.nLods && lods[node.firstLod + i].error <= maxError; ++i)
+        lodId = node.firstLod + i;
+    return lodId;
 }
 
 void Scene::createNodes(
-    Mat4d transformation,
+    uint32_t parentTransform,
     const GLTFLoader::Node& gltfNode,
     const std::vector<GLTFLoader::Node>& gltfNodes,
     const std::vector<GLTFLoader::Mesh>& gltfMeshes,
+    const GLTFLoader& gltfLoader,
     std::vector<Mesh>& meshes
 ) {
-    transformation = (transformation * gltfNode.matrix).eval();
+    uint32_t transform = transforms.addNodeFromMatrix(parentTransform, gltfNode.matrix.cast<float>());
     if (gltfNode.mesh >= 0) {
+        std::vector<uint32_t> instanceTransforms;
+        for (const auto& instanceMatrix : gltfLoader.getInstanceMatrices(gltfNode))
+            instanceTransforms.push_back(transforms.addNodeFromMatrix(transform, instanceMatrix.cast<float>()));
+
         const auto& primitives = gltfMeshes.at(gltfNode.mesh).primitives;
-        for (const auto& primitive : primitives)
-            nodes.emplace_back(transformation.cast<float>(), &meshes.at(primitive.id));
-        return;
+        for (const auto& primitive : primitives) {
+            AABB localBounds;
+            for (const auto& attribute : primitive.attributes) {
+                if (attribute.name == "POSITION")
+                    localBounds = gltfLoader.getAccessorBounds(gltfLoader.getAccessors().at(attribute.accessorId));
+            }
+            auto& mesh = meshes.at(primitive.id);
+            uint32_t lodId = static_cast<uint32_t>(lods.size());
+            lods.push_back({0, mesh.getIndexCount(), 0.0f});
+
+            // EXT_mesh_gpu_instancing instances are children of the node in the transform hierarchy
+            if (instanceTransforms.empty())
+                nodes.emplace_back(Mat4f::Identity(), transform, &mesh, lodId, 1u, localBounds);
+            for (auto instanceTransform : instanceTransforms)
+                nodes.emplace_back(Mat4f::Identity(), instanceTransform, &mesh, lodId, 1u, localBounds);
+        }
     }
 
     for (const auto& childNodeId : gltfNode.children) {
-        createNodes(transformation, gltfNodes.at(childNodeId), gltfNodes, gltfMeshes, meshes);
+        createNodes(transform, gltfNodes.at(childNodeId), gltfNodes, gltfMeshes, gltfLoader, meshes);
+    }
+}
+
+void Scene::createOccluders(const BakedScene& bakedScene, const std::vector<uint32_t>& nodePrimitives)
+{
+    // Coarsest LOD of each primitive, simplification may move the surface slightly which is accepted
+    const auto& bakedPrimitives = bakedScene.getPrimitives();
+    const auto& bakedLods = bakedScene.getLods();
+    std::vector<uint32_t> primitiveOccluders(bakedPrimitives.size(), noOccluder);
+    occluders.clear();
+    for (size_t primitiveId=0; primitiveId<bakedPrimitives.size(); ++primitiveId) {
+        const auto& primitive = bakedPrimitives[primitiveId];
+        const auto* position = bakedScene.findAttribute(primitive, "POSITION");
+        if (primitive.nIndices == 0 || primitive.nLods == 0 || position == nullptr || position->nComponents != 3 ||
+            position->componentType != static_cast<uint32_t>(GLTFLoader::Accessor::ComponentType::FLOAT))
+            continue;
+
+        const auto& lod = bakedLods.at(primitive.firstLod + primitive.nLods - 1);
+        if (lod.nIndices / 3 > maxOccluderTriangles)
+            continue;
+
+        Occluder occluder;
+        const auto* positions = reinterpret_cast<const Vec3f*>(bakedScene.getAttributeData(*position));
+        const char* indexData = bakedScene.getIndexData(primitive);
+        switch (static_cast<GLTFLoader::Accessor::ComponentType>(primitive.indexComponentType)) {
+            case GLTFLoader::Accessor::ComponentType::UNSIGNED_SHORT:
+                createOccluder(reinterpret_cast<const uint16_t*>(indexData) + lod.firstIndex, lod.nIndices,
+                    positions, &occluder);
+                break;
+            case GLTFLoader::Accessor::ComponentType::UNSIGNED_INT:
+                createOccluder(reinterpret_cast<const uint32_t*>(indexData) + lod.firstIndex, lod.nIndices,
+                    positions, &occluder);
+                break;
+            default:
+                continue;
+        }
+        primitiveOccluders[primitiveId] = static_cast<uint32_t>(occluders.size());
+        occluders.push_back(std::move(occluder));
+    }
+
+    for (size_t nodeId=0; nodeId<nodes.size(); ++nodeId)
+        nodes[nodeId].occluder = primitiveOccluders.at(nodePrimitives.at(nodeId));
+}
+
+void Scene::updateNodeBounds(uint32_t nodeId)
+{
+    auto& node = nodes.at(nodeId);
+    node.worldBounds = node.localBounds.transformed(node.transformation);
+
+    // Transforming the local sphere gives a tighter fit than circumscribing the world space box
+    BoundingSphere localSphere = computeBoundingSphere(node.localBounds);
+    if (localSphere.radius < 0.0f) {
+        node.worldSphere = localSphere;
+    }
+    else {
+        float maxScale = node.transformation.block<3,3>(0,0).colwise().norm().maxCoeff();
+        node.worldSphere.center = (node.transformation * localSphere.center.homogeneous()).head<3>();
+        node.worldSphere.radius = localSphere.radius * maxScale;
     }
+    nodeSpheres.set(nodeId, node.worldSphere);
 }
@@ -10,6 +10,10 @@
 
 #include "Shader.hpp"
 #include "gu2_util/FileUtils.hpp"
+#include "gu2_util/Hash.hpp"
+#include "gu2_util/SpirvCache.hpp"
+
+#include <memory>
 
 
 #define GU2_SPIRV_REFLECT_QUERY(MODULE, VECTOR, REFLECT_FUNCTION)   \
@@ -26,14 +30,71 @@
 using namespace gu2;
 
 
-Shader::Shader(VkDevice device) :
+namespace {
+
+// Bump in case the compile options set by Shader change
+constexpr uint64_t spirvCacheKeyVersion {1};
+
+// Resolves the includes relative to the including file and records the files included
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface {
+public:
+    explicit ShaderIncluder(std::vector<Path>* includedFiles) :
+        _includedFiles  (includedFiles)
+    {
+    }
+
+    shaderc_include_result* GetInclude(const char* requestedSource, shaderc_include_type,
+        const char* requestingSource, size_t) override
+    {
+        auto* include = new Include;
+        Path filename = (Path(requestingSource).parent_path() / requestedSource).lexically_normal();
+        if (std::filesystem::is_regular_file(filename)) {
+            include->sourceName = filename.string();
+            include->content = readFile(filename);
+            _includedFiles->push_back(filename);
+        }
+        else {
+            // Empty source name signals a failed include, the content holds the error message
+            std::string error = "Unable to find include file " + filename.string();
+            include->content.assign(error.begin(), error.end());
+        }
+
+        include->result.source_name = include->sourceName.data();
+        include->result.source_name_length = include->sourceName.size();
+        include->result.content = include->content.data();
+        include->result.content_length = include->content.size();
+        include->result.user_data = include;
+        return &include->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result* data) override
+    {
+        delete static_cast<Include*>(data->user_data);
+    }
+
+private:
+    struct Include {
+        shaderc_include_result  result;
+        std::string             sourceName;
+        std::vector<char>       content;
+    };
+
+    std::vector<Path>*  _includedFiles;
+};
+
+} // namespace
+
+
+Shader::Shader(VkDevice device, SpirvCache* spirvCache) :
     _device         (device),
+    _spirvCache     (spirvCache),
     _shaderModule   (nullptr)
 {
 }
 
 Shader::Shader(Shader&& other) :
     _device             (other._device),
+    _spirvCache         (other._spirvCache),
     _macroDefinitions   (std::move(other._macroDefinitions)),
     _filename           (std::move(other._filename)),
     _spirv              (std::move(other._spirv)),
@@ -51,6 +112,7 @@ Shader& Shader::operator=(Shader&& other)
         return *this;
 
     _device = other._device;
+    _spirvCache = other._spirvCache;
     _macroDefinitions = std::move(other._macroDefinitions);
     _filename = std::move(other._filename);
     _spirv = std::move(other._spirv);
@@ -81,6 +143,17 @@ void Shader::loadFromFile(const Path& filename, ShaderType type, bool optimize)
 {
     auto source = readFile(filename);
 
+    // Warm cache skips the compiler altogether
+    uint64_t cacheKey = 0;
+    if (_spirvCache != nullptr) {
+        cacheKey = computeCacheKey(filename, source, type, optimize);
+        if (_spirvCache->find(cacheKey, &_spirv)) {
+            parseSpirvReflection();
+            _shaderModule = createShaderModule(_device, _spirv);
+            return;
+        }
+    }
+
     shaderc::Compiler compiler;
     shaderc::CompileOptions options;
 
@@ -90,6 +163,9 @@ void Shader::loadFromFile(const Path& filename, ShaderType type, bool optimize)
 
     if (optimize) options.SetOptimizationLevel(shaderc_optimization_level_size);
 
+    std::vector<Path> includedFiles;
+    options.SetIncluder(std::make_unique<ShaderIncluder>(&includedFiles));
+
     shaderc::CompilationResult result = compiler.CompileGlslToSpv(
         source.data(), source.size(), type, GU2_PATH_TO_STRING(filename), options);
 
@@ -101,6 +177,8 @@ void Shader::loadFromFile(const Path& filename, ShaderType type, bool optimize)
     }
 
     _spirv = { result.cbegin(), result.cend() };
+    if (_spirvCache != nullptr)
+        _spirvCache->store(cacheKey, includedFiles, _spirv);
     parseSpirvReflection();
     _shaderModule = createShaderModule(_device, _spirv);
 }
@@ -114,6 +192,15 @@ int64_t Shader::getInputVariableLayoutLocation(const std::string& inputVariableN
     return -1;
 }
 
+int64_t Shader::getSpecializationConstantId(const std::string& specializationConstantName) const noexcept
+{
+    for (const auto& specializationConstant : _specializationConstants) {
+        if (specializationConstant->name != nullptr && specializationConstant->name == specializationConstantName)
+            return specializationConstant->constant_id;
+    }
+    return -1;
+}
+
 VkShaderModule Shader::getShaderModule() const noexcept
 {
     return _shaderModule;
@@ -134,6 +221,27 @@ VkShaderModule Shader::createShaderModule(VkDevice device, const SpirvByteCode&
     return shaderModule;
 }
 
+uint64_t Shader::computeCacheKey(const Path& filename, const std::vector<char>& source, ShaderType type,
+    bool optimize) const
+{
+    // The includes are resolved relative to the file, so the directory affects the output as well
+    uint64_t key = hashBytes(source.data(), source.size(), spirvCacheKeyVersion);
+    key = hashCombine(key, hashString(filename.parent_path().lexically_normal().string()));
+    for (const auto& macro : _macroDefinitions) {
+        key = hashCombine(key, hashString(macro.first));
+        key = hashCombine(key, hashString(macro.second));
+    }
+    key = hashCombine(key, static_cast<uint64_t>(type));
+    key = hashCombine(key, optimize ? 1 : 0);
+
+    unsigned int spirvVersion = 0;
+    unsigned int spirvRevision = 0;
+    shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+    key = hashCombine(key, (static_cast<uint64_t>(spirvVersion) << 32) | spirvRevision);
+
+    return key;
+}
+
 void Shader::parseSpirvReflection()
 {
     // Generate reflection data for a shader
@@ -147,6 +255,8 @@ void Shader::parseSpirvReflection()
     GU2_SPIRV_REFLECT_QUERY(_reflectionModule, _descriptorBindings, spvReflectEnumerateDescriptorBindings)
     // Enumerate and extract shader's descriptor sets
     GU2_SPIRV_REFLECT_QUERY(_reflectionModule, _descriptorSets, spvReflectEnumerateDescriptorSets)
+    // Enumerate and extract shader's specialization constants
+    GU2_SPIRV_REFLECT_QUERY(_reflectionModule, _specializationConstants, spvReflectEnumerateSpecializationConstants)
 
     // Generate all necessary data structures to create VkDescriptorSetLayout for each descriptor set in this shader
     _descriptorSetLayouts.resize(_descriptorSets.size(), DescriptorSetLayoutInfo{});
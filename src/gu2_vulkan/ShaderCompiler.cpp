@@ -0,0 +1,94 @@
+//
+// Project: GraphicsUtils2
+// File: ShaderCompiler.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "ShaderCompiler.hpp"
+
+#include <exception>
+
+
+using namespace gu2;
+
+
+ShaderCompiler::ShaderCompiler(ShaderCompilerSettings settings) :
+    _settings   (std::move(settings))
+{
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+    wait();
+}
+
+std::vector<ShaderFuture> ShaderCompiler::compile(const std::vector<ShaderCompileRequest>& requests)
+{
+    std::vector<ShaderFuture> futures;
+    futures.reserve(requests.size());
+    std::vector<Variant*> batch;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto& request : requests) {
+            auto key = makeVariantKey(request);
+            auto futureIter = _variantFutures.find(key);
+            if (futureIter == _variantFutures.end()) { // new variant
+                auto& variant = _variants.emplace_back();
+                variant.request = request;
+                variant.shader = std::make_unique<Shader>(_settings.device, _settings.spirvCache);
+                futureIter = _variantFutures.emplace(std::move(key), variant.promise.get_future().share()).first;
+                batch.push_back(&variant);
+            }
+            futures.push_back(futureIter->second);
+        }
+
+        if (!batch.empty())
+            _batchThreads.emplace_back(&ShaderCompiler::compileBatch, std::move(batch));
+    }
+
+    return futures;
+}
+
+void ShaderCompiler::wait()
+{
+    std::vector<std::thread> batchThreads;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::swap(batchThreads, _batchThreads);
+    }
+    for (auto& batchThread : batchThreads)
+        batchThread.join();
+}
+
+std::string ShaderCompiler::makeVariantKey(const ShaderCompileRequest& request)
+{
+    // One field per line, macro definitions can't contain newlines
+    std::string key = request.filename.lexically_normal().string();
+    key += '\n' + std::to_string(static_cast<int>(request.type)) + (request.optimize ? "O" : "");
+    for (const auto& macro : request.macroDefinitions)
+        key += '\n' + macro.first + '=' + macro.second;
+    return key;
+}
+
+void ShaderCompiler::compileBatch(const std::vector<Variant*>& batch)
+{
+    // Compilation errors are passed to the futures
+    int64_t nVariants = static_cast<int64_t>(batch.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (int64_t i=0; i<nVariants; ++i) {
+        auto& variant = *batch[i];
+        try {
+            for (const auto& macro : variant.request.macroDefinitions)
+                variant.shader->addMacroDefinition(macro.first, macro.second);
+            variant.shader->loadFromFile(variant.request.filename, variant.request.type, variant.request.optimize);
+            variant.promise.set_value(variant.shader.get());
+        }
+        catch (...) {
+            variant.promise.set_exception(std::current_exception());
+        }
+    }
+}
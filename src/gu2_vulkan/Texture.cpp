@@ -9,6 +9,7 @@
 //
 
 #include "Texture.hpp"
+#include "UploadContext.hpp"
 #include "Util.hpp"
 #include "gu2_util/Image.hpp"
 
@@ -17,15 +18,15 @@ using namespace gu2;
 
 
 template<>
-void Texture::createFromImage<uint8_t>(VkCommandPool commandPool, VkQueue queue, const Image<uint8_t>& image);
+void Texture::createFromImage<uint8_t>(UploadContext* uploadContext, const Image<uint8_t>& image);
 
 
 Texture::Texture(TextureSettings settings) :
     _settings       (std::move(settings)),
     _image          (VK_NULL_HANDLE),
-    _imageMemory    (VK_NULL_HANDLE),
     _imageView      (VK_NULL_HANDLE),
-    _sampler        (VK_NULL_HANDLE)
+    _sampler        (VK_NULL_HANDLE),
+    _uploadBatch    (0)
 {
     // Store the device properties in local struct
     vkGetPhysicalDeviceProperties(_settings.physicalDevice, &_physicalDeviceProperties);
@@ -37,28 +38,19 @@ Texture::~Texture()
         vkDestroySampler(_settings.device, _sampler, nullptr);
     if (_imageView != VK_NULL_HANDLE)
         vkDestroyImageView(_settings.device, _imageView, nullptr);
-    if (_image != VK_NULL_HANDLE)
-        vkDestroyImage(_settings.device, _image, nullptr);
-    if (_imageMemory != VK_NULL_HANDLE)
-        vkFreeMemory(_settings.device, _imageMemory, nullptr);
+    gu2::destroyImage(_settings.memoryAllocator, _settings.device, &_image, &_imageAllocation);
 }
 
 void Texture::create(TextureProperties properties)
 {
     // Destroy potential previous image and image memory
-    if (_image != VK_NULL_HANDLE) {
-        vkDestroyImage(_settings.device, _image, nullptr);
-        _image = VK_NULL_HANDLE;
-    }
-    if (_imageMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(_settings.device, _imageMemory, nullptr);
-        _imageMemory = VK_NULL_HANDLE;
-    }
+    gu2::destroyImage(_settings.memoryAllocator, _settings.device, &_image, &_imageAllocation);
 
     _properties = std::move(properties);
 
-    gu2::createImage(_settings.physicalDevice, _settings.device, _properties.width, _properties.height, 1,
-        _properties.format, _properties.tiling, _properties.usage, _properties.memoryProperties, _image, _imageMemory);
+    gu2::createImage(_settings.memoryAllocator, _settings.physicalDevice, _settings.device, _properties.width,
+        _properties.height, 1, _properties.format, _properties.tiling, _properties.usage, _properties.memoryProperties,
+        &_image, &_imageAllocation);
 
     // Destroy potential previous image view
     if (_imageView != VK_NULL_HANDLE) {
@@ -69,7 +61,7 @@ void Texture::create(TextureProperties properties)
     _imageView = gu2::createImageView(_settings.device, _image, _properties.format, _properties.aspectFlags, 1);
 }
 
-void Texture::createFromFile(VkCommandPool commandPool, VkQueue queue, const Path& filename)
+void Texture::createFromFile(UploadContext* uploadContext, const Path& filename)
 {
 #if 1   // TODO temporary toggle to prevent expensive conversion
     Image<uint8_t> image;
@@ -78,57 +70,90 @@ void Texture::createFromFile(VkCommandPool commandPool, VkQueue queue, const Pat
     gu2::Image<uint8_t> image(512, 512);
 #endif
 
-    createFromImage(commandPool, queue, image);
+    createFromImage(uploadContext, image);
     createTextureImageView();
     createTextureSampler();
 }
 
 template<>
-void Texture::createFromImage<uint8_t>(VkCommandPool commandPool, VkQueue queue, const Image<uint8_t>& image)
+void Texture::createFromImage<uint8_t>(UploadContext* uploadContext, const Image<uint8_t>& image)
 {
     // Destroy potential previous image and image memory
-    if (_image != VK_NULL_HANDLE) {
-        vkDestroyImage(_settings.device, _image, nullptr);
-        _image = VK_NULL_HANDLE;
-    }
-    if (_imageMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(_settings.device, _imageMemory, nullptr);
-        _imageMemory = VK_NULL_HANDLE;
-    }
+    gu2::destroyImage(_settings.memoryAllocator, _settings.device, &_image, &_imageAllocation);
+
+    if (image.width() == 0 || image.height() == 0)
+        throw std::runtime_error("Unable to create a texture from an empty image");
 
     _imageMipLevels = std::floor(std::log2(std::max(image.width(), image.height()))) + 1;
     VkDeviceSize imageSize = image.nElements() * sizeof(uint8_t);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(_settings.physicalDevice, _settings.device, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(_settings.device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, image.data(), static_cast<size_t>(imageSize));
-    vkUnmapMemory(_settings.device, stagingBufferMemory);
-
-    #pragma omp critical
-    {
-        gu2::createImage(_settings.physicalDevice, _settings.device,
-            image.width(), image.height(), _imageMipLevels,
-            VK_FORMAT_R8G8B8A8_SRGB,
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _image, _imageMemory);
-
-        gu2::transitionImageLayout(_settings.device, commandPool, queue, _image, VK_FORMAT_R8G8B8A8_SRGB,
+    gu2::createImage(_settings.memoryAllocator, _settings.physicalDevice, _settings.device,
+        image.width(), image.height(), _imageMipLevels,
+        VK_FORMAT_R8G8B8A8_SRGB,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_image, &_imageAllocation);
+
+    using Staging = UploadContext::Staging;
+    _uploadBatch = uploadContext->record(imageSize, [&](VkCommandBuffer commandBuffer, const Staging& staging) {
+        memcpy(staging.data, image.data(), static_cast<size_t>(imageSize));
+        gu2::recordTransitionImageLayout(commandBuffer, _image, VK_FORMAT_R8G8B8A8_SRGB,
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _imageMipLevels);
-        gu2::copyBufferToImage(_settings.device, commandPool, queue, stagingBuffer, _image,
+        gu2::recordCopyBufferToImage(commandBuffer, staging.buffer, staging.offset, _image,
             static_cast<uint32_t>(image.width()), static_cast<uint32_t>(image.height()));
-        gu2::generateMipmaps(_settings.physicalDevice, _settings.device, commandPool, queue, _image,
-            VK_FORMAT_R8G8B8A8_SRGB, image.width(), image.height(), _imageMipLevels);
-    }
+        uploadContext->releaseImage(commandBuffer, _image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _imageMipLevels);
 
-    vkDestroyBuffer(_settings.device, stagingBuffer, nullptr);
-    vkFreeMemory(_settings.device, stagingBufferMemory, nullptr);
+        // Blits require a graphics queue, the mip levels get generated once the image has been acquired
+        uploadContext->recordOnGraphicsQueue(commandBuffer, [physicalDevice = _settings.physicalDevice,
+            textureImage = _image, width = image.width(), height = image.height(), mipLevels = _imageMipLevels](
+            VkCommandBuffer graphicsCommandBuffer) {
+            gu2::recordGenerateMipmaps(physicalDevice, graphicsCommandBuffer, textureImage,
+                VK_FORMAT_R8G8B8A8_SRGB, width, height, mipLevels);
+        });
+    }, std::max<VkDeviceSize>(16, _physicalDeviceProperties.limits.optimalBufferCopyOffsetAlignment));
+}
+
+void Texture::createFromMipChain(
+    UploadContext* uploadContext,
+    uint32_t width,
+    uint32_t height,
+    uint32_t mipLevels,
+    const uint8_t* data
+) {
+    // Destroy potential previous image and image memory
+    gu2::destroyImage(_settings.memoryAllocator, _settings.device, &_image, &_imageAllocation);
+
+    _imageMipLevels = mipLevels;
+    VkDeviceSize imageSize = 0;
+    for (uint32_t i=0, w=width, h=height; i<mipLevels; ++i, w=std::max(w/2, 1u), h=std::max(h/2, 1u))
+        imageSize += static_cast<VkDeviceSize>(w) * h * 4;
+
+    // Mip levels are already present, so no blits are required (and no TRANSFER_SRC usage)
+    gu2::createImage(_settings.memoryAllocator, _settings.physicalDevice, _settings.device,
+        width, height, _imageMipLevels,
+        VK_FORMAT_R8G8B8A8_SRGB,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_image, &_imageAllocation);
+
+    using Staging = UploadContext::Staging;
+    _uploadBatch = uploadContext->record(imageSize, [&](VkCommandBuffer commandBuffer, const Staging& staging) {
+        memcpy(staging.data, data, static_cast<size_t>(imageSize));
+        gu2::recordTransitionImageLayout(commandBuffer, _image, VK_FORMAT_R8G8B8A8_SRGB,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _imageMipLevels);
+        gu2::recordCopyBufferToImageMipChain(commandBuffer, staging.buffer, staging.offset, _image,
+            width, height, _imageMipLevels, 4);
+        uploadContext->releaseImage(commandBuffer, _image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _imageMipLevels);
+    }, std::max<VkDeviceSize>(16, _physicalDeviceProperties.limits.optimalBufferCopyOffsetAlignment));
+
+    createTextureImageView();
+    createTextureSampler();
 }
 
 void Texture::createTextureImageView()
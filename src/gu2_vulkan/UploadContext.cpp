@@ -0,0 +1,589 @@
+//
+// Project: GraphicsUtils2
+// File: UploadContext.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include "UploadContext.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+
+using namespace gu2;
+
+
+namespace {
+
+constexpr VkMemoryPropertyFlags stagingMemoryProperties {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+
+inline VkDeviceSize alignUp(VkDeviceSize offset, VkDeviceSize alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+VkCommandPool createCommandPool(VkDevice device, uint32_t queueFamilyIndex)
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+    VkCommandPool commandPool;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+        throw std::runtime_error("UploadContext: failed to create command pool");
+    return commandPool;
+}
+
+VkCommandBuffer allocateCommandBuffer(VkDevice device, VkCommandPool commandPool)
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+        throw std::runtime_error("UploadContext: failed to allocate command buffer");
+    return commandBuffer;
+}
+
+VkFence createFence(VkDevice device)
+{
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+        throw std::runtime_error("UploadContext: failed to create fence");
+    return fence;
+}
+
+VkSemaphore createTimelineSemaphore(VkDevice device)
+{
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+        throw std::runtime_error("UploadContext: failed to create timeline semaphore");
+    return semaphore;
+}
+
+void beginCommandBuffer(VkCommandBuffer commandBuffer)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        throw std::runtime_error("UploadContext: failed to begin command buffer");
+}
+
+} // namespace
+
+
+UploadContext::UploadContext(UploadContextSettings settings) :
+    _settings               (std::move(settings)),
+    _uploadQueue            (_settings.transferQueue != nullptr ? _settings.transferQueue : _settings.queue),
+    _commandPool            (VK_NULL_HANDLE),
+    _graphicsCommandPool    (VK_NULL_HANDLE),
+    _transferSemaphore      (VK_NULL_HANDLE),
+    _semaphore              (VK_NULL_HANDLE),
+    _stagingBuffer          (VK_NULL_HANDLE),
+    _stagingHead            (0),
+    _stagingUsed            (0),
+    _nextBatchId            (1),
+    _completedBatchId       (0)
+{
+    if (hasTransferQueue()) {
+        if (!_settings.timelineSemaphore)
+            throw std::runtime_error("UploadContext: the transfer queue requires timeline semaphores");
+        _commandPool = createCommandPool(_settings.device, _settings.transferQueueFamilyIndex);
+        _graphicsCommandPool = createCommandPool(_settings.device, _settings.queueFamilyIndex);
+        _transferSemaphore = createTimelineSemaphore(_settings.device);
+    }
+    else
+        _commandPool = createCommandPool(_settings.device, _settings.queueFamilyIndex);
+    if (_settings.timelineSemaphore)
+        _semaphore = createTimelineSemaphore(_settings.device);
+
+    gu2::createBuffer(_settings.memoryAllocator, _settings.physicalDevice, _settings.device, _settings.stagingSize,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingMemoryProperties, &_stagingBuffer, &_stagingAllocation);
+}
+
+UploadContext::~UploadContext()
+{
+    flush();
+
+    for (auto& batch : _freeBatches)
+        vkDestroyFence(_settings.device, batch.fence, nullptr);
+    if (_currentBatch.fence != VK_NULL_HANDLE)
+        vkDestroyFence(_settings.device, _currentBatch.fence, nullptr);
+    for (auto& acquire : _freeAcquires)
+        vkDestroyFence(_settings.device, acquire.fence, nullptr);
+    // Destroying the pools frees the command buffers
+    vkDestroyCommandPool(_settings.device, _commandPool, nullptr);
+    if (_graphicsCommandPool != VK_NULL_HANDLE)
+        vkDestroyCommandPool(_settings.device, _graphicsCommandPool, nullptr);
+    if (_transferSemaphore != VK_NULL_HANDLE)
+        vkDestroySemaphore(_settings.device, _transferSemaphore, nullptr);
+    if (_semaphore != VK_NULL_HANDLE)
+        vkDestroySemaphore(_settings.device, _semaphore, nullptr);
+    gu2::destroyBuffer(_settings.memoryAllocator, _settings.device, &_stagingBuffer, &_stagingAllocation);
+}
+
+bool UploadContext::isTimelineSemaphoreSupported(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_2)
+        return false;
+
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+    return features12.timelineSemaphore == VK_TRUE;
+}
+
+uint64_t UploadContext::record(
+    VkDeviceSize stagingSize,
+    const RecordFunction& recordFunction,
+    VkDeviceSize alignment
+) {
+    if (alignment == 0)
+        throw std::runtime_error("UploadContext: alignment must be nonzero");
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    retireBatches(false);
+
+    Staging staging {VK_NULL_HANDLE, 0, nullptr};
+    if (stagingSize > 0) {
+        if (stagingSize + alignment > _settings.stagingSize) {
+            // Too large for the ring, the buffer is destroyed once the batch has completed. The buffers of the
+            // batches are released in order, so they are allocated linearly.
+            MemoryAllocation allocation;
+            gu2::createBuffer(_settings.memoryAllocator, _settings.physicalDevice, _settings.device, stagingSize,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingMemoryProperties, &staging.buffer, &allocation,
+                MemoryStrategy::Linear);
+            staging.data = allocation.mapped;
+            _currentBatch.dedicatedBuffers.push_back(staging.buffer);
+            _currentBatch.dedicatedAllocations.push_back(allocation);
+        }
+        else {
+            staging.buffer = _stagingBuffer;
+            staging.offset = allocateStaging(stagingSize, alignment);
+            staging.data = static_cast<uint8_t*>(_stagingAllocation.mapped) + staging.offset;
+        }
+    }
+
+    if (_currentBatch.empty)
+        beginBatch();
+    recordFunction(_currentBatch.commandBuffer, staging);
+    uint64_t batchId = _currentBatch.id;
+
+    // The transfer queue is used by nobody else, so submit early to let the device work on the uploads while more
+    // are being recorded. This also lets the dedicated staging buffers be released sooner.
+    if (hasTransferQueue() &&
+        (_currentBatch.stagingBytes >= _settings.stagingSize / 4 || !_currentBatch.dedicatedBuffers.empty()))
+        submitBatch();
+
+    return batchId;
+}
+
+uint64_t UploadContext::record(const std::function<void(VkCommandBuffer commandBuffer)>& recordFunction)
+{
+    return record(0, [&](VkCommandBuffer commandBuffer, const Staging&) { recordFunction(commandBuffer); });
+}
+
+uint64_t UploadContext::copyToBuffer(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset)
+{
+    if (size == 0)
+        return 0;
+
+    return record(size, [&](VkCommandBuffer commandBuffer, const Staging& staging) {
+        memcpy(staging.data, data, static_cast<size_t>(size));
+        VkBufferCopy region{staging.offset, offset, size};
+        vkCmdCopyBuffer(commandBuffer, staging.buffer, buffer, 1, &region);
+        releaseBuffer(commandBuffer, buffer, offset, size);
+    });
+}
+
+void UploadContext::releaseBuffer(
+    VkCommandBuffer commandBuffer,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkDeviceSize size
+) {
+    // The barrier at the end of the batch covers the buffers on the graphics queue
+    if (!hasTransferQueue())
+        return;
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = _settings.transferQueueFamilyIndex;
+    barrier.dstQueueFamilyIndex = _settings.queueFamilyIndex;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr,
+        1, &barrier,
+        0, nullptr);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    _currentBatch.acquireBufferBarriers.push_back(barrier);
+}
+
+void UploadContext::releaseImage(
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    uint32_t mipLevels
+) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    if (!hasTransferQueue()) {
+        // Only the layout transition is needed
+        if (oldLayout == newLayout)
+            return;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+        return;
+    }
+
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = _settings.transferQueueFamilyIndex;
+    barrier.dstQueueFamilyIndex = _settings.queueFamilyIndex;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    _currentBatch.acquireImageBarriers.push_back(barrier);
+}
+
+void UploadContext::recordOnGraphicsQueue(VkCommandBuffer commandBuffer, GraphicsFunction graphicsFunction)
+{
+    if (hasTransferQueue())
+        _currentBatch.graphicsFunctions.push_back(std::move(graphicsFunction));
+    else
+        graphicsFunction(commandBuffer);
+}
+
+uint64_t UploadContext::submit()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    submitBatch();
+    retireBatches(false);
+    submitAcquires();
+    retireAcquires(false);
+    return _nextBatchId - 1; // the current batch is empty, so all the batches begun have been submitted
+}
+
+void UploadContext::wait(uint64_t batchId)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_currentBatch.empty && _currentBatch.id <= batchId)
+        submitBatch();
+    waitBatch(batchId);
+}
+
+void UploadContext::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    submitBatch();
+    waitBatch(_nextBatchId - 1);
+}
+
+bool UploadContext::isComplete(uint64_t batchId)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    retireBatches(false);
+    retireAcquires(false);
+    return _completedBatchId >= batchId;
+}
+
+void UploadContext::beginBatch()
+{
+    if (_currentBatch.commandBuffer == VK_NULL_HANDLE) {
+        if (!_freeBatches.empty()) {
+            _currentBatch.commandBuffer = _freeBatches.back().commandBuffer;
+            _currentBatch.fence = _freeBatches.back().fence;
+            _freeBatches.pop_back();
+        }
+        else {
+            _currentBatch.commandBuffer = allocateCommandBuffer(_settings.device, _commandPool);
+            _currentBatch.fence = createFence(_settings.device);
+        }
+    }
+
+    beginCommandBuffer(_currentBatch.commandBuffer);
+    _currentBatch.id = _nextBatchId++;
+    _currentBatch.empty = false;
+}
+
+void UploadContext::submitBatch()
+{
+    if (_currentBatch.empty)
+        return;
+
+    if (!hasTransferQueue()) {
+        // Make the transfer writes available to everything submitted after the batch
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        vkCmdPipelineBarrier(_currentBatch.commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            1, &barrier,
+            0, nullptr,
+            0, nullptr);
+    }
+
+    if (vkEndCommandBuffer(_currentBatch.commandBuffer) != VK_SUCCESS)
+        throw std::runtime_error("UploadContext: failed to end command buffer");
+
+    // The transfer queue signals the completion of the transfer, the graphics queue the completion of the batch
+    VkSemaphore signalSemaphore = hasTransferQueue() ? _transferSemaphore : _semaphore;
+    uint64_t signalValue = _currentBatch.id;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_currentBatch.commandBuffer;
+    if (signalSemaphore != VK_NULL_HANDLE) {
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
+    }
+    if (vkQueueSubmit(_uploadQueue, 1, &submitInfo, _currentBatch.fence) != VK_SUCCESS)
+        throw std::runtime_error("UploadContext: failed to submit batch");
+
+    _pendingBatches.push_back(std::move(_currentBatch));
+    _currentBatch = Batch{};
+}
+
+void UploadContext::retireBatches(bool wait)
+{
+    while (!_pendingBatches.empty()) {
+        auto& batch = _pendingBatches.front();
+        if (wait) {
+            vkWaitForFences(_settings.device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            wait = false;
+        }
+        else if (vkGetFenceStatus(_settings.device, batch.fence) != VK_SUCCESS)
+            break;
+
+        retireBatch(&batch);
+        _freeBatches.push_back(std::move(batch));
+        _pendingBatches.pop_front();
+    }
+}
+
+void UploadContext::retireBatch(Batch* batch)
+{
+    _stagingUsed -= batch->stagingBytes;
+    for (size_t i=0; i<batch->dedicatedBuffers.size(); ++i) {
+        gu2::destroyBuffer(_settings.memoryAllocator, _settings.device, &batch->dedicatedBuffers[i],
+            &batch->dedicatedAllocations[i]);
+    }
+
+    // A transfer batch completes once its acquires have been executed on the graphics queue
+    if (hasTransferQueue()) {
+        Batch transferred;
+        transferred.id = batch->id;
+        std::swap(transferred.acquireBufferBarriers, batch->acquireBufferBarriers);
+        std::swap(transferred.acquireImageBarriers, batch->acquireImageBarriers);
+        std::swap(transferred.graphicsFunctions, batch->graphicsFunctions);
+        _transferredBatches.push_back(std::move(transferred));
+    }
+    else
+        _completedBatchId = batch->id;
+
+    vkResetFences(_settings.device, 1, &batch->fence);
+    batch->empty = true;
+    batch->stagingBytes = 0;
+    batch->dedicatedBuffers.clear();
+    batch->dedicatedAllocations.clear();
+}
+
+void UploadContext::submitAcquires()
+{
+    while (!_transferredBatches.empty()) {
+        auto& batch = _transferredBatches.front();
+
+        Acquire acquire;
+        if (!_freeAcquires.empty()) {
+            acquire = _freeAcquires.back();
+            _freeAcquires.pop_back();
+        }
+        else
+            acquire.fence = createFence(_settings.device);
+        acquire.id = batch.id;
+
+        // Each batch gets a submission even with nothing to acquire so that the semaphore reaches every batch id
+        bool hasCommands = !batch.acquireBufferBarriers.empty() || !batch.acquireImageBarriers.empty() ||
+            !batch.graphicsFunctions.empty();
+        if (hasCommands) {
+            if (acquire.commandBuffer == VK_NULL_HANDLE)
+                acquire.commandBuffer = allocateCommandBuffer(_settings.device, _graphicsCommandPool);
+            beginCommandBuffer(acquire.commandBuffer);
+            if (!batch.acquireBufferBarriers.empty() || !batch.acquireImageBarriers.empty()) {
+                vkCmdPipelineBarrier(acquire.commandBuffer,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                    0, nullptr,
+                    static_cast<uint32_t>(batch.acquireBufferBarriers.size()), batch.acquireBufferBarriers.data(),
+                    static_cast<uint32_t>(batch.acquireImageBarriers.size()), batch.acquireImageBarriers.data());
+            }
+            if (!batch.graphicsFunctions.empty()) {
+                for (auto& graphicsFunction : batch.graphicsFunctions)
+                    graphicsFunction(acquire.commandBuffer);
+
+                VkMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+                vkCmdPipelineBarrier(acquire.commandBuffer,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                    1, &barrier,
+                    0, nullptr,
+                    0, nullptr);
+            }
+            if (vkEndCommandBuffer(acquire.commandBuffer) != VK_SUCCESS)
+                throw std::runtime_error("UploadContext: failed to end command buffer");
+        }
+
+        // The transfer has completed already, the wait orders the acquires after the releases
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &acquire.id;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &acquire.id;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &_transferSemaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = hasCommands ? 1 : 0;
+        submitInfo.pCommandBuffers = &acquire.commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &_semaphore;
+        if (vkQueueSubmit(_settings.queue, 1, &submitInfo, acquire.fence) != VK_SUCCESS)
+            throw std::runtime_error("UploadContext: failed to submit acquires");
+
+        _pendingAcquires.push_back(acquire);
+        _transferredBatches.pop_front();
+    }
+}
+
+void UploadContext::retireAcquires(bool wait)
+{
+    while (!_pendingAcquires.empty()) {
+        auto& acquire = _pendingAcquires.front();
+        if (wait) {
+            vkWaitForFences(_settings.device, 1, &acquire.fence, VK_TRUE, UINT64_MAX);
+            wait = false;
+        }
+        else if (vkGetFenceStatus(_settings.device, acquire.fence) != VK_SUCCESS)
+            break;
+
+        vkResetFences(_settings.device, 1, &acquire.fence);
+        _completedBatchId = acquire.id;
+        _freeAcquires.push_back(acquire);
+        _pendingAcquires.pop_front();
+    }
+}
+
+void UploadContext::waitBatch(uint64_t batchId)
+{
+    // The acquires pending are older than the transferred batches, which are older than the batches pending
+    while (_completedBatchId < batchId) {
+        if (!_pendingAcquires.empty())
+            retireAcquires(true);
+        else if (!_transferredBatches.empty())
+            submitAcquires();
+        else if (!_pendingBatches.empty())
+            retireBatches(true);
+        else
+            break;
+    }
+}
+
+VkDeviceSize UploadContext::allocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+    const VkDeviceSize capacity = _settings.stagingSize;
+    for (;;) {
+        // Nothing in flight, start over from the beginning to avoid wrapping
+        if (_stagingUsed == 0)
+            _stagingHead = 0;
+
+        // The used part of the ring is contiguous (modulo the capacity) and ends at the head, the allocation fits
+        // in case the padding and the size fit in the remaining part
+        VkDeviceSize offset = alignUp(_stagingHead, alignment);
+        VkDeviceSize padding = offset - _stagingHead;
+        if (offset + size > capacity) {
+            padding = capacity - _stagingHead;
+            offset = 0;
+        }
+        if (_stagingUsed + padding + size <= capacity) {
+            _stagingHead = offset + size;
+            _stagingUsed += padding + size;
+            _currentBatch.stagingBytes += padding + size;
+            return offset;
+        }
+
+        // Ring is full, wait for the oldest batch holding a part of it
+        if (_pendingBatches.empty())
+            submitBatch();
+        if (_pendingBatches.empty())
+            throw std::runtime_error("UploadContext: staging ring exhausted without pending batches");
+        retireBatches(true);
+    }
+}
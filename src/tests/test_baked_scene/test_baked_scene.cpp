@@ -0,0 +1,326 @@
+//
+// Project: GraphicsUtils2
+// File: test_baked_scene.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/BakedScene.hpp>
+#include <gu2_util/GLTFLoader.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+
+using namespace gu2;
+
+
+// Grid of n x n quads split into two primitives (left and right half) sharing the POSITION accessor, the
+// buffer is written into an external .bin file
+static Path writeSplitGrid(const Path& directory, uint32_t n)
+{
+    std::vector<float> positions;
+    for (uint32_t j=0; j<=n; ++j) {
+        for (uint32_t i=0; i<=n; ++i)
+            positions.insert(positions.end(), {static_cast<float>(i), static_cast<float>(j), 0.0f});
+    }
+    std::vector<uint16_t> indices[2];
+    for (uint32_t j=0; j<n; ++j) {
+        for (uint32_t i=0; i<n; ++i) {
+            uint16_t v = static_cast<uint16_t>(j*(n+1) + i);
+            indices[2*i < n ? 0 : 1].insert(indices[2*i < n ? 0 : 1].end(),
+                {v, static_cast<uint16_t>(v+1), static_cast<uint16_t>(v+n+2),
+                 v, static_cast<uint16_t>(v+n+2), static_cast<uint16_t>(v+n+1)});
+        }
+    }
+
+    size_t positionsSize = positions.size()*sizeof(float);
+    size_t indices0Size = indices[0].size()*sizeof(uint16_t);
+    size_t indices1Size = indices[1].size()*sizeof(uint16_t);
+    {
+        std::ofstream bin(directory / "grid.bin", std::ios::binary | std::ios::trunc);
+        bin.write(reinterpret_cast<const char*>(positions.data()), static_cast<std::streamsize>(positionsSize));
+        bin.write(reinterpret_cast<const char*>(indices[0].data()), static_cast<std::streamsize>(indices0Size));
+        bin.write(reinterpret_cast<const char*>(indices[1].data()), static_cast<std::streamsize>(indices1Size));
+    }
+
+    Json gltf = {
+        {"asset", {{"version", "2.0"}}},
+        {"scenes", {{{"nodes", {0}}}}},
+        {"nodes", {{{"mesh", 0}, {"translation", {1.0, 2.0, 3.0}}}}},
+        {"meshes", {{{"primitives", {
+            {{"attributes", {{"POSITION", 0}}}, {"indices", 1}},
+            {{"attributes", {{"POSITION", 0}}}, {"indices", 2}}
+        }}}}},
+        {"buffers", {{{"uri", "grid.bin"}, {"byteLength", positionsSize + indices0Size + indices1Size}}}},
+        {"bufferViews", {
+            {{"buffer", 0}, {"byteOffset", 0}, {"byteLength", positionsSize}},
+            {{"buffer", 0}, {"byteOffset", positionsSize}, {"byteLength", indices0Size}},
+            {{"buffer", 0}, {"byteOffset", positionsSize + indices0Size}, {"byteLength", indices1Size}}
+        }},
+        {"accessors", {
+            {{"bufferView", 0}, {"componentType", 5126}, {"count", (n+1)*(n+1)}, {"type", "VEC3"},
+                {"min", {0.0, 0.0, 0.0}}, {"max", {n, n, 0.0}}},
+            {{"bufferView", 1}, {"componentType", 5123}, {"count", indices[0].size()}, {"type", "SCALAR"}},
+            {{"bufferView", 2}, {"componentType", 5123}, {"count", indices[1].size()}, {"type", "SCALAR"}}
+        }}
+    };
+    Path gltfFilename = directory / "grid.gltf";
+    std::ofstream(gltfFilename) << gltf.dump();
+    return gltfFilename;
+}
+
+static Path createTestDirectory()
+{
+    Path directory = std::filesystem::temp_directory_path() / "gu2_test_baked_scene";
+    std::filesystem::create_directories(directory);
+    return directory;
+}
+
+template <typename T>
+static bool tablesEqual(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()*sizeof(T)) == 0;
+}
+
+
+TEST(BakedScene, SharedAccessorsArePackedOnce)
+{
+    Path directory = createTestDirectory();
+    GLTFLoader gltfLoader;
+    gltfLoader.readFromFile(writeSplitGrid(directory, 8));
+    BakedScene bakedScene;
+    bakedScene.bake(gltfLoader);
+
+    const auto& primitives = bakedScene.getPrimitives();
+    GTEST_ASSERT_EQ(primitives.size(), 2);
+    GTEST_ASSERT_EQ(bakedScene.getNodes().size(), 1);
+    const auto* position0 = bakedScene.findAttribute(primitives[0], "POSITION");
+    const auto* position1 = bakedScene.findAttribute(primitives[1], "POSITION");
+    ASSERT_NE(position0, nullptr);
+    ASSERT_NE(position1, nullptr);
+    GTEST_ASSERT_EQ(position0->byteOffset, position1->byteOffset);
+    GTEST_ASSERT_EQ(position0->count, 81);
+    GTEST_ASSERT_EQ(position1->count, 81);
+
+    // Shared vertices keep their order, only the indices get optimized
+    const auto* positions = reinterpret_cast<const float*>(bakedScene.getAttributeData(*position0));
+    for (uint32_t v=0; v<81; ++v) {
+        GTEST_ASSERT_EQ(positions[3*v], static_cast<float>(v%9));
+        GTEST_ASSERT_EQ(positions[3*v+1], static_cast<float>(v/9));
+    }
+    for (const auto& primitive : primitives) {
+        GTEST_ASSERT_EQ(primitive.nIndices, 192);
+        const auto* indices = reinterpret_cast<const uint16_t*>(bakedScene.getIndexData(primitive));
+        for (uint64_t i=0; i<primitive.nIndices; ++i)
+            ASSERT_LT(indices[i], 81);
+    }
+
+    // Generated attributes are not shared
+    EXPECT_NE(bakedScene.findAttribute(primitives[0], "NORMAL")->byteOffset,
+        bakedScene.findAttribute(primitives[1], "NORMAL")->byteOffset);
+}
+
+TEST(BakedScene, WriteAndReadRoundTrip)
+{
+    Path directory = createTestDirectory();
+    Path gltfFilename = writeSplitGrid(directory, 16);
+    GLTFLoader gltfLoader;
+    gltfLoader.readFromFile(gltfFilename);
+    BakedScene bakedScene;
+    bakedScene.bake(gltfLoader);
+
+    uint64_t sourceHash = BakedScene::computeSourceHash(gltfFilename);
+    Path cacheFilename = directory / "grid.gu2bake";
+    bakedScene.writeToFile(cacheFilename, sourceHash);
+
+    BakedScene readScene;
+    ASSERT_TRUE(readScene.readFromFile(cacheFilename, sourceHash));
+    EXPECT_TRUE(tablesEqual(readScene.getNodes(), bakedScene.getNodes()));
+    EXPECT_TRUE(tablesEqual(readScene.getAttributes(), bakedScene.getAttributes()));
+    EXPECT_TRUE(tablesEqual(readScene.getPrimitives(), bakedScene.getPrimitives()));
+    EXPECT_TRUE(tablesEqual(readScene.getLods(), bakedScene.getLods()));
+    EXPECT_TRUE(tablesEqual(readScene.getMaterials(), bakedScene.getMaterials()));
+    EXPECT_TRUE(tablesEqual(readScene.getImages(), bakedScene.getImages()));
+    GTEST_ASSERT_GT(readScene.getLods().size(), readScene.getPrimitives().size()); // LODs were generated
+
+    const auto& primitives = bakedScene.getPrimitives();
+    for (size_t i=0; i<primitives.size(); ++i) {
+        for (uint32_t j=0; j<primitives[i].nAttributes; ++j) {
+            const auto& attribute = bakedScene.getAttributes()[primitives[i].firstAttribute + j];
+            size_t size = attribute.count*attribute.nComponents*sizeof(float);
+            EXPECT_EQ(memcmp(readScene.getAttributeData(attribute), bakedScene.getAttributeData(attribute), size), 0);
+        }
+        const auto& lastLod = bakedScene.getLods()[primitives[i].firstLod + primitives[i].nLods - 1];
+        size_t indexDataSize = (lastLod.firstIndex + lastLod.nIndices)*sizeof(uint16_t);
+        EXPECT_EQ(memcmp(readScene.getIndexData(readScene.getPrimitives()[i]), bakedScene.getIndexData(primitives[i]),
+            indexDataSize), 0);
+    }
+
+    // Cache baked from different sources needs to be rebaked
+    BakedScene staleScene;
+    EXPECT_FALSE(staleScene.readFromFile(cacheFilename, sourceHash + 1));
+    EXPECT_FALSE(staleScene.readFromFile(directory / "missing.gu2bake", sourceHash));
+}
+
+TEST(BakedScene, ChangedBufferChangesSourceHash)
+{
+    Path directory = createTestDirectory();
+    Path gltfFilename = writeSplitGrid(directory, 4);
+    uint64_t sourceHash = BakedScene::computeSourceHash(gltfFilename);
+
+    GLTFLoader gltfLoader;
+    gltfLoader.readFromFile(gltfFilename);
+    BakedScene bakedScene;
+    bakedScene.bake(gltfLoader);
+    Path cacheFilename = directory / "grid.gu2bake";
+    bakedScene.writeToFile(cacheFilename, sourceHash);
+
+    {   // Move the first vertex, the glTF file itself stays the same
+        std::fstream bin(directory / "grid.bin", std::ios::binary | std::ios::in | std::ios::out);
+        float x = 0.5f;
+        bin.write(reinterpret_cast<const char*>(&x), sizeof(float));
+    }
+    uint64_t newSourceHash = BakedScene::computeSourceHash(gltfFilename);
+    EXPECT_NE(newSourceHash, sourceHash);
+
+    BakedScene readScene;
+    EXPECT_FALSE(readScene.readFromFile(cacheFilename, newSourceHash));
+    EXPECT_TRUE(readScene.readFromFile(cacheFilename, sourceHash));
+}
+
+TEST(BakedScene, MirroredTextureSplitsTangentSeam)
+{
+    // Two quads with the texture mirrored at the shared edge x = 1
+    std::vector<float> positions = {0, 0, 0, 1, 0, 0, 2, 0, 0, 0, 1, 0, 1, 1, 0, 2, 1, 0};
+    std::vector<float> texCoords = {0, 0, 1, 0, 0, 0, 0, 1, 1, 1, 0, 1};
+    std::vector<uint16_t> indices = {0, 1, 4, 0, 4, 3, 1, 2, 5, 1, 5, 4};
+    size_t positionsSize = positions.size()*sizeof(float);
+    size_t texCoordsSize = texCoords.size()*sizeof(float);
+    size_t indicesSize = indices.size()*sizeof(uint16_t);
+
+    Path directory = createTestDirectory();
+    {
+        std::ofstream bin(directory / "mirrored.bin", std::ios::binary | std::ios::trunc);
+        bin.write(reinterpret_cast<const char*>(positions.data()), static_cast<std::streamsize>(positionsSize));
+        bin.write(reinterpret_cast<const char*>(texCoords.data()), static_cast<std::streamsize>(texCoordsSize));
+        bin.write(reinterpret_cast<const char*>(indices.data()), static_cast<std::streamsize>(indicesSize));
+    }
+    Json gltf = {
+        {"asset", {{"version", "2.0"}}},
+        {"scenes", {{{"nodes", {0}}}}},
+        {"nodes", {{{"mesh", 0}}}},
+        {"meshes", {{{"primitives", {{{"attributes", {{"POSITION", 0}, {"TEXCOORD_0", 1}}}, {"indices", 2}}}}}}},
+        {"buffers", {{{"uri", "mirrored.bin"}, {"byteLength", positionsSize + texCoordsSize + indicesSize}}}},
+        {"bufferViews", {
+            {{"buffer", 0}, {"byteOffset", 0}, {"byteLength", positionsSize}},
+            {{"buffer", 0}, {"byteOffset", positionsSize}, {"byteLength", texCoordsSize}},
+            {{"buffer", 0}, {"byteOffset", positionsSize + texCoordsSize}, {"byteLength", indicesSize}}
+        }},
+        {"accessors", {
+            {{"bufferView", 0}, {"componentType", 5126}, {"count", 6}, {"type", "VEC3"},
+                {"min", {0.0, 0.0, 0.0}}, {"max", {2.0, 1.0, 0.0}}},
+            {{"bufferView", 1}, {"componentType", 5126}, {"count", 6}, {"type", "VEC2"}},
+            {{"bufferView", 2}, {"componentType", 5123}, {"count", 12}, {"type", "SCALAR"}}
+        }}
+    };
+    Path gltfFilename = directory / "mirrored.gltf";
+    std::ofstream(gltfFilename) << gltf.dump();
+
+    GLTFLoader gltfLoader;
+    gltfLoader.readFromFile(gltfFilename);
+    BakedScene bakedScene;
+    bakedScene.bake(gltfLoader);
+
+    // Both seam vertices get a duplicate with the mirrored tangent space
+    const auto& primitive = bakedScene.getPrimitives().at(0);
+    const auto* position = bakedScene.findAttribute(primitive, "POSITION");
+    const auto* tangent = bakedScene.findAttribute(primitive, "TANGENT");
+    GTEST_ASSERT_EQ(position->count, 8);
+    GTEST_ASSERT_EQ(tangent->count, 8);
+    const auto* bakedPositions = reinterpret_cast<const Vec3f*>(bakedScene.getAttributeData(*position));
+    const auto* bakedTangents = reinterpret_cast<const Vec4f*>(bakedScene.getAttributeData(*tangent));
+    const auto* bakedIndices = reinterpret_cast<const uint16_t*>(bakedScene.getIndexData(primitive));
+    GTEST_ASSERT_EQ(primitive.nIndices, 12);
+    for (uint64_t i=0; i<primitive.nIndices; i+=3) {
+        float centroidX = (bakedPositions[bakedIndices[i]].x() + bakedPositions[bakedIndices[i+1]].x() +
+            bakedPositions[bakedIndices[i+2]].x()) / 3.0f;
+        float handedness = centroidX < 1.0f ? 1.0f : -1.0f;
+        for (uint64_t c=i; c<i+3; ++c) {
+            const Vec4f& t = bakedTangents[bakedIndices[c]];
+            EXPECT_LT((t - Vec4f(handedness, 0.0f, 0.0f, handedness)).norm(), 1.0e-5f);
+        }
+    }
+}
+
+TEST(BakedScene, NodeHierarchy)
+{
+    // Root with a child node and an instanced mesh node, the instances become children of the mesh node
+    std::vector<float> positions = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+    std::vector<float> instanceTranslations = {1, 0, 0, 2, 0, 0};
+    size_t positionsSize = positions.size()*sizeof(float);
+    size_t translationsSize = instanceTranslations.size()*sizeof(float);
+
+    Path directory = createTestDirectory();
+    {
+        std::ofstream bin(directory / "hierarchy.bin", std::ios::binary | std::ios::trunc);
+        bin.write(reinterpret_cast<const char*>(positions.data()), static_cast<std::streamsize>(positionsSize));
+        bin.write(reinterpret_cast<const char*>(instanceTranslations.data()),
+            static_cast<std::streamsize>(translationsSize));
+    }
+    Json gltf = {
+        {"asset", {{"version", "2.0"}}},
+        {"extensionsUsed", {"EXT_mesh_gpu_instancing"}},
+        {"scenes", {{{"nodes", {0}}}}},
+        {"nodes", {
+            {{"translation", {0.0, 0.0, 5.0}}, {"scale", {2.0, 2.0, 2.0}}, {"children", {1, 2}}},
+            {{"mesh", 0}, {"translation", {1.0, 0.0, 0.0}}},
+            {{"mesh", 0}, {"extensions", {{"EXT_mesh_gpu_instancing", {{"attributes", {{"TRANSLATION", 1}}}}}}}}
+        }},
+        {"meshes", {{{"primitives", {{{"attributes", {{"POSITION", 0}}}}}}}}},
+        {"buffers", {{{"uri", "hierarchy.bin"}, {"byteLength", positionsSize + translationsSize}}}},
+        {"bufferViews", {
+            {{"buffer", 0}, {"byteOffset", 0}, {"byteLength", positionsSize}},
+            {{"buffer", 0}, {"byteOffset", positionsSize}, {"byteLength", translationsSize}}
+        }},
+        {"accessors", {
+            {{"bufferView", 0}, {"componentType", 5126}, {"count", 3}, {"type", "VEC3"},
+                {"min", {0.0, 0.0, 0.0}}, {"max", {1.0, 1.0, 0.0}}},
+            {{"bufferView", 1}, {"componentType", 5126}, {"count", 2}, {"type", "VEC3"}}
+        }}
+    };
+    Path gltfFilename = directory / "hierarchy.gltf";
+    std::ofstream(gltfFilename) << gltf.dump();
+
+    GLTFLoader gltfLoader;
+    gltfLoader.readFromFile(gltfFilename);
+    BakedScene bakedScene;
+    bakedScene.bake(gltfLoader);
+
+    const auto& nodes = bakedScene.getNodes();
+    GTEST_ASSERT_EQ(nodes.size(), 5);
+    std::vector<int64_t> parents;
+    std::vector<uint32_t> nPrimitives;
+    for (const auto& node : nodes) {
+        parents.push_back(node.parent);
+        nPrimitives.push_back(node.nPrimitives);
+    }
+    EXPECT_EQ(parents, std::vector<int64_t>({-1, 0, 0, 2, 2}));
+    EXPECT_EQ(nPrimitives, std::vector<uint32_t>({0, 1, 0, 1, 1}));
+
+    // Local transformations are kept
+    EXPECT_EQ(nodes[0].translation, (std::array<float, 3>{0.0f, 0.0f, 5.0f}));
+    EXPECT_EQ(nodes[0].scale, (std::array<float, 3>{2.0f, 2.0f, 2.0f}));
+    EXPECT_EQ(nodes[1].translation, (std::array<float, 3>{1.0f, 0.0f, 0.0f}));
+    EXPECT_EQ(nodes[1].scale, (std::array<float, 3>{1.0f, 1.0f, 1.0f}));
+    EXPECT_EQ(nodes[3].translation, (std::array<float, 3>{1.0f, 0.0f, 0.0f}));
+    EXPECT_EQ(nodes[4].translation, (std::array<float, 3>{2.0f, 0.0f, 0.0f}));
+    for (const auto& node : nodes)
+        EXPECT_EQ(node.rotation, (std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f}));
+}
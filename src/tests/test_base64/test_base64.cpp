@@ -0,0 +1,106 @@
+//
+// Project: GraphicsUtils2
+// File: test_base64.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/Base64.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+
+static std::default_random_engine rnd(2341562);
+
+
+static std::string encodeBase64(const std::vector<uint8_t>& data, bool padding)
+{
+    static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+    size_t i = 0;
+    for (; i+3 <= data.size(); i+=3) {
+        uint32_t v = (data[i] << 16) | (data[i+1] << 8) | data[i+2];
+        for (int j=0; j<4; ++j)
+            encoded.push_back(alphabet[(v >> (18 - 6*j)) & 0x3f]);
+    }
+    size_t nRemaining = data.size() - i;
+    if (nRemaining > 0) {
+        uint32_t v = data[i] << 16;
+        if (nRemaining == 2)
+            v |= data[i+1] << 8;
+        for (size_t j=0; j<nRemaining+1; ++j)
+            encoded.push_back(alphabet[(v >> (18 - 6*j)) & 0x3f]);
+        if (padding)
+            encoded.append(3-nRemaining, '=');
+    }
+    return encoded;
+}
+
+
+TEST(Base64, KnownStrings)
+{
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"", ""},
+        {"Zg==", "f"},
+        {"Zm8=", "fo"},
+        {"Zm9v", "foo"},
+        {"Zm9vYg", "foob"},
+        {"Zm9vYmE=", "fooba"},
+        {"Zm9vYmFy", "foobar"},
+    };
+
+    for (const auto& [encoded, decoded] : cases) {
+        size_t size = gu2::getBase64DecodedSize(encoded.data(), encoded.size());
+        GTEST_ASSERT_EQ(size, decoded.size());
+        std::string result(size, '\0');
+        gu2::decodeBase64(encoded.data(), encoded.size(), result.data());
+        GTEST_ASSERT_EQ(result, decoded);
+    }
+}
+
+TEST(Base64, RandomData)
+{
+    for (size_t size : {1u, 2u, 3u, 11u, 12u, 13u, 23u, 24u, 25u, 47u, 48u, 49u, 95u, 96u, 97u, 1000u, 65537u}) {
+        std::vector<uint8_t> data(size);
+        for (auto& d : data)
+            d = static_cast<uint8_t>(rnd()%256);
+
+        for (bool padding : {false, true}) {
+            auto encoded = encodeBase64(data, padding);
+            GTEST_ASSERT_EQ(gu2::getBase64DecodedSize(encoded.data(), encoded.size()), size);
+
+            std::vector<uint8_t> decoded(size), decodedScalar(size);
+            gu2::decodeBase64(encoded.data(), encoded.size(), decoded.data());
+            gu2::decodeBase64Scalar(encoded.data(), encoded.size(), decodedScalar.data());
+            GTEST_ASSERT_EQ(decoded, data);
+            GTEST_ASSERT_EQ(decodedScalar, data);
+        }
+    }
+}
+
+TEST(Base64, InvalidInput)
+{
+    std::vector<uint8_t> data(300);
+    for (auto& d : data)
+        d = static_cast<uint8_t>(rnd()%256);
+    auto encoded = encodeBase64(data, true);
+
+    // Invalid characters both in the vectorized part and in the tail
+    for (size_t position : {size_t(5), size_t(100), encoded.size()-3}) {
+        auto corrupted = encoded;
+        corrupted[position] = '*';
+        std::vector<uint8_t> decoded(data.size());
+        EXPECT_THROW(gu2::decodeBase64(corrupted.data(), corrupted.size(), decoded.data()), std::runtime_error);
+    }
+
+    std::string truncated = "Zm9vY";
+    std::vector<uint8_t> decoded(8);
+    EXPECT_THROW(gu2::decodeBase64(truncated.data(), truncated.size(), decoded.data()), std::runtime_error);
+}
@@ -0,0 +1,96 @@
+//
+// Project: GraphicsUtils2
+// File: test_buddy_allocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/BuddyAllocator.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+using namespace gu2;
+
+
+TEST(BuddyAllocator, AllocateFree)
+{
+    BuddyAllocator allocator(256, 16);
+    EXPECT_EQ(allocator.allocate(10), 0u);
+    EXPECT_EQ(allocator.getSize(0), 16u);
+    EXPECT_EQ(allocator.allocate(20), 32u);
+    EXPECT_EQ(allocator.allocate(16), 16u);
+    EXPECT_EQ(allocator.allocate(100), 128u);
+    EXPECT_EQ(allocator.getUsedSize(), 192u);
+    EXPECT_EQ(allocator.getAllocationCount(), 4u);
+    EXPECT_EQ(allocator.getLargestFreeBlock(), 64u);
+    EXPECT_EQ(allocator.allocate(65), BuddyAllocator::invalidOffset);
+
+    // Freeing the buddies merges the blocks back
+    allocator.free(16);
+    allocator.free(0);
+    EXPECT_EQ(allocator.getLargestFreeBlock(), 64u);
+    allocator.free(32);
+    EXPECT_EQ(allocator.getLargestFreeBlock(), 128u);
+    allocator.free(128);
+    EXPECT_EQ(allocator.getUsedSize(), 0u);
+    EXPECT_EQ(allocator.allocate(256), 0u);
+
+    EXPECT_THROW(allocator.free(16), std::runtime_error);
+    EXPECT_THROW(BuddyAllocator(96, 16), std::runtime_error);
+    EXPECT_THROW(BuddyAllocator(256, 24), std::runtime_error);
+}
+
+TEST(BuddyAllocator, Alignment)
+{
+    BuddyAllocator allocator(1024, 16);
+    EXPECT_EQ(allocator.allocate(8), 0u);
+    // The block is enlarged to the alignment
+    EXPECT_EQ(allocator.allocate(8, 256), 256u);
+    EXPECT_EQ(allocator.getSize(256), 256u);
+    EXPECT_EQ(allocator.allocate(8, 4), 16u);
+    EXPECT_THROW(allocator.allocate(8, 0), std::runtime_error);
+    EXPECT_THROW(allocator.allocate(8, 48), std::runtime_error);
+}
+
+TEST(BuddyAllocator, Random)
+{
+    // Live allocations never overlap and are aligned, everything merges back once freed
+    BuddyAllocator allocator(1 << 16, 64);
+    std::mt19937 rng(1234);
+    std::vector<std::pair<uint64_t, uint64_t>> live;   // offset, size
+    for (int i=0; i<10000; ++i) {
+        if (live.empty() || rng() % 3 != 0) {
+            uint64_t size = 1 + rng() % 2000;
+            uint64_t alignment = 1ull << (rng() % 10);
+            uint64_t offset = allocator.allocate(size, alignment);
+            if (offset == BuddyAllocator::invalidOffset)
+                continue;
+            EXPECT_EQ(offset % alignment, 0u);
+            EXPECT_GE(allocator.getSize(offset), size);
+            live.emplace_back(offset, allocator.getSize(offset));
+        }
+        else {
+            size_t j = rng() % live.size();
+            allocator.free(live[j].first);
+            live[j] = live.back();
+            live.pop_back();
+        }
+    }
+
+    std::sort(live.begin(), live.end());
+    for (size_t j=1; j<live.size(); ++j)
+        EXPECT_LE(live[j-1].first + live[j-1].second, live[j].first);
+
+    for (const auto& [offset, size] : live)
+        allocator.free(offset);
+    EXPECT_EQ(allocator.getUsedSize(), 0u);
+    EXPECT_EQ(allocator.getLargestFreeBlock(), allocator.getCapacity());
+}
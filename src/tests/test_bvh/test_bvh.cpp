@@ -0,0 +1,136 @@
+//
+// Project: GraphicsUtils2
+// File: test_bvh.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/BVH.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+using namespace gu2;
+
+
+static std::default_random_engine rnd(1507715);
+
+
+static std::vector<AABB> createRandomBoxes(size_t n)
+{
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+    std::vector<AABB> boxes(n);
+    for (auto& box : boxes) {
+        box.min << position(rnd), position(rnd), position(rnd);
+        box.max = box.min + Vec3f(size(rnd), size(rnd), size(rnd));
+    }
+    return boxes;
+}
+
+static std::vector<uint32_t> bruteForceQuery(const std::vector<AABB>& boxes, const AABB& aabb)
+{
+    std::vector<uint32_t> items;
+    for (uint32_t i=0; i<boxes.size(); ++i) {
+        if (boxes[i].intersects(aabb))
+            items.push_back(i);
+    }
+    return items;
+}
+
+static std::vector<uint32_t> bvhQuery(const BVH& bvh, const std::vector<AABB>& boxes, const AABB& aabb)
+{
+    std::vector<uint32_t> items;
+    bvh.query(aabb, boxes.data(), &items);
+    std::sort(items.begin(), items.end());
+    return items;
+}
+
+
+TEST(Bounds, ComputeAABB)
+{
+    std::uniform_real_distribution<float> dist(-1000.0f, 1000.0f);
+    for (size_t n : {size_t(1), size_t(3), size_t(4), size_t(8), size_t(13), size_t(1000), size_t(1001)}) {
+        std::vector<float> positions(n*3);
+        for (auto& p : positions)
+            p = dist(rnd);
+
+        AABB simd = computeAABB(positions.data(), n);
+        AABB scalar = computeAABBScalar(positions.data(), n);
+        EXPECT_EQ(simd.min, scalar.min);
+        EXPECT_EQ(simd.max, scalar.max);
+    }
+
+    EXPECT_TRUE(computeAABB(nullptr, 0).isEmpty());
+}
+
+TEST(Bounds, Transformed)
+{
+    AABB aabb;
+    aabb.min << -1.0f, -2.0f, -3.0f;
+    aabb.max << 1.0f, 2.0f, 3.0f;
+
+    Mat4f transformation = Mat4f::Identity();
+    transformation.block<3,3>(0,0) = Eigen::AngleAxisf(0.7f, Vec3f(1.0f, 2.0f, 3.0f).normalized()).matrix();
+    transformation.block<3,1>(0,3) << 10.0f, 20.0f, 30.0f;
+    AABB transformed = aabb.transformed(transformation);
+
+    // Compare against the bounds of the transformed corners
+    AABB reference;
+    for (int i=0; i<8; ++i) {
+        Vec3f corner((i&1) ? aabb.max.x() : aabb.min.x(), (i&2) ? aabb.max.y() : aabb.min.y(),
+            (i&4) ? aabb.max.z() : aabb.min.z());
+        reference.extend((transformation * corner.homogeneous()).head<3>().eval());
+    }
+    EXPECT_TRUE(transformed.min.isApprox(reference.min, 1.0e-5f));
+    EXPECT_TRUE(transformed.max.isApprox(reference.max, 1.0e-5f));
+}
+
+TEST(BVH, Query)
+{
+    auto boxes = createRandomBoxes(1000);
+    BVH bvh;
+    bvh.build(boxes.data(), boxes.size());
+    EXPECT_EQ(bvh.getItems().size(), boxes.size());
+
+    auto queries = createRandomBoxes(100);
+    for (auto& query : queries) {
+        query.max += Vec3f::Constant(20.0f);
+        EXPECT_EQ(bvhQuery(bvh, boxes, query), bruteForceQuery(boxes, query));
+    }
+}
+
+TEST(BVH, Refit)
+{
+    auto boxes = createRandomBoxes(500);
+    BVH bvh;
+    bvh.build(boxes.data(), boxes.size());
+
+    // Move a subset of the boxes, incremental refit needs to match a full refit
+    std::uniform_real_distribution<float> offset(-50.0f, 50.0f);
+    std::vector<uint32_t> changedItems;
+    for (uint32_t i=0; i<boxes.size(); i+=7) {
+        Vec3f d(offset(rnd), offset(rnd), offset(rnd));
+        boxes[i].min += d;
+        boxes[i].max += d;
+        changedItems.push_back(i);
+    }
+    bvh.refit(boxes.data(), changedItems);
+
+    BVH reference = bvh;
+    reference.refit(boxes.data());
+    ASSERT_EQ(bvh.getNodes().size(), reference.getNodes().size());
+    for (size_t i=0; i<bvh.getNodes().size(); ++i)
+        EXPECT_EQ(bvh.getNodes()[i].bounds, reference.getNodes()[i].bounds);
+
+    auto queries = createRandomBoxes(100);
+    for (const auto& query : queries)
+        EXPECT_EQ(bvhQuery(bvh, boxes, query), bruteForceQuery(boxes, query));
+}
@@ -0,0 +1,95 @@
+//
+// Project: GraphicsUtils2
+// File: test_frustum_culling.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/FrustumCulling.hpp>
+
+#include <random>
+#include <vector>
+
+
+using namespace gu2;
+
+
+// Camera at the origin looking towards +z, infinite far-plane and inverted depth as in the demos
+static Mat4f createViewProjection()
+{
+    float near = 0.1f;
+    float r = 1.0f; // 90 degree field of view
+    Mat4f projection;
+    projection <<
+        1.0f/r, 0.0f,       0.0f,   0.0f,
+        0.0f,   -1.0f/r,    0.0f,   0.0f,
+        0.0f,   0.0f,       0.0f,   near,
+        0.0f,   0.0f,       1.0f,   0.0f;
+    return projection;
+}
+
+
+TEST(FrustumCulling, Spheres)
+{
+    Frustum frustum = Frustum::fromViewProjection(createViewProjection());
+
+    EXPECT_TRUE(frustum.intersects({Vec3f(0.0f, 0.0f, 10.0f), 1.0f}));
+    EXPECT_TRUE(frustum.intersects({Vec3f(0.0f, 0.0f, 1.0e6f), 1.0f})); // no far-plane
+    EXPECT_FALSE(frustum.intersects({Vec3f(0.0f, 0.0f, -10.0f), 1.0f}));
+    EXPECT_FALSE(frustum.intersects({Vec3f(0.0f, 0.0f, 0.0f), 0.05f}));  // in front of the near plane
+    EXPECT_FALSE(frustum.intersects({Vec3f(12.0f, 0.0f, 10.0f), 1.0f}));
+    EXPECT_TRUE(frustum.intersects({Vec3f(10.5f, 0.0f, 10.0f), 1.0f}));  // straddles the right plane
+    EXPECT_FALSE(frustum.intersects({Vec3f(0.0f, -12.0f, 10.0f), 1.0f}));
+    EXPECT_FALSE(frustum.intersects({Vec3f(0.0f, 0.0f, 10.0f), -1.0f})); // empty
+}
+
+TEST(FrustumCulling, SIMDMatchesScalar)
+{
+    Frustum frustum = Frustum::fromViewProjection(createViewProjection());
+
+    // Odd count to exercise the scalar tail, several chunks for the parallel path
+    std::default_random_engine rnd(1507715517);
+    std::uniform_real_distribution<float> positionDist(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> radiusDist(-0.5f, 5.0f);
+    BoundingSpheres spheres;
+    spheres.resize(10007);
+    for (size_t i=0; i<spheres.size(); ++i)
+        spheres.set(i, {Vec3f(positionDist(rnd), positionDist(rnd), positionDist(rnd)), radiusDist(rnd)});
+
+    std::vector<uint32_t> visible, visibleScalar;
+    CullingStats stats, statsScalar;
+    cullSpheres(frustum, spheres, &visible, &stats);
+    cullSpheresScalar(frustum, spheres, &visibleScalar, &statsScalar);
+
+    std::vector<uint32_t> expected;
+    for (uint32_t i=0; i<spheres.size(); ++i) {
+        if (frustum.intersects({Vec3f(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i]}))
+            expected.push_back(i);
+    }
+
+    EXPECT_GT(expected.size(), 0u);
+    EXPECT_LT(expected.size(), spheres.size());
+    EXPECT_EQ(visible, expected);
+    EXPECT_EQ(visibleScalar, expected);
+    EXPECT_EQ(stats.nTested, spheres.size());
+    EXPECT_EQ(stats.nVisible, expected.size());
+    EXPECT_EQ(statsScalar.nVisible, expected.size());
+
+    // Stats accumulate over calls
+    cullSpheres(frustum, spheres, &visible, &stats);
+    EXPECT_EQ(stats.nTested, 2*spheres.size());
+}
+
+TEST(FrustumCulling, Empty)
+{
+    Frustum frustum = Frustum::fromViewProjection(createViewProjection());
+    BoundingSpheres spheres;
+    std::vector<uint32_t> visible {1, 2, 3};
+    cullSpheres(frustum, spheres, &visible);
+    EXPECT_TRUE(visible.empty());
+}
@@ -0,0 +1,182 @@
+//
+// Project: GraphicsUtils2
+// File: test_gltf_loader.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/GLTFLoader.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+using namespace gu2;
+
+
+static std::string encodeBase64(const char* data, size_t size)
+{
+    static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+    std::string encoded;
+    size_t i = 0;
+    for (; i+3 <= size; i+=3) {
+        uint32_t v = (bytes[i] << 16) | (bytes[i+1] << 8) | bytes[i+2];
+        for (int j=0; j<4; ++j)
+            encoded.push_back(alphabet[(v >> (18 - 6*j)) & 0x3f]);
+    }
+    size_t nRemaining = size - i;
+    if (nRemaining > 0) {
+        uint32_t v = bytes[i] << 16;
+        if (nRemaining == 2)
+            v |= bytes[i+1] << 8;
+        for (size_t j=0; j<nRemaining+1; ++j)
+            encoded.push_back(alphabet[(v >> (18 - 6*j)) & 0x3f]);
+        encoded.append(3-nRemaining, '=');
+    }
+    return encoded;
+}
+
+static Path writeGltf(const std::string& name, const Json& gltf)
+{
+    Path directory = std::filesystem::temp_directory_path() / "gu2_test_gltf_loader";
+    std::filesystem::create_directories(directory);
+    Path filename = directory / name;
+    std::ofstream(filename) << gltf.dump();
+    return filename;
+}
+
+
+TEST(GLTFLoader, EmbeddedBufferAndImage)
+{
+    // Triangle with an odd sized index buffer so that the base64 encoding needs padding
+    const float positions[9] = {0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    const uint16_t indices[3] = {0, 1, 2};
+    std::vector<char> bufferData(sizeof(positions) + sizeof(indices));
+    memcpy(bufferData.data(), positions, sizeof(positions));
+    memcpy(bufferData.data() + sizeof(positions), indices, sizeof(indices));
+    // The loader does not decode images, any bytes will do
+    const std::string imageData = "\x89PNG\r\n\x1a\n not really a png";
+
+    Json gltf = {
+        {"asset", {{"version", "2.0"}}},
+        {"scenes", {{{"nodes", {0}}}}},
+        {"nodes", {{{"mesh", 0}}}},
+        {"meshes", {{{"primitives", {{{"attributes", {{"POSITION", 0}}}, {"indices", 1}}}}}}},
+        {"buffers", {{
+            {"uri", "data:application/octet-stream;base64," + encodeBase64(bufferData.data(), bufferData.size())},
+            {"byteLength", bufferData.size()}
+        }}},
+        {"bufferViews", {
+            {{"buffer", 0}, {"byteOffset", 0}, {"byteLength", sizeof(positions)}},
+            {{"buffer", 0}, {"byteOffset", sizeof(positions)}, {"byteLength", sizeof(indices)}}
+        }},
+        {"accessors", {
+            {{"bufferView", 0}, {"componentType", 5126}, {"count", 3}, {"type", "VEC3"}},
+            {{"bufferView", 1}, {"componentType", 5123}, {"count", 3}, {"type", "SCALAR"}}
+        }},
+        {"images", {
+            {{"uri", "data:image/png;base64," + encodeBase64(imageData.data(), imageData.size())}},
+            {{"uri", "texture.png"}}
+        }}
+    };
+
+    GLTFLoader gltfLoader;
+    gltfLoader.readFromFile(writeGltf("embedded.gltf", gltf));
+
+    const auto& buffers = gltfLoader.getBuffers();
+    GTEST_ASSERT_EQ(buffers.size(), 1);
+    EXPECT_TRUE(buffers[0].filename.empty());
+    GTEST_ASSERT_EQ(buffers[0].bufferSize, bufferData.size());
+    EXPECT_EQ(memcmp(buffers[0].buffer, bufferData.data(), bufferData.size()), 0);
+
+    const auto& accessors = gltfLoader.getAccessors();
+    EXPECT_EQ(memcmp(gltfLoader.getAccessorData(accessors[0]), positions, sizeof(positions)), 0);
+    EXPECT_EQ(memcmp(gltfLoader.getAccessorData(accessors[1]), indices, sizeof(indices)), 0);
+
+    const auto& images = gltfLoader.getImages();
+    GTEST_ASSERT_EQ(images.size(), 2);
+    EXPECT_TRUE(images[0].filename.empty());
+    EXPECT_EQ(images[0].mimeType, "image/png");
+    size_t size = 0;
+    const char* data = gltfLoader.getImageData(images[0], &size);
+    ASSERT_NE(data, nullptr);
+    GTEST_ASSERT_EQ(size, imageData.size());
+    EXPECT_EQ(std::string(data, size), imageData);
+
+    // External images are not loaded by the loader
+    EXPECT_EQ(images[1].filename.filename(), "texture.png");
+    EXPECT_EQ(gltfLoader.getImageData(images[1], &size), nullptr);
+    EXPECT_EQ(size, 0);
+}
+
+TEST(GLTFLoader, UnsupportedDataUri)
+{
+    Json gltf = {
+        {"asset", {{"version", "2.0"}}},
+        {"buffers", {{{"uri", "data:application/octet-stream,AAAA"}, {"byteLength", 3}}}}
+    };
+
+    GLTFLoader gltfLoader;
+    EXPECT_THROW(gltfLoader.readFromFile(writeGltf("unsupported.gltf", gltf)), std::runtime_error);
+}
+
+TEST(GLTFLoader, QuantizedPositionBounds)
+{
+    // KHR_mesh_quantization positions, padded to 4 components as required for vertex attribute alignment
+    const int16_t normalizedPositions[12] = {-32767, 0, 16384, 0, 100, 32767, -32768, 0, 0, -100, 0, 0};
+    const uint16_t integerPositions[12] = {1, 2, 3, 0, 10, 20, 30, 0, 5, 50, 0, 0};
+    std::vector<char> bufferData(sizeof(normalizedPositions) + sizeof(integerPositions));
+    memcpy(bufferData.data(), normalizedPositions, sizeof(normalizedPositions));
+    memcpy(bufferData.data() + sizeof(normalizedPositions), integerPositions, sizeof(integerPositions));
+
+    Json gltf = {
+        {"asset", {{"version", "2.0"}}},
+        {"extensionsUsed", {"KHR_mesh_quantization"}},
+        {"extensionsRequired", {"KHR_mesh_quantization"}},
+        {"buffers", {{
+            {"uri", "data:application/octet-stream;base64," + encodeBase64(bufferData.data(), bufferData.size())},
+            {"byteLength", bufferData.size()}
+        }}},
+        {"bufferViews", {
+            {{"buffer", 0}, {"byteOffset", 0}, {"byteLength", sizeof(normalizedPositions)}, {"byteStride", 8}},
+            {{"buffer", 0}, {"byteOffset", sizeof(normalizedPositions)}, {"byteLength", sizeof(integerPositions)},
+                {"byteStride", 8}}
+        }},
+        {"accessors", {
+            {{"bufferView", 0}, {"componentType", 5122}, {"normalized", true}, {"count", 3}, {"type", "VEC3"},
+                {"min", {-32767, -100, -32768}}, {"max", {100, 32767, 16384}}},
+            {{"bufferView", 0}, {"componentType", 5122}, {"normalized", true}, {"count", 3}, {"type", "VEC3"}},
+            {{"bufferView", 1}, {"componentType", 5123}, {"count", 3}, {"type", "VEC3"}}
+        }}
+    };
+
+    GLTFLoader gltfLoader;
+    gltfLoader.readFromFile(writeGltf("quantized.gltf", gltf));
+    const auto& accessors = gltfLoader.getAccessors();
+    EXPECT_TRUE(accessors[0].normalized);
+    EXPECT_FALSE(accessors[2].normalized);
+
+    // Bounds from min / max and computed from the data agree
+    for (int i=0; i<2; ++i) {
+        AABB bounds = gltfLoader.getAccessorBounds(accessors[i]);
+        EXPECT_FLOAT_EQ(bounds.min.x(), -1.0f);
+        EXPECT_FLOAT_EQ(bounds.min.y(), -100.0f / 32767.0f);
+        EXPECT_FLOAT_EQ(bounds.min.z(), -1.0f);
+        EXPECT_FLOAT_EQ(bounds.max.x(), 100.0f / 32767.0f);
+        EXPECT_FLOAT_EQ(bounds.max.y(), 1.0f);
+        EXPECT_FLOAT_EQ(bounds.max.z(), 16384.0f / 32767.0f);
+    }
+
+    // Non-normalized integers are converted as they are
+    AABB bounds = gltfLoader.getAccessorBounds(accessors[2]);
+    EXPECT_EQ(bounds.min, Vec3f(1.0f, 2.0f, 0.0f));
+    EXPECT_EQ(bounds.max, Vec3f(10.0f, 50.0f, 30.0f));
+}
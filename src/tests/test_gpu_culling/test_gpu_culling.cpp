@@ -0,0 +1,295 @@
+//
+// Project: GraphicsUtils2
+// File: test_gpu_culling.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_vulkan/DescriptorManager.hpp>
+#include <gu2_vulkan/FrameAllocator.hpp>
+#include <gu2_vulkan/GpuCulling.hpp>
+#include <gu2_vulkan/MemoryAllocator.hpp>
+#include <gu2_vulkan/Texture.hpp>
+#include <gu2_vulkan/Util.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+
+using namespace gu2;
+
+
+// Headless compute-only device, a software ICD (lavapipe, SwiftShader) is preferred so that the results don't
+// depend on the GPU of the machine running the tests
+class GpuCullingTest : public ::testing::Test {
+protected:
+    VkInstance                          _instance       {VK_NULL_HANDLE};
+    VkPhysicalDevice                    _physicalDevice {VK_NULL_HANDLE};
+    VkDevice                            _device         {VK_NULL_HANDLE};
+    uint32_t                            _queueFamily    {0};
+    VkQueue                             _queue          {VK_NULL_HANDLE};
+    VkCommandPool                       _commandPool    {VK_NULL_HANDLE};
+    std::unique_ptr<MemoryAllocator>    _memoryAllocator;
+    std::unique_ptr<DescriptorManager>  _descriptorManager;
+
+    void SetUp() override
+    {
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "test_gpu_culling";
+        appInfo.apiVersion = VK_API_VERSION_1_0;
+
+        VkInstanceCreateInfo instanceInfo{};
+        instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceInfo.pApplicationInfo = &appInfo;
+        if (vkCreateInstance(&instanceInfo, nullptr, &_instance) != VK_SUCCESS)
+            GTEST_SKIP() << "No Vulkan ICD available";
+
+        for (auto physicalDevice : gu2::vkEnumeratePhysicalDevices(_instance)) {
+            if (!GpuCulling::isSupported(physicalDevice))
+                continue;
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            if (_physicalDevice == VK_NULL_HANDLE || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+                _physicalDevice = physicalDevice;
+        }
+        if (_physicalDevice == VK_NULL_HANDLE)
+            GTEST_SKIP() << "No Vulkan device supporting GPU culling";
+
+        auto queueFamilies = gu2::vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice);
+        auto computeFamily = std::find_if(queueFamilies.begin(), queueFamilies.end(), [](const auto& family) {
+            return (family.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+        });
+        ASSERT_NE(computeFamily, queueFamilies.end());
+        _queueFamily = static_cast<uint32_t>(computeFamily - queueFamilies.begin());
+
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo{};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = _queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+
+        VkPhysicalDeviceFeatures features{};
+        features.multiDrawIndirect = VK_TRUE;
+        features.drawIndirectFirstInstance = VK_TRUE;
+        const char* extensions[] {VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME};
+
+        VkDeviceCreateInfo deviceInfo{};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        deviceInfo.pEnabledFeatures = &features;
+        deviceInfo.enabledExtensionCount = 1;
+        deviceInfo.ppEnabledExtensionNames = extensions;
+        ASSERT_EQ(vkCreateDevice(_physicalDevice, &deviceInfo, nullptr, &_device), VK_SUCCESS);
+        vkGetDeviceQueue(_device, _queueFamily, 0, &_queue);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = _queueFamily;
+        ASSERT_EQ(vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool), VK_SUCCESS);
+
+        _memoryAllocator = std::make_unique<MemoryAllocator>(MemoryAllocatorSettings{
+            .physicalDevice = _physicalDevice,
+            .device = _device
+        });
+        _descriptorManager = std::make_unique<DescriptorManager>(_device);
+    }
+
+    void TearDown() override
+    {
+        if (_device != VK_NULL_HANDLE) {
+            vkDeviceWaitIdle(_device);
+            _descriptorManager.reset();
+            _memoryAllocator.reset();
+            vkDestroyCommandPool(_device, _commandPool, nullptr);
+            vkDestroyDevice(_device, nullptr);
+        }
+        if (_instance != VK_NULL_HANDLE)
+            vkDestroyInstance(_instance, nullptr);
+    }
+
+    static GpuCulling::Node makeNode(const Vec3f& center, float radius, uint32_t drawGroup, uint32_t firstLod,
+        uint32_t nLods)
+    {
+        GpuCulling::Node node{};
+        node.sphere << center, radius;
+        node.boundsMin << center - Vec3f::Constant(radius), 0.0f;
+        node.boundsMax << center + Vec3f::Constant(radius), 0.0f;
+        node.drawGroup = drawGroup;
+        node.firstLod = firstLod;
+        node.nLods = nLods;
+        node.maxScale = 1.0f;
+        return node;
+    }
+};
+
+
+TEST_F(GpuCullingTest, FrustumCullingWritesDrawCommands)
+{
+    // Occlusion culling is off, the depth texture only needs to exist
+    Texture depthTexture(TextureSettings{_physicalDevice, _device, _memoryAllocator.get()});
+    depthTexture.create(TextureProperties{
+        .width = 16,
+        .height = 16,
+        .format = VK_FORMAT_D32_SFLOAT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        .aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT
+    });
+
+    GpuCulling gpuCulling(GpuCullingSettings{
+        .physicalDevice = _physicalDevice,
+        .device = _device,
+        .descriptorManager = _descriptorManager.get(),
+        .memoryAllocator = _memoryAllocator.get(),
+        .framesInFlight = 1
+    });
+    gpuCulling.setOcclusionCulling(false);
+
+    // Group 0 has nodes 0 - 2, group 1 nodes 3 - 4. LODs 1 and 2 are the chain of node 4.
+    std::vector<GpuCulling::Lod> lods {
+        {0, 36, 0.0f, 0},
+        {100, 24, 0.0f, 10},
+        {200, 12, 0.5f, 20}
+    };
+    gpuCulling.setGeometry(lods, {3, 2}, 5);
+    gpuCulling.setDepthTexture(depthTexture);
+
+    // With identity view and projection the frustum is -1 <= x, y <= 1, 0 <= z <= 1, camera at the origin
+    GpuCulling::Node* nodes = gpuCulling.getNodeData(0);
+    nodes[0] = makeNode(Vec3f(0.0f, 0.0f, 0.5f), 0.1f, 0, 0, 1);   // inside
+    nodes[1] = makeNode(Vec3f(5.0f, 0.0f, 0.5f), 0.1f, 0, 0, 1);   // outside
+    nodes[2] = makeNode(Vec3f(0.95f, 0.0f, 0.5f), 0.1f, 0, 0, 1);  // crossing the right plane
+    nodes[3] = makeNode(Vec3f(0.0f, 0.0f, 0.5f), -1.0f, 1, 0, 1);  // empty
+    nodes[4] = makeNode(Vec3f(0.0f, 0.5f, 0.5f), 0.1f, 1, 1, 2);   // inside, coarse LOD within the error
+
+    Scene::Camera camera;
+    camera.viewportHeight = 1.0f;
+
+    // Draw commands are in device local memory, copy them for reading
+    constexpr uint32_t nCommands = 5;
+    constexpr VkDeviceSize commandsSize = nCommands*sizeof(VkDrawIndexedIndirectCommand);
+    VkBuffer readbackBuffer;
+    MemoryAllocation readbackAllocation;
+    gu2::createBuffer(_memoryAllocator.get(), _physicalDevice, _device, commandsSize,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &readbackBuffer, &readbackAllocation);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(_device, _commandPool);
+    gpuCulling.cull(commandBuffer, 0, camera, 10.0f);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+    VkBufferCopy copyRegion{0, 0, commandsSize};
+    vkCmdCopyBuffer(commandBuffer, gpuCulling.getDrawCommandBuffer(0), readbackBuffer, 1, &copyRegion);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+    endSingleTimeCommands(_device, _commandPool, _queue, commandBuffer);
+
+    EXPECT_EQ(gpuCulling.getVisibleCount(0), 3u);
+
+    std::vector<VkDrawIndexedIndirectCommand> commands(nCommands);
+    memcpy(commands.data(), readbackAllocation.mapped, commandsSize);
+    gu2::destroyBuffer(_memoryAllocator.get(), _device, &readbackBuffer, &readbackAllocation);
+
+    // Commands of a group are written in the order of the atomic increments
+    auto byInstance = [](const VkDrawIndexedIndirectCommand& a, const VkDrawIndexedIndirectCommand& b) {
+        return a.firstInstance < b.firstInstance;
+    };
+    std::sort(commands.begin(), commands.begin() + 2, byInstance);
+
+    const auto& drawGroups = gpuCulling.getDrawGroups();
+    ASSERT_EQ(drawGroups.size(), 2u);
+    EXPECT_EQ(drawGroups[0].firstCommand, 0u);
+    EXPECT_EQ(drawGroups[1].firstCommand, 3u);
+
+    auto expectCommand = [](const VkDrawIndexedIndirectCommand& command, uint32_t indexCount, uint32_t firstIndex,
+        int32_t vertexOffset, uint32_t firstInstance) {
+        EXPECT_EQ(command.indexCount, indexCount);
+        EXPECT_EQ(command.instanceCount, 1u);
+        EXPECT_EQ(command.firstIndex, firstIndex);
+        EXPECT_EQ(command.vertexOffset, vertexOffset);
+        EXPECT_EQ(command.firstInstance, firstInstance);
+    };
+    expectCommand(commands[0], 36, 0, 0, 0);
+    expectCommand(commands[1], 36, 0, 0, 2);
+    expectCommand(commands[3], 12, 200, 20, 4);
+}
+
+TEST_F(GpuCullingTest, MemoryStrategies)
+{
+    constexpr auto firstFit = static_cast<size_t>(MemoryStrategy::FirstFit);
+    constexpr auto buddy = static_cast<size_t>(MemoryStrategy::Buddy);
+    constexpr auto linear = static_cast<size_t>(MemoryStrategy::Linear);
+
+    // The buffers of the frames in flight share a linear block
+    auto frameAllocator = std::make_unique<FrameAllocator>(FrameAllocatorSettings{
+        .physicalDevice = _physicalDevice,
+        .device = _device,
+        .memoryAllocator = _memoryAllocator.get(),
+        .framesInFlight = 2
+    });
+    auto statistics = _memoryAllocator->getStatistics();
+    EXPECT_EQ(statistics.nStrategyBlocks[linear], 1u);
+    EXPECT_EQ(statistics.nStrategyAllocations[linear], 2u);
+    EXPECT_EQ(statistics.nStrategyBlocks[buddy], 0u);
+
+    Texture depthTexture(TextureSettings{_physicalDevice, _device, _memoryAllocator.get()});
+    depthTexture.create(TextureProperties{
+        .width = 64,
+        .height = 32,
+        .format = VK_FORMAT_D32_SFLOAT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        .aspectFlags = VK_IMAGE_ASPECT_DEPTH_BIT
+    });
+    EXPECT_EQ(_memoryAllocator->getStatistics().nStrategyAllocations[firstFit], 1u);
+
+    {
+        // The culling buffers and the depth pyramid are recreated as the scene and the window change, they are
+        // placed in buddy blocks
+        GpuCulling gpuCulling(GpuCullingSettings{
+            .physicalDevice = _physicalDevice,
+            .device = _device,
+            .descriptorManager = _descriptorManager.get(),
+            .memoryAllocator = _memoryAllocator.get(),
+            .framesInFlight = 2
+        });
+        gpuCulling.setGeometry({{0, 36, 0.0f, 0}}, {1}, 1);
+        gpuCulling.setDepthTexture(depthTexture);
+
+        statistics = _memoryAllocator->getStatistics();
+        EXPECT_GE(statistics.nStrategyBlocks[buddy], 1u);
+        // Uniforms, nodes, draw commands, draw counts and their readback per frame, the LODs and the draw groups
+        // and the depth pyramid
+        EXPECT_EQ(statistics.nStrategyAllocations[buddy], 2*5 + 2 + 1u);
+        EXPECT_EQ(statistics.nStrategyAllocations[linear], 2u);
+        EXPECT_EQ(statistics.nDedicatedAllocations, 0u);
+    }
+
+    // The suballocations are released with the resources
+    statistics = _memoryAllocator->getStatistics();
+    EXPECT_EQ(statistics.nStrategyAllocations[buddy], 0u);
+    frameAllocator.reset();
+    EXPECT_EQ(_memoryAllocator->getStatistics().nStrategyAllocations[linear], 0u);
+}
@@ -0,0 +1,61 @@
+//
+// Project: GraphicsUtils2
+// File: test_linear_allocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/LinearAllocator.hpp>
+
+
+using namespace gu2;
+
+
+TEST(LinearAllocator, AllocateFree)
+{
+    LinearAllocator allocator(100);
+    EXPECT_EQ(allocator.allocate(10), 0u);
+    EXPECT_EQ(allocator.allocate(20), 10u);
+    EXPECT_EQ(allocator.allocate(30), 30u);
+    EXPECT_EQ(allocator.getUsedSize(), 60u);
+    EXPECT_EQ(allocator.getAllocationCount(), 3u);
+    EXPECT_EQ(allocator.allocate(50), LinearAllocator::invalidOffset);
+
+    // Space in the middle is not reused
+    allocator.free(10);
+    EXPECT_EQ(allocator.getHead(), 60u);
+    EXPECT_EQ(allocator.allocate(41), LinearAllocator::invalidOffset);
+
+    // Freeing the allocation at the head rolls the head back to the last live allocation
+    allocator.free(30);
+    EXPECT_EQ(allocator.getHead(), 10u);
+    EXPECT_EQ(allocator.allocate(90), 10u);
+
+    // Freeing everything resets the head
+    allocator.free(0);
+    allocator.free(10);
+    EXPECT_EQ(allocator.getHead(), 0u);
+    EXPECT_EQ(allocator.getUsedSize(), 0u);
+    EXPECT_EQ(allocator.allocate(100), 0u);
+
+    EXPECT_THROW(allocator.free(50), std::runtime_error);
+}
+
+TEST(LinearAllocator, Alignment)
+{
+    LinearAllocator allocator(256);
+    EXPECT_EQ(allocator.allocate(3), 0u);
+    EXPECT_EQ(allocator.allocate(16, 64), 64u);
+    // Alignment padding is not reused
+    EXPECT_EQ(allocator.allocate(8, 4), 80u);
+    EXPECT_EQ(allocator.getUsedSize(), 27u);
+    EXPECT_THROW(allocator.allocate(1, 0), std::runtime_error);
+
+    allocator.clear();
+    EXPECT_EQ(allocator.allocate(256), 0u);
+}
@@ -0,0 +1,139 @@
+//
+// Project: GraphicsUtils2
+// File: test_mesh_optimizer.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/MeshOptimizer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+
+using namespace gu2;
+
+
+static std::default_random_engine rnd(8812441);
+
+
+// Grid of n x n quads with the triangles in random order
+static std::vector<uint32_t> createShuffledGrid(uint32_t n, std::vector<Vec3f>* positions)
+{
+    positions->clear();
+    for (uint32_t j=0; j<=n; ++j) {
+        for (uint32_t i=0; i<=n; ++i)
+            positions->emplace_back(static_cast<float>(i), static_cast<float>(j), 0.0f);
+    }
+
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (uint32_t j=0; j<n; ++j) {
+        for (uint32_t i=0; i<n; ++i) {
+            uint32_t v = j*(n+1) + i;
+            triangles.push_back({v, v+1, v+n+2});
+            triangles.push_back({v, v+n+2, v+n+1});
+        }
+    }
+    std::shuffle(triangles.begin(), triangles.end(), rnd);
+
+    std::vector<uint32_t> indices;
+    for (const auto& t : triangles)
+        indices.insert(indices.end(), t.begin(), t.end());
+    return indices;
+}
+
+// Triangles with the vertex positions resolved and rotated to a canonical order, for comparing index buffers
+// referencing differently ordered vertices
+template <typename T_Index>
+static std::vector<std::array<float, 9>> getSortedTriangles(const std::vector<T_Index>& indices,
+    const std::vector<Vec3f>& positions)
+{
+    std::vector<std::array<float, 9>> triangles;
+    for (size_t i=0; i<indices.size(); i+=3) {
+        std::array<float, 9> triangle;
+        for (size_t rotation=0; rotation<3; ++rotation) {
+            std::array<float, 9> rotated;
+            for (size_t j=0; j<3; ++j) {
+                const auto& p = positions[indices[i + (rotation + j) % 3]];
+                for (int k=0; k<3; ++k)
+                    rotated[j*3 + k] = p(k);
+            }
+            if (rotation == 0 || rotated < triangle)
+                triangle = rotated;
+        }
+        triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+
+TEST(MeshOptimizer, VertexCache)
+{
+    std::vector<Vec3f> positions;
+    auto indices = createShuffledGrid(64, &positions);
+    auto original = indices;
+
+    float acmrBefore = computeACMR(indices.data(), indices.size(), positions.size());
+    std::vector<uint32_t> clusters;
+    optimizeVertexCache(indices.data(), indices.size(), positions.size(), &clusters);
+    float acmrAfter = computeACMR(indices.data(), indices.size(), positions.size());
+
+    EXPECT_LT(acmrAfter, 1.0f);
+    EXPECT_LT(acmrAfter, 0.5f*acmrBefore);
+    ASSERT_FALSE(clusters.empty());
+    EXPECT_EQ(clusters[0], 0u);
+    EXPECT_TRUE(std::is_sorted(clusters.begin(), clusters.end()));
+    EXPECT_EQ(getSortedTriangles(indices, positions), getSortedTriangles(original, positions));
+
+    optimizeOverdraw(indices.data(), indices.size(), positions.data(), clusters);
+    EXPECT_EQ(getSortedTriangles(indices, positions), getSortedTriangles(original, positions));
+}
+
+TEST(MeshOptimizer, VertexFetch)
+{
+    std::vector<Vec3f> positions;
+    auto indices = createShuffledGrid(16, &positions);
+    auto original = indices;
+    positions.emplace_back(100.0f, 100.0f, 100.0f); // unused vertex
+
+    std::vector<uint32_t> remap;
+    size_t nUsedVertices = optimizeVertexFetch(indices.data(), indices.size(), positions.size(), &remap);
+    EXPECT_EQ(nUsedVertices, positions.size() - 1);
+    EXPECT_EQ(remap.back(), 0xffffffff);
+
+    // Indices increase by at most one at a time
+    uint32_t maxIndex = 0;
+    for (auto index : indices) {
+        EXPECT_LE(index, maxIndex + 1);
+        maxIndex = std::max(maxIndex, index);
+    }
+
+    auto originalPositions = positions;
+    remapVertices(positions.data(), sizeof(Vec3f), positions.size(), remap);
+    EXPECT_EQ(getSortedTriangles(indices, positions), getSortedTriangles(original, originalPositions));
+}
+
+TEST(MeshOptimizer, NarrowIndices)
+{
+    std::vector<uint32_t> indices {0, 1, 2, 65535, 17, 3};
+    std::vector<uint16_t> narrowed(indices.size());
+    narrowIndices(indices.data(), indices.size(), narrowed.data());
+    for (size_t i=0; i<indices.size(); ++i)
+        EXPECT_EQ(narrowed[i], indices[i]);
+
+    // In place
+    narrowIndices(indices.data(), indices.size(), reinterpret_cast<uint16_t*>(indices.data()));
+    for (size_t i=0; i<narrowed.size(); ++i)
+        EXPECT_EQ(reinterpret_cast<const uint16_t*>(indices.data())[i], narrowed[i]);
+
+    indices = {0, 65536, 1};
+    EXPECT_THROW(narrowIndices(indices.data(), indices.size(), narrowed.data()), std::runtime_error);
+}
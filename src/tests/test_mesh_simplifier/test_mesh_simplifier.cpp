@@ -0,0 +1,179 @@
+//
+// Project: GraphicsUtils2
+// File: test_mesh_simplifier.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/MeshSimplifier.hpp>
+
+#include <cfloat>
+#include <map>
+#include <utility>
+#include <vector>
+
+
+using namespace gu2;
+
+
+// Grid of n x n quads on the z = 0 plane, facing +z
+static std::vector<uint16_t> createGrid(uint16_t n, std::vector<Vec3f>* positions)
+{
+    positions->clear();
+    for (uint16_t j=0; j<=n; ++j) {
+        for (uint16_t i=0; i<=n; ++i)
+            positions->emplace_back(static_cast<float>(i), static_cast<float>(j), 0.0f);
+    }
+
+    std::vector<uint16_t> indices;
+    for (uint16_t j=0; j<n; ++j) {
+        for (uint16_t i=0; i<n; ++i) {
+            uint16_t v = j*(n+1) + i;
+            indices.insert(indices.end(), {v, static_cast<uint16_t>(v+1), static_cast<uint16_t>(v+n+2)});
+            indices.insert(indices.end(), {v, static_cast<uint16_t>(v+n+2), static_cast<uint16_t>(v+n+1)});
+        }
+    }
+    return indices;
+}
+
+// Unit sphere from a subdivided icosahedron, closed and without split vertices
+static std::vector<uint32_t> createSphere(int nSubdivisions, std::vector<Vec3f>* positions)
+{
+    const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    *positions = {
+        {-1.0f, t, 0.0f}, {1.0f, t, 0.0f}, {-1.0f, -t, 0.0f}, {1.0f, -t, 0.0f},
+        {0.0f, -1.0f, t}, {0.0f, 1.0f, t}, {0.0f, -1.0f, -t}, {0.0f, 1.0f, -t},
+        {t, 0.0f, -1.0f}, {t, 0.0f, 1.0f}, {-t, 0.0f, -1.0f}, {-t, 0.0f, 1.0f}};
+    std::vector<uint32_t> indices = {
+        0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+        1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+        3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+        4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1};
+
+    for (int s=0; s<nSubdivisions; ++s) {
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+        auto getMidpoint = [&](uint32_t a, uint32_t b) {
+            auto key = std::minmax(a, b);
+            auto it = midpoints.find(key);
+            if (it != midpoints.end())
+                return it->second;
+            uint32_t v = static_cast<uint32_t>(positions->size());
+            positions->push_back(0.5f*((*positions)[a] + (*positions)[b]));
+            midpoints.emplace(key, v);
+            return v;
+        };
+
+        std::vector<uint32_t> subdivided;
+        for (size_t i=0; i<indices.size(); i+=3) {
+            uint32_t a = indices[i];
+            uint32_t b = indices[i+1];
+            uint32_t c = indices[i+2];
+            uint32_t ab = getMidpoint(a, b);
+            uint32_t bc = getMidpoint(b, c);
+            uint32_t ca = getMidpoint(c, a);
+            subdivided.insert(subdivided.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        indices = std::move(subdivided);
+    }
+
+    for (auto& p : *positions)
+        p.normalize();
+    return indices;
+}
+
+// Indices in range and no degenerate triangles
+template <typename T_Index>
+static void expectValid(const std::vector<T_Index>& indices, size_t nVertices)
+{
+    EXPECT_EQ(indices.size() % 3, 0u);
+    for (size_t i=0; i<indices.size(); i+=3) {
+        for (int j=0; j<3; ++j)
+            EXPECT_LT(indices[i+j], nVertices);
+        EXPECT_NE(indices[i], indices[i+1]);
+        EXPECT_NE(indices[i+1], indices[i+2]);
+        EXPECT_NE(indices[i+2], indices[i]);
+    }
+}
+
+
+TEST(MeshSimplifier, PlanarGrid)
+{
+    std::vector<Vec3f> positions;
+    auto indices = createGrid(16, &positions);
+    ASSERT_EQ(indices.size(), 16*16*6);
+
+    size_t targetIndexCount = indices.size() / 2;
+    float error = -1.0f;
+    auto simplified = simplifyMesh(indices.data(), indices.size(), positions.data(), positions.size(),
+        targetIndexCount, FLT_MAX, &error);
+    expectValid(simplified, positions.size());
+    EXPECT_LE(simplified.size(), targetIndexCount);
+    EXPECT_GT(simplified.size(), 0u);
+
+    // Collapses within the plane are free, the border is locked and no triangle flips, so the area is kept
+    EXPECT_EQ(error, 0.0f);
+    float area = 0.0f;
+    for (size_t i=0; i<simplified.size(); i+=3) {
+        const Vec3f& p0 = positions[simplified[i]];
+        const Vec3f& p1 = positions[simplified[i+1]];
+        const Vec3f& p2 = positions[simplified[i+2]];
+        Vec3f n = (p1 - p0).cross(p2 - p0);
+        EXPECT_GT(n.z(), 0.0f);
+        area += 0.5f*n.z();
+    }
+    EXPECT_NEAR(area, 16.0f*16.0f, 1.0e-3f);
+
+    // Zero target error allows the planar collapses as well
+    auto simplifiedZeroError = simplifyMesh(indices.data(), indices.size(), positions.data(), positions.size(),
+        targetIndexCount, 0.0f, &error);
+    EXPECT_LE(simplifiedZeroError.size(), targetIndexCount);
+    EXPECT_EQ(error, 0.0f);
+}
+
+TEST(MeshSimplifier, Sphere)
+{
+    std::vector<Vec3f> positions;
+    auto indices = createSphere(3, &positions);
+    ASSERT_EQ(indices.size(), 20*64*3);
+
+    // Reaching the target index count, the result stays closed and close to the sphere
+    size_t targetIndexCount = indices.size() / 4;
+    float error = -1.0f;
+    auto simplified = simplifyMesh(indices.data(), indices.size(), positions.data(), positions.size(),
+        targetIndexCount, FLT_MAX, &error);
+    expectValid(simplified, positions.size());
+    EXPECT_LE(simplified.size(), targetIndexCount);
+    EXPECT_GT(simplified.size(), targetIndexCount / 2);
+    EXPECT_GT(error, 0.0f);
+    EXPECT_LT(error, 0.1f);
+
+    std::map<std::pair<uint32_t, uint32_t>, int> edges;
+    for (size_t i=0; i<simplified.size(); i+=3) {
+        for (int j=0; j<3; ++j)
+            ++edges[std::minmax(simplified[i+j], simplified[i + (j+1)%3])];
+
+        // Triangles face outwards and their centroids stay near the surface
+        const Vec3f& p0 = positions[simplified[i]];
+        const Vec3f& p1 = positions[simplified[i+1]];
+        const Vec3f& p2 = positions[simplified[i+2]];
+        Vec3f centroid = (p0 + p1 + p2) / 3.0f;
+        EXPECT_GT((p1 - p0).cross(p2 - p0).dot(centroid), 0.0f);
+        EXPECT_GT(centroid.norm(), 0.8f);
+    }
+    for (const auto& [edge, count] : edges)
+        EXPECT_EQ(count, 2);
+
+    // Stopping at the target error
+    const float targetError = 0.01f;
+    auto simplifiedBounded = simplifyMesh(indices.data(), indices.size(), positions.data(), positions.size(), 0,
+        targetError, &error);
+    expectValid(simplifiedBounded, positions.size());
+    EXPECT_LT(simplifiedBounded.size(), indices.size());
+    EXPECT_GT(simplifiedBounded.size(), simplified.size());
+    EXPECT_LE(error, targetError);
+}
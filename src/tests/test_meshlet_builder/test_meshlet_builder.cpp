@@ -0,0 +1,117 @@
+//
+// Project: GraphicsUtils2
+// File: test_meshlet_builder.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/MeshletBuilder.hpp>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+
+using namespace gu2;
+
+
+// Grid of n x n quads on the xy-plane, facing +z
+static std::vector<uint32_t> createGrid(uint32_t n, std::vector<Vec3f>* positions)
+{
+    positions->clear();
+    for (uint32_t j=0; j<=n; ++j) {
+        for (uint32_t i=0; i<=n; ++i)
+            positions->emplace_back(static_cast<float>(i), static_cast<float>(j), 0.0f);
+    }
+
+    std::vector<uint32_t> indices;
+    for (uint32_t j=0; j<n; ++j) {
+        for (uint32_t i=0; i<n; ++i) {
+            uint32_t v = j*(n+1) + i;
+            indices.insert(indices.end(), {v, v+1, v+n+2, v, v+n+2, v+n+1});
+        }
+    }
+    return indices;
+}
+
+// Triangles of the meshlets resolved back to mesh vertex indices
+static std::vector<std::array<uint32_t, 3>> getMeshletTriangles(const Meshlets& meshlets)
+{
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (size_t m=0; m<meshlets.size(); ++m) {
+        const uint32_t* vertices = &meshlets.vertices[meshlets.vertexOffsets[m]];
+        const uint8_t* localIndices = &meshlets.triangles[meshlets.triangleOffsets[m]];
+        for (uint32_t t=0; t<meshlets.getTriangleCount(m); ++t) {
+            triangles.push_back({vertices[localIndices[t*3]], vertices[localIndices[t*3 + 1]],
+                vertices[localIndices[t*3 + 2]]});
+        }
+    }
+    return triangles;
+}
+
+
+TEST(MeshletBuilder, Partition)
+{
+    std::vector<Vec3f> positions;
+    auto indices = createGrid(32, &positions);
+    auto meshlets = buildMeshlets(indices.data(), indices.size(), positions.data(), positions.size(), 64, 96);
+
+    ASSERT_GT(meshlets.size(), 0u);
+    EXPECT_EQ(meshlets.triangleOffsets.size(), meshlets.size());
+    EXPECT_EQ(meshlets.counts.size(), meshlets.size());
+    EXPECT_EQ(meshlets.spheres.size(), meshlets.size());
+    EXPECT_EQ(meshlets.cones.size(), meshlets.size());
+
+    for (size_t m=0; m<meshlets.size(); ++m) {
+        EXPECT_LE(meshlets.getVertexCount(m), 64u);
+        EXPECT_LE(meshlets.getTriangleCount(m), 96u);
+        EXPECT_EQ(meshlets.triangleOffsets[m] % 4, 0u);
+
+        // Sphere contains the meshlet vertices
+        for (uint32_t v=0; v<meshlets.getVertexCount(m); ++v) {
+            const Vec3f& p = positions[meshlets.vertices[meshlets.vertexOffsets[m] + v]];
+            EXPECT_LE((p - meshlets.spheres[m].head<3>()).norm(), meshlets.spheres[m].w() + 1.0e-5f);
+        }
+    }
+
+    // Every triangle is in exactly one meshlet, winding retained
+    auto triangles = getMeshletTriangles(meshlets);
+    std::vector<std::array<uint32_t, 3>> original;
+    for (size_t i=0; i<indices.size(); i+=3)
+        original.push_back({indices[i], indices[i+1], indices[i+2]});
+    std::sort(triangles.begin(), triangles.end());
+    std::sort(original.begin(), original.end());
+    EXPECT_EQ(triangles, original);
+
+    // Adjacency based growth should fill the meshlets reasonably well
+    EXPECT_LE(meshlets.size(), 2*indices.size()/3 / 96 + 2);
+}
+
+TEST(MeshletBuilder, ConeCulling)
+{
+    std::vector<Vec3f> positions;
+    auto indices = createGrid(8, &positions);
+    auto meshlets = buildMeshlets(indices.data(), indices.size(), positions.data(), positions.size());
+
+    for (size_t m=0; m<meshlets.size(); ++m) {
+        EXPECT_NEAR(meshlets.cones[m].z(), 1.0f, 1.0e-5f);
+        EXPECT_FALSE(isMeshletBackfacing(meshlets.spheres[m], meshlets.cones[m], Vec3f(4.0f, 4.0f, 10.0f)));
+        EXPECT_TRUE(isMeshletBackfacing(meshlets.spheres[m], meshlets.cones[m], Vec3f(4.0f, 4.0f, -10.0f)));
+    }
+}
+
+TEST(MeshletBuilder, InvalidInput)
+{
+    std::vector<uint32_t> indices {0, 1, 2};
+    std::vector<Vec3f> positions(2, Vec3f::Zero());
+    EXPECT_THROW(buildMeshlets(indices.data(), indices.size(), positions.data(), positions.size()),
+        std::runtime_error);
+    positions.resize(3, Vec3f::Zero());
+    EXPECT_THROW(buildMeshlets(indices.data(), indices.size(), positions.data(), positions.size(), 256),
+        std::runtime_error);
+}
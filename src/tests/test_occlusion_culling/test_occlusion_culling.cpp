@@ -0,0 +1,117 @@
+//
+// Project: GraphicsUtils2
+// File: test_occlusion_culling.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/OcclusionCulling.hpp>
+
+#include <vector>
+
+
+using namespace gu2;
+
+
+static constexpr float  near    {0.1f};
+
+
+// Camera at the origin looking towards +z, infinite far-plane and inverted depth as in the demos
+static Mat4f createViewProjection()
+{
+    Mat4f projection;
+    projection <<
+        1.0f,   0.0f,   0.0f,   0.0f,
+        0.0f,   -1.0f,  0.0f,   0.0f,
+        0.0f,   0.0f,   0.0f,   near,
+        0.0f,   0.0f,   1.0f,   0.0f;
+    return projection;
+}
+
+static AABB createBox(const Vec3f& center, float halfSize)
+{
+    AABB box;
+    box.min = center - Vec3f::Constant(halfSize);
+    box.max = center + Vec3f::Constant(halfSize);
+    return box;
+}
+
+// Quad on the plane z = 10 covering x, y in [-5, 5]
+static const std::vector<Vec3f> wallPositions {
+    Vec3f(-5.0f, -5.0f, 10.0f), Vec3f(5.0f, -5.0f, 10.0f), Vec3f(5.0f, 5.0f, 10.0f), Vec3f(-5.0f, 5.0f, 10.0f)};
+
+
+TEST(OcclusionCulling, Wall)
+{
+    std::vector<uint32_t> indices {0, 1, 2, 0, 2, 3};
+    OcclusionBuffer buffer(200, 100);
+    EXPECT_EQ(buffer.getWidth(), 224u);
+    EXPECT_EQ(buffer.getHeight(), 112u);
+
+    buffer.clear(createViewProjection());
+    buffer.addOccluder(Mat4f::Identity(), wallPositions.data(), wallPositions.size(), indices.data(),
+        indices.size());
+    buffer.rasterize();
+    EXPECT_EQ(buffer.getTriangleCount(), 2u);
+
+    // Wall covers the middle half of the buffer at inverted depth near / 10
+    const float* depth = buffer.getDepth();
+    uint32_t width = buffer.getWidth();
+    uint32_t height = buffer.getHeight();
+    EXPECT_NEAR(depth[(height/2)*width + width/2], near/10.0f, 1.0e-6f);
+    EXPECT_EQ(depth[(height/2)*width + 2], 0.0f);
+    EXPECT_EQ(depth[2*width + width/2], 0.0f);
+
+    // Coarsest level has the farthest depth of the whole buffer
+    EXPECT_EQ(buffer.getDepth(buffer.getLevelCount()-1)[0], 0.0f);
+
+    EXPECT_FALSE(buffer.isVisible(createBox(Vec3f(0.0f, 0.0f, 20.0f), 1.0f)));
+    EXPECT_FALSE(buffer.isVisible(createBox(Vec3f(4.0f, -4.0f, 12.0f), 0.5f)));
+    EXPECT_TRUE(buffer.isVisible(createBox(Vec3f(0.0f, 0.0f, 5.0f), 1.0f)));     // in front of the wall
+    EXPECT_TRUE(buffer.isVisible(createBox(Vec3f(0.0f, 0.0f, 9.5f), 1.0f)));     // intersects the wall
+    EXPECT_TRUE(buffer.isVisible(createBox(Vec3f(9.0f, 0.0f, 20.0f), 2.0f)));    // sticks out behind the edge
+    EXPECT_TRUE(buffer.isVisible(createBox(Vec3f(-15.0f, 0.0f, 20.0f), 1.0f)));  // beside the wall
+    EXPECT_TRUE(buffer.isVisible(createBox(Vec3f(0.0f, 0.0f, 0.0f), 1.0f)));     // crosses the near plane
+    EXPECT_FALSE(buffer.isVisible(AABB()));
+}
+
+TEST(OcclusionCulling, TransformedOccluder)
+{
+    // Wall moved behind the box and drawn with 16-bit indices, clockwise winding still occludes
+    std::vector<uint16_t> indices {0, 2, 1, 0, 3, 2};
+    Mat4f modelMatrix = Mat4f::Identity();
+    modelMatrix(2, 3) = 20.0f;
+
+    OcclusionBuffer buffer;
+    buffer.clear(createViewProjection());
+    buffer.addOccluder(modelMatrix, wallPositions.data(), wallPositions.size(), indices.data(), indices.size());
+    buffer.rasterize();
+
+    EXPECT_TRUE(buffer.isVisible(createBox(Vec3f(0.0f, 0.0f, 20.0f), 1.0f)));
+    EXPECT_FALSE(buffer.isVisible(createBox(Vec3f(0.0f, 0.0f, 40.0f), 1.0f)));
+
+    // Clearing removes the occluders
+    buffer.clear(createViewProjection());
+    buffer.rasterize();
+    EXPECT_TRUE(buffer.isVisible(createBox(Vec3f(0.0f, 0.0f, 40.0f), 1.0f)));
+}
+
+TEST(OcclusionCulling, NearPlane)
+{
+    // Triangles crossing the near plane are skipped
+    std::vector<Vec3f> positions {Vec3f(-5.0f, -5.0f, -1.0f), Vec3f(5.0f, -5.0f, 10.0f), Vec3f(0.0f, 5.0f, 10.0f)};
+    std::vector<uint32_t> indices {0, 1, 2};
+    OcclusionBuffer buffer;
+    buffer.clear(createViewProjection());
+    buffer.addOccluder(Mat4f::Identity(), positions.data(), positions.size(), indices.data(), indices.size());
+    EXPECT_EQ(buffer.getTriangleCount(), 0u);
+
+    indices[2] = 3;
+    EXPECT_THROW(buffer.addOccluder(Mat4f::Identity(), positions.data(), positions.size(), indices.data(),
+        indices.size()), std::runtime_error);
+}
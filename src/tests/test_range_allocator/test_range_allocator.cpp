@@ -0,0 +1,116 @@
+//
+// Project: GraphicsUtils2
+// File: test_range_allocator.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/RangeAllocator.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+using namespace gu2;
+
+
+TEST(RangeAllocator, AllocateFree)
+{
+    RangeAllocator allocator(100);
+    EXPECT_EQ(allocator.allocate(10), 0u);
+    EXPECT_EQ(allocator.allocate(20), 10u);
+    EXPECT_EQ(allocator.allocate(30), 30u);
+    EXPECT_EQ(allocator.getUsedSize(), 60u);
+    EXPECT_EQ(allocator.getAllocationCount(), 3u);
+    EXPECT_EQ(allocator.allocate(50), RangeAllocator::invalidOffset);
+
+    // Freed range is reused by first fit
+    allocator.free(10);
+    EXPECT_EQ(allocator.getSize(10), 0u);
+    EXPECT_EQ(allocator.allocate(15), 10u);
+    EXPECT_EQ(allocator.getLargestFreeRange(), 40u);
+
+    // Freeing the neighbours coalesces the ranges
+    allocator.free(0);
+    allocator.free(10);
+    allocator.free(30);
+    EXPECT_EQ(allocator.getUsedSize(), 0u);
+    EXPECT_EQ(allocator.getLargestFreeRange(), 100u);
+    EXPECT_EQ(allocator.allocate(100), 0u);
+
+    EXPECT_THROW(allocator.free(50), std::runtime_error);
+}
+
+TEST(RangeAllocator, Alignment)
+{
+    RangeAllocator allocator(256);
+    EXPECT_EQ(allocator.allocate(3), 0u);
+    EXPECT_EQ(allocator.allocate(16, 64), 64u);
+    // Alignment padding remains available
+    EXPECT_EQ(allocator.allocate(8, 4), 4u);
+    EXPECT_EQ(allocator.getUsedEnd(), 80u);
+    EXPECT_THROW(allocator.allocate(1, 0), std::runtime_error);
+}
+
+TEST(RangeAllocator, Grow)
+{
+    RangeAllocator allocator(10);
+    EXPECT_EQ(allocator.allocate(8), 0u);
+    EXPECT_EQ(allocator.allocate(8), RangeAllocator::invalidOffset);
+    allocator.grow(20);
+    // Tail of the old capacity merges with the added range
+    EXPECT_EQ(allocator.allocate(12), 8u);
+    EXPECT_EQ(allocator.getCapacity(), 20u);
+}
+
+TEST(RangeAllocator, Defragment)
+{
+    std::default_random_engine rnd(1507);
+    std::uniform_int_distribution<uint64_t> sizeDist(1, 32);
+
+    RangeAllocator allocator(4096);
+    std::vector<uint64_t> offsets;
+    for (int i=0; i<100; ++i)
+        offsets.push_back(allocator.allocate(sizeDist(rnd), 4));
+
+    // Free every other allocation and record the sizes of the rest
+    std::vector<uint64_t> remaining;
+    std::vector<uint64_t> sizes;
+    for (size_t i=0; i<offsets.size(); ++i) {
+        if (i % 2 == 0)
+            allocator.free(offsets[i]);
+        else {
+            remaining.push_back(offsets[i]);
+            sizes.push_back(allocator.getSize(offsets[i]));
+        }
+    }
+    uint64_t usedSize = allocator.getUsedSize();
+
+    auto moves = allocator.defragment();
+    for (const auto& move : moves) {
+        auto it = std::find(remaining.begin(), remaining.end(), move.srcOffset);
+        ASSERT_NE(it, remaining.end());
+        EXPECT_EQ(move.size, sizes[it - remaining.begin()]);
+        EXPECT_LT(move.dstOffset, move.srcOffset);
+        *it = move.dstOffset;
+    }
+
+    // Allocations are packed to the beginning in their original order
+    uint64_t end = 0;
+    for (size_t i=0; i<remaining.size(); ++i) {
+        EXPECT_EQ(remaining[i] % 4, 0u);
+        EXPECT_GE(remaining[i], end);
+        EXPECT_LT(remaining[i], end + 4);
+        EXPECT_EQ(allocator.getSize(remaining[i]), sizes[i]);
+        end = remaining[i] + sizes[i];
+    }
+    EXPECT_EQ(allocator.getUsedEnd(), end);
+    EXPECT_EQ(allocator.getUsedSize(), usedSize);
+    EXPECT_EQ(allocator.getLargestFreeRange(), 4096u - end);
+}
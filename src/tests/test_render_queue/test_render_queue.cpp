@@ -0,0 +1,85 @@
+//
+// Project: GraphicsUtils2
+// File: test_render_queue.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/RenderQueue.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+using namespace gu2;
+
+
+static void expectSortedLikeStableSort(RenderQueue* queue)
+{
+    auto expected = queue->getEntries();
+    std::stable_sort(expected.begin(), expected.end(),
+        [](const RenderQueue::Entry& a, const RenderQueue::Entry& b) { return a.key < b.key; });
+
+    queue->sort();
+    const auto& entries = queue->getEntries();
+    ASSERT_EQ(entries.size(), expected.size());
+    for (size_t i=0; i<entries.size(); ++i) {
+        EXPECT_EQ(entries[i].key, expected[i].key);
+        EXPECT_EQ(entries[i].item, expected[i].item);
+    }
+}
+
+TEST(RenderQueue, SortRandomKeys)
+{
+    std::mt19937_64 rnd(1234);
+    RenderQueue queue;
+    for (uint32_t i=0; i<10000; ++i)
+        queue.push(rnd(), i);
+    expectSortedLikeStableSort(&queue);
+}
+
+TEST(RenderQueue, SortIsStable)
+{
+    // Few distinct keys, the items of equal keys retain their order
+    std::mt19937 rnd(4321);
+    std::uniform_int_distribution<uint32_t> state(0, 7);
+    RenderQueue queue;
+    for (uint32_t i=0; i<1000; ++i)
+        queue.push(RenderQueue::makeKey(state(rnd), state(rnd), 0, 0), i);
+    expectSortedLikeStableSort(&queue);
+}
+
+TEST(RenderQueue, SortSmallAndRepeated)
+{
+    RenderQueue queue;
+    queue.sort();
+    EXPECT_TRUE(queue.empty());
+
+    queue.push(42, 0);
+    queue.sort();
+    EXPECT_EQ(queue.getEntries()[0].item, 0u);
+
+    // Equal keys skip all the passes, the queue is reused after clear
+    for (uint32_t i=0; i<100; ++i)
+        queue.push(7, i+1);
+    expectSortedLikeStableSort(&queue);
+    queue.clear();
+    for (uint32_t i=0; i<100; ++i)
+        queue.push(uint64_t(i % 3) << 40 | (99 - i), i);
+    expectSortedLikeStableSort(&queue);
+}
+
+TEST(RenderQueue, MakeKey)
+{
+    // Pipeline dominates the material, which dominates the geometry and the mesh
+    EXPECT_LT(RenderQueue::makeKey(0, 0xffff, 0xfff, 0xffffff), RenderQueue::makeKey(1, 0, 0, 0));
+    EXPECT_LT(RenderQueue::makeKey(1, 0, 0xfff, 0xffffff), RenderQueue::makeKey(1, 1, 0, 0));
+    EXPECT_LT(RenderQueue::makeKey(1, 1, 0, 0xffffff), RenderQueue::makeKey(1, 1, 1, 0));
+    EXPECT_EQ(RenderQueue::makeKey(0x1000, 0x10000, 0x1000, 0x1000000), 0u);
+}
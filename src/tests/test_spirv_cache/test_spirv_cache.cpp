@@ -0,0 +1,117 @@
+//
+// Project: GraphicsUtils2
+// File: test_spirv_cache.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/SpirvCache.hpp>
+
+#include <fstream>
+#include <vector>
+
+
+using namespace gu2;
+
+
+class SpirvCacheTest : public ::testing::Test {
+protected:
+    Path    _directory;
+
+    void SetUp() override
+    {
+        _directory = std::filesystem::temp_directory_path() /
+            ("gu2_test_spirv_cache_" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+        std::filesystem::remove_all(_directory);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(_directory);
+    }
+
+    Path writeFile(const std::string& name, const std::string& contents) const
+    {
+        std::filesystem::create_directories(_directory);
+        Path filename = _directory / name;
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        file << contents;
+        return filename;
+    }
+};
+
+
+TEST_F(SpirvCacheTest, FindInMemory)
+{
+    SpirvCache cache;
+    std::vector<uint32_t> spirv;
+    EXPECT_FALSE(cache.find(1, &spirv));
+
+    cache.store(1, {}, {0x07230203, 1, 2, 3});
+    ASSERT_TRUE(cache.find(1, &spirv));
+    EXPECT_EQ(spirv, std::vector<uint32_t>({0x07230203, 1, 2, 3}));
+    EXPECT_FALSE(cache.find(2, &spirv));
+}
+
+TEST_F(SpirvCacheTest, FindFromDirectory)
+{
+    Path include = writeFile("common.glsl", "#define COMMON 1\n");
+    {
+        SpirvCache cache(_directory / "cache");
+        cache.store(42, {include}, {0x07230203, 4, 5});
+    }
+
+    SpirvCache cache(_directory / "cache");
+    std::vector<uint32_t> spirv;
+    ASSERT_TRUE(cache.find(42, &spirv));
+    EXPECT_EQ(spirv, std::vector<uint32_t>({0x07230203, 4, 5}));
+}
+
+TEST_F(SpirvCacheTest, ChangedDependencyInvalidates)
+{
+    Path include = writeFile("common.glsl", "#define COMMON 1\n");
+    {
+        SpirvCache cache(_directory / "cache");
+        cache.store(42, {include}, {0x07230203});
+    }
+
+    writeFile("common.glsl", "#define COMMON 2\n");
+    SpirvCache cache(_directory / "cache");
+    std::vector<uint32_t> spirv;
+    EXPECT_FALSE(cache.find(42, &spirv));
+
+    // A new entry replaces the stale one
+    cache.store(42, {include}, {0x07230203, 6});
+    ASSERT_TRUE(cache.find(42, &spirv));
+    EXPECT_EQ(spirv, std::vector<uint32_t>({0x07230203, 6}));
+}
+
+TEST_F(SpirvCacheTest, MissingDependencyInvalidates)
+{
+    SpirvCache cache(_directory / "cache");
+    cache.store(7, {_directory / "missing.glsl"}, {0x07230203});
+
+    std::vector<uint32_t> spirv;
+    EXPECT_FALSE(cache.find(7, &spirv));
+}
+
+TEST_F(SpirvCacheTest, CorruptedEntryIsMissing)
+{
+    {
+        SpirvCache cache(_directory / "cache");
+        cache.store(0x1234, {}, {0x07230203, 1, 2, 3});
+    }
+
+    // Truncate the entry file
+    for (const auto& file : std::filesystem::directory_iterator(_directory / "cache"))
+        std::filesystem::resize_file(file.path(), 20);
+
+    SpirvCache cache(_directory / "cache");
+    std::vector<uint32_t> spirv;
+    EXPECT_FALSE(cache.find(0x1234, &spirv));
+}
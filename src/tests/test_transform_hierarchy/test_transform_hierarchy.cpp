@@ -0,0 +1,118 @@
+//
+// Project: GraphicsUtils2
+// File: test_transform_hierarchy.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/TransformHierarchy.hpp>
+
+#include <random>
+#include <vector>
+
+
+using namespace gu2;
+
+
+static std::default_random_engine rnd(2151);
+
+
+static Quatf randomRotation()
+{
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    return Quatf(dist(rnd), dist(rnd), dist(rnd), dist(rnd)).normalized();
+}
+
+// Random tree with each node parented to a random earlier node
+static TransformHierarchy createRandomHierarchy(uint32_t nNodes)
+{
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    TransformHierarchy hierarchy;
+    for (uint32_t i=0; i<nNodes; ++i) {
+        uint32_t parent = i == 0 ? TransformHierarchy::noParent :
+            std::uniform_int_distribution<uint32_t>(0, i-1)(rnd);
+        hierarchy.addNode(parent, Vec3f(dist(rnd), dist(rnd), dist(rnd)), randomRotation(),
+            Vec3f::Constant(1.0f + 0.1f*dist(rnd)));
+    }
+    return hierarchy;
+}
+
+// Recursive double precision reference
+static Mat4d computeWorldMatrix(const TransformHierarchy& hierarchy, uint32_t nodeId)
+{
+    Mat4d local = Mat4d::Identity();
+    local.block<3,3>(0,0) = hierarchy.getRotation(nodeId).cast<double>().toRotationMatrix() *
+        hierarchy.getScale(nodeId).cast<double>().asDiagonal();
+    local.block<3,1>(0,3) = hierarchy.getTranslation(nodeId).cast<double>();
+    uint32_t parent = hierarchy.getParent(nodeId);
+    return parent == TransformHierarchy::noParent ? local : (computeWorldMatrix(hierarchy, parent) * local).eval();
+}
+
+static void expectWorldMatricesCorrect(const TransformHierarchy& hierarchy)
+{
+    for (uint32_t i=0; i<hierarchy.size(); ++i) {
+        Mat4d reference = computeWorldMatrix(hierarchy, i);
+        EXPECT_LT((hierarchy.getWorldMatrix(i).cast<double>() - reference).cwiseAbs().maxCoeff(), 1.0e-4);
+    }
+}
+
+
+TEST(TransformHierarchy, Update)
+{
+    auto hierarchy = createRandomHierarchy(5000);
+    hierarchy.update();
+    EXPECT_EQ(hierarchy.getChangedNodes().size(), hierarchy.size());
+    expectWorldMatricesCorrect(hierarchy);
+
+    // Nothing dirty, nothing changes
+    hierarchy.update();
+    EXPECT_TRUE(hierarchy.getChangedNodes().empty());
+}
+
+TEST(TransformHierarchy, SubtreeUpdate)
+{
+    auto hierarchy = createRandomHierarchy(2000);
+    hierarchy.update();
+
+    uint32_t movedNode = 10;
+    hierarchy.setTranslation(movedNode, Vec3f(5.0f, 0.0f, 0.0f));
+    hierarchy.setRotation(movedNode, randomRotation());
+    hierarchy.update();
+    expectWorldMatricesCorrect(hierarchy);
+
+    // Exactly the moved node and its descendants change
+    size_t nDescendants = 0;
+    for (uint32_t i=0; i<hierarchy.size(); ++i) {
+        bool descendant = false;
+        for (uint32_t n=i; n!=TransformHierarchy::noParent && !descendant; n=hierarchy.getParent(n))
+            descendant = n == movedNode;
+        EXPECT_EQ(hierarchy.isChanged(i), descendant);
+        nDescendants += descendant;
+    }
+    EXPECT_EQ(hierarchy.getChangedNodes().size(), nDescendants);
+}
+
+TEST(TransformHierarchy, Decompose)
+{
+    Vec3f translation(1.0f, -2.0f, 3.0f);
+    Quatf rotation = randomRotation();
+    Vec3f scale(2.0f, 0.5f, 1.5f);
+
+    TransformHierarchy hierarchy;
+    uint32_t a = hierarchy.addNode(TransformHierarchy::noParent, translation, rotation, scale);
+    hierarchy.update();
+    uint32_t b = hierarchy.addNodeFromMatrix(TransformHierarchy::noParent, hierarchy.getWorldMatrix(a));
+    hierarchy.update();
+
+    EXPECT_LT((hierarchy.getTranslation(b) - translation).norm(), 1.0e-5f);
+    EXPECT_LT((hierarchy.getScale(b) - scale).norm(), 1.0e-5f);
+    EXPECT_GT(std::abs(hierarchy.getRotation(b).dot(rotation)), 1.0f - 1.0e-5f);
+    EXPECT_LT((hierarchy.getWorldMatrix(b) - hierarchy.getWorldMatrix(a)).cwiseAbs().maxCoeff(), 1.0e-5f);
+
+    EXPECT_THROW(hierarchy.addNode(5), std::runtime_error);
+}
@@ -0,0 +1,174 @@
+//
+// Project: GraphicsUtils2
+// File: test_vertex_generation.cpp
+//
+// Copyright (c) 2024 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <gtest/gtest.h>
+
+#include <gu2_util/VertexGeneration.hpp>
+
+#include <vector>
+
+
+using namespace gu2;
+
+
+static void expectNear(const Vec4f& a, const Vec4f& b)
+{
+    EXPECT_LT((a - b).norm(), 1.0e-5f) << "(" << a.transpose() << ") != (" << b.transpose() << ")";
+}
+
+
+TEST(VertexGeneration, Quad)
+{
+    const std::vector<Vec3f> positions = {{0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}};
+    // The last triangle is degenerate, its corners get the tangents of the good corners of the same vertices
+    const std::vector<uint16_t> indices = {0, 1, 2, 0, 2, 3, 0, 0, 1};
+
+    std::vector<Vec3f> normals(positions.size());
+    generateNormals(positions.data(), positions.size(), indices.data(), indices.size(), normals.data());
+    for (const auto& normal : normals)
+        EXPECT_EQ(normal, Vec3f(0.0f, 0.0f, 1.0f));
+
+    // Texture coordinates aligned with the positions and rotated by 90 degrees
+    for (bool rotated : {false, true}) {
+        std::vector<Vec2f> texCoords;
+        for (const auto& p : positions)
+            texCoords.push_back(rotated ? Vec2f(p.y(), 1.0f - p.x()) : Vec2f(p.x(), p.y()));
+        Vec4f expected = rotated ? Vec4f(0.0f, 1.0f, 0.0f, 1.0f) : Vec4f(1.0f, 0.0f, 0.0f, 1.0f);
+
+        std::vector<Vec4f> cornerTangents(indices.size());
+        generateTangents(positions.data(), normals.data(), texCoords.data(), positions.size(), indices.data(),
+            indices.size(), cornerTangents.data());
+        for (const auto& tangent : cornerTangents)
+            expectNear(tangent, expected);
+
+        std::vector<uint16_t> splitIndices = indices;
+        std::vector<Vec4f> tangents;
+        std::vector<uint32_t> duplicateSources;
+        EXPECT_TRUE(splitVertices(cornerTangents.data(), splitIndices.data(), splitIndices.size(), positions.size(),
+            0x10000, &tangents, &duplicateSources));
+        EXPECT_TRUE(duplicateSources.empty());
+        EXPECT_EQ(splitIndices, indices);
+        GTEST_ASSERT_EQ(tangents.size(), positions.size());
+        for (const auto& tangent : tangents)
+            expectNear(tangent, expected);
+    }
+}
+
+TEST(VertexGeneration, MirroredUVSeam)
+{
+    // Two quads sharing the edge at x = 1, the texture is mirrored at the edge so the seam vertices are shared by
+    // corners of opposite UV orientation
+    const std::vector<Vec3f> positions = {
+        {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {2.0f, 0.0f, 0.0f},
+        {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {2.0f, 1.0f, 0.0f}};
+    std::vector<Vec2f> texCoords;
+    for (const auto& p : positions)
+        texCoords.emplace_back(p.x() <= 1.0f ? p.x() : 2.0f - p.x(), p.y());
+    const std::vector<uint32_t> indices = {0, 1, 4, 0, 4, 3, 1, 2, 5, 1, 5, 4};
+
+    std::vector<Vec3f> normals(positions.size());
+    generateNormals(positions.data(), positions.size(), indices.data(), indices.size(), normals.data());
+    std::vector<Vec4f> cornerTangents(indices.size());
+    generateTangents(positions.data(), normals.data(), texCoords.data(), positions.size(), indices.data(),
+        indices.size(), cornerTangents.data());
+
+    // Tangent follows the direction of increasing u, the mirrored side has flipped bitangent sign
+    for (size_t c=0; c<6; ++c)
+        expectNear(cornerTangents[c], Vec4f(1.0f, 0.0f, 0.0f, 1.0f));
+    for (size_t c=6; c<12; ++c)
+        expectNear(cornerTangents[c], Vec4f(-1.0f, 0.0f, 0.0f, -1.0f));
+
+    // The seam vertices need to be split
+    std::vector<uint32_t> splitIndices = indices;
+    std::vector<Vec4f> tangents;
+    std::vector<uint32_t> duplicateSources;
+    ASSERT_TRUE(splitVertices(cornerTangents.data(), splitIndices.data(), splitIndices.size(), positions.size(),
+        0xffffffff, &tangents, &duplicateSources));
+    std::sort(duplicateSources.begin(), duplicateSources.end());
+    EXPECT_EQ(duplicateSources, std::vector<uint32_t>({1, 4}));
+    GTEST_ASSERT_EQ(tangents.size(), 8);
+    for (size_t c=0; c<splitIndices.size(); ++c) {
+        EXPECT_EQ(tangents[splitIndices[c]], cornerTangents[c]);
+        uint32_t source = splitIndices[c] < positions.size() ? splitIndices[c] :
+            duplicateSources[splitIndices[c] - positions.size()];
+        EXPECT_EQ(source, indices[c]);
+    }
+
+    // No splitting in case the vertices would not fit
+    std::vector<uint32_t> unsplitIndices = indices;
+    EXPECT_FALSE(splitVertices(cornerTangents.data(), unsplitIndices.data(), unsplitIndices.size(),
+        positions.size(), positions.size(), &tangents, &duplicateSources));
+    EXPECT_EQ(unsplitIndices, indices);
+    EXPECT_EQ(tangents.size(), positions.size());
+    EXPECT_TRUE(duplicateSources.empty());
+}
+
+TEST(VertexGeneration, UVSeam)
+{
+    // Two quads meeting at x = 1 with the seam vertices duplicated, the texture of the right quad is rotated by
+    // 90 degrees. Tangents must not be averaged over the seam.
+    const std::vector<Vec3f> positions = {
+        {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+        {1.0f, 0.0f, 0.0f}, {2.0f, 0.0f, 0.0f}, {2.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}};
+    std::vector<Vec2f> texCoords;
+    for (size_t v=0; v<positions.size(); ++v) {
+        const auto& p = positions[v];
+        texCoords.push_back(v < 4 ? Vec2f(p.x(), p.y()) : Vec2f(p.y(), 2.0f - p.x()));
+    }
+    const std::vector<uint16_t> indices = {0, 1, 2, 0, 2, 3, 4, 5, 6, 4, 6, 7};
+
+    std::vector<Vec3f> normals(positions.size());
+    generateNormals(positions.data(), positions.size(), indices.data(), indices.size(), normals.data());
+    std::vector<Vec4f> cornerTangents(indices.size());
+    generateTangents(positions.data(), normals.data(), texCoords.data(), positions.size(), indices.data(),
+        indices.size(), cornerTangents.data());
+    for (size_t c=0; c<6; ++c)
+        expectNear(cornerTangents[c], Vec4f(1.0f, 0.0f, 0.0f, 1.0f));
+    for (size_t c=6; c<12; ++c)
+        expectNear(cornerTangents[c], Vec4f(0.0f, 1.0f, 0.0f, 1.0f));
+
+    // Continuous texture coordinates over a fold: the shared vertices get the angle weighted average, the other
+    // vertices keep the tangent of their quad
+    const std::vector<Vec3f> foldPositions = {
+        {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {2.0f, 0.0f, 1.0f},
+        {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {2.0f, 1.0f, 1.0f}};
+    std::vector<Vec2f> foldTexCoords;
+    for (const auto& p : foldPositions)
+        foldTexCoords.emplace_back(p.x(), p.y());
+    const std::vector<uint32_t> foldIndices = {0, 1, 4, 0, 4, 3, 1, 2, 5, 1, 5, 4};
+
+    std::vector<Vec3f> foldNormals(foldPositions.size());
+    generateNormals(foldPositions.data(), foldPositions.size(), foldIndices.data(), foldIndices.size(),
+        foldNormals.data());
+    std::vector<Vec4f> foldTangents(foldIndices.size());
+    generateTangents(foldPositions.data(), foldNormals.data(), foldTexCoords.data(), foldPositions.size(),
+        foldIndices.data(), foldIndices.size(), foldTangents.data());
+    for (size_t c=0; c<foldIndices.size(); ++c) {
+        uint32_t v = foldIndices[c];
+        const Vec4f& tangent = foldTangents[c];
+        EXPECT_NEAR(tangent.head<3>().norm(), 1.0f, 1.0e-5f);
+        EXPECT_NEAR(tangent.head<3>().dot(foldNormals[v]), 0.0f, 1.0e-5f);
+        EXPECT_EQ(tangent.w(), 1.0f);
+        if (v == 0 || v == 3)
+            expectNear(tangent, Vec4f(1.0f, 0.0f, 0.0f, 1.0f));
+        else if (v == 2 || v == 5)
+            expectNear(tangent, Vec4f(std::sqrt(0.5f), 0.0f, std::sqrt(0.5f), 1.0f));
+        else
+            EXPECT_GT(tangent.z(), 0.1f);
+    }
+
+    // Smooth tangents, no splitting
+    std::vector<uint32_t> splitIndices = foldIndices;
+    std::vector<Vec4f> tangents;
+    std::vector<uint32_t> duplicateSources;
+    EXPECT_TRUE(splitVertices(foldTangents.data(), splitIndices.data(), splitIndices.size(), foldPositions.size(),
+        0xffffffff, &tangents, &duplicateSources));
+    EXPECT_TRUE(duplicateSources.empty());
+}